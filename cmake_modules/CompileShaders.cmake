@@ -1,3 +1,5 @@
+# Compiles every shader found under shaders_path to SPIR-V. Shaders are compiled with the additional glslangValidator
+# arguments in SHADER_GLSLANG_FLAGS, if set.
 macro(compile_shaders target_name shaders_path)
 
 
@@ -19,7 +21,7 @@ macro(compile_shaders target_name shaders_path)
         add_custom_command(
                 OUTPUT ${SPIRV}
                 COMMAND ${CMAKE_COMMAND} -E make_directory "${CMAKE_CURRENT_BINARY_DIR}/${shaders_path}/${GLSL_SUBDIR}/"
-                COMMAND glslangValidator -V -Od ${GLSL} -o ${SPIRV}
+                COMMAND glslangValidator -V -Od ${SHADER_GLSLANG_FLAGS} ${GLSL} -o ${SPIRV}
                 DEPENDS ${GLSL})
         list(APPEND SPIRV_BINARY_FILES ${SPIRV})
     endforeach (GLSL)
@@ -35,4 +37,59 @@ macro(compile_shaders target_name shaders_path)
             "$<TARGET_FILE_DIR:${target_name}>/${shaders_path}"
             )
 
+endmacro()
+
+# Compiles every combination of the given feature defines (ARGN) of a single shader. Permutation of mask M is written
+# to <shader_file>.M.spv, where bit i of M enables the i-th feature. Permutations enabling feature F are compiled with
+# the additional glslangValidator arguments in F_GLSLANG_FLAGS, which follow the ones in SHADER_GLSLANG_FLAGS.
+# Permutations are optimized with spirv-opt when it is available.
+macro(compile_shader_permutations target_name shaders_path shader_file)
+    set(PERMUTATION_FEATURES ${ARGN})
+    list(LENGTH PERMUTATION_FEATURES PERMUTATION_FEATURE_COUNT)
+    math(EXPR PERMUTATION_LAST_MASK "(1 << ${PERMUTATION_FEATURE_COUNT}) - 1")
+
+    find_program(SPIRV_OPT_EXECUTABLE spirv-opt)
+
+    set(PERMUTATION_SOURCE "${CMAKE_CURRENT_SOURCE_DIR}/${shaders_path}/${shader_file}")
+    set(PERMUTATION_BINARY_FILES "")
+
+    foreach (PERMUTATION_MASK RANGE 0 ${PERMUTATION_LAST_MASK})
+        set(PERMUTATION_DEFINES "-DSHADER_PERMUTATION")
+        set(PERMUTATION_FLAGS "")
+        set(PERMUTATION_BIT 0)
+
+        foreach (PERMUTATION_FEATURE ${PERMUTATION_FEATURES})
+            math(EXPR PERMUTATION_ENABLED "(${PERMUTATION_MASK} >> ${PERMUTATION_BIT}) & 1")
+            if (PERMUTATION_ENABLED)
+                list(APPEND PERMUTATION_DEFINES "-D${PERMUTATION_FEATURE}")
+                list(APPEND PERMUTATION_FLAGS ${${PERMUTATION_FEATURE}_GLSLANG_FLAGS})
+            endif ()
+            math(EXPR PERMUTATION_BIT "${PERMUTATION_BIT} + 1")
+        endforeach (PERMUTATION_FEATURE)
+
+        set(PERMUTATION_SPIRV "${CMAKE_CURRENT_BINARY_DIR}/${shaders_path}/${shader_file}.${PERMUTATION_MASK}.spv")
+
+        if (SPIRV_OPT_EXECUTABLE)
+            add_custom_command(
+                    OUTPUT ${PERMUTATION_SPIRV}
+                    COMMAND ${CMAKE_COMMAND} -E make_directory "${CMAKE_CURRENT_BINARY_DIR}/${shaders_path}/"
+                    COMMAND glslangValidator -V ${SHADER_GLSLANG_FLAGS} ${PERMUTATION_FLAGS} ${PERMUTATION_DEFINES} ${PERMUTATION_SOURCE} -o ${PERMUTATION_SPIRV}.unopt
+                    COMMAND ${SPIRV_OPT_EXECUTABLE} -O ${PERMUTATION_SPIRV}.unopt -o ${PERMUTATION_SPIRV}
+                    COMMAND ${CMAKE_COMMAND} -E remove ${PERMUTATION_SPIRV}.unopt
+                    DEPENDS ${PERMUTATION_SOURCE})
+        else ()
+            add_custom_command(
+                    OUTPUT ${PERMUTATION_SPIRV}
+                    COMMAND ${CMAKE_COMMAND} -E make_directory "${CMAKE_CURRENT_BINARY_DIR}/${shaders_path}/"
+                    COMMAND glslangValidator -V ${SHADER_GLSLANG_FLAGS} ${PERMUTATION_FLAGS} ${PERMUTATION_DEFINES} ${PERMUTATION_SOURCE} -o ${PERMUTATION_SPIRV}
+                    DEPENDS ${PERMUTATION_SOURCE})
+        endif ()
+
+        list(APPEND PERMUTATION_BINARY_FILES ${PERMUTATION_SPIRV})
+    endforeach (PERMUTATION_MASK)
+
+    add_custom_target(${target_name}_shader_permutations DEPENDS ${PERMUTATION_BINARY_FILES})
+
+    add_dependencies(${target_name} ${target_name}_shader_permutations)
+
 endmacro()
\ No newline at end of file
@@ -0,0 +1,62 @@
+#ifndef LOGIPATHTRACER_BVHANALYSIS_HPP
+#define LOGIPATHTRACER_BVHANALYSIS_HPP
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "BVHBuilders.hpp"
+
+struct BVHStatistics {
+  uint32_t nodeCount = 0u;
+  uint32_t leafCount = 0u;
+  float sahCost = 0.0f;
+  uint32_t maxDepth = 0u;
+  float averageLeafDepth = 0.0f;
+  // Traversal stack entries needed by path_tracing.comp if every box is hit (including the terminating entry).
+  uint32_t requiredStackSize = 0u;
+  // Surface area of the children's intersection relative to the parent, over inner nodes.
+  float averageOverlap = 0.0f;
+  float maxOverlap = 0.0f;
+  // Number of leaves per primitive count.
+  std::map<uint32_t, uint32_t> leafSizeHistogram;
+};
+
+/**
+ * Mesh BVH in the mesh BVH nodes buffer.
+ */
+struct MeshBVHInfo {
+  std::string name;
+  BVHBuilderType builder = BVHBuilderType::eAuto;
+  uint32_t triangleCount = 0u;
+  uint32_t nodeOffset = 0u;
+  uint32_t nodeCount = 0u;
+};
+
+/**
+ * Walks the tree from the first node. Child indices are relative to nodes.
+ */
+BVHStatistics analyzeBVH(const GPUBVHNode* nodes, size_t nodeCount);
+
+struct SceneBVHStatistics {
+  BVHStatistics topLevel;
+  // Same order as the analyzed meshes.
+  std::vector<BVHStatistics> meshes;
+};
+
+/**
+ * Analyzes the objects BVH and every mesh BVH. Mesh child indices are relative to the mesh's node offset.
+ */
+SceneBVHStatistics analyzeSceneBVHs(const GPUBVHNode* objectBVHNodes, size_t objectBVHNodeCount,
+                                    const GPUBVHNode* meshBVHNodes, const std::vector<MeshBVHInfo>& meshes);
+
+/**
+ * Logs a summary and every tree that needs a deeper stack than traversalStackSize. Returns the number of such trees.
+ */
+uint32_t logBVHStatistics(const SceneBVHStatistics& statistics, const std::vector<MeshBVHInfo>& meshes,
+                          uint32_t traversalStackSize);
+
+void writeBVHReport(std::ostream& out, const SceneBVHStatistics& statistics, const std::vector<MeshBVHInfo>& meshes,
+                    uint32_t traversalStackSize);
+
+#endif // LOGIPATHTRACER_BVHANALYSIS_HPP
@@ -0,0 +1,33 @@
+#ifndef LOGIPATHTRACER_BVHBENCHMARK_HPP
+#define LOGIPATHTRACER_BVHBENCHMARK_HPP
+
+#define LSG_VULKAN
+#include <lsg/lsg.h>
+#include "BVHBuilders.hpp"
+#include "SceneRayQueries.hpp"
+
+/**
+ * Builds the BVH of every mesh in the scene with each builder and logs the build time, SAH cost and the rate of
+ * closest hit rays traced through it on a single CPU thread, with the near first traversal of path_tracing.comp and
+ * with children visited in stored order. Rays start on a sphere around the mesh and aim at random points within its
+ * bounds, so the numbers are comparable between builders but not between meshes.
+ */
+void runBVHBenchmark(const lsg::Ref<lsg::Scene>& scene, const BVHBuildConfiguration& configuration,
+                     uint32_t rayCount = 100000u);
+
+/**
+ * Compares the two-level scene BVH (objects BVH over per mesh BVHs) with the flattened one (see
+ * BVHBuildConfiguration::flattenScene) by tracing the same closest hit rays through the whole scene on a single CPU
+ * thread. Logs the build time of the BVHs that differ between the modes and the rays/s of both.
+ */
+void runSceneBVHBenchmark(const lsg::Ref<lsg::Scene>& scene, const BVHBuildConfiguration& configuration,
+                          uint32_t rayCount = 100000u);
+
+/**
+ * Traces the same random rays through the converted scene (see PTSceneConverter::getHostScene) with the closest hit
+ * and the occlusion query on a single CPU thread, then as batches over all hardware threads. Logs the rays/s of both,
+ * the share of occluded rays and the latency of a single query.
+ */
+void runOcclusionBenchmark(const HostScene& scene, uint32_t rayCount = 100000u);
+
+#endif // LOGIPATHTRACER_BVHBENCHMARK_HPP
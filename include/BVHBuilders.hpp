@@ -0,0 +1,105 @@
+#ifndef LOGIPATHTRACER_BVHBUILDERS_HPP
+#define LOGIPATHTRACER_BVHBUILDERS_HPP
+
+#include <glm/glm.hpp>
+#include <limits>
+#include <string>
+#include <vector>
+#define LSG_VULKAN
+#include <lsg/lsg.h>
+#include "SceneLayout.hpp"
+
+enum class BVHBuilderType {
+  // Picks the builder by the primitive count (see BVHBuildConfiguration).
+  eAuto,
+  // Spatial split BVH (lsg::bvh::SplitBVHBuilder). Best quality, but slow and memory hungry.
+  eSplit,
+  // Top down SAH over binned centroids. Large subtrees are built in parallel.
+  eBinnedSAH,
+  // Linear BVH over Morton sorted centroids. Fastest to build, lowest quality.
+  eLBVH
+};
+
+struct BVHBuildConfiguration {
+  // Builder of the mesh BVHs.
+  BVHBuilderType meshBuilder = BVHBuilderType::eAuto;
+  // Builder of the objects BVH. Spatial splits need triangles, so eSplit falls back to eBinnedSAH.
+  BVHBuilderType objectBuilder = BVHBuilderType::eBinnedSAH;
+  // With eAuto, meshes with at most splitMaxTriangles triangles use the split builder and meshes with at least
+  // lbvhMinTriangles the LBVH builder. The rest use the binned SAH builder.
+  uint32_t splitMaxTriangles = 100000u;
+  uint32_t lbvhMinTriangles = 2000000u;
+  // Larger leaves are only created if no split is found.
+  uint32_t maxLeafSize = 4u;
+  uint32_t sahBinCount = 16u;
+  // Pre-transform the triangles of all meshes to world space and build a single BVH over the whole scene (built by
+  // meshBuilder, eSplit falls back to eBinnedSAH). Traversal then skips the objects BVH and the per object ray
+  // transforms. Meant for static scenes. The BVH needs every triangle, so the scene is displayed once fully loaded.
+  bool flattenScene = false;
+  // BVH statistics of the loaded scene are written to this file as JSON (see BVHAnalysis.hpp). Empty disables the
+  // report. A summary and trees too deep for the traversal stack are always logged.
+  std::string reportPath;
+  // Traces this many random rays through the loaded scene on the CPU with the closest hit and the occlusion query (see
+  // runOcclusionBenchmark). Host copies of the geometry are kept until then. Zero disables the benchmark.
+  uint32_t occlusionBenchmarkRays = 0u;
+};
+
+struct BVHBounds {
+  glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+  glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+  void grow(const glm::vec3& point);
+
+  void grow(const BVHBounds& bounds);
+
+  bool empty() const;
+
+  glm::vec3 centroid() const;
+
+  float surfaceArea() const;
+
+  /**
+   * Bounds of the transformed corners.
+   */
+  BVHBounds transform(const glm::mat4& matrix) const;
+};
+
+/**
+ * BVH in the layout used by the path tracer. Root is the first node. Inner nodes reference their children and leaves
+ * a range [first, last) of primitiveIndices.
+ */
+struct BVH {
+  std::vector<GPUBVHNode> nodes;
+  std::vector<uint32_t> primitiveIndices;
+  BVHBounds bounds;
+};
+
+const char* toString(BVHBuilderType type);
+
+/**
+ * Resolves eAuto to the builder for a mesh with the given number of triangles.
+ */
+BVHBuilderType selectMeshBuilder(const BVHBuildConfiguration& configuration, size_t triangleCount);
+
+/**
+ * Builds the BVH over the triangles of the geometry. Split BVH may reference a triangle from several leaves.
+ */
+BVH buildMeshBVH(const lsg::Ref<lsg::Geometry>& geometry, BVHBuilderType type,
+                 const BVHBuildConfiguration& configuration);
+
+/**
+ * Builds the BVH over the given primitive bounds (eSplit is built as eBinnedSAH).
+ */
+BVH buildBVH(const std::vector<BVHBounds>& primitiveBounds, BVHBuilderType type,
+             const BVHBuildConfiguration& configuration);
+
+/**
+ * SAH cost of the BVH: traversal cost of inner nodes and intersection cost of leaf primitives, weighted by the surface
+ * area of the node relative to the root.
+ */
+float computeSAHCost(const GPUBVHNode* nodes, size_t nodeCount, float traversalCost = 1.0f,
+                     float intersectionCost = 1.0f);
+
+float computeSAHCost(const std::vector<GPUBVHNode>& nodes, float traversalCost = 1.0f, float intersectionCost = 1.0f);
+
+#endif // LOGIPATHTRACER_BVHBUILDERS_HPP
@@ -0,0 +1,98 @@
+#ifndef LOGIPATHTRACER_GLTFBUFFERS_HPP
+#define LOGIPATHTRACER_GLTFBUFFERS_HPP
+
+#include <cstring>
+#include <glm/glm.hpp>
+#define LSG_VULKAN
+#include <lsg/lsg.h>
+#include <string>
+#include <vector>
+#include "MappedFile.hpp"
+
+/**
+ * Strided view of the elements of a glTF accessor in a mapped buffer.
+ */
+struct GLTFAccessorView {
+  const std::byte* data = nullptr;
+  size_t count = 0u;
+  size_t stride = 0u;
+  // glTF component type (e.g. 5126 for float) and number of components per element.
+  uint32_t componentType = 0u;
+  uint32_t componentCount = 0u;
+
+  explicit operator bool() const {
+    return data != nullptr;
+  }
+
+  /**
+   * Element at the given index. Mapped data is not necessarily aligned for T.
+   */
+  template <typename T>
+  T get(size_t index) const {
+    T value;
+    std::memcpy(&value, data + index * stride, sizeof(T));
+    return value;
+  }
+
+  /**
+   * Element of an index accessor widened to 32 bits.
+   */
+  uint32_t index(size_t index) const;
+};
+
+/**
+ * Triangle list primitive whose positions and normals are float 3D vectors and whose optional uvs are float 2D vectors.
+ * Indices are optional unsigned integers.
+ */
+struct GLTFPrimitive {
+  GLTFAccessorView positions;
+  GLTFAccessorView normals;
+  GLTFAccessorView uvs;
+  GLTFAccessorView indices;
+
+  size_t triangleCount() const;
+
+  /**
+   * Vertex at the given corner (0 to 2) of the triangle.
+   */
+  uint32_t vertex(size_t triangle, uint32_t corner) const;
+};
+
+/**
+ * Binary buffers of a glTF scene mapped into memory, that is the .bin files of a .gltf or the binary chunk of a .glb.
+ * Scene converters read vertices and indices straight from the mapped pages into staging memory. Only the parts of the
+ * JSON that locate the primitive attributes are parsed. Buffers embedded as data URIs are not mapped.
+ */
+class GLTFBuffers {
+ public:
+  GLTFBuffers() = default;
+
+  /**
+   * Throws std::runtime_error if the file can not be mapped or is not valid glTF.
+   */
+  explicit GLTFBuffers(const std::string& path);
+
+  /**
+   * Same as above, but logs the error and returns no buffers if the file can not be mapped.
+   */
+  static GLTFBuffers tryMap(const std::string& path);
+
+  /**
+   * Primitive with the geometry of the submesh, or nullptr if it is not in the mapped buffers or its attributes have
+   * other formats. Positions, uvs and indices of the submesh are compared with the primitive. Submeshes are expected
+   * in glTF order, in which case the lookup does not search.
+   */
+  const GLTFPrimitive* find(const lsg::Ref<lsg::SubMesh>& submesh) const;
+
+  size_t mappedBytes() const;
+
+  explicit operator bool() const;
+
+ private:
+  std::vector<MappedFile> files_;
+  std::vector<GLTFPrimitive> primitives_;
+  // Primitive following the last one found.
+  mutable size_t cursor_ = 0u;
+};
+
+#endif // LOGIPATHTRACER_GLTFBUFFERS_HPP
@@ -0,0 +1,48 @@
+#ifndef LOGIPATHTRACER_GPUTIMER_HPP
+#define LOGIPATHTRACER_GPUTIMER_HPP
+
+#include <logi/logi.hpp>
+#include <vector>
+
+/**
+ * Measures GPU time of named scopes with timestamp queries. Each scope owns a begin and end query. Queries are reset
+ * and written by the recorded command buffers and read back once the submission that wrote them has completed.
+ */
+class GPUTimer {
+ public:
+  GPUTimer() = default;
+
+  GPUTimer(const logi::PhysicalDevice& physicalDevice, const logi::LogicalDevice& logicalDevice, uint32_t scopeCount);
+
+  void recordReset(const logi::CommandBuffer& cmdBuffer) const;
+
+  /**
+   * Resets only the queries of the given scope. Used when scopes are recorded in separate command buffers.
+   */
+  void recordReset(const logi::CommandBuffer& cmdBuffer, uint32_t scope) const;
+
+  void recordBegin(const logi::CommandBuffer& cmdBuffer, uint32_t scope,
+                   vk::PipelineStageFlagBits stage = vk::PipelineStageFlagBits::eTopOfPipe) const;
+
+  void recordEnd(const logi::CommandBuffer& cmdBuffer, uint32_t scope,
+                 vk::PipelineStageFlagBits stage = vk::PipelineStageFlagBits::eBottomOfPipe) const;
+
+  /**
+   * Reads back results of the last completed submission. Returns false if no scope has results available (yet).
+   */
+  bool fetchResults();
+
+  double getMilliseconds(uint32_t scope) const;
+
+  bool isSupported() const;
+
+  void destroy();
+
+ private:
+  logi::QueryPool queryPool_;
+  double timestampPeriod_ = 0.0;
+  std::vector<uint64_t> timestamps_;
+  std::vector<double> milliseconds_;
+};
+
+#endif // LOGIPATHTRACER_GPUTIMER_HPP
@@ -5,4 +5,25 @@
 #ifndef LOGIPATHTRACER_HELPERS_HPP
 #define LOGIPATHTRACER_HELPERS_HPP
 
+#include <logi/logi.hpp>
+#include "GPUTexture.hpp"
+
+/**
+ * Uploads a single level 2D image and creates its view. Blocks until the upload is finished. Image is left in
+ * shader read only layout. Sampler is not created.
+ */
+GPUTexture uploadTexture(const logi::MemoryAllocator& allocator, const logi::CommandPool& commandPool,
+                         const logi::Queue& queue, const void* data, uint64_t byteSize, uint32_t width,
+                         uint32_t height, vk::Format format);
+
+/**
+ * Peak resident set size of the process in bytes. Returns 0 if it can not be queried on this platform.
+ */
+size_t getPeakResidentSetSize();
+
+/**
+ * Current resident set size of the process in bytes. Returns 0 if it can not be queried on this platform.
+ */
+size_t getCurrentResidentSetSize();
+
 #endif // LOGIPATHTRACER_HELPERS_HPP
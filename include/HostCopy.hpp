@@ -0,0 +1,171 @@
+#ifndef LOGIPATHTRACER_HOSTCOPY_HPP
+#define LOGIPATHTRACER_HOSTCOPY_HPP
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Helpers.hpp"
+#include "MappedFile.hpp"
+
+enum class HostCopyRetention {
+  // Release the host copies once the scene is uploaded.
+  eDrop,
+  // Keep the host copies in memory, trimmed to their size.
+  eCompact,
+  // Write the host copies to a file and map it. Pages are loaded on access (e.g. for refits) and can be evicted.
+  eMapped
+};
+
+struct HostCopyConfiguration {
+  // What happens to the host copies of the uploaded scene data (objects, BVH nodes, materials and geometry).
+  HostCopyRetention retention = HostCopyRetention::eDrop;
+  // Also copy the vertices and the triangle objects of a flattened scene, which the CPU ray queries need (see
+  // SceneRayQueries.hpp). Geometry is the bulk of the scene, so it is only copied on request.
+  bool geometry = false;
+  // File used by HostCopyRetention::eMapped. Overwritten on every scene load.
+  std::string spillPath = "scene_host_copy.bin";
+};
+
+/**
+ * Host copy of an array that was uploaded to the GPU. Filled through resident() while loading and afterwards either
+ * released, trimmed or moved to a mapped file.
+ */
+template <typename T>
+class HostCopy {
+ public:
+  std::vector<T>& resident() {
+    return resident_;
+  }
+
+  const T* data() const {
+    return mapped_ ? mapped_ : resident_.data();
+  }
+
+  size_t size() const {
+    return mapped_ ? mappedSize_ : resident_.size();
+  }
+
+  bool empty() const {
+    return size() == 0u;
+  }
+
+  const T& operator[](size_t index) const {
+    return data()[index];
+  }
+
+  const T* begin() const {
+    return data();
+  }
+
+  const T* end() const {
+    return data() + size();
+  }
+
+  /**
+   * Bytes held in process memory. Mapped data is not counted.
+   */
+  size_t residentBytes() const {
+    return resident_.capacity() * sizeof(T);
+  }
+
+  void clear() {
+    std::vector<T>().swap(resident_);
+    mapped_ = nullptr;
+    mappedSize_ = 0u;
+  }
+
+  void compact() {
+    resident_.shrink_to_fit();
+  }
+
+  /**
+   * Appends the data to the file (at an offset aligned for T). The resident copy is kept until attach, so that it can
+   * stay in memory if the file can not be written or mapped.
+   */
+  void spill(std::ofstream& file, size_t& fileOffset) {
+    static const char kPadding[alignof(T)] = {};
+    size_t padding = (alignof(T) - fileOffset % alignof(T)) % alignof(T);
+    file.write(kPadding, padding);
+
+    spillOffset_ = fileOffset + padding;
+    mappedSize_ = resident_.size();
+    file.write(reinterpret_cast<const char*>(resident_.data()), resident_.size() * sizeof(T));
+    fileOffset = spillOffset_ + resident_.size() * sizeof(T);
+  }
+
+  /**
+   * Switches to the spilled data in the mapped file and releases the resident copy.
+   */
+  void attach(const MappedFile& file) {
+    mapped_ = mappedSize_ > 0u ? reinterpret_cast<const T*>(file.data() + spillOffset_) : nullptr;
+    std::vector<T>().swap(resident_);
+  }
+
+ private:
+  std::vector<T> resident_;
+  const T* mapped_ = nullptr;
+  size_t mappedSize_ = 0u;
+  size_t spillOffset_ = 0u;
+};
+
+/**
+ * Applies the retention policy of the configuration to the host copies of a scene and logs the resident memory before
+ * and after. Mapped copies are spilled to configuration.spillPath and read from file, which then holds the mapping. If
+ * the file can not be written or mapped, the copies stay in memory and are compacted. Returns the name of the applied
+ * policy.
+ */
+template <typename... T>
+const char* retainHostCopies(const HostCopyConfiguration& configuration, MappedFile& file, HostCopy<T>&... copies) {
+  auto residentBytes = [&copies...]() { return (size_t(0u) + ... + copies.residentBytes()); };
+  const size_t bytesBefore = residentBytes();
+  const char* policyName = "compacted";
+
+  switch (configuration.retention) {
+    case HostCopyRetention::eDrop:
+      (copies.clear(), ...);
+      policyName = "dropped";
+      break;
+    case HostCopyRetention::eCompact:
+      (copies.compact(), ...);
+      break;
+    case HostCopyRetention::eMapped: {
+      // Writes to a file that failed to open are ignored and leave the stream failed.
+      std::ofstream spillFile(configuration.spillPath, std::ios::binary | std::ios::trunc);
+      size_t fileOffset = 0u;
+      (copies.spill(spillFile, fileOffset), ...);
+      spillFile.flush();
+      bool mapped = spillFile.good();
+      spillFile.close();
+
+      if (mapped) {
+        try {
+          file = MappedFile(configuration.spillPath);
+        } catch (const std::runtime_error& error) {
+          std::cout << error.what() << std::endl;
+          mapped = false;
+        }
+      }
+
+      // Copies are still resident, so they are compacted instead.
+      if (!mapped) {
+        std::cout << "Failed to spill host scene copies to " << configuration.spillPath << ". They are kept in memory."
+                  << std::endl;
+        (copies.compact(), ...);
+        break;
+      }
+
+      (copies.attach(file), ...);
+      policyName = "mapped";
+      break;
+    }
+  }
+
+  std::cout << "Host scene copies " << policyName << ": " << bytesBefore / 1024u << " KB -> " << residentBytes() / 1024u
+            << " KB resident. RSS " << getCurrentResidentSetSize() / (1024u * 1024u) << " MB (peak "
+            << getPeakResidentSetSize() / (1024u * 1024u) << " MB)." << std::endl;
+  return policyName;
+}
+
+#endif // LOGIPATHTRACER_HOSTCOPY_HPP
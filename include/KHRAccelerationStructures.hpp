@@ -0,0 +1,60 @@
+#ifndef LOGIPATHTRACER_KHRACCELERATIONSTRUCTURES_HPP
+#define LOGIPATHTRACER_KHRACCELERATIONSTRUCTURES_HPP
+
+#include <logi/logi.hpp>
+#include <vector>
+#include "PTSceneConverter.hpp"
+
+/**
+ * VK_KHR_acceleration_structure acceleration structures over the path tracer scene, traced by the RAY_QUERY
+ * permutations of path_tracing.comp. Every mesh (distinct vertex range) gets a bottom level structure and every object
+ * an instance whose custom index is the object index. A flattened scene is a single instance over the world space
+ * vertices. Logi does not wrap the KHR ray tracing objects, so they are created through the device dispatcher.
+ */
+class KHRAccelerationStructures {
+ public:
+  KHRAccelerationStructures() = default;
+
+  KHRAccelerationStructures(const logi::PhysicalDevice& physicalDevice, const logi::LogicalDevice& logicalDevice);
+
+  /**
+   * Builds the structures over the committed objects, replacing the previous ones. Transforms are copied from the
+   * objects buffer on the GPU, so the host copies of the scene are not needed. Blocks until the build has finished.
+   */
+  void build(const PTSceneConverter& sceneConverter, bool flattened, const logi::CommandPool& cmdPool,
+             const logi::Queue& queue);
+
+  const vk::AccelerationStructureKHR& getTopLevel() const;
+
+  bool isBuilt() const;
+
+  void destroy();
+
+ private:
+  struct Allocation {
+    vk::Buffer buffer;
+    vk::DeviceMemory memory;
+    vk::DeviceAddress address = 0u;
+  };
+
+  struct Structure {
+    Allocation storage;
+    vk::AccelerationStructureKHR handle;
+  };
+
+  Allocation allocate(vk::DeviceSize size, vk::BufferUsageFlags usage, bool hostVisible) const;
+
+  void free(Allocation& allocation) const;
+
+  Structure createStructure(vk::AccelerationStructureTypeKHR type, vk::DeviceSize size) const;
+
+  void destroyStructure(Structure& structure) const;
+
+  logi::PhysicalDevice physicalDevice_;
+  logi::LogicalDevice logicalDevice_;
+  vk::DeviceSize scratchAlignment_ = 1u;
+  std::vector<Structure> bottomLevels_;
+  Structure topLevel_;
+};
+
+#endif // LOGIPATHTRACER_KHRACCELERATIONSTRUCTURES_HPP
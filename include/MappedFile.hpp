@@ -0,0 +1,47 @@
+#ifndef LOGIPATHTRACER_MAPPEDFILE_HPP
+#define LOGIPATHTRACER_MAPPEDFILE_HPP
+
+#include <cstddef>
+#include <string>
+
+/**
+ * Read only memory mapping of a whole file. Pages are loaded on first access and can be dropped by the OS under
+ * memory pressure, so mapped data does not count towards the resident memory of the process.
+ */
+class MappedFile {
+ public:
+  MappedFile() = default;
+
+  /**
+   * Throws std::runtime_error if the file can not be opened or mapped.
+   */
+  explicit MappedFile(const std::string& path);
+
+  MappedFile(const MappedFile&) = delete;
+
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  MappedFile(MappedFile&& other) noexcept;
+
+  MappedFile& operator=(MappedFile&& other) noexcept;
+
+  ~MappedFile();
+
+  const std::byte* data() const;
+
+  size_t size() const;
+
+  explicit operator bool() const;
+
+  void close();
+
+ private:
+  const std::byte* data_ = nullptr;
+  size_t size_ = 0u;
+#if defined(_WIN32)
+  void* file_ = nullptr;
+  void* mapping_ = nullptr;
+#endif
+};
+
+#endif // LOGIPATHTRACER_MAPPEDFILE_HPP
@@ -5,84 +5,236 @@
 #ifndef LOGIPATHTRACER_PTSCENECONVERTER_HPP
 #define LOGIPATHTRACER_PTSCENECONVERTER_HPP
 
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <glm/glm.hpp>
 #include <logi/logi.hpp>
 #define LSG_VULKAN
 #include <lsg/lsg.h>
+#include <memory>
+#include <mutex>
 #include <vector>
+#include "BVHAnalysis.hpp"
+#include "BVHBuilders.hpp"
+#include "GLTFBuffers.hpp"
 #include "GPUTexture.hpp"
+#include "HostCopy.hpp"
+#include "SceneLayout.hpp"
+#include "SceneRayQueries.hpp"
+#include "TextureStreamer.hpp"
 
-struct GPUObjectData {
-  explicit GPUObjectData(const glm::mat4& worldMatrix = {}, const glm::mat4& worldMatrixInverse = {},
-                         const glm::vec4& baseColorFactor = {}, const glm::vec3& emissionFactor = {},
-                         float metallicFactor = {}, float roughnessFactor = {}, float transmissionFactor = {},
-                         float ior = {}, uint32_t colorTexture = std::numeric_limits<uint32_t>::max(),
-                         uint32_t emissionTexture = std::numeric_limits<uint32_t>::max(),
-                         uint32_t metallicRoughnessTexture = std::numeric_limits<uint32_t>::max(),
-                         uint32_t transmissionTexture = std::numeric_limits<uint32_t>::max(),
-                         uint32_t normalTexture = std::numeric_limits<uint32_t>::max(), uint32_t bvhOffset = {},
-                         uint32_t verticesOffset = {});
-
-  glm::mat4 worldMatrix;
-  glm::mat4 worldMatrixInverse;
-  glm::vec4 baseColorFactor;
-  glm::vec3 emissionFactor;
-  float metallicFactor;
-  float roughnessFactor;
-  float transmissionFactor;
-  float ior;
-  uint32_t colorTexture;
-  uint32_t emissionTexture;
-  uint32_t metallicRoughnessTexture;
-  uint32_t transmissionTexture;
-  uint32_t normalTexture;
-  uint32_t bvhOffset;
-  uint32_t verticesOffset;
-  std::byte padding[8];
+/**
+ * Material features used by the scene. Used to select the leanest path tracing shader permutation.
+ */
+struct SceneFeatures {
+  bool textures = false;
+  bool transmission = false;
+  bool normalMaps = false;
 };
 
-struct GPUVertex {
-  explicit GPUVertex(const glm::vec3& position = {}, const glm::vec3& normal = {}, const glm::vec2& uv = {});
+/**
+ * Vertices of an object in the vertices buffer, drawn by the visibility pass of RendererPT. A flattened scene has a
+ * single range over all triangles, whose objects are read from the primitive objects instead.
+ */
+struct VertexRange {
+  uint32_t firstVertex;
+  uint32_t vertexCount;
+  uint32_t objectIndex;
+};
 
-  alignas(16) glm::vec3 position;
-  alignas(16) glm::vec3 normal;
-  alignas(8) glm::vec2 uv;
+/**
+ * GPU buffer that keeps spare capacity, so that scene data can be appended while the scene is loading.
+ */
+struct GrowableGPUBuffer {
+  logi::VMABuffer buffer;
+  // Size of the valid contents (the buffer itself may be larger).
+  vk::DeviceSize size = 0u;
 };
 
-struct GPUBVHNode {
-  GPUBVHNode(const glm::vec3& min, const glm::vec3& max, bool isLeaf, const glm::uvec2& indices);
+/**
+ * Host visible buffer written by the loading thread. Copied to a device buffer when its batch is committed.
+ */
+struct StagedData {
+  logi::VMABuffer buffer;
+  vk::DeviceSize size = 0u;
+};
 
-  alignas(16) glm::vec3 min;
-  alignas(16) glm::vec3 max;
-  alignas(4) uint32_t isLeaf;
-  alignas(8) glm::uvec2 indices;
+/**
+ * Scene data converted by the loading thread and not yet uploaded. Vertices, mesh BVH nodes and textures are appended
+ * to the previous batches. Object data and objects BVH cover the whole scene loaded so far and replace the previous.
+ */
+struct SceneBatch {
+  std::vector<GPUObjectData> objectData;
+  std::vector<GPUBVHNode> objectBVHNodes;
+  // Materials of the converted submeshes. Appended like the vertices.
+  std::vector<GPUMaterial> materials;
+  // Interleaved vertices of each converted submesh, written straight into staging memory.
+  std::vector<StagedData> vertices;
+  uint32_t vertexCount = 0u;
+  std::vector<GPUBVHNode> meshBVHNodes;
+  std::vector<MeshBVHInfo> meshBVHs;
+  // Object of every triangle of the flattened scene BVH, in BVH primitive order. Empty if the scene is not flattened.
+  std::vector<uint32_t> primitiveObjects;
+  std::vector<lsg::Ref<lsg::Texture>> textures;
+  // Last batch of the scene.
+  bool final = false;
 };
 
 class PTSceneConverter {
  public:
   PTSceneConverter(logi::MemoryAllocator allocator, logi::CommandPool commandPool, logi::Queue transferQueue);
 
-  void loadScene(const lsg::Ref<lsg::Scene>& scene);
+  /**
+   * Converts the scene on the calling thread. A batch is published every batchInterval (and once the conversion
+   * finishes), each with an objects BVH over all objects converted so far. Batches are uploaded by commitBatches.
+   */
+  void loadScene(const lsg::Ref<lsg::Scene>& scene,
+                 std::chrono::milliseconds batchInterval = std::chrono::milliseconds::max());
+
+  bool hasPendingBatches() const;
+
+  /**
+   * Uploads the published batches. Must not be called while the scene buffers are in use by the GPU. Buffers may be
+   * reallocated, so the descriptors have to be rewritten afterwards. Returns false if there was nothing to commit.
+   */
+  bool commitBatches();
+
+  /**
+   * True once the final batch is committed.
+   */
+  bool isLoadComplete() const;
 
   const std::vector<lsg::Ref<lsg::Object>>& getCameras() const;
 
   const logi::VMABuffer& getObjectDataBuffer() const;
 
+  const logi::VMABuffer& getMaterialsBuffer() const;
+
   const logi::VMABuffer& getObjectBvhNodesBuffer() const;
 
   const logi::VMABuffer& getVerticesBuffer() const;
 
   const logi::VMABuffer& getMeshBvhNodesBuffer() const;
 
+  /**
+   * Object index of every triangle if the scene is flattened (see BVHBuildConfiguration::flattenScene). Allocated, but
+   * empty otherwise.
+   */
+  const logi::VMABuffer& getPrimitiveObjectsBuffer() const;
+
   const std::vector<GPUTexture>& getTextures() const;
 
+  const SceneFeatures& getSceneFeatures() const;
+
+  /**
+   * Vertex range of every committed object. Kept regardless of the host copy retention.
+   */
+  const std::vector<VertexRange>& getVertexRanges() const;
+
+  /**
+   * Host copies of the uploaded data. Empty once the scene is loaded if the retention policy drops them.
+   */
+  const HostCopy<GPUObjectData>& getHostObjectData() const;
+
+  const HostCopy<GPUMaterial>& getHostMaterials() const;
+
+  const HostCopy<GPUBVHNode>& getHostObjectBvhNodes() const;
+
+  const HostCopy<GPUBVHNode>& getHostMeshBvhNodes() const;
+
+  /**
+   * Host copies for the CPU ray queries. Not valid unless the geometry is copied (see HostCopyConfiguration::geometry).
+   */
+  HostScene getHostScene() const;
+
+  /**
+   * Takes effect on the next loadScene.
+   */
+  void setHostCopyRetention(const HostCopyConfiguration& configuration);
+
+  /**
+   * Takes effect on the next loadScene. Vertices are staged from the mapped binary buffers of this .gltf or .glb file
+   * (see GLTFBuffers). Empty reads them from the scene graph.
+   */
+  void setMappedBuffersPath(const std::string& path);
+
+  /**
+   * Takes effect on the next loadScene. BVHs that need more than traversalStackSize stack entries are reported.
+   */
+  void setBVHBuildConfiguration(const BVHBuildConfiguration& configuration, uint32_t traversalStackSize);
+
+  /**
+   * Takes effect on the next loadScene.
+   */
+  void setTextureStreaming(const TextureStreamingConfiguration& configuration);
+
+  bool isTextureStreamingActive() const;
+
+  /**
+   * Passes the texture feedback of the last frame (one entry per texture) to the streamer and updates the textures
+   * whose resident image changed. Returns their indices, so that their descriptors can be rewritten.
+   */
+  std::vector<uint32_t> updateTextureStreaming(const uint32_t* feedback, uint32_t frameIndex);
+
   void reset();
 
  protected:
-  logi::VMABuffer copyToGPU(void* data, size_t size, const vk::BufferUsageFlags& usageFlags);
+  /**
+   * Writes data at the given offset, growing the buffer if needed. Contents in front of the offset are preserved.
+   * Returns true if the buffer was reallocated.
+   */
+  bool writeToGPU(GrowableGPUBuffer& target, vk::DeviceSize offset, const void* data, vk::DeviceSize size);
+
+  /**
+   * Same as above, but copies the staged chunks back to back starting at offset. Staging buffers are destroyed.
+   */
+  bool writeToGPU(GrowableGPUBuffer& target, vk::DeviceSize offset, std::vector<StagedData>& chunks);
+
+  /**
+   * Host visible buffer for the loading thread. No buffer is created if size is zero.
+   */
+  StagedData createStagingBuffer(vk::DeviceSize size);
+
+  /**
+   * Interleaves the vertices of the submesh in BVH primitive order directly into a mapped staging buffer. Vertices are
+   * read from the mapped glTF primitive if there is one.
+   */
+  StagedData stageVertices(const lsg::Ref<lsg::SubMesh>& submesh, const GLTFPrimitive* primitive,
+                           const std::vector<uint32_t>& primitiveIndices);
+
+  /**
+   * Builds the BVH over the world space triangles of the whole scene and stages them in BVH primitive order. Vertices
+   * hold three entries per triangle and triangleObjects one.
+   */
+  void stageFlattenedScene(SceneBatch& batch, const std::vector<GPUVertex>& vertices,
+                           const std::vector<uint32_t>& triangleObjects, const std::vector<BVHBounds>& triangleBounds);
+
+  void publishBatch(SceneBatch& batch, const std::vector<GPUObjectData>& unorderedObjectData,
+                    const std::vector<BVHBounds>& objectAABBs, bool final);
 
   uint32_t copyTextureToGPU(const lsg::Ref<lsg::Texture>& texture);
 
+  /**
+   * Applies the retention policy to the host copies once the whole scene is uploaded and reports host memory usage.
+   */
+  void applyHostCopyRetention();
+
+  /**
+   * Logs the memory used by the scene buffers and the amount saved by the packed layouts (see SceneLayout.hpp).
+   */
+  void reportLayoutSavings() const;
+
+  /**
+   * Analyzes the BVHs of the loaded scene (see BVHAnalysis.hpp). Needs the host copies of the BVH nodes.
+   */
+  void reportBVHStatistics() const;
+
+  /**
+   * True if the host copies include the geometry.
+   */
+  bool retainsGeometry() const;
+
  private:
   logi::MemoryAllocator allocator_;
   logi::CommandPool commandPool_;
@@ -90,17 +242,41 @@ class PTSceneConverter {
 
   std::vector<lsg::Ref<lsg::Object>> cameras_;
 
-  std::vector<GPUObjectData> objectData_;
-  std::vector<GPUBVHNode> objectBVHNodes_;
-  std::vector<GPUVertex> vertices_;
-  std::vector<GPUBVHNode> meshBVHNodes_;
+  HostCopy<GPUObjectData> objectData_;
+  HostCopy<GPUMaterial> materials_;
+  HostCopy<GPUBVHNode> objectBVHNodes_;
+  // Vertices are only copied if the geometry is retained.
+  uint32_t vertexCount_ = 0u;
+  std::vector<VertexRange> vertexRanges_;
+  HostCopy<GPUVertex> vertices_;
+  HostCopy<uint32_t> primitiveObjects_;
+  HostCopy<GPUBVHNode> meshBVHNodes_;
+  HostCopyConfiguration hostCopyConfig_;
+  MappedFile hostCopyFile_;
+  std::string mappedBuffersPath_;
+  BVHBuildConfiguration bvhBuildConfig_;
+  uint32_t traversalStackSize_ = 20u;
+  std::vector<MeshBVHInfo> meshBVHInfos_;
 
-  logi::VMABuffer objectDataBuffer_;
-  logi::VMABuffer objectBVHNodesBuffer_;
-  logi::VMABuffer verticesBuffer_;
-  logi::VMABuffer meshBVHNodesBuffer_;
+  GrowableGPUBuffer objectDataBuffer_;
+  GrowableGPUBuffer materialsBuffer_;
+  GrowableGPUBuffer objectBVHNodesBuffer_;
+  GrowableGPUBuffer verticesBuffer_;
+  GrowableGPUBuffer meshBVHNodesBuffer_;
+  GrowableGPUBuffer primitiveObjectsBuffer_;
+
+  mutable std::mutex batchMutex_;
+  std::deque<SceneBatch> pendingBatches_;
+  std::atomic<bool> loadComplete_ = false;
 
   std::vector<GPUTexture> textures_;
+
+  SceneFeatures sceneFeatures_;
+
+  TextureStreamingConfiguration textureStreamingConfig_;
+  std::unique_ptr<TextureStreamer> textureStreamer_;
+
+  static constexpr vk::DeviceSize kMinBufferCapacity = 64u * 1024u;
 };
 
 #endif // LOGIPATHTRACER_PTSCENECONVERTER_HPP
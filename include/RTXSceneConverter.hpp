@@ -8,7 +8,10 @@
 #include <logi/logi.hpp>
 #define LSG_VULKAN
 #include <lsg/lsg.h>
+#include "GLTFBuffers.hpp"
 #include "GPUTexture.hpp"
+#include "HostCopy.hpp"
+#include "SceneLayout.hpp"
 
 struct RTMesh {
   RTMesh() = default;
@@ -22,32 +25,6 @@ struct RTMesh {
   logi::VMAAccelerationStructureNV blas;
 };
 
-struct RTXMaterial {
-  RTXMaterial(const glm::vec4& baseColorFactor, const glm::vec3& emissionFactor, float metallicFactor,
-              float roughnessFactor, float transmissionFactor, float ior, uint32_t verticesOffset);
-
-  glm::vec4 baseColorFactor;
-  glm::vec3 emissionFactor;
-  float metallicFactor;
-  float roughnessFactor;
-  float transmissionFactor;
-  float ior;
-  uint32_t colorTexture = std::numeric_limits<uint32_t>::max();
-  uint32_t emissionTexture = std::numeric_limits<uint32_t>::max();
-  uint32_t metallicRoughnessTexture = std::numeric_limits<uint32_t>::max();
-  uint32_t transmissionTexture = std::numeric_limits<uint32_t>::max();
-  uint32_t normalTexture = std::numeric_limits<uint32_t>::max();
-  uint32_t verticesOffset;
-  uint32_t padding[3];
-};
-
-struct RTXVertex {
-  RTXVertex(const glm::vec3& normal, const glm::vec2& uv = {});
-
-  alignas(16) glm::vec3 normal;
-  alignas(16) glm::vec2 uv;
-};
-
 class RTXSceneConverter {
  public:
   RTXSceneConverter(logi::MemoryAllocator allocator, logi::CommandPool commandPool, logi::Queue transferQueue);
@@ -60,12 +37,58 @@ class RTXSceneConverter {
 
   const logi::VMABuffer& getVertexBuffer() const;
 
+  const logi::VMABuffer& getInstancesBuffer() const;
+
   const std::vector<GPUTexture>& getTextures() const;
 
+  /**
+   * Host copies of the uploaded materials and instances. Empty once the scene is loaded if the retention policy drops
+   * them.
+   */
+  const HostCopy<GPUMaterial>& getHostMaterials() const;
+
+  const HostCopy<RTXInstance>& getHostInstances() const;
+
+  /**
+   * Takes effect on the next loadScene.
+   */
+  void setHostCopyRetention(const HostCopyConfiguration& configuration);
+
+  /**
+   * Takes effect on the next loadScene. Vertices and indices are copied from the mapped binary buffers of this .gltf or
+   * .glb file (see GLTFBuffers). Empty reads them from the scene graph.
+   */
+  void setMappedBuffersPath(const std::string& path);
+
  protected:
-  void loadMesh(const lsg::Ref<lsg::SubMesh>& subMesh, const glm::mat4x3& worldMatrix);
+  static bool isLoadable(const lsg::Ref<lsg::SubMesh>& subMesh);
+
+  /**
+   * Geometry is read from the mapped glTF primitive if there is one.
+   */
+  void loadMesh(const lsg::Ref<lsg::SubMesh>& subMesh, const GLTFPrimitive* primitive, const glm::mat4x3& worldMatrix);
+
+  logi::VMABuffer createGPUBuffer(size_t size, const vk::BufferUsageFlags& usageFlags);
+
+  logi::VMABuffer copyToGPU(const void* data, size_t size, const vk::BufferUsageFlags& usageFlags);
+
+  /**
+   * Returns the persistently mapped staging memory, grown to hold at least size bytes. Contents are valid until the
+   * next call.
+   */
+  std::byte* mapStaging(vk::DeviceSize size);
 
-  logi::VMABuffer copyToGPU(void* data, size_t size, const vk::BufferUsageFlags& usageFlags);
+  /**
+   * Copies the first size bytes of the staging memory to the destination buffer. Blocks until the copy is finished.
+   */
+  void flushStaging(const logi::Buffer& dstBuffer, vk::DeviceSize dstOffset, vk::DeviceSize size);
+
+  void releaseStaging();
+
+  /**
+   * Applies the retention policy to the host copies once the scene is uploaded and reports host memory usage.
+   */
+  void applyHostCopyRetention();
 
   uint32_t copyTextureToGPU(const lsg::Ref<lsg::Texture>& texture);
 
@@ -82,13 +105,25 @@ class RTXSceneConverter {
   logi::Queue transferQueue_;
 
   std::vector<RTMesh> rtMeshes_;
-  std::vector<RTXMaterial> materials_;
+  HostCopy<GPUMaterial> materials_;
+  // Indexed by gl_InstanceID.
+  HostCopy<RTXInstance> instances_;
+  HostCopyConfiguration hostCopyConfig_;
+  MappedFile hostCopyFile_;
+  std::string mappedBuffersPath_;
   logi::VMABuffer materialsBuffer_;
-  std::vector<RTXVertex> vertices_;
+  logi::VMABuffer instancesBuffer_;
+  // Vertices only live in GPU memory.
+  uint32_t vertexCount_ = 0u;
   logi::VMABuffer verticesBuffer_;
 
+  logi::VMABuffer stagingBuffer_;
+  std::byte* stagingMemory_ = nullptr;
+
   logi::VMAAccelerationStructureNV tlas_;
   std::vector<GPUTexture> textures_;
+
+  static constexpr vk::DeviceSize kMinStagingSize = 16u * 1024u * 1024u;
 };
 
 #endif // LOGIPATHTRACER_RTX_SCENE_CONVERTER_HPP
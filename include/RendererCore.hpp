@@ -3,12 +3,156 @@
 #define LOGIPATHTRACER_RENDERERCORE_HPP
 
 #define GLFW_INCLUDE_VULKAN
+#include <chrono>
 #include <cppglfw/CppGLFW.h>
 #include <fstream>
 #include <logi/logi.hpp>
 #include <lsg/lsg.h>
 #include <map>
 #include <vector>
+#include "BVHBuilders.hpp"
+#include "HostCopy.hpp"
+#include "TextureStreamer.hpp"
+
+struct DenoiserConfiguration {
+  // Run the edge-avoiding a-trous filter on the accumulated image before it is displayed.
+  bool enabled = false;
+  // Number of a-trous passes. Pass i samples with a step width of 2^i pixels.
+  uint32_t iterations = 5u;
+  // Edge-stopping parameters for color (halved every pass), normal and relative depth differences.
+  float colorPhi = 1.0f;
+  float normalPhi = 0.1f;
+  float depthPhi = 0.05f;
+};
+
+struct ReprojectionConfiguration {
+  // Reproject accumulated samples to the new camera position instead of discarding them on camera movement.
+  bool enabled = false;
+  // Maximum number of samples carried over by the reprojection. Limits ghosting of view dependent shading.
+  uint32_t maxHistoryLength = 32u;
+  // History is rejected if its depth differs by more than this fraction of the expected depth.
+  float depthTolerance = 0.05f;
+  // History is rejected if the cosine between its normal and the current normal is below this value.
+  float normalTolerance = 0.9f;
+};
+
+struct DynamicResolutionConfiguration {
+  // Lower the path tracing resolution while the camera moves to hold the target GPU frame time. Full resolution is
+  // restored as soon as the camera stops.
+  bool enabled = false;
+  // Target GPU time of all timed passes of a frame in milliseconds.
+  float targetFrameTime = 16.6f;
+  // Lowest selectable scale relative to the configured render scale.
+  float minScale = 0.25f;
+  // Number of discrete scales. Quantization bounds the number of pooled render target sets.
+  uint32_t scaleSteps = 8u;
+};
+
+enum class TileOrder {
+  // Rings of tiles around the center.
+  eSpiral,
+  // Tiles sorted by distance from the center (user selected region first).
+  ePriority
+};
+
+struct TiledRenderingConfiguration {
+  // Split path tracing into tiles that are submitted separately, at most frameBudget worth of tiles per frame. Keeps
+  // presentation responsive and bounds the GPU time of a single submission. Not combined with the reprojection or the
+  // dynamic resolution, which both need a complete frame.
+  bool enabled = false;
+  // Tile edge length in pixels. Rounded up to a multiple of the path tracing workgroup size.
+  uint32_t tileSize = 256u;
+  // GPU time budget for path tracing tiles per frame in milliseconds.
+  float frameBudget = 8.0f;
+  TileOrder order = TileOrder::eSpiral;
+  // Normalized image position that tiles are ordered around.
+  glm::vec2 center = glm::vec2(0.5f);
+};
+
+struct PathTracingKernelConfiguration {
+  // Workgroup shape of the path tracing kernel.
+  uint32_t workgroupWidth = 16u;
+  uint32_t workgroupHeight = 16u;
+  // Maximum depth of the BVH traversal stack.
+  uint32_t intersectionStackSize = 20u;
+  // Maximum number of bounces of a path.
+  uint32_t maxTraceDepth = 10u;
+  // Number of bounces before russian roulette may terminate a path.
+  uint32_t russianRouletteBounces = 2u;
+  // Microfacet (Heitz) BSDFs instead of the basic ones. Only honored by shader permutations.
+  bool useMicrofacet = true;
+  // Bind the shader permutation that only contains the features used by the loaded scene.
+  bool selectShaderPermutation = true;
+  // Benchmark candidate workgroup shapes on the loaded scene and use the fastest. Result is cached per device.
+  bool autotuneWorkgroupSize = false;
+  std::string autotuneCachePath = "workgroup_cache.txt";
+  // Persistent threads kernel (see PERSISTENT_THREADS in path_tracing.comp). Launches persistentWorkgroupCount
+  // workgroups of one subgroup that fetch 8x8 pixel blocks until the image is done. Not supported in tiled mode or on
+  // devices without compute subgroup operations.
+  bool persistentThreads = false;
+  uint32_t persistentWorkgroupCount = 512u;
+  // Benchmark the per pixel and the persistent threads kernel on the loaded scene and log their rays per second.
+  bool compareTraversalKernels = false;
+  // Count the rays traced by the path tracing dispatch and log the rays per second with the sample statistics. Costs an
+  // atomic per workgroup (per subgroup in the persistent threads kernel) and a counter reset per dispatch. The
+  // traversal kernel comparison counts regardless. Not supported in tiled mode.
+  bool countRays = false;
+  // Camera rays start from a rasterized visibility buffer instead of traversing the scene (see
+  // RASTER_PRIMARY_VISIBILITY in path_tracing.comp). The buffer is redrawn whenever the camera moves. Not supported in
+  // tiled mode.
+  bool rasterPrimaryVisibility = false;
+  // Benchmark the path tracing dispatch with traced and with rasterized camera rays on the loaded scene. Needs
+  // rasterPrimaryVisibility.
+  bool compareRasterVisibility = false;
+};
+
+enum class PreviewShading {
+  // Full path tracing, that is no preview.
+  ePathTracing,
+  // Albedo of the camera ray hits lit by a headlight.
+  eAlbedoNormal,
+  // Albedo of the camera ray hits occluded by a single ambient occlusion ray.
+  eAmbientOcclusion,
+  // Emission reached by the camera rays and a single bounce.
+  eDirectLighting
+};
+
+const char* toString(PreviewShading shading);
+
+struct PreviewConfiguration {
+  // Shading of the frames rendered while the camera moves (see SHADING_* in path_tracing.comp). Path tracing resumes
+  // once the camera stood still for staticFrames frames. Reprojection only carries path traced samples, so it is idle
+  // while a preview is shown.
+  PreviewShading shading = PreviewShading::ePathTracing;
+  uint32_t staticFrames = 8u;
+  // Length of the ambient occlusion rays in world units.
+  float aoDistance = 1.0f;
+};
+
+enum class RayTracingBackend {
+  // Fastest backend supported by the device: ray queries, else the software BVH.
+  eAuto,
+  // BVH traversal in path_tracing.comp. Runs on any device.
+  eSoftwareBVH,
+  // VK_KHR_ray_query from path_tracing.comp against VK_KHR_acceleration_structure acceleration structures. Falls back
+  // to the software BVH on devices without support.
+  eRayQuery,
+  // VK_NV_ray_tracing pipeline of RendererRTX. Fails on devices without support.
+  eNVRayTracing
+};
+
+const char* toString(RayTracingBackend backend);
+
+struct SceneLoadingConfiguration {
+  // Display the scene while it is loading. Converted geometry is uploaded in batches and the objects BVH is rebuilt
+  // for every batch.
+  bool progressive = true;
+  // Minimal time between two batches in milliseconds.
+  uint32_t batchInterval = 250u;
+  // .gltf or .glb file the scene was loaded from. Its binary buffers are mapped and the scene converters read vertices
+  // and indices from the mapped file instead of the scene graph (see GLTFBuffers). Empty disables the mapping.
+  std::string mappedBuffersPath;
+};
 
 struct RendererConfiguration {
   explicit RendererConfiguration(std::string windowTitle = "Renderer", int32_t windowWidth = 1280,
@@ -24,6 +168,20 @@ struct RendererConfiguration {
   std::vector<const char*> instanceExtensions;
   std::vector<const char*> deviceExtensions;
   std::vector<const char*> validationLayers;
+  DenoiserConfiguration denoiser;
+  ReprojectionConfiguration reprojection;
+  DynamicResolutionConfiguration dynamicResolution;
+  TiledRenderingConfiguration tiledRendering;
+  PathTracingKernelConfiguration kernel;
+  PreviewConfiguration preview;
+  TextureStreamingConfiguration textureStreaming;
+  SceneLoadingConfiguration sceneLoading;
+  HostCopyConfiguration hostCopies;
+  BVHBuildConfiguration bvhBuild;
+  // Resolved against the device capabilities by selectPhysicalDevice.
+  RayTracingBackend rayTracingBackend = RayTracingBackend::eAuto;
+  // Pipeline cache file. Loaded on startup (if it matches the device) and saved on shutdown. Empty disables the cache.
+  std::string pipelineCachePath = "pipeline_cache.bin";
 };
 
 struct ShaderInfo {
@@ -47,6 +205,8 @@ class RendererCore {
  public:
   explicit RendererCore(cppglfw::Window window, const RendererConfiguration& configuration);
 
+  virtual ~RendererCore();
+
   virtual void drawFrame();
 
   virtual void loadScene(const lsg::Ref<lsg::Scene>& scene) = 0;
@@ -54,8 +214,18 @@ class RendererCore {
  protected:
   void createInstance(const std::vector<const char*>& extensions, const std::vector<const char*>& validationLayers);
 
+  /**
+   * Prefers discrete over integrated and virtual GPUs over CPU implementations (e.g. lavapipe), then devices supporting
+   * the faster backend. Devices without the descriptor indexing features of the texture tables are rejected. Resolves
+   * rayTracingBackend_ to the backend used on the selected device.
+   */
   void selectPhysicalDevice();
 
+  /**
+   * Selected device supports the compute subgroup operations of the persistent threads kernel (see path_tracing.comp).
+   */
+  bool supportsComputeSubgroupOperations() const;
+
   void createLogicalDevice(const std::vector<const char*>& deviceExtensions);
 
   vk::SurfaceFormatKHR chooseSwapSurfaceFormat();
@@ -72,9 +242,36 @@ class RendererCore {
 
   void buildSyncObjects();
 
+  void loadPipelineCache();
+
+  void savePipelineCache() const;
+
+  /**
+   * Logs the time since the start of the construction. Called by the derived renderers once all pipelines are created.
+   */
+  void reportStartupTime() const;
+
   logi::ShaderModule createShaderModule(const std::string& shaderPath);
 
-  PipelineLayoutData loadPipelineShaders(const std::vector<ShaderInfo>& shaderInfo);
+  /**
+   * Creates the shader modules of a pipeline and a pipeline layout reflected from them. Shaders in layoutShaderInfo
+   * only add their bindings to the layout, e.g. permutations that are later bound with the same layout.
+   */
+  PipelineLayoutData loadPipelineShaders(const std::vector<ShaderInfo>& shaderInfo,
+                                         const std::vector<ShaderInfo>& layoutShaderInfo = {});
+
+  /**
+   * Allocates a set whose last binding is a runtime array holding descriptorCount descriptors. The set is allocated
+   * from its own update-after-bind pool, which replaces (and destroys) the given pool.
+   */
+  logi::DescriptorSet allocateVariableDescriptorSet(logi::DescriptorPool& pool, const logi::DescriptorSetLayout& layout,
+                                                    vk::DescriptorType type, uint32_t descriptorCount);
+
+  /**
+   * Creates the buffer holding the Sobol direction numbers and writes it to the storage buffer binding of the set.
+   */
+  logi::VMABuffer createSamplerBuffer(const logi::MemoryAllocator& allocator, const logi::DescriptorSet& descriptorSet,
+                                      uint32_t binding);
 
   void initializeCommandBuffers();
 
@@ -90,6 +287,8 @@ class RendererCore {
   logi::VulkanInstance instance_;
   logi::SurfaceKHR surface_;
   logi::PhysicalDevice physicalDevice_;
+  // Never eAuto once the physical device is selected.
+  RayTracingBackend rayTracingBackend_;
   logi::LogicalDevice logicalDevice_;
   logi::QueueFamily graphicsFamily_;
   logi::QueueFamily presentFamily_;
@@ -111,7 +310,18 @@ class RendererCore {
   logi::CommandPool graphicsFamilyCmdPool_;
   std::vector<logi::CommandBuffer> mainCmdBuffers_;
 
+  // Shared by all pipeline creation.
+  logi::PipelineCache pipelineCache_;
+  std::string pipelineCachePath_;
+  bool pipelineCacheWarm_ = false;
+  std::chrono::time_point<std::chrono::high_resolution_clock> constructionStart_;
+
   size_t currentFrame_ = 0;
+
+  // Upper bound of runtime descriptor arrays (e.g. texture tables), clamped to the update-after-bind limits of the
+  // device by selectPhysicalDevice.
+  static constexpr uint32_t kMaxVariableDescriptorCount = 16384u;
+  uint32_t maxVariableDescriptorCount_ = kMaxVariableDescriptorCount;
 };
 
 #endif // LOGIPATHTRACER_RENDERERCORE_HPP
@@ -7,6 +7,8 @@
 
 #include <lsg/lsg.h>
 #include "GPUTexture.hpp"
+#include "GPUTimer.hpp"
+#include "KHRAccelerationStructures.hpp"
 #include "PTSceneConverter.hpp"
 #include "RendererCore.hpp"
 
@@ -14,11 +16,58 @@ class RendererPT : public RendererCore {
  public:
   RendererPT(const cppglfw::Window& window, const RendererConfiguration& configuration);
 
+  ~RendererPT() override;
+
   void loadScene(const lsg::Ref<lsg::Scene>& scene) override;
 
   void drawFrame() override;
 
+  /**
+   * Moves the point that tiles are ordered around (normalized image coordinates). Only used in tiled mode.
+   */
+  void setTileCenter(const glm::vec2& center);
+
+  /**
+   * Switches between the per pixel and the persistent threads path tracing kernel. Ignored in tiled mode and on devices
+   * without compute subgroup operations.
+   */
+  void setPersistentThreads(bool enabled);
+
+  /**
+   * Shading of the frames rendered while the camera moves (see PreviewConfiguration). Path tracing disables the
+   * preview.
+   */
+  void setPreviewShading(PreviewShading shading);
+
+  /**
+   * Closest hit of the camera ray through the given point (normalized image coordinates) on the CPU. Needs the host
+   * copies of the scene geometry (see HostCopyConfiguration::geometry). Returns false on a miss or without a scene.
+   */
+  bool pick(const glm::vec2& position, SceneHit& hit) const;
+
+  /**
+   * Distance to the surface under the image center, e.g. for autofocus. Negative on a miss.
+   */
+  float focusDistance() const;
+
  protected:
+  /**
+   * Images whose size follows the render extent. Sets are pooled per extent, so changing the render scale does not
+   * reallocate them.
+   */
+  struct RenderTargets {
+    vk::Extent2D extent;
+    GPUTexture accumulation;
+    GPUTexture albedo;
+    GPUTexture normalDepth;
+    std::array<GPUTexture, 2> denoise;
+    // Rasterized camera ray hits (see shaders/visibility.frag) and their depth. 1x1 placeholder unless enabled.
+    GPUTexture visibility;
+    GPUTexture visibilityDepth;
+    logi::Framebuffer visibilityFramebuffer;
+    uint32_t lastUsedFrame = 0u;
+  };
+
   void createTexViewerRenderPass();
 
   void createFrameBuffers();
@@ -27,40 +76,228 @@ class RendererPT : public RendererCore {
 
   void createPathTracingPipeline();
 
-  void initializeAccumulationTexture();
+  void createDenoisePipeline();
+
+  void createVisibilityRenderPass();
+
+  void createVisibilityPipeline();
+
+  /**
+   * Loads the path tracing shader permutation that matches the features of the loaded scene.
+   */
+  void selectPathTracingShader();
+
+  /**
+   * Uploads the scene batches published by the loading thread and rebinds the scene buffers. Called by the render
+   * thread when the GPU is idle. The first batch with a camera makes the scene displayable.
+   */
+  void commitSceneBatches();
+
+  /**
+   * Selects the fastest workgroup shape for the loaded scene, either from the per device cache or by benchmarking.
+   */
+  void autotuneWorkgroupSize();
+
+  /**
+   * Returns the fastest GPU time of a full frame path tracing dispatch in milliseconds (negative if not measurable).
+   */
+  double benchmarkPathTracing(uint32_t iterations);
+
+  /**
+   * Benchmarks both path tracing kernels on the loaded scene and logs their rays per second.
+   */
+  void compareTraversalKernels();
+
+  /**
+   * Benchmarks the path tracing dispatch with traced and with rasterized camera rays and logs the time saved.
+   */
+  void compareRasterVisibility();
+
+  /**
+   * Resets the traversal counters and dispatches the selected path tracing kernel over the render extent.
+   */
+  void recordPathTracingDispatch(const logi::CommandBuffer& cmdBuffer);
+
+  void createReprojectionPipeline();
+
+  vk::Extent2D getRenderExtent() const;
+
+  vk::Extent2D getMaxRenderExtent() const;
+
+  void initializeStorageTexture(GPUTexture& texture, vk::Format format, const vk::Extent2D& extent,
+                                vk::ImageUsageFlags additionalUsage = {});
+
+  void initializeDepthTexture(GPUTexture& texture, const vk::Extent2D& extent);
+
+  void initializeRenderTargets();
+
+  void acquireRenderTargets(const vk::Extent2D& extent);
+
+  void destroyRenderTargets(RenderTargets& renderTargets);
+
+  float selectRenderScale(bool cameraMoved) const;
+
+  void applyRenderScale(float scale);
 
   void initializeDescriptorSets();
 
-  void updateAccumulationTexDescriptorSet();
+  /**
+   * Allocates the texture table set (set 1 of the path tracing layout) with room for as many textures as the device
+   * allows. Textures are written into it as they are published (see boundTextureCount_).
+   */
+  void initializeTextureDescriptorSet();
+
+  void updateRenderTargetDescriptorSets();
+
+  const GPUTexture& getOutputTexture() const;
+
+  void recordHistoryCommands();
+
+  /**
+   * Projection of the world onto the render targets that rasterizes the camera rays of generateRay in
+   * path_tracing.comp (without the jitter).
+   */
+  glm::mat4 getVisibilityViewProjection() const;
+
+  /**
+   * Draws the visibility buffer of the current camera. Submitted before the frame, which reads it.
+   */
+  void submitVisibilityPass();
 
   void initializeUBOBuffer();
 
   void updateUBOBuffer();
 
+  void initializeTraversalCountersBuffer();
+
+  /**
+   * Number of rays traced by the last finished path tracing dispatch. Rays are only counted with
+   * PathTracingKernelConfiguration::countRays.
+   */
+  uint32_t fetchRayCount();
+
   void initializeAndBindSceneBuffer();
 
+  /**
+   * Hands the texture feedback of the last frame to the streamer and rewrites descriptors of the textures whose
+   * resident level changed. Returns true if any texture changed.
+   */
+  bool updateTextureStreaming();
+
   void recordCommandBuffers();
 
+  void recordDenoiseCommands(const logi::CommandBuffer& cmdBuffer);
+
+  uint32_t getTileSize() const;
+
+  void recordTileCommands();
+
+  void submitTiles();
+
   void onSwapChainRecreate() override;
 
+  /**
+   * Preview shading while the camera moves and until it stood still for the configured number of frames, path tracing
+   * otherwise.
+   */
+  PreviewShading selectShading(bool cameraMoved);
+
+  /**
+   * Logs the average path tracing dispatch time of every shading mode that rendered a frame.
+   */
+  void logShadingCosts() const;
+
   void preDraw() override;
 
   void postDraw() override;
 
  private:
+  static constexpr uint32_t kTimerPathTracing = 0u;
+  static constexpr uint32_t kTimerReprojection = 1u;
+  static constexpr uint32_t kTimerDenoise = 2u;
+  static constexpr uint32_t kTimerScopeCount = 3u;
+  static constexpr size_t kShadingModeCount = 4u;
+  static constexpr size_t kMaxPooledRenderTargets = 4u;
+  // Workgroup width of the persistent threads kernel. Matches the subgroup size of most devices.
+  static constexpr uint32_t kPersistentWorkgroupSize = 32u;
+  // All features ray query permutation (see selectPathTracingShader). Only reflected for the pipeline layout.
+  static constexpr const char* kRayQueryLayoutShader = "shaders/path_tracing.comp.47.spv";
+  static constexpr vk::Format kVisibilityFormat = vk::Format::eR32G32B32A32Uint;
+  static constexpr vk::Format kVisibilityDepthFormat = vk::Format::eD32Sfloat;
+  // Visibility pass uses reversed depth with an infinite far plane. Nearer surfaces are left to the traced rays.
+  static constexpr float kVisibilityNearPlane = 0.001f;
+
   struct CameraGPU {
     glm::mat4 worldMatrix;
     float fovY;
     std::byte padding[12];
   };
 
+  struct ShadingCost {
+    double milliseconds = 0.0;
+    uint32_t frames = 0u;
+  };
+
   struct PathTracerUBO {
     CameraGPU camera;
-    glm::uvec2 random;
+    uint32_t sampleIndex;
+    uint32_t scrambleSeed;
     VkBool32 reset;
+    uint32_t shadingMode;
+    float aoDistance;
+  };
+
+  struct ReprojectionUBO {
+    CameraGPU camera;
+    CameraGPU previousCamera;
+    uint32_t maxHistoryLength;
+    float depthTolerance;
+    float normalTolerance;
+    VkBool32 active;
+    glm::uvec2 historyExtent;
+  };
+
+  // Layout of the path tracing specialization constants (constant_id 0 to 9).
+  struct PathTracingSpecialization {
+    vk::Bool32 writeAOVs;
+    uint32_t workgroupWidth;
+    uint32_t workgroupHeight;
+    uint32_t intersectionStackSize;
+    uint32_t maxTraceDepth;
+    uint32_t russianRouletteBounces;
+    uint32_t textureFeedbackInterval;
+    vk::Bool32 flatSceneBVH;
+    vk::Bool32 rasterPrimaryVisibility;
+    vk::Bool32 countRays;
+  };
+
+  struct PathTracingPushConstants {
+    glm::uvec2 tileOffset;
+  };
+
+  struct VisibilityPushConstants {
+    glm::mat4 viewProjection;
+  };
+
+  // Layout of TraversalCountersBuffer in path_tracing.comp.
+  struct TraversalCounters {
+    uint32_t nextBlock;
+    uint32_t rayCount;
+  };
+
+  struct DenoisePushConstants {
+    int32_t stepWidth;
+    float colorPhi;
+    float normalPhi;
+    float depthPhi;
+    uint32_t flags;
   };
 
   logi::DescriptorPool descriptorPool_;
+  // Update-after-bind pool of the texture table. The table is allocated once, at capacity.
+  logi::DescriptorPool textureDescriptorPool_;
+  // Number of leading texture table slots that hold the scene textures.
+  uint32_t boundTextureCount_ = 0u;
   logi::MemoryAllocator allocator_;
 
   logi::RenderPass texViewerRenderPass_;
@@ -72,19 +309,97 @@ class RendererPT : public RendererCore {
   std::vector<logi::DescriptorSet> texViewerDescSets_;
 
   PipelineLayoutData pathTracingPipelineLayoutData_;
+  // Selected shader permutation. Uses the layout of the default (all features) shader, merged with the bindings of the
+  // all features ray query permutation for the ray query backend.
+  logi::ShaderModule pathTracingShaderVariant_;
+  uint32_t pathTracingPermutation_ = std::numeric_limits<uint32_t>::max();
   logi::Pipeline pathTracingPipeline_;
   std::vector<logi::DescriptorSet> pathTracingDescSets_;
 
-  GPUTexture accumulationTexture_;
+  PipelineLayoutData denoisePipelineLayoutData_;
+  logi::Pipeline denoisePipeline_;
+  // Input -> output sets: accumulation -> ping, ping -> pong, pong -> ping.
+  std::vector<logi::DescriptorSet> denoiseDescSets_;
+
+  PipelineLayoutData reprojectionPipelineLayoutData_;
+  logi::Pipeline reprojectionPipeline_;
+  std::vector<logi::DescriptorSet> reprojectionDescSets_;
+
+  // Visibility pass of the rasterized camera rays. Only created if enabled.
+  logi::RenderPass visibilityRenderPass_;
+  PipelineLayoutData visibilityPipelineLayoutData_;
+  logi::Pipeline visibilityPipeline_;
+  std::vector<logi::DescriptorSet> visibilityDescSets_;
+  logi::CommandBuffer visibilityCmdBuffer_;
+  GPUTimer visibilityTimer_;
+  // Visibility buffer matches the current camera, scene and render targets.
+  bool visibilityValid_ = false;
+
+  // Render targets of the current render extent and the pool of recently used ones (including the current).
+  RenderTargets renderTargets_;
+  std::vector<RenderTargets> renderTargetPool_;
+  logi::Sampler outputSampler_;
+  // Accumulation and normal/depth of the previous camera position.
+  GPUTexture historyTexture_;
+  GPUTexture historyNormalDepthTexture_;
+
+  DenoiserConfiguration denoiserConfig_;
+  ReprojectionConfiguration reprojectionConfig_;
+  DynamicResolutionConfiguration dynamicResolutionConfig_;
+  float dynamicRenderScale_;
+  TiledRenderingConfiguration tiledConfig_;
+  PathTracingKernelConfiguration kernelConfig_;
+  PreviewConfiguration previewConfig_;
+  // Shading of the last frame and the number of frames since the camera last moved.
+  PreviewShading activeShading_ = PreviewShading::ePathTracing;
+  uint32_t staticFrameCount_ = 0u;
+  // Summed path tracing dispatch time and number of timed frames per shading mode.
+  std::array<ShadingCost, kShadingModeCount> shadingCosts_;
+  TextureStreamingConfiguration textureStreamingConfig_;
+  SceneLoadingConfiguration sceneLoadingConfig_;
+  // Scene is converted into a single BVH over world space triangles (see BVHBuildConfiguration::flattenScene).
+  bool flatSceneBVH_;
+  // Built over the complete scene if the ray query backend is used. The scene is traversed in software until then.
+  KHRAccelerationStructures accelerationStructures_;
+  // Ray query permutations are selected. Cleared if they are missing, so that they are not retried.
+  bool rayQueriesEnabled_ = false;
+  // Device supports the subgroup operations of the persistent threads kernel. Otherwise the per pixel kernel is used.
+  bool persistentThreadsSupported_ = false;
+  // Finest requested level per texture, written by sparsely sampled first hits (see path_tracing.comp).
+  logi::VMABuffer textureFeedbackBuffer_;
+  logi::VMABuffer traversalCountersBuffer_;
+  uint32_t lastFrameRayCount_ = 0u;
+
+  // Tile offsets in submission order and their command buffers. Tiles are timed separately.
+  std::vector<glm::uvec2> tileOffsets_;
+  std::vector<logi::CommandBuffer> tileCmdBuffers_;
+  GPUTimer tileTimer_;
+  // Index of the next tile in the current pass over the image.
+  uint32_t tileCursor_ = 0u;
+  double averageTileTime_ = 0.0;
+  GPUTimer gpuTimer_;
 
   PathTracerUBO ubo_;
   logi::VMABuffer uboBuffer_;
 
+  ReprojectionUBO reprojectionUBO_;
+  logi::VMABuffer reprojectionUBOBuffer_;
+  // Copies the accumulation to the history textures. Submitted before the frame whenever the camera moves.
+  logi::CommandBuffer historyCmdBuffer_;
+  // History is invalid until a frame was rendered with the current scene and render targets.
+  bool historyValid_ = false;
+  uint32_t frameIndex_ = 0u;
+
   uint32_t sampleCount = 1;
   float invSampleCount = 1;
   logi::VMABuffer sampleCountBuffer_;
 
+  logi::VMABuffer sobolDirectionsBuffer_;
+
   std::atomic<bool> sceneLoaded_ = false;
+  // Set when a scene batch was committed. Restarts the accumulation on the next frame.
+  bool sceneChanged_ = false;
+  std::chrono::time_point<std::chrono::high_resolution_clock> sceneLoadStart_;
   lsg::Ref<lsg::Transform> selectedCameraTransform_;
   PTSceneConverter sceneConverter_;
 };
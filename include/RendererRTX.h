@@ -3,6 +3,7 @@
 
 #include <lsg/lsg.h>
 #include "GPUTexture.hpp"
+#include "GPUTimer.hpp"
 #include "RTXSceneConverter.hpp"
 #include "RendererCore.hpp"
 
@@ -38,12 +39,25 @@ class RendererRTX : public RendererCore {
 
   void initializeDescriptorSets();
 
+  /**
+   * Allocates the texture table set (set 1 of the path tracing layout) with room for as many textures as the device
+   * allows. Textures are written into it as they are published (see boundTextureCount_).
+   */
+  void initializeTextureDescriptorSet();
+
   void updateAccumulationTexDescriptorSet();
 
   void initializeUBOs();
 
   void updateUBOBuffer();
 
+  void initializeRayCounterBuffer();
+
+  /**
+   * Number of rays traced by the last finished launch.
+   */
+  uint32_t fetchRayCount();
+
   void initializeAndBindSceneBuffer();
 
   void recordCommandBuffers();
@@ -58,6 +72,8 @@ class RendererRTX : public RendererCore {
   static constexpr uint32_t kIndexRaygen = 0u;
   static constexpr uint32_t kIndexMiss = 1u;
   static constexpr uint32_t kIndexClosestHit = 2u;
+  static constexpr uint32_t kTimerPathTracing = 0u;
+  static constexpr uint32_t kTimerScopeCount = 1u;
 
   struct CameraGPU {
     glm::mat4 worldMatrix;
@@ -67,13 +83,18 @@ class RendererRTX : public RendererCore {
 
   struct PathTracerUBO {
     CameraGPU camera;
-    glm::vec2 random;
+    uint32_t sampleIndex;
+    uint32_t scrambleSeed;
     vk::Bool32 reset;
   };
 
   vk::PhysicalDeviceRayTracingPropertiesNV rayTracingProperties_;
 
   logi::DescriptorPool descriptorPool_;
+  // Update-after-bind pool of the texture table. The table is allocated once, at capacity.
+  logi::DescriptorPool textureDescriptorPool_;
+  // Number of leading texture table slots that hold the scene textures.
+  uint32_t boundTextureCount_ = 0u;
   logi::MemoryAllocator allocator_;
 
   logi::RenderPass texViewerRenderPass_;
@@ -90,6 +111,11 @@ class RendererRTX : public RendererCore {
   logi::VMABuffer shaderBindingTable_;
 
   GPUTexture accumulationTexture_;
+  GPUTimer gpuTimer_;
+  // Rays are counted and logged with the sample statistics (see PathTracingKernelConfiguration::countRays).
+  bool countRays_;
+  logi::VMABuffer rayCounterBuffer_;
+  uint32_t lastFrameRayCount_ = 0u;
 
   PathTracerUBO ubo_;
   logi::VMABuffer uboBuffer_;
@@ -98,6 +124,8 @@ class RendererRTX : public RendererCore {
   float invSampleCount = 1;
   logi::VMABuffer sampleCountBuffer_;
 
+  logi::VMABuffer sobolDirectionsBuffer_;
+
   RTXSceneConverter sceneConverter_;
   std::atomic<bool> sceneLoaded_ = false;
   lsg::Ref<lsg::Transform> selectedCameraTransform_;
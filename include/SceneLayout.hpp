@@ -0,0 +1,104 @@
+#ifndef LOGIPATHTRACER_SCENELAYOUT_HPP
+#define LOGIPATHTRACER_SCENELAYOUT_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+/**
+ * Scene buffer structs are defined once in shaders/common/scene_layout.glsl. GLSL type names are mapped to glm types,
+ * whose sizes and alignments match std430 for the subset of types used there. Offsets are verified below.
+ */
+namespace std430 {
+using uint = uint32_t;
+using vec3 = glm::vec3;
+using vec4 = glm::vec4;
+using mat3x4 = glm::mat3x4;
+
+#include "../shaders/common/scene_layout.glsl"
+} // namespace std430
+
+using std430::GPUBVHNode;
+using std430::GPUMaterial;
+using std430::GPUObjectData;
+using std430::GPUVertex;
+using std430::RTXInstance;
+using std430::RTXVertex;
+
+// Expected std430 offsets: vec4 and mat3x4 columns are aligned to 16 bytes, vec3 to 16 bytes with a trailing scalar
+// packed into its last 4 bytes, scalars to 4 bytes. Struct size is rounded up to the largest member alignment.
+static_assert(offsetof(GPUMaterial, baseColorFactor) == 0u);
+static_assert(offsetof(GPUMaterial, emissionFactor) == 16u);
+static_assert(offsetof(GPUMaterial, metallicFactor) == 28u);
+static_assert(offsetof(GPUMaterial, roughnessFactor) == 32u);
+static_assert(offsetof(GPUMaterial, ior) == 40u);
+static_assert(offsetof(GPUMaterial, colorTexture) == 44u);
+static_assert(offsetof(GPUMaterial, normalTexture) == 60u);
+static_assert(sizeof(GPUMaterial) == 64u);
+
+static_assert(offsetof(GPUObjectData, objectToWorld) == 0u);
+static_assert(offsetof(GPUObjectData, worldToObject) == 48u);
+static_assert(offsetof(GPUObjectData, materialIndex) == 96u);
+static_assert(offsetof(GPUObjectData, bvhOffset) == 100u);
+static_assert(offsetof(GPUObjectData, verticesOffset) == 104u);
+static_assert(sizeof(GPUObjectData) == 112u);
+
+static_assert(offsetof(GPUVertex, position) == 0u);
+static_assert(offsetof(GPUVertex, normal) == 12u);
+static_assert(offsetof(GPUVertex, uv) == 16u);
+static_assert(sizeof(GPUVertex) == 20u);
+
+static_assert(offsetof(GPUBVHNode, minCorner) == 0u);
+static_assert(offsetof(GPUBVHNode, childOrFirst) == 12u);
+static_assert(offsetof(GPUBVHNode, maxCorner) == 16u);
+static_assert(offsetof(GPUBVHNode, childOrLast) == 28u);
+static_assert(sizeof(GPUBVHNode) == 32u);
+
+static_assert(offsetof(RTXVertex, uv) == 4u);
+static_assert(sizeof(RTXVertex) == 8u);
+
+static_assert(offsetof(RTXInstance, verticesOffset) == 4u);
+static_assert(sizeof(RTXInstance) == 8u);
+
+/**
+ * Rows of the affine part of the matrix (see transformPoint in scene_layout.glsl).
+ */
+inline glm::mat3x4 packAffine(const glm::mat4& matrix) {
+  glm::mat4 rows = glm::transpose(matrix);
+  return glm::mat3x4(rows[0], rows[1], rows[2]);
+}
+
+inline uint32_t encodeOctahedral(const glm::vec3& normal) {
+  glm::vec3 n = normal / (std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z));
+  glm::vec2 e(n.x, n.y);
+
+  if (n.z < 0.0f) {
+    e = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * glm::vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+  }
+
+  return glm::packSnorm2x16(e);
+}
+
+inline GPUVertex packVertex(const glm::vec3& position, const glm::vec3& normal, const glm::vec2& uv = {}) {
+  return GPUVertex{{position.x, position.y, position.z}, encodeOctahedral(normal), glm::packHalf2x16(uv)};
+}
+
+inline RTXVertex packRTXVertex(const glm::vec3& normal, const glm::vec2& uv = {}) {
+  return RTXVertex{encodeOctahedral(normal), glm::packHalf2x16(uv)};
+}
+
+inline GPUBVHNode packBVHNode(const glm::vec3& min, const glm::vec3& max, bool isLeaf, const glm::uvec2& indices) {
+  return GPUBVHNode{min, indices.x, max, indices.y | (isLeaf ? std430::BVH_LEAF_BIT : 0u)};
+}
+
+inline bool isLeaf(const GPUBVHNode& node) {
+  return (node.childOrLast & std430::BVH_LEAF_BIT) != 0u;
+}
+
+inline glm::uvec2 nodeIndices(const GPUBVHNode& node) {
+  return glm::uvec2(node.childOrFirst, node.childOrLast & ~std430::BVH_LEAF_BIT);
+}
+
+#endif // LOGIPATHTRACER_SCENELAYOUT_HPP
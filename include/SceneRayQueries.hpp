@@ -0,0 +1,70 @@
+#ifndef LOGIPATHTRACER_SCENERAYQUERIES_HPP
+#define LOGIPATHTRACER_SCENERAYQUERIES_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <limits>
+#include <vector>
+#include "SceneLayout.hpp"
+
+/**
+ * Host copies of the path tracer scene buffers (see PTSceneConverter::getHostScene). Queries traverse them the same way
+ * as path_tracing.comp, so they agree with the GPU up to floating point differences. Box tests use SSE where available.
+ * Queries only read the scene, so any number of threads may run them at once.
+ */
+struct HostScene {
+  const GPUObjectData* objects = nullptr;
+  const GPUBVHNode* objectBVHNodes = nullptr;
+  size_t objectBVHNodeCount = 0u;
+  const GPUBVHNode* meshBVHNodes = nullptr;
+  size_t meshBVHNodeCount = 0u;
+  const GPUVertex* vertices = nullptr;
+  // Object of every triangle if the scene is flattened.
+  const uint32_t* primitiveObjects = nullptr;
+  // Single BVH over world space triangles at the start of meshBVHNodes (see BVHBuildConfiguration::flattenScene).
+  bool flattened = false;
+
+  /**
+   * False if there is nothing to trace, e.g. if the host copies were dropped.
+   */
+  bool valid() const;
+};
+
+struct SceneRay {
+  glm::vec3 origin;
+  // Not necessarily normalized. Distances are in units of the direction.
+  glm::vec3 direction;
+};
+
+struct SceneHit {
+  float distance = std::numeric_limits<float>::infinity();
+  uint32_t objectIndex = 0u;
+  // Index of the first vertex of the triangle.
+  uint32_t primitiveIndex = 0u;
+};
+
+/**
+ * Closest hit in (EPS, tMax) (see sceneIntersect in path_tracing.comp). Returns false on a miss.
+ */
+bool intersect(const HostScene& scene, const SceneRay& ray, float tMax, SceneHit& hit);
+
+/**
+ * True if any triangle is hit in (EPS, tMax). Returns on the first hit (see shaders/common/scene_occlusion.glsl).
+ */
+bool occluded(const HostScene& scene, const SceneRay& ray, float tMax = std::numeric_limits<float>::infinity());
+
+/**
+ * Closest hit of every ray. Rays are split across threadCount threads (all hardware threads if zero). Misses have an
+ * infinite distance.
+ */
+std::vector<SceneHit> intersect(const HostScene& scene, const std::vector<SceneRay>& rays,
+                                float tMax = std::numeric_limits<float>::infinity(), uint32_t threadCount = 0u);
+
+/**
+ * Occlusion of every ray (one byte per ray, so that threads never share a written element). Rays are split as above.
+ */
+std::vector<uint8_t> occluded(const HostScene& scene, const std::vector<SceneRay>& rays,
+                              float tMax = std::numeric_limits<float>::infinity(), uint32_t threadCount = 0u);
+
+#endif // LOGIPATHTRACER_SCENERAYQUERIES_HPP
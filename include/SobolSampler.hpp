@@ -0,0 +1,25 @@
+#ifndef LOGIPATHTRACER_SOBOLSAMPLER_HPP
+#define LOGIPATHTRACER_SOBOLSAMPLER_HPP
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Generates Sobol direction numbers (Joe & Kuo, new-joe-kuo-6.21201) that are uploaded to the GPU and consumed by
+ * common/random.glsl. Numbers are laid out dimension-major, kBits entries per dimension, with the most significant
+ * bit aligned to bit 31.
+ */
+class SobolSampler {
+ public:
+  static constexpr uint32_t kDimensions = 32u;
+  static constexpr uint32_t kBits = 32u;
+
+  SobolSampler();
+
+  const std::vector<uint32_t>& getDirectionNumbers() const;
+
+ private:
+  std::vector<uint32_t> directionNumbers_;
+};
+
+#endif // LOGIPATHTRACER_SOBOLSAMPLER_HPP
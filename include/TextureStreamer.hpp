@@ -0,0 +1,128 @@
+#ifndef LOGIPATHTRACER_TEXTURESTREAMER_HPP
+#define LOGIPATHTRACER_TEXTURESTREAMER_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <logi/logi.hpp>
+#include <lsg/lsg.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "GPUTexture.hpp"
+
+struct TextureStreamingConfiguration {
+  // Upload only a low resolution level of every texture on load and stream in the finer levels that the path tracer
+  // requests (first hits of sparsely sampled pixels) under a fixed VRAM budget.
+  bool enabled = false;
+  // Budget of all streamed textures (including the base levels) in MB.
+  uint32_t vramBudget = 512u;
+  // Largest dimension of the base level that is uploaded on load.
+  uint32_t baseResolution = 128u;
+  // One of feedbackInterval x feedbackInterval pixels records the texture levels it needs per frame.
+  uint32_t feedbackInterval = 8u;
+  // Maximum number of finer levels uploaded per frame.
+  uint32_t maxUploadsPerFrame = 2u;
+};
+
+/**
+ * Keeps a single level of every registered texture resident. Levels are downsampled from the host image on a
+ * background thread (2x2 box filter) and uploaded by update(), which is called by the render thread once the previous
+ * frame has finished. Textures that were requested least recently fall back to their base level when a finer level
+ * does not fit into the budget.
+ */
+class TextureStreamer {
+ public:
+  TextureStreamer(logi::MemoryAllocator allocator, logi::CommandPool commandPool, logi::Queue queue,
+                  const TextureStreamingConfiguration& configuration);
+
+  TextureStreamer(const TextureStreamer&) = delete;
+
+  TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+  ~TextureStreamer();
+
+  /**
+   * Only 8 bit per channel formats are downsampled on the CPU. Other textures are uploaded at full resolution.
+   */
+  static bool isStreamable(vk::Format format);
+
+  /**
+   * Registers the texture at the given index of the texture table and uploads its base level. Returned texture has
+   * no sampler.
+   */
+  GPUTexture registerTexture(uint32_t textureIndex, const lsg::Ref<lsg::Image>& image);
+
+  /**
+   * Consumes the feedback of the last frame (one entry per texture table index, see path_tracing.comp), requests
+   * finer levels and uploads the finished ones. Replaced images are destroyed, so no submission may still use them.
+   * Returns texture table indices whose image changed.
+   */
+  std::vector<uint32_t> update(const uint32_t* feedback, size_t feedbackSize, uint32_t frameIndex);
+
+  /**
+   * Returns the currently resident image of the texture.
+   */
+  const GPUTexture& getTexture(uint32_t textureIndex) const;
+
+  uint64_t getResidentBytes() const;
+
+ protected:
+  struct StreamedTexture {
+    lsg::Ref<lsg::Image> image;
+    // Number of levels of the full mip chain and the level that is always resident.
+    uint32_t mipCount = 0u;
+    uint32_t baseMip = 0u;
+    GPUTexture base;
+    // Finer level than the base (if resident).
+    GPUTexture streamed;
+    uint32_t residentMip = 0u;
+    uint64_t streamedBytes = 0u;
+    uint32_t lastRequestedFrame = 0u;
+    bool pending = false;
+  };
+
+  struct LevelRequest {
+    uint32_t textureIndex;
+    uint32_t mip;
+    lsg::Ref<lsg::Image> image;
+  };
+
+  struct LevelData {
+    uint32_t textureIndex;
+    uint32_t mip;
+    uint32_t width;
+    uint32_t height;
+    std::vector<uint8_t> pixels;
+  };
+
+  static LevelData downsample(const LevelRequest& request);
+
+  void workerLoop();
+
+  /**
+   * Evicts streamed levels of textures requested before lastRequestedFrame (least recently requested first) until at
+   * least byteSize bytes are freed. Nothing is evicted if that is not possible. Evicted indices are appended.
+   */
+  bool makeRoom(uint64_t byteSize, uint32_t lastRequestedFrame, std::vector<uint32_t>& evicted);
+
+  void evict(StreamedTexture& texture);
+
+ private:
+  logi::MemoryAllocator allocator_;
+  logi::CommandPool commandPool_;
+  logi::Queue queue_;
+  TextureStreamingConfiguration configuration_;
+
+  // Indexed by texture table index. Only accessed by the render (and loading) thread.
+  std::vector<StreamedTexture> textures_;
+  uint64_t residentBytes_ = 0u;
+
+  std::mutex mutex_;
+  std::condition_variable requestAvailable_;
+  std::deque<LevelRequest> requests_;
+  std::deque<LevelData> results_;
+  bool stopWorker_ = false;
+  std::thread worker_;
+};
+
+#endif // LOGIPATHTRACER_TEXTURESTREAMER_HPP
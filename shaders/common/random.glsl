@@ -1,17 +1,78 @@
 #ifndef LOGIPATHTRACER_COMMON_RANDOM_GLSL
 #define LOGIPATHTRACER_COMMON_RANDOM_GLSL
 
+/*
+ * Owen-scrambled Sobol sampler (Burley, "Practical Hash-based Owen Scrambling", JCGT 2020).
+ * Direction numbers are generated on the CPU (SobolSampler) and bound at SOBOL_DIRECTIONS_BINDING.
+ * Every call to rand() returns the next dimension of the current sample. Dimensions past SOBOL_DIMENSIONS are padded
+ * by reusing the table with an independently shuffled sample index.
+ */
+
+#ifndef SOBOL_DIRECTIONS_BINDING
+#error "SOBOL_DIRECTIONS_BINDING must be defined before including random.glsl"
+#endif
+
+#define SOBOL_DIMENSIONS 32
+#define SOBOL_BITS 32
+
+layout(std430, set = 0, binding = SOBOL_DIRECTIONS_BINDING) readonly buffer SobolDirectionsBuffer {
+  uint sobolDirections[];
+};
+
 #ifndef RANDOM_SEED_SET
 #define RANDOM_SEED_SET
+// x: per pixel scramble seed, y: next dimension to be drawn.
 uvec2 seed;
+uint samplerIndex;
 #endif
 
+uint hashPCG(uint v) {
+  uint state = v * 747796405u + 2891336453u;
+  uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+  return (word >> 22u) ^ word;
+}
+
+uint hashCombine(uint seed, uint v) {
+  return seed ^ (v + 0x9e3779b9u + (seed << 6u) + (seed >> 2u));
+}
+
+uint nestedUniformScramble(uint x, uint scramble) {
+  x = bitfieldReverse(x);
+  // Laine-Karras permutation.
+  x += scramble;
+  x ^= x * 0x6c50b47cu;
+  x ^= x * 0xb82f1e52u;
+  x ^= x * 0xc7afe638u;
+  x ^= x * 0x8d22f6e6u;
+  return bitfieldReverse(x);
+}
+
+uint sobol(uint index, uint dimension) {
+  uint result = 0u;
+  uint offset = dimension * SOBOL_BITS;
+
+  for (uint bit = 0u; index != 0u; index >>= 1u, bit++) {
+    if ((index & 1u) != 0u) {
+      result ^= sobolDirections[offset + bit];
+    }
+  }
+
+  return result;
+}
+
+void initSampler(uvec2 pixel, uint sampleIndex, uint scrambleSeed) {
+  // Hash each coordinate separately so that pixels on row and column 0 still receive distinct seeds.
+  seed = uvec2(hashPCG(pixel.x + hashPCG(pixel.y + hashPCG(scrambleSeed))), 0u);
+  samplerIndex = sampleIndex;
+}
+
 float rand() {
-  seed += uvec2(1);
-  // return fract(sin(dot(seed.xy, vec2(12.9898, 78.233))) * 43758.5453);
-  uvec2 q = 1103515245U * ((seed >> 1U) ^ (seed.yx));
-  uint n = 1103515245U * ((q.x) ^ (q.y >> 3U));
-  return float(n) * (1.0 / float(0xffffffffU));
+  uint dimension = seed.y++;
+  uint index = nestedUniformScramble(samplerIndex, hashCombine(seed.x, dimension / SOBOL_DIMENSIONS));
+  uint value = nestedUniformScramble(sobol(index, dimension % SOBOL_DIMENSIONS), hashCombine(seed.x, hashPCG(dimension)));
+
+  // Use top 24 bits so the result is exactly representable and strictly below 1.
+  return float(value >> 8u) * (1.0 / float(1u << 24u));
 }
 
-  #endif// LOGIPATHTRACER_COMMON_RANDOM_GLSL
\ No newline at end of file
+#endif// LOGIPATHTRACER_COMMON_RANDOM_GLSL
@@ -60,6 +60,26 @@ bool rayAABBIntersectTest(Ray ray, vec3 minCorner, vec3 maxCorner, float distanc
   return t1 > 0.0;;
 }
 
+// Distance at which the ray enters the box (zero if it starts inside). INFINITY if the box is missed or entered at or
+// beyond distance. invDir is the reciprocal of the ray direction.
+float rayAABBEntry(Ray ray, vec3 invDir, vec3 minCorner, vec3 maxCorner, float distance) {
+  vec3 near = (minCorner - ray.origin) * invDir;
+  vec3 far = (maxCorner - ray.origin) * invDir;
+
+  vec3 tmin = min(near, far);
+  vec3 tmax = max(near, far);
+
+  float t0 = max(max(tmin.x, tmin.y), tmin.z);
+  float t1 = min(min(tmax.x, tmax.y), tmax.z);
+
+  if (t0 > t1 || t1 <= 0.0) {
+    return INFINITY;
+  }
+
+  float entry = max(t0, 0.0);
+  return entry < distance ? entry : INFINITY;
+}
+
 float rayTriangleIntersect(Ray ray, vec3 v0, vec3 v1, vec3 v2) {
   vec3 edge1 = v1 - v0;
   vec3 edge2 = v2 - v0;
@@ -0,0 +1,100 @@
+#ifndef LOGIPATHTRACER_COMMON_SCENE_LAYOUT_GLSL
+#define LOGIPATHTRACER_COMMON_SCENE_LAYOUT_GLSL
+
+/*
+ * Scene buffer structs shared by the shaders and the host (see include/SceneLayout.hpp, which includes this file and
+ * verifies the std430 offsets). Only types that have the same size and alignment in C++ and std430 may be used:
+ * scalars, vec4, mat3x4, and vec3 followed by a scalar. Helpers that are GLSL only go below the __cplusplus guard.
+ */
+
+// Set in GPUBVHNode::childOrLast of leaf nodes.
+const uint BVH_LEAF_BIT = 0x80000000u;
+
+struct GPUMaterial {
+    vec4 baseColorFactor;// Base color of the material (RGBA). Transparency not yet supported.
+    vec3 emissionFactor;// Emissive factor (RGB).
+    float metallicFactor;// Metalness factor (used to determine specular component strength).
+    float roughnessFactor;// Roughness factor (used to determine diffuse component strength).
+    float transmissionFactor;
+    float ior;
+    uint colorTexture;
+    uint emissionTexture;
+    uint metallicRoughnessTexture;
+    uint transmissionTexture;
+    uint normalTexture;
+};
+
+// Object (submesh instance) of the path tracer. Affine transforms are stored as their three rows.
+struct GPUObjectData {
+    mat3x4 objectToWorld;
+    mat3x4 worldToObject;
+    uint materialIndex;
+    uint bvhOffset;// Offset of the object's BVH nodes.
+    uint verticesOffset;// Offset of the object's vertices.
+    uint vertexCount;// Three per triangle. Zero in a flattened scene, whose triangles are not grouped by object.
+};
+
+struct GPUVertex {
+    float position[3];
+    uint normal;// Octahedral encoded, snorm 2x16.
+    uint uv;// Half 2x16.
+};
+
+struct GPUBVHNode {
+    vec3 minCorner;// Minimum bounding box point.
+    uint childOrFirst;// Left child index (inner node) or first primitive (leaf).
+    vec3 maxCorner;// Maximum bounding box point.
+    uint childOrLast;// Right child index (inner node) or one past the last primitive (leaf) | BVH_LEAF_BIT.
+};
+
+// Shading data of a ray tracing vertex. Positions only live in the acceleration structures.
+struct RTXVertex {
+    uint normal;// Octahedral encoded, snorm 2x16.
+    uint uv;// Half 2x16.
+};
+
+struct RTXInstance {
+    uint materialIndex;
+    uint verticesOffset;
+};
+
+#ifndef __cplusplus
+
+vec3 transformPoint(mat3x4 transform, vec3 point) {
+    return vec4(point, 1.0) * transform;
+}
+
+vec3 transformDirection(mat3x4 transform, vec3 direction) {
+    return vec4(direction, 0.0) * transform;
+}
+
+vec3 decodeOctahedral(uint encoded) {
+    vec2 e = unpackSnorm2x16(encoded);
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+
+    return normalize(n);
+}
+
+vec2 decodeUV(uint encoded) {
+    return unpackHalf2x16(encoded);
+}
+
+vec3 vertexPosition(GPUVertex vertex) {
+    return vec3(vertex.position[0], vertex.position[1], vertex.position[2]);
+}
+
+bool isLeaf(GPUBVHNode node) {
+    return (node.childOrLast & BVH_LEAF_BIT) != 0u;
+}
+
+uvec2 nodeIndices(GPUBVHNode node) {
+    return uvec2(node.childOrFirst, node.childOrLast & ~BVH_LEAF_BIT);
+}
+
+#endif
+
+#endif// LOGIPATHTRACER_COMMON_SCENE_LAYOUT_GLSL
@@ -0,0 +1,125 @@
+#ifndef LOGIPATHTRACER_COMMON_SCENE_OCCLUSION_GLSL
+#define LOGIPATHTRACER_COMMON_SCENE_OCCLUSION_GLSL
+
+#include "constants.glsl"
+#include "ray.glsl"
+#include "scene_layout.glsl"
+
+/*
+ * Any hit traversal of the path tracer scene for shadow and visibility rays. Returns on the first triangle hit in
+ * (EPS, tMax), so children are visited in stored order and no entry distances are kept. Distances are in units of the
+ * ray direction, as in sceneIntersect.
+ *
+ * The including shader declares the scene buffers (objects, objectBVHNodes, vertices and meshBVHNodes) and the
+ * INTERSECTION_STACK_SIZE and FLAT_SCENE_BVH constants, as path_tracing.comp does. The host counterpart is occluded in
+ * SceneRayQueries.hpp. With RAY_QUERY the including shader declares topLevelAS instead, which is traced in hardware.
+ */
+
+#ifdef RAY_QUERY
+
+bool occluded(Ray ray, float tMax) {
+    rayQueryEXT rayQuery;
+    rayQueryInitializeEXT(rayQuery, topLevelAS, gl_RayFlagsOpaqueEXT | gl_RayFlagsTerminateOnFirstHitEXT, 0xFF, ray.origin, EPS, ray.direction, tMax);
+    while (rayQueryProceedEXT(rayQuery)) {
+    }
+
+    return rayQueryGetIntersectionTypeEXT(rayQuery, true) != gl_RayQueryCommittedIntersectionNoneEXT;
+}
+
+#else
+
+// Ray has to be in the space of the mesh vertices.
+bool meshOccluded(Ray rayObjSpace, int bvhOffset, uint verticesOffset, float tMax) {
+    vec3 invDir = 1.0 / rayObjSpace.direction;
+
+    uint ptr = 0;
+    int traversalStack[INTERSECTION_STACK_SIZE];
+    traversalStack[ptr++] = -1;
+
+    int idx = bvhOffset;
+    while (idx > -1) {
+        GPUBVHNode node = meshBVHNodes[idx];
+        uvec2 indices = nodeIndices(node);
+
+        if (isLeaf(node)) {
+            for (uint i = indices.x; i < indices.y; i++) {
+                uint firstVertexIdx = verticesOffset + 3 * i;
+                float triDistance = rayTriangleIntersect(rayObjSpace, vertexPosition(vertices[firstVertexIdx]), vertexPosition(vertices[firstVertexIdx + 1]), vertexPosition(vertices[firstVertexIdx + 2]));
+
+                if (triDistance > EPS && triDistance < tMax) {
+                    return true;
+                }
+            }
+        } else {
+            int leftIdx = int(bvhOffset + indices.x);
+            int rightIdx = int(bvhOffset + indices.y);
+            bool hitLeft = rayAABBEntry(rayObjSpace, invDir, meshBVHNodes[leftIdx].minCorner, meshBVHNodes[leftIdx].maxCorner, tMax) != INFINITY;
+            bool hitRight = rayAABBEntry(rayObjSpace, invDir, meshBVHNodes[rightIdx].minCorner, meshBVHNodes[rightIdx].maxCorner, tMax) != INFINITY;
+
+            if (hitLeft && hitRight) {
+                traversalStack[ptr++] = rightIdx;
+            }
+
+            if (hitLeft || hitRight) {
+                idx = hitLeft ? leftIdx : rightIdx;
+                continue;
+            }
+        }
+
+        idx = traversalStack[--ptr];
+    }
+
+    return false;
+}
+
+bool occluded(Ray ray, float tMax) {
+    if (FLAT_SCENE_BVH) {
+        return meshOccluded(ray, 0, 0u, tMax);
+    }
+
+    vec3 invDir = 1.0 / ray.direction;
+
+    uint ptr = 0;
+    int traversalStack[INTERSECTION_STACK_SIZE];
+    traversalStack[ptr++] = -1;
+
+    int idx = 0;
+    while (idx > -1) {
+        GPUBVHNode node = objectBVHNodes[idx];
+        uvec2 indices = nodeIndices(node);
+
+        if (isLeaf(node)) {
+            for (uint i = indices.x; i < indices.y; i++) {
+                Ray rayObjSpace;
+                rayObjSpace.origin = transformPoint(objects[i].worldToObject, ray.origin);
+                rayObjSpace.direction = transformDirection(objects[i].worldToObject, ray.direction);
+
+                if (meshOccluded(rayObjSpace, int(objects[i].bvhOffset), objects[i].verticesOffset, tMax)) {
+                    return true;
+                }
+            }
+        } else {
+            int leftIdx = int(indices.x);
+            int rightIdx = int(indices.y);
+            bool hitLeft = rayAABBEntry(ray, invDir, objectBVHNodes[leftIdx].minCorner, objectBVHNodes[leftIdx].maxCorner, tMax) != INFINITY;
+            bool hitRight = rayAABBEntry(ray, invDir, objectBVHNodes[rightIdx].minCorner, objectBVHNodes[rightIdx].maxCorner, tMax) != INFINITY;
+
+            if (hitLeft && hitRight) {
+                traversalStack[ptr++] = rightIdx;
+            }
+
+            if (hitLeft || hitRight) {
+                idx = hitLeft ? leftIdx : rightIdx;
+                continue;
+            }
+        }
+
+        idx = traversalStack[--ptr];
+    }
+
+    return false;
+}
+
+#endif
+
+#endif// LOGIPATHTRACER_COMMON_SCENE_OCCLUSION_GLSL
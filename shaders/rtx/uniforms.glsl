@@ -7,58 +7,58 @@
 
 precision highp float;
 
+#define SOBOL_DIRECTIONS_BINDING 6
+
 #include "../common/ray.glsl"
+#include "../common/random.glsl"
+#include "../common/scene_layout.glsl"
 
 struct Camera {
     mat4 worldMatrix;
     float fovY;
 };
 
-struct Material {
-    vec4 baseColorFactor;
-    vec3 emissionFactor;
-    float metallicFactor;
-    float roughnessFactor;
-    float transmissionFactor;
-    float ior;
-    uint colorTexture;
-    uint emissionTexture;
-    uint metallicRoughnessTexture;
-    uint transmissionTexture;
-    uint normalTexture;
-    uint verticesOffset;
-};
-
-struct Vertex {
+// Surface hit by a ray, returned by closesthit.rchit. Shading and the bounce loop are in raygen.rgen.
+struct RayPayload {
+    vec3 position;
+    // Interpolated vertex normal in world space, not yet facing the ray.
     vec3 normal;
     vec2 uv;
-};
-
-struct RayPayload {
-    vec3 mask;
-    vec3 accColor;
-    uint depth;
-    uvec2 seed;
+    uint materialIndex;
+    // INFINITY on a miss.
+    float distance;
 };
 
 layout(set = 0, binding = 0, rgba32f) uniform image2D accumulationImage;
 
 layout(std140, set = 0, binding = 1) uniform UBO {
     Camera camera;
-    uvec2 seed;
+    uint sampleIndex;
+    uint scrambleSeed;
     bool reset;
 } ubo;
 
 layout(set = 0, binding = 2) uniform accelerationStructureNV accelerator;
 
 layout(std430, set = 0, binding = 3) buffer MaterialsBuffer {
-    Material materials[];
+    GPUMaterial materials[];
 };
 
 layout(std430, set = 0, binding = 4) buffer VertexBuffer {
-    Vertex vertices[];
+    RTXVertex vertices[];
 };
 
-layout(set = 0, binding = 5) uniform sampler2D textures[512];
+// Indexed by gl_InstanceID.
+layout(std430, set = 0, binding = 5) buffer InstancesBuffer {
+    RTXInstance instances[];
+};
+
+// Reset by the renderer before every launch that counts rays (see COUNT_RAYS in raygen.rgen).
+layout(std430, set = 0, binding = 7) buffer RayCounterBuffer {
+    uint rayCount;
+} rayCounter;
+
+// Texture table is sized to the loaded scene and may be updated while bound.
+layout(set = 1, binding = 0) uniform sampler2D textures[];
 
 #endif// LOGIPATHTRACER_RTX_UNIFORMS_H
@@ -4,6 +4,9 @@
 
 precision highp float;
 
+// Normalize by the per pixel sample count stored in alpha instead of the global one (history length varies per pixel).
+layout (constant_id = 0) const bool kPerPixelSampleCount = false;
+
 layout (binding = 0) uniform sampler2D samplerColor;
 layout(std140, set = 0, binding = 1) uniform UBO {
     float invSampleCount;
@@ -21,9 +24,41 @@ vec4 ToneMap(in vec4 c, float limit) {
 const float gamma = 2.2;
 const float exposure = 1.5;
 
+vec3 normalizedColor(vec4 accumulated) {
+    return kPerPixelSampleCount ? accumulated.rgb / max(accumulated.w, 1.0) : accumulated.rgb * ubo.invSampleCount;
+}
+
+// Catmull-Rom filtered fetch of the normalized color. Used when the image was rendered at a lower resolution
+// (dynamic resolution), where bilinear upscaling visibly blurs the image.
+vec3 upscaleCatmullRom(vec2 uv) {
+    ivec2 size = textureSize(samplerColor, 0);
+    vec2 samplePos = uv * vec2(size) - 0.5;
+    ivec2 basePixel = ivec2(floor(samplePos));
+    vec2 f = samplePos - vec2(basePixel);
+
+    vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+    vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+    vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+    vec2 w3 = f * f * (-0.5 + 0.5 * f);
+    vec2 weights[4] = vec2[](w0, w1, w2, w3);
+
+    vec3 result = vec3(0.0);
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            ivec2 pixel = clamp(basePixel + ivec2(x - 1, y - 1), ivec2(0), size - 1);
+            result += weights[x].x * weights[y].y * normalizedColor(texelFetch(samplerColor, pixel, 0));
+        }
+    }
+
+    // Negative lobes may overshoot below zero.
+    return max(result, vec3(0.0));
+}
+
 void main() {
     vec2 uv = vec2(inUV.x, 1.0 - inUV.y);
-    vec3 hdrColor = texture(samplerColor, uv).rgb * ubo.invSampleCount;
+    // More than one output pixel per texel means the image is upscaled.
+    bool upscale = abs(dFdx(uv.x)) * float(textureSize(samplerColor, 0).x) < 0.99;
+    vec3 hdrColor = upscale ? upscaleCatmullRom(uv) : normalizedColor(texture(samplerColor, uv));
 
     // Exposure tone mapping
     vec3 mapped = vec3(1.0) - exp(-hdrColor * exposure);
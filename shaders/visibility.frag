@@ -0,0 +1,14 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout (location = 0) in vec2 inBarycentrics;
+layout (location = 1) flat in uint inObjectIndex;
+layout (location = 2) flat in uint inPrimitiveIndex;
+
+// Object index, index of the triangle's first vertex (as Intersection in path_tracing.comp) and the barycentrics of
+// the second and the third vertex at the pixel center. Cleared to 0xFFFFFFFF objects where nothing was drawn.
+layout (location = 0) out uvec4 outVisibility;
+
+void main() {
+    outVisibility = uvec4(inObjectIndex, inPrimitiveIndex, floatBitsToUint(inBarycentrics));
+}
@@ -0,0 +1,53 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "common/scene_layout.glsl"
+
+/*
+ * Visibility buffer pass of the hybrid path tracer (see PathTracingKernelConfiguration::rasterPrimaryVisibility). No
+ * vertex buffers are bound: gl_VertexIndex indexes the path tracer vertices (firstVertex of the draw is the object's
+ * verticesOffset) and gl_InstanceIndex is the object index (firstInstance of the draw).
+ */
+
+// Vertices of a flattened scene are drawn at once and their objects are read from primitiveObjects.
+layout (constant_id = 0) const bool FLAT_SCENE_BVH = false;
+
+layout(std430, set = 0, binding = 0) readonly buffer ObjectsBuffer {
+    GPUObjectData objects[];
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer TrianglesBuffer {
+    GPUVertex vertices[];
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer PrimitiveObjectsBuffer {
+    uint primitiveObjects[];
+};
+
+// Projection matches generateRay in path_tracing.comp (see RendererPT::recordVisibilityCommands).
+layout (push_constant) uniform PushConstants {
+    mat4 viewProjection;
+} pc;
+
+layout (location = 0) out vec2 outBarycentrics;
+layout (location = 1) flat out uint outObjectIndex;
+layout (location = 2) flat out uint outPrimitiveIndex;
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+void main() {
+    // Triangles start at multiples of three in the vertices buffer.
+    uint corner = uint(gl_VertexIndex) % 3u;
+    uint objectIndex = FLAT_SCENE_BVH ? primitiveObjects[gl_VertexIndex / 3] : uint(gl_InstanceIndex);
+
+    // Weights of the second and the third vertex. Interpolated with perspective correction.
+    outBarycentrics = vec2(corner == 1u ? 1.0 : 0.0, corner == 2u ? 1.0 : 0.0);
+    outObjectIndex = objectIndex;
+    outPrimitiveIndex = uint(gl_VertexIndex) - corner;
+
+    vec3 position = transformPoint(objects[objectIndex].objectToWorld, vertexPosition(vertices[gl_VertexIndex]));
+    gl_Position = pc.viewProjection * vec4(position, 1.0);
+}
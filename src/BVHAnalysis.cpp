@@ -0,0 +1,186 @@
+#include "BVHAnalysis.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+namespace {
+
+BVHBounds nodeBounds(const GPUBVHNode& node) {
+  BVHBounds bounds;
+  bounds.grow(node.minCorner);
+  bounds.grow(node.maxCorner);
+  return bounds;
+}
+
+float overlapRatio(const GPUBVHNode& parent, const GPUBVHNode& left, const GPUBVHNode& right) {
+  BVHBounds overlap;
+  overlap.min = glm::max(left.minCorner, right.minCorner);
+  overlap.max = glm::min(left.maxCorner, right.maxCorner);
+
+  const float parentArea = nodeBounds(parent).surfaceArea();
+  return parentArea > 0.0f ? overlap.surfaceArea() / parentArea : 0.0f;
+}
+
+std::string escapeJson(const std::string& text) {
+  std::string escaped;
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (static_cast<unsigned char>(c) < 0x20u) {
+      escaped += ' ';
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+void writeStatistics(std::ostream& out, const BVHStatistics& statistics, uint32_t traversalStackSize,
+                     const std::string& indent) {
+  out << indent << "\"nodes\": " << statistics.nodeCount << ",\n";
+  out << indent << "\"leaves\": " << statistics.leafCount << ",\n";
+  out << indent << "\"sahCost\": " << statistics.sahCost << ",\n";
+  out << indent << "\"maxDepth\": " << statistics.maxDepth << ",\n";
+  out << indent << "\"averageLeafDepth\": " << statistics.averageLeafDepth << ",\n";
+  out << indent << "\"requiredStackSize\": " << statistics.requiredStackSize << ",\n";
+  out << indent << "\"exceedsStack\": " << (statistics.requiredStackSize > traversalStackSize ? "true" : "false")
+      << ",\n";
+  out << indent << "\"averageOverlap\": " << statistics.averageOverlap << ",\n";
+  out << indent << "\"maxOverlap\": " << statistics.maxOverlap << ",\n";
+  out << indent << "\"leafSizeHistogram\": {";
+
+  bool first = true;
+  for (const auto& [leafSize, count] : statistics.leafSizeHistogram) {
+    out << (first ? "" : ", ") << "\"" << leafSize << "\": " << count;
+    first = false;
+  }
+  out << "}\n";
+}
+
+} // namespace
+
+BVHStatistics analyzeBVH(const GPUBVHNode* nodes, size_t nodeCount) {
+  BVHStatistics statistics;
+
+  if (nodeCount == 0u) {
+    return statistics;
+  }
+
+  statistics.nodeCount = nodeCount;
+  statistics.sahCost = computeSAHCost(nodes, nodeCount);
+
+  // Same order as the traversal in path_tracing.comp, with every box hit: one child is visited next and the other one
+  // pushed. The stack starts with the terminating entry.
+  std::vector<std::pair<uint32_t, uint32_t>> stack;
+  stack.emplace_back(std::numeric_limits<uint32_t>::max(), 0u);
+  statistics.requiredStackSize = 1u;
+
+  uint64_t leafDepthSum = 0u;
+  uint32_t innerCount = 0u;
+  double overlapSum = 0.0;
+
+  std::pair<uint32_t, uint32_t> current(0u, 0u);
+  while (current.first != std::numeric_limits<uint32_t>::max()) {
+    const auto [nodeIndex, depth] = current;
+    const GPUBVHNode& node = nodes[nodeIndex];
+    glm::uvec2 indices = nodeIndices(node);
+
+    statistics.maxDepth = std::max(statistics.maxDepth, depth);
+
+    if (isLeaf(node)) {
+      statistics.leafCount++;
+      statistics.leafSizeHistogram[indices.y - indices.x]++;
+      leafDepthSum += depth;
+    } else if (indices.x < nodeCount && indices.y < nodeCount) {
+      float overlap = overlapRatio(node, nodes[indices.x], nodes[indices.y]);
+      overlapSum += overlap;
+      statistics.maxOverlap = std::max(statistics.maxOverlap, overlap);
+      innerCount++;
+
+      stack.emplace_back(indices.y, depth + 1u);
+      statistics.requiredStackSize = std::max(statistics.requiredStackSize, static_cast<uint32_t>(stack.size()));
+      current = {indices.x, depth + 1u};
+      continue;
+    } else {
+      std::cout << "BVH node " << nodeIndex << " references a child outside of the tree." << std::endl;
+    }
+
+    current = stack.back();
+    stack.pop_back();
+  }
+
+  statistics.averageLeafDepth = statistics.leafCount > 0u ? static_cast<float>(leafDepthSum) / statistics.leafCount
+                                                          : 0.0f;
+  statistics.averageOverlap = innerCount > 0u ? static_cast<float>(overlapSum / innerCount) : 0.0f;
+  return statistics;
+}
+
+SceneBVHStatistics analyzeSceneBVHs(const GPUBVHNode* objectBVHNodes, size_t objectBVHNodeCount,
+                                    const GPUBVHNode* meshBVHNodes, const std::vector<MeshBVHInfo>& meshes) {
+  SceneBVHStatistics statistics;
+  statistics.topLevel = analyzeBVH(objectBVHNodes, objectBVHNodeCount);
+
+  statistics.meshes.reserve(meshes.size());
+  for (const auto& mesh : meshes) {
+    statistics.meshes.emplace_back(analyzeBVH(meshBVHNodes + mesh.nodeOffset, mesh.nodeCount));
+  }
+
+  return statistics;
+}
+
+uint32_t logBVHStatistics(const SceneBVHStatistics& statistics, const std::vector<MeshBVHInfo>& meshes,
+                          uint32_t traversalStackSize) {
+  uint32_t maxMeshDepth = 0u;
+  double meshSAHSum = 0.0;
+  for (const auto& mesh : statistics.meshes) {
+    maxMeshDepth = std::max(maxMeshDepth, mesh.maxDepth);
+    meshSAHSum += mesh.sahCost;
+  }
+
+  std::cout << "BVH: objects SAH " << statistics.topLevel.sahCost << ", depth " << statistics.topLevel.maxDepth
+            << ". Meshes average SAH "
+            << (statistics.meshes.empty() ? 0.0 : meshSAHSum / statistics.meshes.size()) << ", max depth "
+            << maxMeshDepth << "." << std::endl;
+
+  uint32_t exceeding = 0u;
+  auto check = [&](const BVHStatistics& tree, const std::string& name) {
+    if (tree.requiredStackSize > traversalStackSize) {
+      std::cout << "Warning: BVH of " << name << " needs " << tree.requiredStackSize
+                << " traversal stack entries, but the stack holds " << traversalStackSize
+                << ". Traversal may overflow the stack." << std::endl;
+      exceeding++;
+    }
+  };
+
+  check(statistics.topLevel, "the objects");
+  for (size_t i = 0u; i < statistics.meshes.size(); i++) {
+    check(statistics.meshes[i], meshes[i].name);
+  }
+
+  return exceeding;
+}
+
+void writeBVHReport(std::ostream& out, const SceneBVHStatistics& statistics, const std::vector<MeshBVHInfo>& meshes,
+                    uint32_t traversalStackSize) {
+  out << std::setprecision(6);
+  out << "{\n";
+  out << "  \"traversalStackSize\": " << traversalStackSize << ",\n";
+  out << "  \"topLevel\": {\n";
+  writeStatistics(out, statistics.topLevel, traversalStackSize, "    ");
+  out << "  },\n";
+  out << "  \"meshes\": [";
+
+  for (size_t i = 0u; i < statistics.meshes.size(); i++) {
+    out << (i == 0u ? "\n" : ",\n");
+    out << "    {\n";
+    out << "      \"name\": \"" << escapeJson(meshes[i].name) << "\",\n";
+    out << "      \"builder\": \"" << toString(meshes[i].builder) << "\",\n";
+    out << "      \"triangles\": " << meshes[i].triangleCount << ",\n";
+    writeStatistics(out, statistics.meshes[i], traversalStackSize, "      ");
+    out << "    }";
+  }
+
+  out << (statistics.meshes.empty() ? "]\n" : "\n  ]\n");
+  out << "}\n";
+}
@@ -0,0 +1,452 @@
+#include "BVHBenchmark.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+
+namespace {
+
+struct BenchmarkRay {
+  glm::vec3 origin;
+  glm::vec3 direction;
+};
+
+using Triangle = std::array<glm::vec3, 3u>;
+
+// Distance at which the ray enters the node (zero if it starts inside), infinity on a miss or beyond maxDistance.
+float boundsEntry(const BenchmarkRay& ray, const glm::vec3& inverseDirection, const GPUBVHNode& node,
+                  float maxDistance) {
+  glm::vec3 t0 = (node.minCorner - ray.origin) * inverseDirection;
+  glm::vec3 t1 = (node.maxCorner - ray.origin) * inverseDirection;
+  glm::vec3 tMin = glm::min(t0, t1);
+  glm::vec3 tMax = glm::max(t0, t1);
+
+  float enter = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f));
+  float exit = std::min(std::min(tMax.x, tMax.y), tMax.z);
+  return enter <= exit && enter < maxDistance ? enter : std::numeric_limits<float>::infinity();
+}
+
+// Moller-Trumbore. Returns infinity on a miss.
+float intersectTriangle(const BenchmarkRay& ray, const Triangle& triangle) {
+  constexpr float kEpsilon = 1e-7f;
+  const float kMiss = std::numeric_limits<float>::infinity();
+
+  glm::vec3 edge1 = triangle[1] - triangle[0];
+  glm::vec3 edge2 = triangle[2] - triangle[0];
+  glm::vec3 p = glm::cross(ray.direction, edge2);
+  float determinant = glm::dot(edge1, p);
+
+  if (std::abs(determinant) < kEpsilon) {
+    return kMiss;
+  }
+
+  float inverseDeterminant = 1.0f / determinant;
+  glm::vec3 t = ray.origin - triangle[0];
+  float u = glm::dot(t, p) * inverseDeterminant;
+  if (u < 0.0f || u > 1.0f) {
+    return kMiss;
+  }
+
+  glm::vec3 q = glm::cross(t, edge1);
+  float v = glm::dot(ray.direction, q) * inverseDeterminant;
+  if (v < 0.0f || u + v > 1.0f) {
+    return kMiss;
+  }
+
+  float distance = glm::dot(edge2, q) * inverseDeterminant;
+  return distance > kEpsilon ? distance : kMiss;
+}
+
+enum class TraversalOrder {
+  // Children are pushed in the order they are stored.
+  eFixed,
+  // Nearer child is visited first, the farther one is pushed with its entry distance and skipped once a closer hit is
+  // found. Same as path_tracing.comp.
+  eNearFirst
+};
+
+/**
+ * Closest hit BVH traversal. Leaf calls leafIntersect(first, last, closest), which lowers closest on a hit. Returns
+ * the closest hit below maxDistance (infinity if there is none).
+ */
+template <typename LeafIntersect>
+float traverse(const BenchmarkRay& ray, const std::vector<GPUBVHNode>& nodes, float maxDistance, TraversalOrder order,
+               LeafIntersect leafIntersect) {
+  constexpr uint32_t kStackSize = 64u;
+  const glm::vec3 inverseDirection = glm::vec3(1.0f) / ray.direction;
+
+  float closest = maxDistance;
+  std::array<std::pair<uint32_t, float>, kStackSize> stack;
+  uint32_t stackSize = 0u;
+
+  if (!nodes.empty()) {
+    float rootEntry = boundsEntry(ray, inverseDirection, nodes[0], closest);
+    if (rootEntry < closest) {
+      stack[stackSize++] = {0u, rootEntry};
+    }
+  }
+
+  while (stackSize > 0u) {
+    auto [nodeIndex, entry] = stack[--stackSize];
+
+    while (entry < closest) {
+      const GPUBVHNode& node = nodes[nodeIndex];
+      glm::uvec2 indices = nodeIndices(node);
+
+      if (isLeaf(node)) {
+        leafIntersect(indices.x, indices.y, closest);
+        break;
+      }
+
+      std::pair<uint32_t, float> near(indices.x, boundsEntry(ray, inverseDirection, nodes[indices.x], closest));
+      std::pair<uint32_t, float> far(indices.y, boundsEntry(ray, inverseDirection, nodes[indices.y], closest));
+
+      if (order == TraversalOrder::eFixed) {
+        // Both children go through the stack, the second one is popped first.
+        for (const auto& child : {near, far}) {
+          if (child.second < closest && stackSize < kStackSize) {
+            stack[stackSize++] = child;
+          }
+        }
+        break;
+      }
+
+      if (far.second < near.second) {
+        std::swap(near, far);
+      }
+
+      if (far.second < closest && stackSize < kStackSize) {
+        stack[stackSize++] = far;
+      }
+
+      std::tie(nodeIndex, entry) = near;
+    }
+  }
+
+  return closest;
+}
+
+/**
+ * Closest hit on triangles in BVH primitive order.
+ */
+float traceClosest(const BenchmarkRay& ray, const std::vector<GPUBVHNode>& nodes,
+                   const std::vector<Triangle>& triangles, TraversalOrder order = TraversalOrder::eNearFirst,
+                   float maxDistance = std::numeric_limits<float>::infinity()) {
+  return traverse(ray, nodes, maxDistance, order, [&](uint32_t first, uint32_t last, float& closest) {
+    for (uint32_t i = first; i < last; i++) {
+      closest = std::min(closest, intersectTriangle(ray, triangles[i]));
+    }
+  });
+}
+
+/**
+ * Mesh of the two-level scene. Triangles are in object space.
+ */
+struct BenchmarkObject {
+  glm::mat4 worldToObject;
+  std::vector<GPUBVHNode> nodes;
+  std::vector<Triangle> triangles;
+};
+
+/**
+ * Two-level traversal of sceneIntersect in path_tracing.comp. The ray is transformed into the space of every object
+ * in a visited leaf. Transforms are affine and directions are not normalized, so distances carry over.
+ */
+float traceTwoLevel(const BenchmarkRay& ray, const std::vector<GPUBVHNode>& objectNodes,
+                    const std::vector<BenchmarkObject>& objects) {
+  const float kNoHit = std::numeric_limits<float>::infinity();
+
+  return traverse(ray, objectNodes, kNoHit, TraversalOrder::eNearFirst,
+                  [&](uint32_t first, uint32_t last, float& closest) {
+                    for (uint32_t i = first; i < last; i++) {
+                      const BenchmarkObject& object = objects[i];
+                      BenchmarkRay objectRay;
+                      objectRay.origin = glm::vec3(object.worldToObject * glm::vec4(ray.origin, 1.0f));
+                      objectRay.direction = glm::vec3(object.worldToObject * glm::vec4(ray.direction, 0.0f));
+                      closest = traceClosest(objectRay, object.nodes, object.triangles, TraversalOrder::eNearFirst,
+                                             closest);
+                    }
+                  });
+}
+
+std::vector<BenchmarkRay> generateRays(const BVHBounds& bounds, uint32_t rayCount) {
+  std::mt19937 generator(1337u);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  std::normal_distribution<float> normal;
+
+  const glm::vec3 center = bounds.centroid();
+  const float radius = std::max(glm::length(bounds.max - bounds.min), 1e-6f);
+
+  std::vector<BenchmarkRay> rays(rayCount);
+  for (auto& ray : rays) {
+    glm::vec3 onSphere = glm::normalize(glm::vec3(normal(generator), normal(generator), normal(generator)));
+    glm::vec3 offset(unit(generator), unit(generator), unit(generator));
+    glm::vec3 target = bounds.min + (bounds.max - bounds.min) * offset;
+
+    ray.origin = center + onSphere * radius;
+    ray.direction = glm::normalize(target - ray.origin);
+  }
+
+  return rays;
+}
+
+} // namespace
+
+void runBVHBenchmark(const lsg::Ref<lsg::Scene>& scene, const BVHBuildConfiguration& configuration,
+                     uint32_t rayCount) {
+  std::cout << "BVH benchmark (" << rayCount << " rays per mesh)" << std::endl;
+
+  scene->traverseDown([&](const lsg::Ref<lsg::Object>& object) {
+    lsg::Ref<lsg::Mesh> mesh = object->getComponent<lsg::Mesh>();
+    if (!mesh) {
+      return true;
+    }
+
+    for (const auto& subMesh : mesh->subMeshes()) {
+      lsg::Ref<lsg::Geometry> geometry = subMesh->geometry();
+      if (!geometry || !geometry->hasVertices()) {
+        continue;
+      }
+
+      auto positionAccessor = geometry->getTrianglePositionAccessor();
+      std::cout << object->name() << " (" << positionAccessor->count() << " triangles)" << std::endl;
+
+      // Same rays for every builder.
+      BVHBounds meshBounds;
+      for (size_t i = 0u; i < positionAccessor->count(); i++) {
+        lsg::Triangle<glm::vec3> triangle = (*positionAccessor)[i];
+        meshBounds.grow(triangle.a());
+        meshBounds.grow(triangle.b());
+        meshBounds.grow(triangle.c());
+      }
+      std::vector<BenchmarkRay> rays = generateRays(meshBounds, rayCount);
+
+      for (BVHBuilderType type : {BVHBuilderType::eSplit, BVHBuilderType::eBinnedSAH, BVHBuilderType::eLBVH}) {
+        auto buildStart = std::chrono::high_resolution_clock::now();
+        BVH bvh = buildMeshBVH(geometry, type, configuration);
+        auto buildTime = std::chrono::high_resolution_clock::now() - buildStart;
+
+        std::vector<Triangle> triangles;
+        triangles.reserve(bvh.primitiveIndices.size());
+        for (uint32_t idx : bvh.primitiveIndices) {
+          lsg::Triangle<glm::vec3> triangle = (*positionAccessor)[idx];
+          triangles.push_back({triangle.a(), triangle.b(), triangle.c()});
+        }
+
+        // Rays per second and hits of each traversal order.
+        auto trace = [&](TraversalOrder order) {
+          uint32_t hits = 0u;
+          auto traceStart = std::chrono::high_resolution_clock::now();
+          for (const auto& ray : rays) {
+            hits += traceClosest(ray, bvh.nodes, triangles, order) < std::numeric_limits<float>::infinity() ? 1u : 0u;
+          }
+          auto traceTime = std::chrono::high_resolution_clock::now() - traceStart;
+          return std::make_pair(rays.size() / std::max(std::chrono::duration<double>(traceTime).count(), 1e-9), hits);
+        };
+
+        auto [fixedRate, fixedHits] = trace(TraversalOrder::eFixed);
+        auto [nearFirstRate, hits] = trace(TraversalOrder::eNearFirst);
+        double buildMs = std::chrono::duration<double, std::milli>(buildTime).count();
+
+        std::cout << "  " << std::setw(10) << toString(type) << ": build " << std::fixed << std::setprecision(1)
+                  << buildMs << " ms, SAH " << std::setprecision(2) << computeSAHCost(bvh.nodes) << ", "
+                  << bvh.nodes.size() << " nodes, " << std::setprecision(3) << nearFirstRate / 1e6
+                  << " Mrays/s near first, " << fixedRate / 1e6 << " Mrays/s fixed order (" << hits << " hits"
+                  << (hits != fixedHits ? ", traversal orders disagree" : "") << ")" << std::defaultfloat << std::endl;
+      }
+    }
+
+    return true;
+  });
+}
+
+void runSceneBVHBenchmark(const lsg::Ref<lsg::Scene>& scene, const BVHBuildConfiguration& configuration,
+                          uint32_t rayCount) {
+  std::vector<BenchmarkObject> unorderedObjects;
+  std::vector<BVHBounds> objectBounds;
+  std::vector<Triangle> worldTriangles;
+  std::vector<BVHBounds> worldTriangleBounds;
+  BVHBounds sceneBounds;
+
+  // Same conversion as PTSceneConverter::loadScene, once per submesh for each mode.
+  for (const auto& rootObj : scene->children()) {
+    rootObj->traverseDown([&](const lsg::Ref<lsg::Object>& object) {
+      lsg::Ref<lsg::Mesh> mesh = object->getComponent<lsg::Mesh>();
+      if (!mesh) {
+        return true;
+      }
+
+      glm::mat4 worldMatrix(1.0f);
+      if (auto transform = object->getComponent<lsg::Transform>()) {
+        worldMatrix = transform->worldMatrix();
+      }
+
+      for (const auto& subMesh : mesh->subMeshes()) {
+        lsg::Ref<lsg::Geometry> geometry = subMesh->geometry();
+        if (!geometry || !geometry->hasVertices()) {
+          continue;
+        }
+
+        auto positionAccessor = geometry->getTrianglePositionAccessor();
+        BVH bvh = buildMeshBVH(geometry, selectMeshBuilder(configuration, positionAccessor->count()), configuration);
+
+        BenchmarkObject& benchmarkObject = unorderedObjects.emplace_back();
+        benchmarkObject.worldToObject = glm::inverse(worldMatrix);
+        benchmarkObject.nodes = std::move(bvh.nodes);
+        benchmarkObject.triangles.reserve(bvh.primitiveIndices.size());
+        for (uint32_t idx : bvh.primitiveIndices) {
+          lsg::Triangle<glm::vec3> triangle = (*positionAccessor)[idx];
+          benchmarkObject.triangles.push_back({triangle.a(), triangle.b(), triangle.c()});
+        }
+        objectBounds.emplace_back(bvh.bounds.transform(worldMatrix));
+
+        for (size_t i = 0u; i < positionAccessor->count(); i++) {
+          lsg::Triangle<glm::vec3> triangle = (*positionAccessor)[i];
+          Triangle& worldTriangle = worldTriangles.emplace_back();
+          BVHBounds& bounds = worldTriangleBounds.emplace_back();
+
+          worldTriangle = {triangle.a(), triangle.b(), triangle.c()};
+          for (auto& vertex : worldTriangle) {
+            vertex = glm::vec3(worldMatrix * glm::vec4(vertex, 1.0f));
+            bounds.grow(vertex);
+          }
+          sceneBounds.grow(bounds);
+        }
+      }
+
+      return true;
+    });
+  }
+
+  std::cout << "Scene BVH benchmark (" << unorderedObjects.size() << " meshes, " << worldTriangles.size()
+            << " triangles, " << rayCount << " rays)" << std::endl;
+
+  // Two-level: objects in the order of the objects BVH leaves.
+  auto buildStart = std::chrono::high_resolution_clock::now();
+  BVH objectBVH = buildBVH(objectBounds, configuration.objectBuilder, configuration);
+  auto twoLevelBuildTime = std::chrono::high_resolution_clock::now() - buildStart;
+
+  std::vector<BenchmarkObject> objects;
+  objects.reserve(objectBVH.primitiveIndices.size());
+  for (uint32_t idx : objectBVH.primitiveIndices) {
+    objects.emplace_back(std::move(unorderedObjects[idx]));
+  }
+
+  // Flattened: same builder selection as PTSceneConverter::stageFlattenedScene.
+  BVHBuilderType flatBuilder = selectMeshBuilder(configuration, worldTriangles.size());
+  if (flatBuilder == BVHBuilderType::eSplit) {
+    flatBuilder = BVHBuilderType::eBinnedSAH;
+  }
+
+  buildStart = std::chrono::high_resolution_clock::now();
+  BVH flatBVH = buildBVH(worldTriangleBounds, flatBuilder, configuration);
+  auto flatBuildTime = std::chrono::high_resolution_clock::now() - buildStart;
+
+  std::vector<Triangle> flatTriangles;
+  flatTriangles.reserve(flatBVH.primitiveIndices.size());
+  for (uint32_t idx : flatBVH.primitiveIndices) {
+    flatTriangles.emplace_back(worldTriangles[idx]);
+  }
+
+  std::vector<BenchmarkRay> rays = generateRays(sceneBounds, rayCount);
+
+  auto report = [&](const char* name, auto buildTime, const auto& trace) {
+    uint32_t hits = 0u;
+    auto traceStart = std::chrono::high_resolution_clock::now();
+    for (const auto& ray : rays) {
+      hits += trace(ray) < std::numeric_limits<float>::infinity() ? 1u : 0u;
+    }
+    auto traceTime = std::chrono::high_resolution_clock::now() - traceStart;
+
+    double buildMs = std::chrono::duration<double, std::milli>(buildTime).count();
+    double traceSeconds = std::max(std::chrono::duration<double>(traceTime).count(), 1e-9);
+    double raysPerSecond = rays.size() / traceSeconds;
+
+    std::cout << "  " << std::setw(10) << name << ": build " << std::fixed << std::setprecision(1) << buildMs
+              << " ms, " << std::setprecision(3) << raysPerSecond / 1e6 << " Mrays/s (" << hits << " hits)"
+              << std::defaultfloat << std::endl;
+    return raysPerSecond;
+  };
+
+  // Two-level build time only covers the objects BVH, mesh BVHs are shared by both modes in the renderer.
+  double twoLevelRate = report("two-level", twoLevelBuildTime, [&](const BenchmarkRay& ray) {
+    return traceTwoLevel(ray, objectBVH.nodes, objects);
+  });
+  double flatRate = report("flattened", flatBuildTime, [&](const BenchmarkRay& ray) {
+    return traceClosest(ray, flatBVH.nodes, flatTriangles);
+  });
+
+  std::cout << "  Flattened scene traces " << std::setprecision(3) << flatRate / twoLevelRate
+            << "x the rays of the two-level scene." << std::defaultfloat << std::endl;
+}
+
+void runOcclusionBenchmark(const HostScene& scene, uint32_t rayCount) {
+  if (!scene.valid()) {
+    std::cout << "Occlusion benchmark needs the host copies of the scene geometry." << std::endl;
+    return;
+  }
+
+  // Root of the tree that traversal starts in.
+  const GPUBVHNode& root = scene.flattened ? scene.meshBVHNodes[0] : scene.objectBVHNodes[0];
+  BVHBounds sceneBounds;
+  sceneBounds.grow(root.minCorner);
+  sceneBounds.grow(root.maxCorner);
+
+  std::vector<SceneRay> rays;
+  rays.reserve(rayCount);
+  for (const auto& ray : generateRays(sceneBounds, rayCount)) {
+    rays.push_back({ray.origin, ray.direction});
+  }
+
+  std::vector<bool> closestHits(rays.size());
+  auto traceStart = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0u; i < rays.size(); i++) {
+    SceneHit hit;
+    closestHits[i] = intersect(scene, rays[i], std::numeric_limits<float>::infinity(), hit);
+  }
+  auto closestTime = std::chrono::high_resolution_clock::now() - traceStart;
+
+  std::vector<bool> anyHits(rays.size());
+  traceStart = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0u; i < rays.size(); i++) {
+    anyHits[i] = occluded(scene, rays[i]);
+  }
+  auto occludedTime = std::chrono::high_resolution_clock::now() - traceStart;
+
+  const double closestRate = rays.size() / std::max(std::chrono::duration<double>(closestTime).count(), 1e-9);
+  const double occludedRate = rays.size() / std::max(std::chrono::duration<double>(occludedTime).count(), 1e-9);
+  const size_t occludedCount = std::count(anyHits.begin(), anyHits.end(), true);
+
+  std::cout << "Occlusion benchmark (" << rays.size() << " rays): closest hit " << std::fixed << std::setprecision(3)
+            << closestRate / 1e6 << " Mrays/s, occluded " << occludedRate / 1e6 << " Mrays/s ("
+            << std::setprecision(1) << 100.0 * occludedCount / std::max<size_t>(rays.size(), 1u) << "% occluded"
+            << (anyHits != closestHits ? ", queries disagree" : "") << ")" << std::defaultfloat << std::endl;
+
+  // Batches are split over all hardware threads.
+  traceStart = std::chrono::high_resolution_clock::now();
+  std::vector<SceneHit> batchHits = intersect(scene, rays);
+  auto batchClosestTime = std::chrono::high_resolution_clock::now() - traceStart;
+
+  traceStart = std::chrono::high_resolution_clock::now();
+  std::vector<uint8_t> batchOcclusion = occluded(scene, rays);
+  auto batchOccludedTime = std::chrono::high_resolution_clock::now() - traceStart;
+
+  bool batchesAgree = true;
+  for (size_t i = 0u; i < rays.size(); i++) {
+    batchesAgree &= (batchHits[i].distance != std::numeric_limits<float>::infinity()) == closestHits[i];
+    batchesAgree &= (batchOcclusion[i] != 0u) == anyHits[i];
+  }
+
+  const double batchClosestRate = rays.size() / std::max(std::chrono::duration<double>(batchClosestTime).count(), 1e-9);
+  const double batchOccludedRate =
+    rays.size() / std::max(std::chrono::duration<double>(batchOccludedTime).count(), 1e-9);
+
+  std::cout << "  Batched on " << std::max(std::thread::hardware_concurrency(), 1u) << " threads: closest hit "
+            << std::fixed << std::setprecision(3) << batchClosestRate / 1e6 << " Mrays/s, occluded "
+            << batchOccludedRate / 1e6 << " Mrays/s" << (batchesAgree ? "" : ", batches disagree")
+            << ". Single query latency: closest hit " << std::setprecision(2) << 1e6 / closestRate << " us, occluded "
+            << 1e6 / occludedRate << " us." << std::defaultfloat << std::endl;
+}
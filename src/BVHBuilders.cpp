@@ -0,0 +1,485 @@
+#include "BVHBuilders.hpp"
+#include <algorithm>
+#include <array>
+#include <future>
+#include <thread>
+
+namespace {
+
+// Subtrees with fewer primitives are not worth a thread.
+constexpr uint32_t kParallelMinPrimitives = 16384u;
+constexpr uint32_t kMaxBinCount = 64u;
+// Centroid extent below which an axis is not split.
+constexpr float kMinExtent = 1e-12f;
+
+struct BuildNode {
+  BVHBounds bounds;
+  // Children (inner node) or primitive range [first, last) (leaf).
+  uint32_t first = 0u;
+  uint32_t last = 0u;
+  bool isLeaf = false;
+};
+
+struct PrimitiveReference {
+  BVHBounds bounds;
+  glm::vec3 centroid;
+  uint32_t index;
+};
+
+uint32_t parallelDepth() {
+  uint32_t depth = 0u;
+  for (uint32_t threads = std::max(std::thread::hardware_concurrency(), 1u); threads > 1u; threads >>= 1u) {
+    depth++;
+  }
+  return depth;
+}
+
+BVH finalize(const std::vector<BuildNode>& buildNodes, std::vector<uint32_t>&& primitiveIndices) {
+  BVH bvh;
+  bvh.nodes.reserve(buildNodes.size());
+  for (const auto& node : buildNodes) {
+    bvh.nodes.emplace_back(packBVHNode(node.bounds.min, node.bounds.max, node.isLeaf, {node.first, node.last}));
+  }
+  bvh.primitiveIndices = std::move(primitiveIndices);
+  bvh.bounds = buildNodes.front().bounds;
+  return bvh;
+}
+
+/**
+ * Appends the nodes built by another thread. Their child indices are relative to the start of the vector.
+ */
+uint32_t appendSubtree(std::vector<BuildNode>& nodes, const std::vector<BuildNode>& subtree) {
+  const auto offset = static_cast<uint32_t>(nodes.size());
+  for (BuildNode node : subtree) {
+    if (!node.isLeaf) {
+      node.first += offset;
+      node.last += offset;
+    }
+    nodes.emplace_back(node);
+  }
+  return offset;
+}
+
+class BinnedSAHBuilder {
+ public:
+  BinnedSAHBuilder(const std::vector<BVHBounds>& primitiveBounds, const BVHBuildConfiguration& configuration)
+    : binCount_(std::clamp(configuration.sahBinCount, 2u, kMaxBinCount)),
+      maxLeafSize_(std::max(configuration.maxLeafSize, 1u)) {
+    references_.reserve(primitiveBounds.size());
+    for (uint32_t i = 0u; i < primitiveBounds.size(); i++) {
+      references_.push_back({primitiveBounds[i], primitiveBounds[i].centroid(), i});
+    }
+  }
+
+  BVH build() {
+    std::vector<BuildNode> nodes;
+    nodes.reserve(2u * references_.size());
+    buildNode(0u, references_.size(), nodes, parallelDepth());
+
+    std::vector<uint32_t> primitiveIndices;
+    primitiveIndices.reserve(references_.size());
+    for (const auto& reference : references_) {
+      primitiveIndices.emplace_back(reference.index);
+    }
+
+    return finalize(nodes, std::move(primitiveIndices));
+  }
+
+ private:
+  uint32_t buildNode(uint32_t begin, uint32_t end, std::vector<BuildNode>& nodes, uint32_t remainingParallelDepth) {
+    const auto nodeIndex = static_cast<uint32_t>(nodes.size());
+    nodes.emplace_back();
+
+    BVHBounds bounds;
+    BVHBounds centroidBounds;
+    for (uint32_t i = begin; i < end; i++) {
+      bounds.grow(references_[i].bounds);
+      centroidBounds.grow(references_[i].centroid);
+    }
+    nodes[nodeIndex].bounds = bounds;
+
+    const uint32_t count = end - begin;
+    uint32_t mid = count > maxLeafSize_ ? begin + count / 2u : end;
+
+    if (count > 1u) {
+      // Small nodes do not need more bins than primitives.
+      const uint32_t binCount = std::min(binCount_, std::max(count, 2u));
+      float bestCost = std::numeric_limits<float>::max();
+      int32_t bestAxis = -1;
+      uint32_t bestBin = 0u;
+      findSplit(begin, end, binCount, centroidBounds, bestCost, bestAxis, bestBin);
+
+      // Split cost relative to the cost of intersecting all primitives in a leaf.
+      const float splitCost = 1.0f + bestCost / std::max(bounds.surfaceArea(), std::numeric_limits<float>::min());
+
+      if (bestAxis >= 0 && (count > maxLeafSize_ || splitCost < static_cast<float>(count))) {
+        const float axisMin = centroidBounds.min[bestAxis];
+        const float scale = binCount / std::max(centroidBounds.max[bestAxis] - axisMin, kMinExtent);
+        auto isLeft = [&](const PrimitiveReference& ref) {
+          return binIndex(ref.centroid[bestAxis], axisMin, scale, binCount) < bestBin;
+        };
+        auto splitIt = std::partition(references_.begin() + begin, references_.begin() + end, isLeft);
+        mid = static_cast<uint32_t>(splitIt - references_.begin());
+      }
+    }
+
+    // Leaf if small enough, otherwise a median split when all centroids coincide.
+    if (mid == begin || mid == end) {
+      if (count <= maxLeafSize_ || count <= 1u) {
+        nodes[nodeIndex].first = begin;
+        nodes[nodeIndex].last = end;
+        nodes[nodeIndex].isLeaf = true;
+        return nodeIndex;
+      }
+      mid = begin + count / 2u;
+    }
+
+    uint32_t left;
+    uint32_t right;
+
+    if (remainingParallelDepth > 0u && count >= kParallelMinPrimitives) {
+      auto leftFuture = std::async(std::launch::async, [&, begin, mid]() {
+        std::vector<BuildNode> subtree;
+        buildNode(begin, mid, subtree, remainingParallelDepth - 1u);
+        return subtree;
+      });
+      right = buildNode(mid, end, nodes, remainingParallelDepth - 1u);
+      left = appendSubtree(nodes, leftFuture.get());
+    } else {
+      left = buildNode(begin, mid, nodes, 0u);
+      right = buildNode(mid, end, nodes, 0u);
+    }
+
+    nodes[nodeIndex].first = left;
+    nodes[nodeIndex].last = right;
+    return nodeIndex;
+  }
+
+  void findSplit(uint32_t begin, uint32_t end, uint32_t binCount, const BVHBounds& centroidBounds, float& bestCost,
+                 int32_t& bestAxis, uint32_t& bestBin) const {
+    std::array<std::array<BVHBounds, kMaxBinCount>, 3> binBounds;
+    std::array<std::array<uint32_t, kMaxBinCount>, 3> binCounts;
+    std::array<float, kMaxBinCount> rightCosts;
+
+    for (int32_t axis = 0; axis < 3; axis++) {
+      std::fill_n(binBounds[axis].begin(), binCount, BVHBounds());
+      std::fill_n(binCounts[axis].begin(), binCount, 0u);
+    }
+
+    const glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+    const glm::vec3 scale = glm::vec3(static_cast<float>(binCount)) / glm::max(extent, glm::vec3(kMinExtent));
+
+    // All axes are binned in a single pass over the primitives.
+    for (uint32_t i = begin; i < end; i++) {
+      const PrimitiveReference& reference = references_[i];
+
+      for (int32_t axis = 0; axis < 3; axis++) {
+        uint32_t bin = binIndex(reference.centroid[axis], centroidBounds.min[axis], scale[axis], binCount);
+        binBounds[axis][bin].grow(reference.bounds);
+        binCounts[axis][bin]++;
+      }
+    }
+
+    for (int32_t axis = 0; axis < 3; axis++) {
+      if (extent[axis] <= kMinExtent) {
+        continue;
+      }
+
+      // Sweep from the right, then evaluate the split in front of each bin from the left.
+      BVHBounds accumulated;
+      uint32_t accumulatedCount = 0u;
+      for (uint32_t bin = binCount - 1u; bin > 0u; bin--) {
+        accumulated.grow(binBounds[axis][bin]);
+        accumulatedCount += binCounts[axis][bin];
+        rightCosts[bin] = accumulated.surfaceArea() * static_cast<float>(accumulatedCount);
+      }
+
+      accumulated = BVHBounds();
+      accumulatedCount = 0u;
+      for (uint32_t bin = 1u; bin < binCount; bin++) {
+        accumulated.grow(binBounds[axis][bin - 1u]);
+        accumulatedCount += binCounts[axis][bin - 1u];
+
+        if (accumulatedCount == 0u || accumulatedCount == end - begin) {
+          continue;
+        }
+
+        float cost = accumulated.surfaceArea() * static_cast<float>(accumulatedCount) + rightCosts[bin];
+        if (cost < bestCost) {
+          bestCost = cost;
+          bestAxis = axis;
+          bestBin = bin;
+        }
+      }
+    }
+  }
+
+  static uint32_t binIndex(float centroid, float axisMin, float scale, uint32_t binCount) {
+    return std::min(static_cast<uint32_t>((centroid - axisMin) * scale), binCount - 1u);
+  }
+
+  // Partitioned in place, so that the primitives of a node are contiguous in memory.
+  std::vector<PrimitiveReference> references_;
+  uint32_t binCount_;
+  uint32_t maxLeafSize_;
+};
+
+uint32_t expandBits(uint32_t value) {
+  value = (value * 0x00010001u) & 0xFF0000FFu;
+  value = (value * 0x00000101u) & 0x0F00F00Fu;
+  value = (value * 0x00000011u) & 0xC30C30C3u;
+  value = (value * 0x00000005u) & 0x49249249u;
+  return value;
+}
+
+uint32_t countLeadingZeros(uint32_t value) {
+  uint32_t count = 0u;
+  for (uint32_t bit = 0x80000000u; bit != 0u && (value & bit) == 0u; bit >>= 1u) {
+    count++;
+  }
+  return count;
+}
+
+class LBVHBuilder {
+ public:
+  LBVHBuilder(const std::vector<BVHBounds>& primitiveBounds, const BVHBuildConfiguration& configuration)
+    : primitiveBounds_(primitiveBounds), maxLeafSize_(std::max(configuration.maxLeafSize, 1u)) {}
+
+  BVH build() {
+    BVHBounds centroidBounds;
+    for (const auto& bounds : primitiveBounds_) {
+      centroidBounds.grow(bounds.centroid());
+    }
+
+    // 10 bits per axis of the centroid position within the centroid bounds.
+    const glm::vec3 extent = glm::max(centroidBounds.max - centroidBounds.min, glm::vec3(kMinExtent));
+    std::vector<std::pair<uint32_t, uint32_t>> sorted(primitiveBounds_.size());
+    for (uint32_t i = 0u; i < primitiveBounds_.size(); i++) {
+      glm::vec3 position = glm::clamp((primitiveBounds_[i].centroid() - centroidBounds.min) / extent, 0.0f, 1.0f);
+      glm::uvec3 cell = glm::uvec3(position * 1023.0f);
+      sorted[i] = {(expandBits(cell.x) << 2u) | (expandBits(cell.y) << 1u) | expandBits(cell.z), i};
+    }
+    std::sort(sorted.begin(), sorted.end());
+
+    codes_.reserve(sorted.size());
+    std::vector<uint32_t> primitiveIndices;
+    primitiveIndices.reserve(sorted.size());
+    for (const auto& [code, index] : sorted) {
+      codes_.emplace_back(code);
+      primitiveIndices.emplace_back(index);
+    }
+    primitiveIndices_ = &primitiveIndices;
+
+    std::vector<BuildNode> nodes;
+    nodes.reserve(2u * primitiveIndices.size());
+    buildNode(0u, primitiveIndices.size(), nodes);
+    return finalize(nodes, std::move(primitiveIndices));
+  }
+
+ private:
+  uint32_t buildNode(uint32_t begin, uint32_t end, std::vector<BuildNode>& nodes) {
+    const auto nodeIndex = static_cast<uint32_t>(nodes.size());
+    nodes.emplace_back();
+
+    if (end - begin <= maxLeafSize_) {
+      for (uint32_t i = begin; i < end; i++) {
+        nodes[nodeIndex].bounds.grow(primitiveBounds_[(*primitiveIndices_)[i]]);
+      }
+      nodes[nodeIndex].first = begin;
+      nodes[nodeIndex].last = end;
+      nodes[nodeIndex].isLeaf = true;
+      return nodeIndex;
+    }
+
+    const uint32_t mid = findSplit(begin, end);
+    const uint32_t left = buildNode(begin, mid, nodes);
+    const uint32_t right = buildNode(mid, end, nodes);
+
+    nodes[nodeIndex].bounds.grow(nodes[left].bounds);
+    nodes[nodeIndex].bounds.grow(nodes[right].bounds);
+    nodes[nodeIndex].first = left;
+    nodes[nodeIndex].last = right;
+    return nodeIndex;
+  }
+
+  /**
+   * First index of the range whose code has the highest differing bit set. Median if all codes are equal.
+   */
+  uint32_t findSplit(uint32_t begin, uint32_t end) const {
+    const uint32_t firstCode = codes_[begin];
+    const uint32_t lastCode = codes_[end - 1u];
+
+    if (firstCode == lastCode) {
+      return begin + (end - begin) / 2u;
+    }
+
+    const uint32_t commonPrefix = countLeadingZeros(firstCode ^ lastCode);
+
+    // Binary search for the last code that shares more than commonPrefix bits with the first.
+    uint32_t split = begin;
+    uint32_t step = end - 1u - begin;
+    do {
+      step = (step + 1u) / 2u;
+      uint32_t candidate = split + step;
+
+      if (candidate < end - 1u && countLeadingZeros(firstCode ^ codes_[candidate]) > commonPrefix) {
+        split = candidate;
+      }
+    } while (step > 1u);
+
+    return split + 1u;
+  }
+
+  const std::vector<BVHBounds>& primitiveBounds_;
+  std::vector<uint32_t> codes_;
+  const std::vector<uint32_t>* primitiveIndices_ = nullptr;
+  uint32_t maxLeafSize_;
+};
+
+} // namespace
+
+void BVHBounds::grow(const glm::vec3& point) {
+  min = glm::min(min, point);
+  max = glm::max(max, point);
+}
+
+void BVHBounds::grow(const BVHBounds& bounds) {
+  min = glm::min(min, bounds.min);
+  max = glm::max(max, bounds.max);
+}
+
+bool BVHBounds::empty() const {
+  return min.x > max.x || min.y > max.y || min.z > max.z;
+}
+
+glm::vec3 BVHBounds::centroid() const {
+  return (min + max) * 0.5f;
+}
+
+float BVHBounds::surfaceArea() const {
+  if (empty()) {
+    return 0.0f;
+  }
+
+  glm::vec3 extent = max - min;
+  return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+BVHBounds BVHBounds::transform(const glm::mat4& matrix) const {
+  BVHBounds transformed;
+
+  for (uint32_t corner = 0u; corner < 8u; corner++) {
+    glm::vec3 point((corner & 1u) ? max.x : min.x, (corner & 2u) ? max.y : min.y, (corner & 4u) ? max.z : min.z);
+    transformed.grow(glm::vec3(matrix * glm::vec4(point, 1.0f)));
+  }
+
+  return transformed;
+}
+
+const char* toString(BVHBuilderType type) {
+  switch (type) {
+    case BVHBuilderType::eAuto:
+      return "auto";
+    case BVHBuilderType::eSplit:
+      return "split";
+    case BVHBuilderType::eBinnedSAH:
+      return "binned SAH";
+    case BVHBuilderType::eLBVH:
+      return "LBVH";
+  }
+  return "unknown";
+}
+
+BVHBuilderType selectMeshBuilder(const BVHBuildConfiguration& configuration, size_t triangleCount) {
+  if (configuration.meshBuilder != BVHBuilderType::eAuto) {
+    return configuration.meshBuilder;
+  }
+
+  if (triangleCount <= configuration.splitMaxTriangles) {
+    return BVHBuilderType::eSplit;
+  }
+
+  return triangleCount >= configuration.lbvhMinTriangles ? BVHBuilderType::eLBVH : BVHBuilderType::eBinnedSAH;
+}
+
+BVH buildMeshBVH(const lsg::Ref<lsg::Geometry>& geometry, BVHBuilderType type,
+                 const BVHBuildConfiguration& configuration) {
+  auto positionAccessor = geometry->getTrianglePositionAccessor();
+
+  if (type == BVHBuilderType::eAuto) {
+    type = selectMeshBuilder(configuration, positionAccessor->count());
+  }
+
+  if (type == BVHBuilderType::eSplit) {
+    lsg::bvh::SplitBVHBuilder<float> builder;
+    auto lsgBVH = builder.process(positionAccessor);
+
+    BVH bvh;
+    bvh.nodes.reserve(lsgBVH->getNodes().size());
+    for (const auto& node : lsgBVH->getNodes()) {
+      bvh.nodes.emplace_back(packBVHNode(node.bounds.min(), node.bounds.max(), node.is_leaf, node.child_indices));
+    }
+    bvh.primitiveIndices = lsgBVH->getPrimitiveIndices();
+    bvh.bounds.grow(lsgBVH->getBounds().min());
+    bvh.bounds.grow(lsgBVH->getBounds().max());
+    return bvh;
+  }
+
+  std::vector<BVHBounds> triangleBounds(positionAccessor->count());
+  for (size_t i = 0u; i < triangleBounds.size(); i++) {
+    lsg::Triangle<glm::vec3> triangle = (*positionAccessor)[i];
+    triangleBounds[i].grow(triangle.a());
+    triangleBounds[i].grow(triangle.b());
+    triangleBounds[i].grow(triangle.c());
+  }
+
+  return buildBVH(triangleBounds, type, configuration);
+}
+
+BVH buildBVH(const std::vector<BVHBounds>& primitiveBounds, BVHBuilderType type,
+             const BVHBuildConfiguration& configuration) {
+  if (primitiveBounds.empty()) {
+    // Single empty leaf.
+    BVH bvh;
+    bvh.nodes.emplace_back(packBVHNode(glm::vec3(0.0f), glm::vec3(0.0f), true, {0u, 0u}));
+    return bvh;
+  }
+
+  if (type == BVHBuilderType::eLBVH) {
+    return LBVHBuilder(primitiveBounds, configuration).build();
+  }
+
+  return BinnedSAHBuilder(primitiveBounds, configuration).build();
+}
+
+float computeSAHCost(const std::vector<GPUBVHNode>& nodes, float traversalCost, float intersectionCost) {
+  return computeSAHCost(nodes.data(), nodes.size(), traversalCost, intersectionCost);
+}
+
+float computeSAHCost(const GPUBVHNode* nodes, size_t nodeCount, float traversalCost, float intersectionCost) {
+  if (nodeCount == 0u) {
+    return 0.0f;
+  }
+
+  auto surfaceArea = [](const GPUBVHNode& node) {
+    BVHBounds bounds;
+    bounds.grow(node.minCorner);
+    bounds.grow(node.maxCorner);
+    return bounds.surfaceArea();
+  };
+
+  const float rootArea = surfaceArea(nodes[0]);
+  if (rootArea <= 0.0f) {
+    return 0.0f;
+  }
+
+  float cost = 0.0f;
+  for (size_t i = 0u; i < nodeCount; i++) {
+    const GPUBVHNode& node = nodes[i];
+    glm::uvec2 indices = nodeIndices(node);
+    float nodeCost = isLeaf(node) ? intersectionCost * (indices.y - indices.x) : traversalCost;
+    cost += nodeCost * surfaceArea(node) / rootArea;
+  }
+
+  return cost;
+}
@@ -0,0 +1,566 @@
+#include "GLTFBuffers.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+constexpr uint32_t kComponentUnsignedByte = 5121u;
+constexpr uint32_t kComponentUnsignedShort = 5123u;
+constexpr uint32_t kComponentUnsignedInt = 5125u;
+constexpr uint32_t kComponentFloat = 5126u;
+constexpr uint32_t kModeTriangles = 4u;
+
+constexpr uint32_t kGLBMagic = 0x46546C67u;
+constexpr uint32_t kGLBChunkJSON = 0x4E4F534Au;
+constexpr uint32_t kGLBChunkBIN = 0x004E4942u;
+
+/**
+ * Parsed JSON value. Objects keep their members in document order.
+ */
+struct JsonValue {
+  enum class Type { eNull, eBool, eNumber, eString, eArray, eObject };
+
+  Type type = Type::eNull;
+  bool boolean = false;
+  double number = 0.0;
+  std::string string;
+  std::vector<JsonValue> array;
+  std::vector<std::pair<std::string, JsonValue>> object;
+
+  const JsonValue* find(const std::string& key) const {
+    for (const auto& [name, value] : object) {
+      if (name == key) {
+        return &value;
+      }
+    }
+    return nullptr;
+  }
+
+  const std::vector<JsonValue>& elements(const std::string& key) const {
+    static const std::vector<JsonValue> kEmpty;
+    const JsonValue* value = find(key);
+    return value && value->type == Type::eArray ? value->array : kEmpty;
+  }
+
+  size_t integer(const std::string& key, size_t fallback) const {
+    const JsonValue* value = find(key);
+    return value && value->type == Type::eNumber && value->number >= 0.0 ? static_cast<size_t>(value->number)
+                                                                         : fallback;
+  }
+
+  std::string text(const std::string& key) const {
+    const JsonValue* value = find(key);
+    return value && value->type == Type::eString ? value->string : std::string();
+  }
+};
+
+/**
+ * Recursive descent parser of RFC 8259 JSON. Throws std::runtime_error on malformed input.
+ */
+class JsonParser {
+ public:
+  JsonParser(const char* begin, const char* end) : current_(begin), end_(end) {}
+
+  JsonValue parseDocument() {
+    JsonValue value = parseValue();
+    skipWhitespace();
+    if (current_ != end_) {
+      fail("trailing characters");
+    }
+    return value;
+  }
+
+ private:
+  [[noreturn]] void fail(const char* what) const {
+    throw std::runtime_error(std::string("Invalid glTF JSON: ") + what + ".");
+  }
+
+  void skipWhitespace() {
+    while (current_ != end_ && (*current_ == ' ' || *current_ == '\t' || *current_ == '\n' || *current_ == '\r')) {
+      current_++;
+    }
+  }
+
+  char next() {
+    if (current_ == end_) {
+      fail("unexpected end");
+    }
+    return *current_++;
+  }
+
+  void expect(const char* literal) {
+    for (; *literal != '\0'; literal++) {
+      if (next() != *literal) {
+        fail("unexpected character");
+      }
+    }
+  }
+
+  JsonValue parseValue() {
+    skipWhitespace();
+    if (current_ == end_) {
+      fail("unexpected end");
+    }
+
+    JsonValue value;
+    switch (*current_) {
+      case '{':
+        value.type = JsonValue::Type::eObject;
+        current_++;
+        skipWhitespace();
+        if (current_ != end_ && *current_ == '}') {
+          current_++;
+          return value;
+        }
+        while (true) {
+          skipWhitespace();
+          std::string key = parseString();
+          skipWhitespace();
+          expect(":");
+          value.object.emplace_back(std::move(key), parseValue());
+          skipWhitespace();
+          const char separator = next();
+          if (separator == '}') {
+            return value;
+          }
+          if (separator != ',') {
+            fail("expected , or }");
+          }
+        }
+      case '[':
+        value.type = JsonValue::Type::eArray;
+        current_++;
+        skipWhitespace();
+        if (current_ != end_ && *current_ == ']') {
+          current_++;
+          return value;
+        }
+        while (true) {
+          value.array.emplace_back(parseValue());
+          skipWhitespace();
+          const char separator = next();
+          if (separator == ']') {
+            return value;
+          }
+          if (separator != ',') {
+            fail("expected , or ]");
+          }
+        }
+      case '"':
+        value.type = JsonValue::Type::eString;
+        value.string = parseString();
+        return value;
+      case 't':
+        expect("true");
+        value.type = JsonValue::Type::eBool;
+        value.boolean = true;
+        return value;
+      case 'f':
+        expect("false");
+        value.type = JsonValue::Type::eBool;
+        return value;
+      case 'n':
+        expect("null");
+        return value;
+      default:
+        value.type = JsonValue::Type::eNumber;
+        value.number = parseNumber();
+        return value;
+    }
+  }
+
+  double parseNumber() {
+    const char* start = current_;
+    while (current_ != end_ && *current_ != '\0' && std::strchr("+-0123456789.eE", *current_) != nullptr) {
+      current_++;
+    }
+
+    // strtod needs a terminated string.
+    const std::string token(start, current_);
+    char* parsedEnd = nullptr;
+    const double number = std::strtod(token.c_str(), &parsedEnd);
+    if (token.empty() || parsedEnd != token.c_str() + token.size()) {
+      fail("invalid number");
+    }
+    return number;
+  }
+
+  uint32_t parseHex4() {
+    uint32_t codePoint = 0u;
+    for (int i = 0; i < 4; i++) {
+      const char c = next();
+      codePoint <<= 4u;
+      if (c >= '0' && c <= '9') {
+        codePoint |= static_cast<uint32_t>(c - '0');
+      } else if (c >= 'a' && c <= 'f') {
+        codePoint |= static_cast<uint32_t>(c - 'a' + 10);
+      } else if (c >= 'A' && c <= 'F') {
+        codePoint |= static_cast<uint32_t>(c - 'A' + 10);
+      } else {
+        fail("invalid unicode escape");
+      }
+    }
+    return codePoint;
+  }
+
+  static void appendUTF8(std::string& string, uint32_t codePoint) {
+    if (codePoint < 0x80u) {
+      string += static_cast<char>(codePoint);
+    } else if (codePoint < 0x800u) {
+      string += static_cast<char>(0xC0u | (codePoint >> 6u));
+      string += static_cast<char>(0x80u | (codePoint & 0x3Fu));
+    } else if (codePoint < 0x10000u) {
+      string += static_cast<char>(0xE0u | (codePoint >> 12u));
+      string += static_cast<char>(0x80u | ((codePoint >> 6u) & 0x3Fu));
+      string += static_cast<char>(0x80u | (codePoint & 0x3Fu));
+    } else {
+      string += static_cast<char>(0xF0u | (codePoint >> 18u));
+      string += static_cast<char>(0x80u | ((codePoint >> 12u) & 0x3Fu));
+      string += static_cast<char>(0x80u | ((codePoint >> 6u) & 0x3Fu));
+      string += static_cast<char>(0x80u | (codePoint & 0x3Fu));
+    }
+  }
+
+  std::string parseString() {
+    expect("\"");
+
+    std::string string;
+    for (char c = next(); c != '"'; c = next()) {
+      if (c != '\\') {
+        string += c;
+        continue;
+      }
+
+      switch (next()) {
+        case '"':
+          string += '"';
+          break;
+        case '\\':
+          string += '\\';
+          break;
+        case '/':
+          string += '/';
+          break;
+        case 'b':
+          string += '\b';
+          break;
+        case 'f':
+          string += '\f';
+          break;
+        case 'n':
+          string += '\n';
+          break;
+        case 'r':
+          string += '\r';
+          break;
+        case 't':
+          string += '\t';
+          break;
+        case 'u': {
+          uint32_t codePoint = parseHex4();
+          // Characters outside the basic multilingual plane are escaped as surrogate pairs.
+          if (codePoint >= 0xD800u && codePoint < 0xDC00u) {
+            expect("\\u");
+            const uint32_t low = parseHex4();
+            if (low < 0xDC00u || low >= 0xE000u) {
+              fail("invalid surrogate pair");
+            }
+            codePoint = 0x10000u + ((codePoint - 0xD800u) << 10u) + (low - 0xDC00u);
+          }
+          appendUTF8(string, codePoint);
+          break;
+        }
+        default:
+          fail("invalid escape");
+      }
+    }
+
+    return string;
+  }
+
+  const char* current_;
+  const char* end_;
+};
+
+uint32_t readUint32(const std::byte* data) {
+  uint32_t value;
+  std::memcpy(&value, data, sizeof(uint32_t));
+  return value;
+}
+
+// URIs of external buffers are relative to the glTF file and may contain percent escapes.
+std::string resolveURI(const std::string& gltfPath, const std::string& uri) {
+  std::string path = gltfPath.substr(0u, gltfPath.find_last_of("/\\") + 1u);
+
+  for (size_t i = 0u; i < uri.size(); i++) {
+    if (uri[i] == '%' && i + 2u < uri.size()) {
+      path += static_cast<char>(std::strtol(uri.substr(i + 1u, 2u).c_str(), nullptr, 16));
+      i += 2u;
+    } else {
+      path += uri[i];
+    }
+  }
+
+  return path;
+}
+
+size_t componentSize(uint32_t componentType) {
+  switch (componentType) {
+    case 5120u:
+    case kComponentUnsignedByte:
+      return 1u;
+    case 5122u:
+    case kComponentUnsignedShort:
+      return 2u;
+    case kComponentUnsignedInt:
+    case kComponentFloat:
+      return 4u;
+    default:
+      return 0u;
+  }
+}
+
+uint32_t componentCount(const std::string& type) {
+  if (type == "SCALAR") {
+    return 1u;
+  }
+  if (type == "VEC2") {
+    return 2u;
+  }
+  if (type == "VEC3") {
+    return 3u;
+  }
+  if (type == "VEC4") {
+    return 4u;
+  }
+  return 0u;
+}
+
+/**
+ * Byte range of every buffer and its views, as far as they are mapped.
+ */
+struct MappedLayout {
+  std::vector<std::pair<const std::byte*, size_t>> buffers;
+  const std::vector<JsonValue>* bufferViews = nullptr;
+  const std::vector<JsonValue>* accessors = nullptr;
+};
+
+/**
+ * View of the accessor if it lies in a mapped buffer and its elements have the given component type and count. Sparse
+ * accessors are not supported.
+ */
+GLTFAccessorView mapAccessor(const MappedLayout& layout, size_t accessorIndex, uint32_t componentType,
+                             uint32_t components) {
+  if (accessorIndex >= layout.accessors->size()) {
+    return {};
+  }
+
+  const JsonValue& accessor = (*layout.accessors)[accessorIndex];
+  const size_t bufferViewIndex = accessor.integer("bufferView", layout.bufferViews->size());
+  if (accessor.find("sparse") || bufferViewIndex >= layout.bufferViews->size() ||
+      accessor.integer("componentType", 0u) != componentType || componentCount(accessor.text("type")) != components) {
+    return {};
+  }
+
+  const JsonValue& bufferView = (*layout.bufferViews)[bufferViewIndex];
+  const size_t bufferIndex = bufferView.integer("buffer", layout.buffers.size());
+  if (bufferIndex >= layout.buffers.size() || !layout.buffers[bufferIndex].first) {
+    return {};
+  }
+
+  GLTFAccessorView view;
+  view.componentType = componentType;
+  view.componentCount = components;
+  view.count = accessor.integer("count", 0u);
+
+  const size_t elementSize = componentSize(componentType) * components;
+  view.stride = bufferView.integer("byteStride", elementSize);
+
+  // Elements must lie within both the view and the mapped buffer.
+  const size_t viewOffset = bufferView.integer("byteOffset", 0u);
+  const size_t viewLength = bufferView.integer("byteLength", 0u);
+  const size_t accessorOffset = accessor.integer("byteOffset", 0u);
+  const size_t accessedBytes = view.count > 0u ? (view.count - 1u) * view.stride + elementSize : 0u;
+  if (view.stride < elementSize || accessorOffset + accessedBytes > viewLength ||
+      viewOffset + viewLength > layout.buffers[bufferIndex].second) {
+    return {};
+  }
+
+  view.data = layout.buffers[bufferIndex].first + viewOffset + accessorOffset;
+  return view;
+}
+
+bool samePosition(const glm::vec3& lhs, const glm::vec3& rhs) {
+  return std::memcmp(&lhs, &rhs, sizeof(glm::vec3)) == 0;
+}
+
+bool matches(const GLTFPrimitive& primitive, const lsg::Ref<lsg::Geometry>& geometry) {
+  if (!geometry->hasVertices() || !geometry->hasNormals() || geometry->hasUv(0u) != static_cast<bool>(primitive.uvs) ||
+      geometry->hasIndices() != static_cast<bool>(primitive.indices)) {
+    return false;
+  }
+
+  lsg::TBufferAccessor<glm::vec3> vertices = geometry->getVertices();
+  const size_t vertexCount = vertices.count();
+  if (vertexCount != primitive.positions.count || vertexCount == 0u ||
+      !samePosition(vertices[0], primitive.positions.get<glm::vec3>(0u)) ||
+      !samePosition(vertices[vertexCount - 1u], primitive.positions.get<glm::vec3>(vertexCount - 1u))) {
+    return false;
+  }
+
+  if (!primitive.indices) {
+    return true;
+  }
+
+  lsg::BufferAccessor indices = geometry->getIndices();
+  if (indices.count() != primitive.indices.count || indices.elementSize() != primitive.indices.stride) {
+    return false;
+  }
+
+  // Index buffers are tightly packed, so the whole range is compared.
+  const auto* data = reinterpret_cast<const std::byte*>(indices.bufferView().data()) + indices.byteOffset();
+  return std::memcmp(data, primitive.indices.data, indices.count() * indices.elementSize()) == 0;
+}
+
+} // namespace
+
+uint32_t GLTFAccessorView::index(size_t index) const {
+  switch (componentType) {
+    case kComponentUnsignedByte:
+      return get<uint8_t>(index);
+    case kComponentUnsignedShort:
+      return get<uint16_t>(index);
+    default:
+      return get<uint32_t>(index);
+  }
+}
+
+size_t GLTFPrimitive::triangleCount() const {
+  return (indices ? indices.count : positions.count) / 3u;
+}
+
+uint32_t GLTFPrimitive::vertex(size_t triangle, uint32_t corner) const {
+  const size_t element = triangle * 3u + corner;
+  return indices ? indices.index(element) : static_cast<uint32_t>(element);
+}
+
+GLTFBuffers::GLTFBuffers(const std::string& path) {
+  MappedFile& file = files_.emplace_back(path);
+  const std::byte* data = file.data();
+  const size_t size = file.size();
+
+  // A .glb holds the JSON chunk followed by the binary chunk, which is buffer 0.
+  const char* jsonBegin = reinterpret_cast<const char*>(data);
+  const char* jsonEnd = jsonBegin + size;
+  std::pair<const std::byte*, size_t> binaryChunk(nullptr, 0u);
+
+  if (size >= 20u && readUint32(data) == kGLBMagic) {
+    const size_t jsonLength = readUint32(data + 12u);
+    if (readUint32(data + 16u) != kGLBChunkJSON || 20u + jsonLength > size) {
+      throw std::runtime_error("Invalid glTF binary: " + path);
+    }
+    jsonBegin = reinterpret_cast<const char*>(data + 20u);
+    jsonEnd = jsonBegin + jsonLength;
+
+    const size_t binaryOffset = 20u + jsonLength;
+    if (binaryOffset + 8u <= size && readUint32(data + binaryOffset + 4u) == kGLBChunkBIN) {
+      const size_t binaryLength = readUint32(data + binaryOffset);
+      if (binaryOffset + 8u + binaryLength > size) {
+        throw std::runtime_error("Invalid glTF binary: " + path);
+      }
+      binaryChunk = {data + binaryOffset + 8u, binaryLength};
+    }
+  }
+
+  const JsonValue document = JsonParser(jsonBegin, jsonEnd).parseDocument();
+
+  MappedLayout layout;
+  layout.bufferViews = &document.elements("bufferViews");
+  layout.accessors = &document.elements("accessors");
+
+  for (const JsonValue& buffer : document.elements("buffers")) {
+    const std::string uri = buffer.text("uri");
+
+    if (uri.empty() && layout.buffers.empty() && binaryChunk.first) {
+      layout.buffers.emplace_back(binaryChunk);
+    } else if (!uri.empty() && uri.compare(0u, 5u, "data:") != 0) {
+      const MappedFile& bufferFile = files_.emplace_back(resolveURI(path, uri));
+      layout.buffers.emplace_back(bufferFile.data(), bufferFile.size());
+    } else {
+      layout.buffers.emplace_back(nullptr, 0u);
+    }
+  }
+
+  for (const JsonValue& mesh : document.elements("meshes")) {
+    for (const JsonValue& primitive : mesh.elements("primitives")) {
+      const JsonValue* attributes = primitive.find("attributes");
+      if (!attributes || primitive.integer("mode", kModeTriangles) != kModeTriangles) {
+        continue;
+      }
+
+      const size_t missing = layout.accessors->size();
+      GLTFPrimitive mapped;
+      mapped.positions = mapAccessor(layout, attributes->integer("POSITION", missing), kComponentFloat, 3u);
+      mapped.normals = mapAccessor(layout, attributes->integer("NORMAL", missing), kComponentFloat, 3u);
+
+      const size_t uvAccessor = attributes->integer("TEXCOORD_0", missing);
+      mapped.uvs = mapAccessor(layout, uvAccessor, kComponentFloat, 2u);
+
+      const size_t indexAccessor = primitive.integer("indices", missing);
+      for (uint32_t indexType : {kComponentUnsignedByte, kComponentUnsignedShort, kComponentUnsignedInt}) {
+        if (!mapped.indices) {
+          mapped.indices = mapAccessor(layout, indexAccessor, indexType, 1u);
+        }
+      }
+
+      // Quantized or unmapped attributes are left to the scene graph.
+      if (!mapped.positions || !mapped.normals || mapped.normals.count != mapped.positions.count ||
+          (uvAccessor != missing && (!mapped.uvs || mapped.uvs.count != mapped.positions.count)) ||
+          (indexAccessor != missing && !mapped.indices)) {
+        continue;
+      }
+
+      primitives_.emplace_back(mapped);
+    }
+  }
+}
+
+GLTFBuffers GLTFBuffers::tryMap(const std::string& path) {
+  try {
+    return GLTFBuffers(path);
+  } catch (const std::runtime_error& error) {
+    std::cout << error.what() << " Geometry is read from the scene graph." << std::endl;
+    return GLTFBuffers();
+  }
+}
+
+const GLTFPrimitive* GLTFBuffers::find(const lsg::Ref<lsg::SubMesh>& submesh) const {
+  const lsg::Ref<lsg::Geometry> geometry = submesh->geometry();
+  if (!geometry) {
+    return nullptr;
+  }
+
+  for (size_t i = 0u; i < primitives_.size(); i++) {
+    const size_t candidate = (cursor_ + i) % primitives_.size();
+    if (matches(primitives_[candidate], geometry)) {
+      cursor_ = candidate + 1u;
+      return &primitives_[candidate];
+    }
+  }
+
+  return nullptr;
+}
+
+size_t GLTFBuffers::mappedBytes() const {
+  size_t bytes = 0u;
+  for (const auto& file : files_) {
+    bytes += file.size();
+  }
+  return bytes;
+}
+
+GLTFBuffers::operator bool() const {
+  return !primitives_.empty();
+}
@@ -0,0 +1,83 @@
+#include "GPUTimer.hpp"
+#include <iostream>
+
+GPUTimer::GPUTimer(const logi::PhysicalDevice& physicalDevice, const logi::LogicalDevice& logicalDevice,
+                   uint32_t scopeCount)
+  : timestamps_(2u * scopeCount), milliseconds_(scopeCount, 0.0) {
+  const vk::PhysicalDeviceLimits limits = physicalDevice.getProperties().limits;
+
+  // Timer silently records nothing if the device can not timestamp graphics and compute queues.
+  if (!limits.timestampComputeAndGraphics) {
+    std::cout << "Timestamp queries are not supported. GPU timings will not be available." << std::endl;
+    return;
+  }
+
+  timestampPeriod_ = limits.timestampPeriod;
+
+  vk::QueryPoolCreateInfo queryPoolInfo;
+  queryPoolInfo.queryType = vk::QueryType::eTimestamp;
+  queryPoolInfo.queryCount = timestamps_.size();
+
+  queryPool_ = logicalDevice.createQueryPool(queryPoolInfo);
+}
+
+void GPUTimer::recordReset(const logi::CommandBuffer& cmdBuffer) const {
+  if (queryPool_) {
+    cmdBuffer.resetQueryPool(queryPool_, 0u, timestamps_.size());
+  }
+}
+
+void GPUTimer::recordReset(const logi::CommandBuffer& cmdBuffer, uint32_t scope) const {
+  if (queryPool_) {
+    cmdBuffer.resetQueryPool(queryPool_, 2u * scope, 2u);
+  }
+}
+
+void GPUTimer::recordBegin(const logi::CommandBuffer& cmdBuffer, uint32_t scope,
+                           vk::PipelineStageFlagBits stage) const {
+  if (queryPool_) {
+    cmdBuffer.writeTimestamp(stage, queryPool_, 2u * scope);
+  }
+}
+
+void GPUTimer::recordEnd(const logi::CommandBuffer& cmdBuffer, uint32_t scope, vk::PipelineStageFlagBits stage) const {
+  if (queryPool_) {
+    cmdBuffer.writeTimestamp(stage, queryPool_, 2u * scope + 1u);
+  }
+}
+
+bool GPUTimer::fetchResults() {
+  if (!queryPool_) {
+    return false;
+  }
+
+  bool available = false;
+
+  // Scopes are fetched separately so that scopes which are not recorded (e.g. disabled passes) do not block the rest.
+  for (uint32_t scope = 0; scope < milliseconds_.size(); scope++) {
+    uint64_t* scopeTimestamps = &timestamps_[2u * scope];
+    vk::Result result = queryPool_.getResults(2u * scope, 2u, 2u * sizeof(uint64_t), scopeTimestamps,
+                                              sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+
+    if (result == vk::Result::eSuccess) {
+      milliseconds_[scope] = (scopeTimestamps[1] - scopeTimestamps[0]) * timestampPeriod_ / 1e6;
+      available = true;
+    }
+  }
+
+  return available;
+}
+
+double GPUTimer::getMilliseconds(uint32_t scope) const {
+  return milliseconds_[scope];
+}
+
+bool GPUTimer::isSupported() const {
+  return static_cast<bool>(queryPool_);
+}
+
+void GPUTimer::destroy() {
+  if (queryPool_) {
+    queryPool_.destroy();
+  }
+}
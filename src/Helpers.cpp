@@ -1,3 +1,166 @@
 //
 // Created by primoz on 25. 08. 19.
 //
+
+#include "Helpers.hpp"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <fstream>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+GPUTexture uploadTexture(const logi::MemoryAllocator& allocator, const logi::CommandPool& commandPool,
+                         const logi::Queue& queue, const void* data, uint64_t byteSize, uint32_t width,
+                         uint32_t height, vk::Format format) {
+  GPUTexture gpuTexture;
+
+  logi::CommandBuffer cmdBuffer = commandPool.allocateCommandBuffer(vk::CommandBufferLevel::ePrimary);
+  cmdBuffer.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+
+  // Allocate staging buffer.
+  VmaAllocationCreateInfo stagingBufferAllocationInfo = {};
+  stagingBufferAllocationInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_CPU_TO_GPU;
+
+  vk::BufferCreateInfo stagingBufferInfo;
+  stagingBufferInfo.size = byteSize;
+  stagingBufferInfo.usage = vk::BufferUsageFlagBits::eTransferSrc;
+  stagingBufferInfo.sharingMode = vk::SharingMode::eExclusive;
+
+  logi::VMABuffer stagingBuffer = allocator.createBuffer(stagingBufferInfo, stagingBufferAllocationInfo);
+  stagingBuffer.writeToBuffer(data, byteSize);
+
+  // Allocate dedicated GPU image.
+  VmaAllocationCreateInfo gpuImageAllocationInfo = {};
+  gpuImageAllocationInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_GPU_ONLY;
+
+  vk::ImageCreateInfo imageInfo;
+  imageInfo.imageType = vk::ImageType::e2D;
+  imageInfo.extent.width = width;
+  imageInfo.extent.height = height;
+  imageInfo.extent.depth = 1;
+  imageInfo.mipLevels = 1;
+  imageInfo.arrayLayers = 1;
+  imageInfo.format = format;
+  imageInfo.tiling = vk::ImageTiling::eOptimal;
+  imageInfo.initialLayout = vk::ImageLayout::eUndefined;
+  imageInfo.usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst;
+  imageInfo.samples = vk::SampleCountFlagBits::e1;
+  imageInfo.sharingMode = vk::SharingMode::eExclusive;
+
+  gpuTexture.image = allocator.createImage(imageInfo, gpuImageAllocationInfo);
+
+  // Transition to DST optimal
+  vk::ImageMemoryBarrier barrierDstOptimal;
+  barrierDstOptimal.oldLayout = vk::ImageLayout::eUndefined;
+  barrierDstOptimal.newLayout = vk::ImageLayout::eTransferDstOptimal;
+  barrierDstOptimal.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrierDstOptimal.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrierDstOptimal.image = gpuTexture.image;
+  barrierDstOptimal.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+  barrierDstOptimal.subresourceRange.baseMipLevel = 0;
+  barrierDstOptimal.subresourceRange.levelCount = 1;
+  barrierDstOptimal.subresourceRange.baseArrayLayer = 0;
+  barrierDstOptimal.subresourceRange.layerCount = 1;
+  barrierDstOptimal.srcAccessMask = {};
+  barrierDstOptimal.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+
+  cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, {}, {},
+                            barrierDstOptimal);
+
+  // Copy data to texture
+  vk::BufferImageCopy region = {};
+  region.bufferOffset = 0;
+  region.bufferRowLength = 0;
+  region.bufferImageHeight = 0;
+  region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+  region.imageSubresource.mipLevel = 0;
+  region.imageSubresource.baseArrayLayer = 0;
+  region.imageSubresource.layerCount = 1;
+  region.imageOffset = vk::Offset3D();
+  region.imageExtent = vk::Extent3D{width, height, 1};
+
+  cmdBuffer.copyBufferToImage(stagingBuffer, gpuTexture.image, vk::ImageLayout::eTransferDstOptimal, region);
+
+  // Transition to DST optimal
+  vk::ImageMemoryBarrier barrierShaderReadOptimal;
+  barrierShaderReadOptimal.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+  barrierShaderReadOptimal.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+  barrierShaderReadOptimal.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrierShaderReadOptimal.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrierShaderReadOptimal.image = gpuTexture.image;
+  barrierShaderReadOptimal.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+  barrierShaderReadOptimal.subresourceRange.baseMipLevel = 0;
+  barrierShaderReadOptimal.subresourceRange.levelCount = 1;
+  barrierShaderReadOptimal.subresourceRange.baseArrayLayer = 0;
+  barrierShaderReadOptimal.subresourceRange.layerCount = 1;
+  barrierShaderReadOptimal.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+  barrierShaderReadOptimal.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+
+  cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, {}, {},
+                            barrierShaderReadOptimal);
+
+  cmdBuffer.end();
+
+  vk::SubmitInfo submit_info;
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &static_cast<const vk::CommandBuffer&>(cmdBuffer);
+  queue.submit({submit_info});
+  queue.waitIdle();
+
+  stagingBuffer.destroy();
+  cmdBuffer.destroy();
+
+  // Create image view.
+  gpuTexture.imageView =
+    gpuTexture.image.createImageView(vk::ImageViewCreateFlags(), vk::ImageViewType::e2D, format, vk::ComponentMapping(),
+                                     vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
+
+  return gpuTexture;
+}
+
+size_t getPeakResidentSetSize() {
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+    return counters.PeakWorkingSetSize;
+  }
+  return 0u;
+#else
+  rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0u;
+  }
+#if defined(__APPLE__)
+  // Reported in bytes on macOS and in kilobytes elsewhere.
+  return static_cast<size_t>(usage.ru_maxrss);
+#else
+  return static_cast<size_t>(usage.ru_maxrss) * 1024u;
+#endif
+#endif
+}
+
+size_t getCurrentResidentSetSize() {
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+    return counters.WorkingSetSize;
+  }
+  return 0u;
+#elif defined(__linux__)
+  // Second field of statm is the number of resident pages.
+  std::ifstream statm("/proc/self/statm");
+  size_t totalPages = 0u;
+  size_t residentPages = 0u;
+  if (!(statm >> totalPages >> residentPages)) {
+    return 0u;
+  }
+  return residentPages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#else
+  return 0u;
+#endif
+}
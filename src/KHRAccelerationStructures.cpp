@@ -0,0 +1,301 @@
+#include "KHRAccelerationStructures.hpp"
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+
+namespace {
+
+// objectToWorld is stored as rows, the same layout as VkTransformMatrixKHR (see packAffine).
+constexpr vk::DeviceSize kTransformSize = sizeof(vk::TransformMatrixKHR);
+static_assert(offsetof(GPUObjectData, objectToWorld) == 0u && sizeof(GPUObjectData::objectToWorld) == kTransformSize);
+
+vk::DeviceAddress alignAddress(vk::DeviceAddress address, vk::DeviceSize alignment) {
+  return (address + alignment - 1u) / alignment * alignment;
+}
+
+} // namespace
+
+KHRAccelerationStructures::KHRAccelerationStructures(const logi::PhysicalDevice& physicalDevice,
+                                                     const logi::LogicalDevice& logicalDevice)
+  : physicalDevice_(physicalDevice), logicalDevice_(logicalDevice) {
+  scratchAlignment_ =
+    physicalDevice_
+      .getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceAccelerationStructurePropertiesKHR>()
+      .get<vk::PhysicalDeviceAccelerationStructurePropertiesKHR>()
+      .minAccelerationStructureScratchOffsetAlignment;
+  scratchAlignment_ = std::max<vk::DeviceSize>(scratchAlignment_, 1u);
+}
+
+void KHRAccelerationStructures::build(const PTSceneConverter& sceneConverter, bool flattened,
+                                      const logi::CommandPool& cmdPool, const logi::Queue& queue) {
+  destroy();
+
+  const vk::Device& device = static_cast<const vk::Device&>(logicalDevice_);
+  const auto& dispatcher = logicalDevice_.getDispatcher();
+
+  // Ranges without a whole triangle have no geometry to build.
+  std::vector<VertexRange> ranges;
+  uint32_t vertexCount = 0u;
+  for (const auto& range : sceneConverter.getVertexRanges()) {
+    if (range.vertexCount >= 3u) {
+      ranges.emplace_back(range);
+      vertexCount = std::max(vertexCount, range.firstVertex + range.vertexCount);
+    }
+  }
+
+  if (ranges.empty()) {
+    return;
+  }
+
+  // Vertices buffer lacks the build input usage, so positions are read from a copy.
+  const vk::DeviceSize verticesSize = vertexCount * sizeof(GPUVertex);
+  Allocation vertices = allocate(verticesSize,
+                                 vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR |
+                                   vk::BufferUsageFlagBits::eTransferDst,
+                                 false);
+
+  // Bottom level structure of every mesh. Objects instancing the same mesh share its vertex range.
+  std::map<uint32_t, size_t> bottomLevelIndices;
+  std::vector<vk::AccelerationStructureGeometryKHR> geometries;
+  std::vector<vk::AccelerationStructureBuildGeometryInfoKHR> buildInfos;
+  std::vector<vk::AccelerationStructureBuildRangeInfoKHR> buildRanges;
+  vk::DeviceSize scratchSize = 0u;
+
+  // Build infos point into geometries.
+  geometries.reserve(ranges.size());
+
+  for (const auto& range : ranges) {
+    if (!bottomLevelIndices.emplace(range.firstVertex, bottomLevels_.size()).second) {
+      continue;
+    }
+
+    vk::AccelerationStructureGeometryTrianglesDataKHR triangles;
+    triangles.vertexFormat = vk::Format::eR32G32B32Sfloat;
+    triangles.vertexData.deviceAddress = vertices.address + range.firstVertex * sizeof(GPUVertex);
+    triangles.vertexStride = sizeof(GPUVertex);
+    triangles.maxVertex = range.vertexCount - 1u;
+    triangles.indexType = vk::IndexType::eNoneKHR;
+
+    geometries.emplace_back();
+    geometries.back().geometryType = vk::GeometryTypeKHR::eTriangles;
+    geometries.back().geometry.triangles = triangles;
+    geometries.back().flags = vk::GeometryFlagBitsKHR::eOpaque;
+
+    vk::AccelerationStructureBuildGeometryInfoKHR buildInfo;
+    buildInfo.type = vk::AccelerationStructureTypeKHR::eBottomLevel;
+    buildInfo.flags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace;
+    buildInfo.mode = vk::BuildAccelerationStructureModeKHR::eBuild;
+    buildInfo.geometryCount = 1u;
+    buildInfo.pGeometries = &geometries.back();
+
+    const uint32_t triangleCount = range.vertexCount / 3u;
+    vk::AccelerationStructureBuildSizesInfoKHR sizes = device.getAccelerationStructureBuildSizesKHR(
+      vk::AccelerationStructureBuildTypeKHR::eDevice, buildInfo, triangleCount, dispatcher);
+
+    bottomLevels_.emplace_back(
+      createStructure(vk::AccelerationStructureTypeKHR::eBottomLevel, sizes.accelerationStructureSize));
+    buildInfo.dstAccelerationStructure = bottomLevels_.back().handle;
+    buildInfos.emplace_back(buildInfo);
+    buildRanges.emplace_back(triangleCount, 0u, 0u, 0u);
+    scratchSize = std::max(scratchSize, sizes.buildScratchSize);
+  }
+
+  // Instances are written on the host with an identity transform. Object transforms are copied over it on the GPU.
+  const uint32_t instanceCount = ranges.size();
+  Allocation instances = allocate(instanceCount * sizeof(vk::AccelerationStructureInstanceKHR),
+                                  vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR |
+                                    vk::BufferUsageFlagBits::eTransferDst,
+                                  true);
+  auto* mappedInstances = static_cast<vk::AccelerationStructureInstanceKHR*>(
+    device.mapMemory(instances.memory, 0u, VK_WHOLE_SIZE, {}, dispatcher));
+
+  const vk::TransformMatrixKHR identity(std::array<std::array<float, 4>, 3>{
+    {{1.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f, 0.0f}}});
+  std::vector<vk::BufferCopy> transformCopies;
+
+  for (uint32_t i = 0u; i < instanceCount; i++) {
+    const Structure& bottomLevel = bottomLevels_[bottomLevelIndices.at(ranges[i].firstVertex)];
+    const vk::DeviceAddress bottomLevelAddress = device.getAccelerationStructureAddressKHR(
+      vk::AccelerationStructureDeviceAddressInfoKHR(bottomLevel.handle), dispatcher);
+
+    // Triangles are intersected from both sides, as in rayTriangleIntersect.
+    mappedInstances[i] = vk::AccelerationStructureInstanceKHR(
+      identity, ranges[i].objectIndex, 0xFFu, 0u, vk::GeometryInstanceFlagBitsKHR::eTriangleFacingCullDisable,
+      bottomLevelAddress);
+
+    if (!flattened) {
+      transformCopies.emplace_back(ranges[i].objectIndex * sizeof(GPUObjectData),
+                                   i * sizeof(vk::AccelerationStructureInstanceKHR), kTransformSize);
+    }
+  }
+
+  device.unmapMemory(instances.memory, dispatcher);
+
+  vk::AccelerationStructureGeometryKHR instanceGeometry;
+  instanceGeometry.geometryType = vk::GeometryTypeKHR::eInstances;
+  instanceGeometry.geometry.instances.arrayOfPointers = VK_FALSE;
+  instanceGeometry.geometry.instances.data.deviceAddress = instances.address;
+
+  vk::AccelerationStructureBuildGeometryInfoKHR topLevelInfo;
+  topLevelInfo.type = vk::AccelerationStructureTypeKHR::eTopLevel;
+  topLevelInfo.flags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace;
+  topLevelInfo.mode = vk::BuildAccelerationStructureModeKHR::eBuild;
+  topLevelInfo.geometryCount = 1u;
+  topLevelInfo.pGeometries = &instanceGeometry;
+
+  vk::AccelerationStructureBuildSizesInfoKHR topLevelSizes = device.getAccelerationStructureBuildSizesKHR(
+    vk::AccelerationStructureBuildTypeKHR::eDevice, topLevelInfo, instanceCount, dispatcher);
+  topLevel_ = createStructure(vk::AccelerationStructureTypeKHR::eTopLevel, topLevelSizes.accelerationStructureSize);
+  topLevelInfo.dstAccelerationStructure = topLevel_.handle;
+  scratchSize = std::max(scratchSize, topLevelSizes.buildScratchSize);
+
+  // Builds run one after another, so they share the scratch memory.
+  Allocation scratch =
+    allocate(scratchSize + scratchAlignment_,
+             vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress, false);
+  const vk::DeviceAddress scratchAddress = alignAddress(scratch.address, scratchAlignment_);
+
+  logi::CommandBuffer cmdBuffer = cmdPool.allocateCommandBuffer(vk::CommandBufferLevel::ePrimary);
+  cmdBuffer.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+  const vk::CommandBuffer& commands = static_cast<const vk::CommandBuffer&>(cmdBuffer);
+
+  cmdBuffer.copyBuffer(sceneConverter.getVerticesBuffer(), vertices.buffer, vk::BufferCopy(0u, 0u, verticesSize));
+  if (!transformCopies.empty()) {
+    cmdBuffer.copyBuffer(sceneConverter.getObjectDataBuffer(), instances.buffer, transformCopies);
+  }
+
+  // Build inputs are read as shader resources.
+  vk::MemoryBarrier copyBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead);
+  cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                            vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, {}, copyBarrier, {}, {});
+
+  // Scratch is reused and the top level reads the bottom levels, so every build waits for the previous one.
+  vk::MemoryBarrier buildBarrier(vk::AccessFlagBits::eAccelerationStructureWriteKHR,
+                                 vk::AccessFlagBits::eAccelerationStructureReadKHR |
+                                   vk::AccessFlagBits::eAccelerationStructureWriteKHR);
+
+  for (size_t i = 0u; i < buildInfos.size(); i++) {
+    buildInfos[i].scratchData.deviceAddress = scratchAddress;
+    const vk::AccelerationStructureBuildRangeInfoKHR* buildRange = &buildRanges[i];
+    commands.buildAccelerationStructuresKHR(buildInfos[i], buildRange, dispatcher);
+    cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+                              vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, {}, buildBarrier, {}, {});
+  }
+
+  topLevelInfo.scratchData.deviceAddress = scratchAddress;
+  const vk::AccelerationStructureBuildRangeInfoKHR topLevelRange(instanceCount, 0u, 0u, 0u);
+  const vk::AccelerationStructureBuildRangeInfoKHR* topLevelRangePtr = &topLevelRange;
+  commands.buildAccelerationStructuresKHR(topLevelInfo, topLevelRangePtr, dispatcher);
+
+  cmdBuffer.end();
+
+  vk::SubmitInfo submitInfo;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &commands;
+  queue.submit({submitInfo});
+  queue.waitIdle();
+
+  cmdBuffer.destroy();
+
+  // Structures do not reference their build inputs.
+  free(scratch);
+  free(instances);
+  free(vertices);
+
+  std::cout << "Built acceleration structures: " << bottomLevels_.size() << " meshes, " << instanceCount
+            << " instances." << std::endl;
+}
+
+const vk::AccelerationStructureKHR& KHRAccelerationStructures::getTopLevel() const {
+  return topLevel_.handle;
+}
+
+bool KHRAccelerationStructures::isBuilt() const {
+  return static_cast<bool>(topLevel_.handle);
+}
+
+void KHRAccelerationStructures::destroy() {
+  for (auto& bottomLevel : bottomLevels_) {
+    destroyStructure(bottomLevel);
+  }
+  bottomLevels_.clear();
+  destroyStructure(topLevel_);
+}
+
+KHRAccelerationStructures::Allocation KHRAccelerationStructures::allocate(vk::DeviceSize size,
+                                                                          vk::BufferUsageFlags usage,
+                                                                          bool hostVisible) const {
+  const vk::Device& device = static_cast<const vk::Device&>(logicalDevice_);
+  const auto& dispatcher = logicalDevice_.getDispatcher();
+
+  Allocation allocation;
+  allocation.buffer = device.createBuffer(
+    vk::BufferCreateInfo({}, size, usage | vk::BufferUsageFlagBits::eShaderDeviceAddress), nullptr, dispatcher);
+
+  const vk::MemoryRequirements requirements = device.getBufferMemoryRequirements(allocation.buffer, dispatcher);
+  const vk::MemoryPropertyFlags properties =
+    hostVisible ? vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
+                : vk::MemoryPropertyFlagBits::eDeviceLocal;
+  const vk::PhysicalDeviceMemoryProperties memoryProperties = physicalDevice_.getMemoryProperties();
+
+  uint32_t memoryType = memoryProperties.memoryTypeCount;
+  for (uint32_t i = 0u; i < memoryProperties.memoryTypeCount; i++) {
+    if ((requirements.memoryTypeBits & (1u << i)) &&
+        (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+      memoryType = i;
+      break;
+    }
+  }
+
+  if (memoryType == memoryProperties.memoryTypeCount) {
+    device.destroyBuffer(allocation.buffer, nullptr, dispatcher);
+    throw std::runtime_error("Failed to find memory for the acceleration structures.");
+  }
+
+  // Build inputs, scratch and storage are all referenced by their device address.
+  vk::MemoryAllocateFlagsInfo allocateFlags(vk::MemoryAllocateFlagBits::eDeviceAddress);
+  vk::MemoryAllocateInfo allocateInfo(requirements.size, memoryType);
+  allocateInfo.pNext = &allocateFlags;
+
+  allocation.memory = device.allocateMemory(allocateInfo, nullptr, dispatcher);
+  device.bindBufferMemory(allocation.buffer, allocation.memory, 0u, dispatcher);
+  allocation.address = device.getBufferAddress(vk::BufferDeviceAddressInfo(allocation.buffer), dispatcher);
+  return allocation;
+}
+
+void KHRAccelerationStructures::free(Allocation& allocation) const {
+  if (!allocation.buffer) {
+    return;
+  }
+
+  const vk::Device& device = static_cast<const vk::Device&>(logicalDevice_);
+  device.destroyBuffer(allocation.buffer, nullptr, logicalDevice_.getDispatcher());
+  device.freeMemory(allocation.memory, nullptr, logicalDevice_.getDispatcher());
+  allocation = Allocation();
+}
+
+KHRAccelerationStructures::Structure KHRAccelerationStructures::createStructure(vk::AccelerationStructureTypeKHR type,
+                                                                                vk::DeviceSize size) const {
+  Structure structure;
+  structure.storage = allocate(size, vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR, false);
+
+  vk::AccelerationStructureCreateInfoKHR createInfo;
+  createInfo.buffer = structure.storage.buffer;
+  createInfo.size = size;
+  createInfo.type = type;
+
+  structure.handle = static_cast<const vk::Device&>(logicalDevice_)
+                       .createAccelerationStructureKHR(createInfo, nullptr, logicalDevice_.getDispatcher());
+  return structure;
+}
+
+void KHRAccelerationStructures::destroyStructure(Structure& structure) const {
+  if (structure.handle) {
+    static_cast<const vk::Device&>(logicalDevice_)
+      .destroyAccelerationStructureKHR(structure.handle, nullptr, logicalDevice_.getDispatcher());
+    structure.handle = nullptr;
+  }
+  free(structure.storage);
+}
@@ -4,17 +4,30 @@
 #include <logi/logi.hpp>
 
 #define LSG_VULKAN
+#include <iostream>
 #include <lsg/lsg.h>
 #include <thread>
 #include <vulkan/vulkan.hpp>
+#include "BVHBenchmark.hpp"
 #include "RendererPT.h"
 #include "RendererRTX.h"
 
-const bool RTX = true;
+// Automatic selection uses ray queries where the device supports them, else the software BVH. The NV ray tracing
+// pipeline (RendererRTX) is only used if requested.
+const RayTracingBackend RAY_TRACING_BACKEND = RayTracingBackend::eAuto;
+// Runs the CPU BVH builder benchmark on the scene instead of rendering it.
+const bool BVH_BENCHMARK = false;
+const char* const SCENE_PATH = "./resources/mitsuba/testball.gltf";
 
 int main() {
   lsg::GLTFLoader loader;
-  std::vector<lsg::Ref<lsg::Scene>> scenes = loader.load("./resources/mitsuba/testball.gltf");
+  std::vector<lsg::Ref<lsg::Scene>> scenes = loader.load(SCENE_PATH);
+
+  if (BVH_BENCHMARK) {
+    runBVHBenchmark(scenes[0], BVHBuildConfiguration());
+    runSceneBVHBenchmark(scenes[0], BVHBuildConfiguration());
+    return 0;
+  }
 
   lsg::Ref<lsg::Object> camera;
   scenes[0]->traverseDown([&](const lsg::Ref<lsg::Object>& object) {
@@ -32,15 +45,24 @@ int main() {
   RendererConfiguration config;
   config.renderScale = 1;
   // config.validationLayers.clear();
+  config.rayTracingBackend = RAY_TRACING_BACKEND;
+  config.sceneLoading.mappedBuffersPath = SCENE_PATH;
   std::unique_ptr<RendererCore> renderer;
-  if (RTX) {
-    config.deviceExtensions.emplace_back("VK_NV_ray_tracing");
-    config.deviceExtensions.emplace_back("VK_KHR_get_memory_requirements2");
-    config.instanceExtensions.emplace_back("VK_KHR_get_physical_device_properties2");
+  if (RAY_TRACING_BACKEND == RayTracingBackend::eNVRayTracing) {
     renderer = std::make_unique<RendererRTX>(window, config);
   } else {
+    // Kept for picking (see RendererPT::pick).
+    config.hostCopies.retention = HostCopyRetention::eCompact;
+    config.hostCopies.geometry = true;
+    config.preview.shading = PreviewShading::eAlbedoNormal;
+    // Keeps the converged samples while navigating the scene.
+    config.reprojection.enabled = true;
     renderer = std::make_unique<RendererPT>(window, config);
   }
+  auto* rendererPT = dynamic_cast<RendererPT*>(renderer.get());
+  bool pickPressed = false;
+  PreviewShading previewShading = config.preview.shading;
+  bool previewPressed = false;
 
   auto loadThread = std::thread([&]() { renderer->loadScene(scenes[0]); });
 
@@ -92,6 +114,28 @@ int main() {
       cameraTransform->rotateZ(-dt / 1000.0f);
     }
 
+    // Reports the surface under the image center.
+    bool pickDown = window.getKey(GLFW_KEY_F) == GLFW_PRESS;
+    if (rendererPT && pickDown && !pickPressed) {
+      SceneHit hit;
+      if (rendererPT->pick(glm::vec2(0.5f), hit)) {
+        std::cout << "Picked object " << hit.objectIndex << ", triangle " << hit.primitiveIndex / 3u << " at distance "
+                  << hit.distance << "." << std::endl;
+      } else {
+        std::cout << "Nothing to pick." << std::endl;
+      }
+    }
+    pickPressed = pickDown;
+
+    // Cycles the shading shown while the camera moves.
+    bool previewDown = window.getKey(GLFW_KEY_P) == GLFW_PRESS;
+    if (rendererPT && previewDown && !previewPressed) {
+      previewShading = static_cast<PreviewShading>((static_cast<uint32_t>(previewShading) + 1u) % 4u);
+      rendererPT->setPreviewShading(previewShading);
+      std::cout << "Preview shading: " << toString(previewShading) << "." << std::endl;
+    }
+    previewPressed = previewDown;
+
     glfwInstance.pollEvents();
     renderer->drawFrame();
   }
@@ -0,0 +1,132 @@
+#include "MappedFile.hpp"
+#include <stdexcept>
+#include <utility>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& path) {
+#if defined(_WIN32)
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    throw std::runtime_error("Failed to open file: " + path);
+  }
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(file, &fileSize)) {
+    CloseHandle(file);
+    throw std::runtime_error("Failed to query size of file: " + path);
+  }
+
+  file_ = file;
+  size_ = static_cast<size_t>(fileSize.QuadPart);
+
+  // Empty files can not be mapped.
+  if (size_ == 0u) {
+    return;
+  }
+
+  HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping) {
+    close();
+    throw std::runtime_error("Failed to map file: " + path);
+  }
+  mapping_ = mapping;
+
+  data_ = static_cast<const std::byte*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  if (!data_) {
+    close();
+    throw std::runtime_error("Failed to map file: " + path);
+  }
+#else
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Failed to open file: " + path);
+  }
+
+  struct stat fileStat {};
+  if (fstat(fd, &fileStat) != 0) {
+    ::close(fd);
+    throw std::runtime_error("Failed to query size of file: " + path);
+  }
+
+  size_ = static_cast<size_t>(fileStat.st_size);
+
+  // Empty files can not be mapped.
+  if (size_ > 0u) {
+    void* mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      ::close(fd);
+      throw std::runtime_error("Failed to map file: " + path);
+    }
+    data_ = static_cast<const std::byte*>(mapping);
+  }
+
+  // Mapping stays valid after the descriptor is closed.
+  ::close(fd);
+#endif
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+  *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+  if (this != &other) {
+    close();
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+#if defined(_WIN32)
+    std::swap(file_, other.file_);
+    std::swap(mapping_, other.mapping_);
+#endif
+  }
+
+  return *this;
+}
+
+MappedFile::~MappedFile() {
+  close();
+}
+
+const std::byte* MappedFile::data() const {
+  return data_;
+}
+
+size_t MappedFile::size() const {
+  return size_;
+}
+
+MappedFile::operator bool() const {
+  return data_ != nullptr;
+}
+
+void MappedFile::close() {
+#if defined(_WIN32)
+  if (data_) {
+    UnmapViewOfFile(data_);
+  }
+  if (mapping_) {
+    CloseHandle(mapping_);
+  }
+  if (file_) {
+    CloseHandle(file_);
+  }
+  file_ = nullptr;
+  mapping_ = nullptr;
+#else
+  if (data_) {
+    munmap(const_cast<std::byte*>(data_), size_);
+  }
+#endif
+  data_ = nullptr;
+  size_ = 0u;
+}
@@ -3,34 +3,89 @@
 //
 
 #include "PTSceneConverter.hpp"
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iostream>
 #include <utility>
+#include "BVHBenchmark.hpp"
+#include "Helpers.hpp"
+
+namespace {
+
+/**
+ * Appends the triangles of the submesh transformed to world space, together with their bounds and object index. Reads
+ * the mapped primitive if there is one.
+ */
+void appendWorldSpaceTriangles(const lsg::Ref<lsg::SubMesh>& submesh, const GLTFPrimitive* primitive,
+                               const glm::mat4& worldMatrix, uint32_t objectIndex, std::vector<GPUVertex>& vertices,
+                               std::vector<uint32_t>& triangleObjects, std::vector<BVHBounds>& triangleBounds) {
+  auto positionAccessor = submesh->geometry()->getTrianglePositionAccessor();
+  auto normalAccessor = submesh->geometry()->getTriangleNormalAccessor();
+  auto uvAccessor = submesh->geometry()->hasUv(0u) ? submesh->geometry()->getTriangleUVAccessor(0u) : nullptr;
+
+  // Normals are transformed the same way as the shader transforms object space normals, so that both modes match.
+  const glm::mat3 normalMatrix(worldMatrix);
+
+  for (size_t i = 0u; i < positionAccessor->count(); i++) {
+    std::array<glm::vec3, 3u> positions;
+    std::array<glm::vec3, 3u> normals;
+    std::array<glm::vec2, 3u> uvs = {};
+
+    if (primitive) {
+      for (uint32_t corner = 0u; corner < 3u; corner++) {
+        const uint32_t v = primitive->vertex(i, corner);
+        positions[corner] = primitive->positions.get<glm::vec3>(v);
+        normals[corner] = primitive->normals.get<glm::vec3>(v);
+        if (primitive->uvs) {
+          uvs[corner] = primitive->uvs.get<glm::vec2>(v);
+        }
+      }
+    } else {
+      lsg::Triangle<glm::vec3> posTri = (*positionAccessor)[i];
+      lsg::Triangle<glm::vec3> normalTri = (*normalAccessor)[i];
+      positions = {posTri.a(), posTri.b(), posTri.c()};
+      normals = {normalTri.a(), normalTri.b(), normalTri.c()};
+
+      if (uvAccessor) {
+        lsg::Triangle<glm::vec2> uvTri = (*uvAccessor)[i];
+        uvs = {uvTri.a(), uvTri.b(), uvTri.c()};
+      }
+    }
+
+    BVHBounds& bounds = triangleBounds.emplace_back();
+    for (size_t v = 0u; v < 3u; v++) {
+      glm::vec3 position(worldMatrix * glm::vec4(positions[v], 1.0f));
+      bounds.grow(position);
+      vertices.emplace_back(packVertex(position, normalMatrix * normals[v], uvs[v]));
+    }
+    triangleObjects.emplace_back(objectIndex);
+  }
+}
 
-GPUObjectData::GPUObjectData(const glm::mat4& worldMatrix, const glm::mat4& worldMatrixInverse,
-                             const glm::vec4& baseColorFactor, const glm::vec3& emissionFactor, float metallicFactor,
-                             float roughnessFactor, float transmissionFactor, float ior, uint32_t colorTexture,
-                             uint32_t emissionTexture, uint32_t metallicRoughnessTexture, uint32_t transmissionTexture,
-                             uint32_t normalTexture, uint32_t bvhOffset, uint32_t verticesOffset)
-  : worldMatrix(worldMatrix), worldMatrixInverse(worldMatrixInverse), baseColorFactor(baseColorFactor),
-    emissionFactor(emissionFactor), metallicFactor(metallicFactor), roughnessFactor(roughnessFactor),
-    transmissionFactor(transmissionFactor), colorTexture(colorTexture), emissionTexture(emissionTexture),
-    metallicRoughnessTexture(metallicRoughnessTexture), transmissionTexture(transmissionTexture),
-    normalTexture(normalTexture), ior(ior), bvhOffset(bvhOffset), verticesOffset(verticesOffset) {}
-
-GPUVertex::GPUVertex(const glm::vec3& position, const glm::vec3& normal, const glm::vec2& uv)
-  : position(position), normal(normal), uv(uv) {}
-
-GPUBVHNode::GPUBVHNode(const glm::vec3& min, const glm::vec3& max, bool isLeaf, const glm::uvec2& indices)
-  : min(min), max(max), isLeaf(isLeaf), indices(indices) {}
+} // namespace
 
 PTSceneConverter::PTSceneConverter(logi::MemoryAllocator allocator, logi::CommandPool commandPool,
                                    logi::Queue transferQueue)
   : allocator_(std::move(allocator)), commandPool_(std::move(commandPool)), transferQueue_(std::move(transferQueue)) {}
 
-void PTSceneConverter::loadScene(const lsg::Ref<lsg::Scene>& scene) {
+void PTSceneConverter::loadScene(const lsg::Ref<lsg::Scene>& scene, std::chrono::milliseconds batchInterval) {
   reset();
 
-  std::vector<lsg::AABB<float>> objectAABBs;
-  std::vector<GPUObjectData> unorderedObjectData;
+  // Vertices are staged from the mapped glTF buffers where they match the scene graph.
+  const GLTFBuffers mappedBuffers =
+    mappedBuffersPath_.empty() ? GLTFBuffers() : GLTFBuffers::tryMap(mappedBuffersPath_);
+  size_t submeshCount = 0u;
+  size_t mappedSubmeshCount = 0u;
+
+  if (textureStreamingConfig_.enabled) {
+    textureStreamer_ =
+      std::make_unique<TextureStreamer>(allocator_, commandPool_, transferQueue_, textureStreamingConfig_);
+  }
+
+  // Cameras are collected first, so that the first batch can already be displayed.
+  std::vector<lsg::Ref<lsg::Object>> cameras;
+  std::vector<std::pair<lsg::Ref<lsg::Object>, glm::mat4>> meshObjects;
 
   for (const auto& rootObj : scene->children()) {
     rootObj->traverseDown([&](const lsg::Ref<lsg::Object>& object) {
@@ -43,116 +98,405 @@ void PTSceneConverter::loadScene(const lsg::Ref<lsg::Scene>& scene) {
 
       // Handle cameras.
       if (auto camera = object->getComponent<lsg::PerspectiveCamera>()) {
-        cameras_.emplace_back(object);
+        cameras.emplace_back(object);
       }
 
-      // Handle geometry.
-      if (auto mesh = object->getComponent<lsg::Mesh>()) {
-        std::cout << "Building BVH for object " << object->name() << "..." << std::endl;
-
-        for (const auto& submesh : mesh->subMeshes()) {
-          lsg::Ref<lsg::MetallicRoughnessMaterial> material =
-            lsg::dynamicRefCast<lsg::MetallicRoughnessMaterial>(submesh->material());
-
-          // Skip if the object does not have MetallicRoughnessMaterial.
-          if (!material) {
-            std::cout << "Unknown material. Skipping submesh." << std::endl;
-            continue;
-          }
-
-          // Convert object data into GPU compatible format.
-          unorderedObjectData.emplace_back();
-          GPUObjectData& objectData = unorderedObjectData.back();
-          objectData.worldMatrix = worldMatrix;
-          objectData.worldMatrixInverse = glm::inverse(objectData.worldMatrix);
-          objectData.baseColorFactor = material->baseColorFactor();
-          objectData.colorTexture = (material->baseColorTex()) ? copyTextureToGPU(material->baseColorTex())
-                                                               : std::numeric_limits<uint32_t>::max();
-          objectData.emissionFactor = material->emissiveFactor();
-          objectData.emissionTexture = (material->emissiveTex()) ? copyTextureToGPU(material->emissiveTex())
-                                                                 : std::numeric_limits<uint32_t>::max();
-          objectData.metallicFactor = material->metallicFactor();
-          objectData.roughnessFactor = material->roughnessFactor();
-          objectData.metallicRoughnessTexture = (material->metallicRoughnessTex())
-                                                  ? copyTextureToGPU(material->metallicRoughnessTex())
-                                                  : std::numeric_limits<uint32_t>::max();
-          objectData.transmissionFactor = material->transmissionFactor();
-          objectData.transmissionTexture = (material->transmissionTexture())
-                                             ? copyTextureToGPU(material->transmissionTexture())
-                                             : std::numeric_limits<uint32_t>::max();
-          objectData.normalTexture =
-            (material->normalTex()) ? copyTextureToGPU(material->normalTex()) : std::numeric_limits<uint32_t>::max();
-
-          objectData.ior = material->ior();
-          objectData.bvhOffset = meshBVHNodes_.size();
-          objectData.verticesOffset = vertices_.size();
-
-          std::cout << "VTX offset: " << vertices_.size() << std::endl;
-
-          auto positionAccessor = submesh->geometry()->getTrianglePositionAccessor();
-          auto normalAccessor = submesh->geometry()->getTriangleNormalAccessor();
-          auto uvAccessor = submesh->geometry()->hasUv(0u) ? submesh->geometry()->getTriangleUVAccessor(0u) : nullptr;
-
-          // Build triangles BVH nodes.
-          lsg::bvh::SplitBVHBuilder<float> builder;
-          auto bvh = builder.process(positionAccessor);
-          for (const auto& node : bvh->getNodes()) {
-            meshBVHNodes_.emplace_back(node.bounds.min(), node.bounds.max(), node.is_leaf, node.child_indices);
-          }
-          std::cout << "Vtx count: " << bvh->getPrimitiveIndices().size() * 3 << std::endl;
-
-          // Convert vertices into GPU compatible format (interleave).
-          for (uint32_t idx : bvh->getPrimitiveIndices()) {
-            lsg::Triangle<glm::vec3> posTri = (*positionAccessor)[idx];
-            lsg::Triangle<glm::vec3> normalTri = (*normalAccessor)[idx];
-
-            if (uvAccessor) {
-              lsg::Triangle<glm::vec2> uvTri = (*uvAccessor)[idx];
-
-              vertices_.emplace_back(posTri.a(), normalTri.a(), uvTri.a());
-              vertices_.emplace_back(posTri.b(), normalTri.b(), uvTri.b());
-              vertices_.emplace_back(posTri.c(), normalTri.c(), uvTri.c());
-            } else {
-              vertices_.emplace_back(posTri.a(), normalTri.a());
-              vertices_.emplace_back(posTri.b(), normalTri.b());
-              vertices_.emplace_back(posTri.c(), normalTri.c());
-            }
-          }
-
-          objectAABBs.emplace_back(bvh->getBounds().transform(worldMatrix));
-        }
-        std::cout << " Finished." << std::endl;
+      if (object->getComponent<lsg::Mesh>()) {
+        meshObjects.emplace_back(object, worldMatrix);
       }
 
       return true;
     });
   }
 
-  std::cout << "Building scene BVH..." << std::flush;
+  {
+    std::lock_guard<std::mutex> lock(batchMutex_);
+    cameras_ = std::move(cameras);
+  }
+
+  SceneBatch batch;
+  std::vector<BVHBounds> objectAABBs;
+  std::vector<GPUObjectData> unorderedObjectData;
+  uint32_t textureCount = 0u;
+  uint32_t vertexCount = 0u;
+  uint32_t meshBVHNodeCount = 0u;
+  // World space triangles of the flattened scene. The BVH is built once all of them are converted.
+  const bool flatten = bvhBuildConfig_.flattenScene;
+  std::vector<GPUVertex> flatVertices;
+  std::vector<uint32_t> flatTriangleObjects;
+  std::vector<BVHBounds> flatTriangleBounds;
+  auto lastPublish = std::chrono::steady_clock::now();
+
+  // Textures are uploaded when the batch is committed, in the order of their indices.
+  auto addTexture = [&](const lsg::Ref<lsg::Texture>& texture) {
+    if (!texture) {
+      return std::numeric_limits<uint32_t>::max();
+    }
+    batch.textures.emplace_back(texture);
+    return textureCount++;
+  };
+
+  for (const auto& [object, worldMatrix] : meshObjects) {
+    std::cout << "Building BVH for object " << object->name() << "..." << std::endl;
+
+    for (const auto& submesh : object->getComponent<lsg::Mesh>()->subMeshes()) {
+      lsg::Ref<lsg::MetallicRoughnessMaterial> material =
+        lsg::dynamicRefCast<lsg::MetallicRoughnessMaterial>(submesh->material());
+
+      // Skip if the object does not have MetallicRoughnessMaterial.
+      if (!material) {
+        std::cout << "Unknown material. Skipping submesh." << std::endl;
+        continue;
+      }
+
+      // Convert material into GPU compatible format.
+      GPUMaterial& gpuMaterial = batch.materials.emplace_back();
+      gpuMaterial.baseColorFactor = material->baseColorFactor();
+      gpuMaterial.colorTexture = addTexture(material->baseColorTex());
+      gpuMaterial.emissionFactor = material->emissiveFactor();
+      gpuMaterial.emissionTexture = addTexture(material->emissiveTex());
+      gpuMaterial.metallicFactor = material->metallicFactor();
+      gpuMaterial.roughnessFactor = material->roughnessFactor();
+      gpuMaterial.metallicRoughnessTexture = addTexture(material->metallicRoughnessTex());
+      gpuMaterial.transmissionFactor = material->transmissionFactor();
+      gpuMaterial.transmissionTexture = addTexture(material->transmissionTexture());
+      gpuMaterial.normalTexture = addTexture(material->normalTex());
+      gpuMaterial.ior = material->ior();
+
+      // Convert object data into GPU compatible format. Flattened triangles are already in world space.
+      const glm::mat4 objectMatrix = flatten ? glm::mat4(1.0f) : worldMatrix;
+      GPUObjectData& objectData = unorderedObjectData.emplace_back();
+      objectData.objectToWorld = packAffine(objectMatrix);
+      objectData.worldToObject = packAffine(glm::inverse(objectMatrix));
+      objectData.materialIndex = static_cast<uint32_t>(unorderedObjectData.size() - 1u);
+      objectData.bvhOffset = meshBVHNodeCount;
+      objectData.verticesOffset = vertexCount;
+      objectData.vertexCount = 0u;
+
+      const GLTFPrimitive* primitive = mappedBuffers.find(submesh);
+      submeshCount++;
+      mappedSubmeshCount += primitive ? 1u : 0u;
+
+      if (flatten) {
+        const auto objectIndex = static_cast<uint32_t>(unorderedObjectData.size() - 1u);
+        appendWorldSpaceTriangles(submesh, primitive, worldMatrix, objectIndex, flatVertices, flatTriangleObjects,
+                                  flatTriangleBounds);
+        continue;
+      }
+
+      // Build triangles BVH nodes.
+      const size_t triangleCount = submesh->geometry()->getTrianglePositionAccessor()->count();
+      BVHBuilderType builderType = selectMeshBuilder(bvhBuildConfig_, triangleCount);
+      BVH bvh = buildMeshBVH(submesh->geometry(), builderType, bvhBuildConfig_);
+      std::cout << " " << triangleCount << " triangles (" << toString(builderType) << " BVH)." << std::endl;
+
+      batch.meshBVHs.push_back({object->name(), builderType, static_cast<uint32_t>(triangleCount), meshBVHNodeCount,
+                                static_cast<uint32_t>(bvh.nodes.size())});
+      batch.meshBVHNodes.insert(batch.meshBVHNodes.end(), bvh.nodes.begin(), bvh.nodes.end());
+      meshBVHNodeCount += bvh.nodes.size();
+      vertexCount += bvh.primitiveIndices.size() * 3u;
+      objectData.vertexCount = bvh.primitiveIndices.size() * 3u;
+
+      batch.vertices.emplace_back(stageVertices(submesh, primitive, bvh.primitiveIndices));
+      batch.vertexCount += bvh.primitiveIndices.size() * 3u;
+
+      objectAABBs.emplace_back(bvh.bounds.transform(worldMatrix));
+
+      auto sinceLastPublish =
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - lastPublish);
+      if (sinceLastPublish >= batchInterval) {
+        publishBatch(batch, unorderedObjectData, objectAABBs, false);
+        lastPublish = std::chrono::steady_clock::now();
+      }
+    }
+    std::cout << " Finished." << std::endl;
+  }
+
+  if (flatten) {
+    stageFlattenedScene(batch, flatVertices, flatTriangleObjects, flatTriangleBounds);
+  }
+
+  if (mappedBuffers) {
+    std::cout << "Staged " << mappedSubmeshCount << " of " << submeshCount << " submeshes from "
+              << mappedBuffers.mappedBytes() / 1024u << " KB of mapped glTF buffers." << std::endl;
+  }
+
+  publishBatch(batch, unorderedObjectData, objectAABBs, true);
+}
+
+void PTSceneConverter::stageFlattenedScene(SceneBatch& batch, const std::vector<GPUVertex>& vertices,
+                                           const std::vector<uint32_t>& triangleObjects,
+                                           const std::vector<BVHBounds>& triangleBounds) {
+  // Spatial splits need the triangles of a single geometry.
+  BVHBuilderType builderType = selectMeshBuilder(bvhBuildConfig_, triangleBounds.size());
+  if (builderType == BVHBuilderType::eSplit) {
+    builderType = BVHBuilderType::eBinnedSAH;
+  }
+
+  BVH bvh = buildBVH(triangleBounds, builderType, bvhBuildConfig_);
+  std::cout << "Flattened scene: " << triangleBounds.size() << " triangles (" << toString(builderType) << " BVH)."
+            << std::endl;
+
+  batch.meshBVHs.push_back({"flattened scene", builderType, static_cast<uint32_t>(triangleBounds.size()), 0u,
+                            static_cast<uint32_t>(bvh.nodes.size())});
+  batch.meshBVHNodes = std::move(bvh.nodes);
+
+  StagedData staged = createStagingBuffer(bvh.primitiveIndices.size() * 3u * sizeof(GPUVertex));
+  batch.primitiveObjects.reserve(bvh.primitiveIndices.size());
+
+  if (staged.size > 0u) {
+    auto* vertex = static_cast<GPUVertex*>(staged.buffer.mapMemory());
+
+    for (uint32_t idx : bvh.primitiveIndices) {
+      vertex = std::copy_n(vertices.begin() + idx * 3u, 3u, vertex);
+      batch.primitiveObjects.emplace_back(triangleObjects[idx]);
+    }
+
+    staged.buffer.unmapMemory();
+  }
 
-  // Build objects BVH nodes.
-  lsg::bvh::BVHBuilder<float> builder;
-  auto bvh = builder.process(objectAABBs);
-  for (const auto& node : bvh->getNodes()) {
-    objectBVHNodes_.emplace_back(node.bounds.min(), node.bounds.max(), node.is_leaf, node.child_indices);
+  batch.vertices.emplace_back(std::move(staged));
+  batch.vertexCount += bvh.primitiveIndices.size() * 3u;
+}
+
+StagedData PTSceneConverter::stageVertices(const lsg::Ref<lsg::SubMesh>& submesh, const GLTFPrimitive* primitive,
+                                           const std::vector<uint32_t>& primitiveIndices) {
+  auto positionAccessor = submesh->geometry()->getTrianglePositionAccessor();
+  auto normalAccessor = submesh->geometry()->getTriangleNormalAccessor();
+  auto uvAccessor = submesh->geometry()->hasUv(0u) ? submesh->geometry()->getTriangleUVAccessor(0u) : nullptr;
+
+  StagedData staged = createStagingBuffer(primitiveIndices.size() * 3u * sizeof(GPUVertex));
+
+  if (staged.size == 0u) {
+    return staged;
+  }
+
+  // Convert vertices into GPU compatible format (interleave).
+  auto* vertex = static_cast<GPUVertex*>(staged.buffer.mapMemory());
+
+  if (primitive) {
+    for (uint32_t idx : primitiveIndices) {
+      for (uint32_t corner = 0u; corner < 3u; corner++) {
+        const uint32_t v = primitive->vertex(idx, corner);
+        *vertex++ = packVertex(primitive->positions.get<glm::vec3>(v), primitive->normals.get<glm::vec3>(v),
+                               primitive->uvs ? primitive->uvs.get<glm::vec2>(v) : glm::vec2(0.0f));
+      }
+    }
+
+    staged.buffer.unmapMemory();
+    return staged;
   }
 
-  for (uint32_t idx : bvh->getPrimitiveIndices()) {
-    objectData_.emplace_back(unorderedObjectData[idx]);
+  for (uint32_t idx : primitiveIndices) {
+    lsg::Triangle<glm::vec3> posTri = (*positionAccessor)[idx];
+    lsg::Triangle<glm::vec3> normalTri = (*normalAccessor)[idx];
+
+    if (uvAccessor) {
+      lsg::Triangle<glm::vec2> uvTri = (*uvAccessor)[idx];
+
+      *vertex++ = packVertex(posTri.a(), normalTri.a(), uvTri.a());
+      *vertex++ = packVertex(posTri.b(), normalTri.b(), uvTri.b());
+      *vertex++ = packVertex(posTri.c(), normalTri.c(), uvTri.c());
+    } else {
+      *vertex++ = packVertex(posTri.a(), normalTri.a());
+      *vertex++ = packVertex(posTri.b(), normalTri.b());
+      *vertex++ = packVertex(posTri.c(), normalTri.c());
+    }
+  }
+
+  staged.buffer.unmapMemory();
+  return staged;
+}
+
+StagedData PTSceneConverter::createStagingBuffer(vk::DeviceSize size) {
+  StagedData staged;
+  staged.size = size;
+
+  if (size == 0u) {
+    return staged;
+  }
+
+  // Staging memory is written by the loading thread and read by the transfer, so it is never cached on the device.
+  VmaAllocationCreateInfo stagingBufferAllocationInfo = {};
+  stagingBufferAllocationInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_CPU_ONLY;
+
+  vk::BufferCreateInfo stagingBufferInfo;
+  stagingBufferInfo.size = size;
+  stagingBufferInfo.usage = vk::BufferUsageFlagBits::eTransferSrc;
+  stagingBufferInfo.sharingMode = vk::SharingMode::eExclusive;
+
+  staged.buffer = allocator_.createBuffer(stagingBufferInfo, stagingBufferAllocationInfo);
+  return staged;
+}
+
+void PTSceneConverter::publishBatch(SceneBatch& batch, const std::vector<GPUObjectData>& unorderedObjectData,
+                                    const std::vector<BVHBounds>& objectAABBs, bool final) {
+  if (bvhBuildConfig_.flattenScene) {
+    // Triangles reference their objects by index, so the objects keep the conversion order and need no BVH.
+    batch.objectData = unorderedObjectData;
+  } else if (!objectAABBs.empty()) {
+    // Objects BVH is rebuilt over all objects converted so far.
+    BVH bvh = buildBVH(objectAABBs, bvhBuildConfig_.objectBuilder, bvhBuildConfig_);
+    batch.objectBVHNodes = std::move(bvh.nodes);
+
+    for (uint32_t idx : bvh.primitiveIndices) {
+      batch.objectData.emplace_back(unorderedObjectData[idx]);
+    }
+  }
+
+  batch.final = final;
+
+  std::lock_guard<std::mutex> lock(batchMutex_);
+  pendingBatches_.emplace_back(std::move(batch));
+  batch = SceneBatch();
+}
+
+bool PTSceneConverter::hasPendingBatches() const {
+  std::lock_guard<std::mutex> lock(batchMutex_);
+  return !pendingBatches_.empty();
+}
+
+bool PTSceneConverter::commitBatches() {
+  std::deque<SceneBatch> batches;
+  {
+    std::lock_guard<std::mutex> lock(batchMutex_);
+    batches.swap(pendingBatches_);
+  }
+
+  if (batches.empty()) {
+    return false;
+  }
+
+  // Geometry and textures are appended in publishing order. Objects and their BVH are replaced by the latest batch.
+  for (auto& batch : batches) {
+    for (const auto& texture : batch.textures) {
+      copyTextureToGPU(texture);
+    }
+
+    // Copied before the upload destroys the staging buffers.
+    if (retainsGeometry()) {
+      for (auto& staged : batch.vertices) {
+        if (staged.size == 0u) {
+          continue;
+        }
+
+        auto* vertex = static_cast<const GPUVertex*>(staged.buffer.mapMemory());
+        vertices_.resident().insert(vertices_.resident().end(), vertex, vertex + staged.size / sizeof(GPUVertex));
+        staged.buffer.unmapMemory();
+      }
+
+      primitiveObjects_.resident().insert(primitiveObjects_.resident().end(), batch.primitiveObjects.begin(),
+                                          batch.primitiveObjects.end());
+    }
+
+    writeToGPU(materialsBuffer_, materialsBuffer_.size, batch.materials.data(),
+               batch.materials.size() * sizeof(GPUMaterial));
+    writeToGPU(verticesBuffer_, verticesBuffer_.size, batch.vertices);
+    writeToGPU(meshBVHNodesBuffer_, meshBVHNodesBuffer_.size, batch.meshBVHNodes.data(),
+               batch.meshBVHNodes.size() * sizeof(GPUBVHNode));
+    writeToGPU(primitiveObjectsBuffer_, primitiveObjectsBuffer_.size, batch.primitiveObjects.data(),
+               batch.primitiveObjects.size() * sizeof(uint32_t));
+
+    vertexCount_ += batch.vertexCount;
+    materials_.resident().insert(materials_.resident().end(), batch.materials.begin(), batch.materials.end());
+    meshBVHNodes_.resident().insert(meshBVHNodes_.resident().end(), batch.meshBVHNodes.begin(),
+                                    batch.meshBVHNodes.end());
+    meshBVHInfos_.insert(meshBVHInfos_.end(), batch.meshBVHs.begin(), batch.meshBVHs.end());
+
+    // Determine which material features are used by the scene.
+    constexpr uint32_t kNoTexture = std::numeric_limits<uint32_t>::max();
+    for (const auto& material : batch.materials) {
+      sceneFeatures_.textures |= material.colorTexture != kNoTexture || material.emissionTexture != kNoTexture ||
+                                 material.metallicRoughnessTexture != kNoTexture ||
+                                 material.transmissionTexture != kNoTexture;
+      sceneFeatures_.transmission |= material.transmissionFactor > 0.0f || material.transmissionTexture != kNoTexture;
+      sceneFeatures_.normalMaps |= material.normalTexture != kNoTexture;
+    }
+  }
+
+  SceneBatch& latest = batches.back();
+  objectData_.resident() = std::move(latest.objectData);
+  objectBVHNodes_.resident() = std::move(latest.objectBVHNodes);
+  loadComplete_ = latest.final;
+
+  writeToGPU(objectDataBuffer_, 0u, objectData_.data(), objectData_.size() * sizeof(GPUObjectData));
+  writeToGPU(objectBVHNodesBuffer_, 0u, objectBVHNodes_.data(), objectBVHNodes_.size() * sizeof(GPUBVHNode));
+
+  // Unlike the host copies, the ranges are always kept.
+  vertexRanges_.clear();
+  if (bvhBuildConfig_.flattenScene) {
+    vertexRanges_.push_back({0u, vertexCount_, 0u});
+  } else {
+    for (uint32_t i = 0; i < objectData_.size(); i++) {
+      vertexRanges_.push_back({objectData_.data()[i].verticesOffset, objectData_.data()[i].vertexCount, i});
+    }
+  }
+
+  if (loadComplete_) {
+    std::cout << "Scene features:" << (sceneFeatures_.textures ? " textures" : "")
+              << (sceneFeatures_.transmission ? " transmission" : "")
+              << (sceneFeatures_.normalMaps ? " normal-maps" : "") << std::endl;
+  }
+
+  std::cout << "Committed " << objectData_.size() << " objects (" << vertexCount_ << " vertices)"
+            << (loadComplete_ ? "." : ", loading continues.") << std::endl;
+
+  if (loadComplete_) {
+    reportLayoutSavings();
+    reportBVHStatistics();
+
+    if (bvhBuildConfig_.occlusionBenchmarkRays > 0u) {
+      runOcclusionBenchmark(getHostScene(), bvhBuildConfig_.occlusionBenchmarkRays);
+    }
+
+    applyHostCopyRetention();
+  }
+
+  return true;
+}
+
+void PTSceneConverter::applyHostCopyRetention() {
+  retainHostCopies(hostCopyConfig_, hostCopyFile_, objectData_, materials_, objectBVHNodes_, meshBVHNodes_,
+                   vertices_, primitiveObjects_);
+}
+
+void PTSceneConverter::reportLayoutSavings() const {
+  // Sizes of the previous (unpacked) layouts. Materials were part of the objects.
+  constexpr size_t kUnpackedObjectSize = 208u;
+  constexpr size_t kUnpackedVertexSize = 48u;
+  constexpr size_t kUnpackedBVHNodeSize = 48u;
+
+  const size_t bvhNodeCount = objectBVHNodes_.size() + meshBVHNodes_.size();
+  const size_t packedBytes = objectData_.size() * sizeof(GPUObjectData) + materials_.size() * sizeof(GPUMaterial) +
+                             vertexCount_ * sizeof(GPUVertex) + bvhNodeCount * sizeof(GPUBVHNode);
+  const size_t unpackedBytes = objectData_.size() * kUnpackedObjectSize + vertexCount_ * kUnpackedVertexSize +
+                               bvhNodeCount * kUnpackedBVHNodeSize;
+
+  std::cout << "Scene buffers: " << packedBytes / 1024u << " KB (packed layouts save "
+            << (unpackedBytes - std::min(packedBytes, unpackedBytes)) / 1024u << " KB)." << std::endl;
+}
+
+void PTSceneConverter::reportBVHStatistics() const {
+  SceneBVHStatistics statistics =
+    analyzeSceneBVHs(objectBVHNodes_.data(), objectBVHNodes_.size(), meshBVHNodes_.data(), meshBVHInfos_);
+  logBVHStatistics(statistics, meshBVHInfos_, traversalStackSize_);
+
+  if (bvhBuildConfig_.reportPath.empty()) {
+    return;
   }
 
-  std::cout << " Copying to GPU" << std::endl;
+  std::ofstream file(bvhBuildConfig_.reportPath);
+  if (!file) {
+    std::cout << "Failed to write BVH report to " << bvhBuildConfig_.reportPath << "." << std::endl;
+    return;
+  }
 
-  objectDataBuffer_ =
-    copyToGPU(objectData_.data(), objectData_.size() * sizeof(GPUObjectData), vk::BufferUsageFlagBits::eStorageBuffer);
-  objectBVHNodesBuffer_ = copyToGPU(objectBVHNodes_.data(), objectBVHNodes_.size() * sizeof(GPUBVHNode),
-                                    vk::BufferUsageFlagBits::eStorageBuffer);
-  verticesBuffer_ =
-    copyToGPU(vertices_.data(), vertices_.size() * sizeof(GPUVertex), vk::BufferUsageFlagBits::eStorageBuffer);
-  meshBVHNodesBuffer_ =
-    copyToGPU(meshBVHNodes_.data(), meshBVHNodes_.size() * sizeof(GPUBVHNode), vk::BufferUsageFlagBits::eStorageBuffer);
+  writeBVHReport(file, statistics, meshBVHInfos_, traversalStackSize_);
+  std::cout << "BVH report written to " << bvhBuildConfig_.reportPath << "." << std::endl;
+}
 
-  std::cout << " Finished." << std::endl;
+bool PTSceneConverter::isLoadComplete() const {
+  return loadComplete_;
 }
 
 const std::vector<lsg::Ref<lsg::Object>>& PTSceneConverter::getCameras() const {
@@ -160,59 +504,202 @@ const std::vector<lsg::Ref<lsg::Object>>& PTSceneConverter::getCameras() const {
 }
 
 const logi::VMABuffer& PTSceneConverter::getObjectDataBuffer() const {
-  return objectDataBuffer_;
+  return objectDataBuffer_.buffer;
+}
+
+const logi::VMABuffer& PTSceneConverter::getMaterialsBuffer() const {
+  return materialsBuffer_.buffer;
 }
 
 const logi::VMABuffer& PTSceneConverter::getObjectBvhNodesBuffer() const {
-  return objectBVHNodesBuffer_;
+  return objectBVHNodesBuffer_.buffer;
 }
 
 const logi::VMABuffer& PTSceneConverter::getVerticesBuffer() const {
-  return verticesBuffer_;
+  return verticesBuffer_.buffer;
 }
 
 const logi::VMABuffer& PTSceneConverter::getMeshBvhNodesBuffer() const {
-  return meshBVHNodesBuffer_;
+  return meshBVHNodesBuffer_.buffer;
+}
+
+const logi::VMABuffer& PTSceneConverter::getPrimitiveObjectsBuffer() const {
+  return primitiveObjectsBuffer_.buffer;
 }
 
 const std::vector<GPUTexture>& PTSceneConverter::getTextures() const {
   return textures_;
 }
 
-logi::VMABuffer PTSceneConverter::copyToGPU(void* data, size_t size, const vk::BufferUsageFlags& usageFlags) {
+const SceneFeatures& PTSceneConverter::getSceneFeatures() const {
+  return sceneFeatures_;
+}
+
+const std::vector<VertexRange>& PTSceneConverter::getVertexRanges() const {
+  return vertexRanges_;
+}
+
+const HostCopy<GPUObjectData>& PTSceneConverter::getHostObjectData() const {
+  return objectData_;
+}
+
+const HostCopy<GPUMaterial>& PTSceneConverter::getHostMaterials() const {
+  return materials_;
+}
+
+const HostCopy<GPUBVHNode>& PTSceneConverter::getHostObjectBvhNodes() const {
+  return objectBVHNodes_;
+}
+
+const HostCopy<GPUBVHNode>& PTSceneConverter::getHostMeshBvhNodes() const {
+  return meshBVHNodes_;
+}
+
+HostScene PTSceneConverter::getHostScene() const {
+  HostScene scene;
+  scene.objects = objectData_.data();
+  scene.objectBVHNodes = objectBVHNodes_.data();
+  scene.objectBVHNodeCount = objectBVHNodes_.size();
+  scene.meshBVHNodes = meshBVHNodes_.data();
+  scene.meshBVHNodeCount = meshBVHNodes_.size();
+  scene.vertices = vertices_.empty() ? nullptr : vertices_.data();
+  scene.primitiveObjects = primitiveObjects_.empty() ? nullptr : primitiveObjects_.data();
+  scene.flattened = bvhBuildConfig_.flattenScene;
+  return scene;
+}
+
+bool PTSceneConverter::retainsGeometry() const {
+  // Dropped with the other host copies once the scene is loaded.
+  return hostCopyConfig_.geometry || bvhBuildConfig_.occlusionBenchmarkRays > 0u;
+}
+
+void PTSceneConverter::setHostCopyRetention(const HostCopyConfiguration& configuration) {
+  hostCopyConfig_ = configuration;
+}
+
+void PTSceneConverter::setMappedBuffersPath(const std::string& path) {
+  mappedBuffersPath_ = path;
+}
+
+void PTSceneConverter::setBVHBuildConfiguration(const BVHBuildConfiguration& configuration,
+                                                uint32_t traversalStackSize) {
+  bvhBuildConfig_ = configuration;
+  traversalStackSize_ = traversalStackSize;
+}
+
+void PTSceneConverter::setTextureStreaming(const TextureStreamingConfiguration& configuration) {
+  textureStreamingConfig_ = configuration;
+}
+
+bool PTSceneConverter::isTextureStreamingActive() const {
+  return static_cast<bool>(textureStreamer_);
+}
+
+std::vector<uint32_t> PTSceneConverter::updateTextureStreaming(const uint32_t* feedback, uint32_t frameIndex) {
+  if (!textureStreamer_) {
+    return {};
+  }
+
+  std::vector<uint32_t> changed = textureStreamer_->update(feedback, textures_.size(), frameIndex);
+
+  // Samplers are kept, only the resident image changes.
+  for (uint32_t textureIndex : changed) {
+    const GPUTexture& streamed = textureStreamer_->getTexture(textureIndex);
+    textures_[textureIndex].image = streamed.image;
+    textures_[textureIndex].imageView = streamed.imageView;
+  }
+
+  return changed;
+}
+
+bool PTSceneConverter::writeToGPU(GrowableGPUBuffer& target, vk::DeviceSize offset, const void* data,
+                                  vk::DeviceSize size) {
+  std::vector<StagedData> chunks;
+
+  if (size > 0u) {
+    // Allocate staging buffer.
+    VmaAllocationCreateInfo stagingBufferAllocationInfo = {};
+    stagingBufferAllocationInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_CPU_TO_GPU;
+
+    vk::BufferCreateInfo stagingBufferInfo;
+    stagingBufferInfo.size = size;
+    stagingBufferInfo.usage = vk::BufferUsageFlagBits::eTransferSrc;
+    stagingBufferInfo.sharingMode = vk::SharingMode::eExclusive;
+
+    StagedData& staged = chunks.emplace_back();
+    staged.buffer = allocator_.createBuffer(stagingBufferInfo, stagingBufferAllocationInfo);
+    staged.buffer.writeToBuffer(data, size);
+    staged.size = size;
+  }
+
+  return writeToGPU(target, offset, chunks);
+}
+
+bool PTSceneConverter::writeToGPU(GrowableGPUBuffer& target, vk::DeviceSize offset, std::vector<StagedData>& chunks) {
+  vk::DeviceSize size = 0u;
+  for (const auto& chunk : chunks) {
+    size += chunk.size;
+  }
+
+  const vk::DeviceSize requiredSize = offset + size;
+  const vk::DeviceSize capacity = target.buffer ? target.buffer.size() : 0u;
+  const bool reallocate = requiredSize > capacity || !target.buffer;
+
+  if (!reallocate && size == 0u) {
+    target.size = requiredSize;
+    return false;
+  }
+
   logi::CommandBuffer cmdBuffer = commandPool_.allocateCommandBuffer(vk::CommandBufferLevel::ePrimary);
   cmdBuffer.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
 
-  // Allocate staging buffer.
-  VmaAllocationCreateInfo stagingBufferAllocationInfo = {};
-  stagingBufferAllocationInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_CPU_TO_GPU;
+  logi::VMABuffer previousBuffer;
 
-  vk::BufferCreateInfo stagingBufferInfo;
-  stagingBufferInfo.size = size;
-  stagingBufferInfo.usage = usageFlags | vk::BufferUsageFlagBits::eTransferSrc;
-  stagingBufferInfo.sharingMode = vk::SharingMode::eExclusive;
+  if (reallocate) {
+    // Capacity grows geometrically, so that appending is amortized constant per byte.
+    VmaAllocationCreateInfo gpuBufferAllocationInfo = {};
+    gpuBufferAllocationInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_GPU_ONLY;
+
+    vk::BufferCreateInfo gpuBufferInfo;
+    gpuBufferInfo.size = std::max({requiredSize, 2u * capacity, kMinBufferCapacity});
+    gpuBufferInfo.usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc |
+                          vk::BufferUsageFlagBits::eTransferDst;
+    gpuBufferInfo.sharingMode = vk::SharingMode::eExclusive;
 
-  logi::VMABuffer stagingBuffer = allocator_.createBuffer(stagingBufferInfo, stagingBufferAllocationInfo);
-  stagingBuffer.writeToBuffer(data, size);
+    previousBuffer = target.buffer;
+    target.buffer = allocator_.createBuffer(gpuBufferInfo, gpuBufferAllocationInfo);
 
-  // Allocate dedicated GPU buffer.
-  VmaAllocationCreateInfo gpuBufferAllocationInfo = {};
-  gpuBufferAllocationInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_GPU_ONLY;
+    // Keep the contents in front of the written range.
+    if (previousBuffer && offset > 0u) {
+      vk::BufferCopy copyRegion;
+      copyRegion.size = std::min(offset, target.size);
+      copyRegion.srcOffset = 0u;
+      copyRegion.dstOffset = 0u;
 
-  vk::BufferCreateInfo gpuBufferInfo;
-  gpuBufferInfo.size = size;
-  gpuBufferInfo.usage = usageFlags | vk::BufferUsageFlagBits::eTransferDst;
-  gpuBufferInfo.sharingMode = vk::SharingMode::eExclusive;
+      cmdBuffer.copyBuffer(previousBuffer, target.buffer, copyRegion);
 
-  logi::VMABuffer gpuBuffer = allocator_.createBuffer(gpuBufferInfo, gpuBufferAllocationInfo);
+      vk::MemoryBarrier copyBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eTransferWrite);
+      cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, {},
+                                copyBarrier, {}, {});
+    }
+  }
+
+  // Add copy commands to cmd buffer.
+  vk::DeviceSize dstOffset = offset;
+  for (const auto& chunk : chunks) {
+    if (chunk.size == 0u) {
+      continue;
+    }
+
+    vk::BufferCopy copyRegion;
+    copyRegion.size = chunk.size;
+    copyRegion.srcOffset = 0u;
+    copyRegion.dstOffset = dstOffset;
 
-  // Add copy command to cmd buffer.
-  vk::BufferCopy copyRegion;
-  copyRegion.size = size;
-  copyRegion.srcOffset = 0u;
-  copyRegion.dstOffset = 0u;
+    cmdBuffer.copyBuffer(chunk.buffer, target.buffer, copyRegion);
+    dstOffset += chunk.size;
+  }
 
-  cmdBuffer.copyBuffer(stagingBuffer, gpuBuffer, copyRegion);
   cmdBuffer.end();
 
   vk::SubmitInfo submit_info;
@@ -221,132 +708,77 @@ logi::VMABuffer PTSceneConverter::copyToGPU(void* data, size_t size, const vk::B
   transferQueue_.submit({submit_info});
   transferQueue_.waitIdle();
 
-  stagingBuffer.destroy();
+  for (auto& chunk : chunks) {
+    if (chunk.buffer) {
+      chunk.buffer.destroy();
+    }
+  }
+  chunks.clear();
+
+  if (previousBuffer) {
+    previousBuffer.destroy();
+  }
   cmdBuffer.destroy();
 
-  return gpuBuffer;
+  target.size = requiredSize;
+  return reallocate;
 }
 
 void PTSceneConverter::reset() {
   cameras_.clear();
+  sceneFeatures_ = SceneFeatures();
   objectData_.clear();
+  materials_.clear();
   objectBVHNodes_.clear();
+  vertexCount_ = 0u;
+  vertexRanges_.clear();
   vertices_.clear();
+  primitiveObjects_.clear();
   meshBVHNodes_.clear();
+  meshBVHInfos_.clear();
+  // Spill file is rewritten by the next load.
+  hostCopyFile_.close();
+
+  for (GrowableGPUBuffer* buffer : {&objectDataBuffer_, &materialsBuffer_, &objectBVHNodesBuffer_, &verticesBuffer_,
+                                    &meshBVHNodesBuffer_, &primitiveObjectsBuffer_}) {
+    if (buffer->buffer) {
+      buffer->buffer.destroy();
+    }
+    *buffer = GrowableGPUBuffer();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(batchMutex_);
+    for (auto& batch : pendingBatches_) {
+      for (auto& staged : batch.vertices) {
+        if (staged.buffer) {
+          staged.buffer.destroy();
+        }
+      }
+    }
+    pendingBatches_.clear();
+  }
+  loadComplete_ = false;
 
-  objectDataBuffer_.destroy();
-  objectBVHNodesBuffer_.destroy();
-  verticesBuffer_.destroy();
-  meshBVHNodesBuffer_.destroy();
+  // Streamer owns the images of streamed textures, so their table entries go with it.
+  textureStreamer_.reset();
+  textures_.clear();
 }
 
 uint32_t PTSceneConverter::copyTextureToGPU(const lsg::Ref<lsg::Texture>& texture) {
   lsg::Ref<lsg::Image> image = texture->image();
 
+  uint32_t textureIndex = textures_.size();
   GPUTexture& gpuTexture = textures_.emplace_back();
 
-  uint64_t imageByteSize = image->pixelSize() * image->height() * image->width();
-
-  logi::CommandBuffer cmdBuffer = commandPool_.allocateCommandBuffer(vk::CommandBufferLevel::ePrimary);
-  cmdBuffer.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
-
-  // Allocate staging buffer.
-  VmaAllocationCreateInfo stagingBufferAllocationInfo = {};
-  stagingBufferAllocationInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_CPU_TO_GPU;
-
-  vk::BufferCreateInfo stagingBufferInfo;
-  stagingBufferInfo.size = imageByteSize;
-  stagingBufferInfo.usage = vk::BufferUsageFlagBits::eTransferSrc;
-  stagingBufferInfo.sharingMode = vk::SharingMode::eExclusive;
-
-  logi::VMABuffer stagingBuffer = allocator_.createBuffer(stagingBufferInfo, stagingBufferAllocationInfo);
-  stagingBuffer.writeToBuffer(image->rawPixelData(), imageByteSize);
-
-  // Allocate dedicated GPU image.
-  VmaAllocationCreateInfo gpuImageAllocationInfo = {};
-  gpuImageAllocationInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_GPU_ONLY;
-
-  vk::ImageCreateInfo imageInfo;
-  imageInfo.imageType = vk::ImageType::e2D;
-  imageInfo.extent.width = image->width();
-  imageInfo.extent.height = image->height();
-  imageInfo.extent.depth = 1;
-  imageInfo.mipLevels = 1;
-  imageInfo.arrayLayers = 1;
-  imageInfo.format = image->getFormat();
-  imageInfo.tiling = vk::ImageTiling::eOptimal;
-  imageInfo.initialLayout = vk::ImageLayout::eUndefined;
-  imageInfo.usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst;
-  imageInfo.samples = vk::SampleCountFlagBits::e1;
-  imageInfo.sharingMode = vk::SharingMode::eExclusive;
-
-  gpuTexture.image = allocator_.createImage(imageInfo, gpuImageAllocationInfo);
-
-  // Transition to DST optimal
-  vk::ImageMemoryBarrier barrierDstOptimal;
-  barrierDstOptimal.oldLayout = vk::ImageLayout::eUndefined;
-  barrierDstOptimal.newLayout = vk::ImageLayout::eTransferDstOptimal;
-  barrierDstOptimal.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  barrierDstOptimal.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  barrierDstOptimal.image = gpuTexture.image;
-  barrierDstOptimal.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-  barrierDstOptimal.subresourceRange.baseMipLevel = 0;
-  barrierDstOptimal.subresourceRange.levelCount = 1;
-  barrierDstOptimal.subresourceRange.baseArrayLayer = 0;
-  barrierDstOptimal.subresourceRange.layerCount = 1;
-  barrierDstOptimal.srcAccessMask = {};
-  barrierDstOptimal.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
-
-  cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, {}, {},
-                            barrierDstOptimal);
-
-  // Copy data to texture
-  vk::BufferImageCopy region = {};
-  region.bufferOffset = 0;
-  region.bufferRowLength = 0;
-  region.bufferImageHeight = 0;
-  region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-  region.imageSubresource.mipLevel = 0;
-  region.imageSubresource.baseArrayLayer = 0;
-  region.imageSubresource.layerCount = 1;
-  region.imageOffset = vk::Offset3D();
-  region.imageExtent = vk::Extent3D{static_cast<uint32_t>(image->width()), static_cast<uint32_t>(image->height()), 1};
-
-  cmdBuffer.copyBufferToImage(stagingBuffer, gpuTexture.image, vk::ImageLayout::eTransferDstOptimal, region);
-
-  // Transition to DST optimal
-  vk::ImageMemoryBarrier barrierShaderReadOptimal;
-  barrierShaderReadOptimal.oldLayout = vk::ImageLayout::eTransferDstOptimal;
-  barrierShaderReadOptimal.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-  barrierShaderReadOptimal.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  barrierShaderReadOptimal.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  barrierShaderReadOptimal.image = gpuTexture.image;
-  barrierShaderReadOptimal.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-  barrierShaderReadOptimal.subresourceRange.baseMipLevel = 0;
-  barrierShaderReadOptimal.subresourceRange.levelCount = 1;
-  barrierShaderReadOptimal.subresourceRange.baseArrayLayer = 0;
-  barrierShaderReadOptimal.subresourceRange.layerCount = 1;
-  barrierShaderReadOptimal.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-  barrierShaderReadOptimal.dstAccessMask = vk::AccessFlagBits::eShaderRead;
-
-  cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, {}, {},
-                            barrierShaderReadOptimal);
-
-  cmdBuffer.end();
-
-  vk::SubmitInfo submit_info;
-  submit_info.commandBufferCount = 1;
-  submit_info.pCommandBuffers = &static_cast<const vk::CommandBuffer&>(cmdBuffer);
-  transferQueue_.submit({submit_info});
-  transferQueue_.waitIdle();
-
-  stagingBuffer.destroy();
-  cmdBuffer.destroy();
-
-  // Create image view.
-  gpuTexture.imageView = gpuTexture.image.createImageView(
-    vk::ImageViewCreateFlags(), vk::ImageViewType::e2D, image->getFormat(), vk::ComponentMapping(),
-    vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
+  if (textureStreamer_ && TextureStreamer::isStreamable(image->getFormat())) {
+    // Only the base level is uploaded. Finer levels are streamed in once the path tracer requests them.
+    gpuTexture = textureStreamer_->registerTexture(textureIndex, image);
+  } else {
+    uint64_t imageByteSize = image->pixelSize() * image->height() * image->width();
+    gpuTexture = uploadTexture(allocator_, commandPool_, transferQueue_, image->rawPixelData(), imageByteSize,
+                               image->width(), image->height(), image->getFormat());
+  }
 
   lsg::Ref<lsg::Sampler> sampler = texture->sampler();
 
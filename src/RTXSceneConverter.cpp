@@ -2,8 +2,12 @@
 // Created by primoz on 25. 08. 19.
 //
 #include "RTXSceneConverter.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
 #include <glm/gtx/string_cast.hpp>
 #include <utility>
+#include "Helpers.hpp"
 
 struct RTXGeometryInstance {
   glm::mat4x3 transform;
@@ -14,14 +18,6 @@ struct RTXGeometryInstance {
   uint64_t accelerationStructureHandle;
 };
 
-RTXMaterial::RTXMaterial(const glm::vec4& baseColorFactor, const glm::vec3& emissionFactor, float metallicFactor,
-                         float roughnessFactor, float transmissionFactor, float ior, uint32_t verticesOffset)
-  : baseColorFactor(baseColorFactor), emissionFactor(emissionFactor), metallicFactor(metallicFactor),
-    roughnessFactor(roughnessFactor), transmissionFactor(transmissionFactor), ior(ior), verticesOffset(verticesOffset) {
-}
-
-RTXVertex::RTXVertex(const glm::vec3& normal, const glm::vec2& uv) : normal(normal), uv(uv) {}
-
 RTXSceneConverter::RTXSceneConverter(logi::MemoryAllocator allocator, logi::CommandPool commandPool,
                                      logi::Queue transferQueue)
   : allocator_(std::move(allocator)), commandPool_(std::move(commandPool)), transferQueue_(std::move(transferQueue)) {}
@@ -29,6 +25,12 @@ RTXSceneConverter::RTXSceneConverter(logi::MemoryAllocator allocator, logi::Comm
 void RTXSceneConverter::loadScene(const lsg::Ref<lsg::Scene>& scene) {
   reset();
 
+  // Geometry is copied from the mapped glTF buffers where they match the scene graph.
+  const GLTFBuffers mappedBuffers =
+    mappedBuffersPath_.empty() ? GLTFBuffers() : GLTFBuffers::tryMap(mappedBuffersPath_);
+
+  std::vector<std::pair<lsg::Ref<lsg::SubMesh>, glm::mat4x3>> subMeshes;
+
   scene->traverseDownExcl([&](const lsg::Ref<lsg::Object>& obj) {
     // Check if the object has mesh.
     lsg::Ref<lsg::Mesh> mesh = obj->getComponent<lsg::Mesh>();
@@ -46,12 +48,42 @@ void RTXSceneConverter::loadScene(const lsg::Ref<lsg::Scene>& scene) {
                   : glm::mat4x3(1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f);
 
     for (const auto& subMesh : mesh->subMeshes()) {
-      loadMesh(subMesh, transformMatrix);
+      subMeshes.emplace_back(subMesh, transformMatrix);
     }
 
     return true;
   });
 
+  // Vertices are written straight from the staging memory into their final place, so the buffer is sized first.
+  size_t totalVertexCount = 0u;
+  for (const auto& [subMesh, transformMatrix] : subMeshes) {
+    if (isLoadable(subMesh)) {
+      totalVertexCount += subMesh->geometry()->getTriangleNormalAccessor()->count() * 3u;
+    }
+  }
+
+  VmaAllocationCreateInfo verticesAllocationInfo = {};
+  verticesAllocationInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_GPU_ONLY;
+
+  vk::BufferCreateInfo verticesInfo;
+  verticesInfo.size = std::max<size_t>(totalVertexCount, 1u) * sizeof(RTXVertex);
+  verticesInfo.usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst;
+  verticesInfo.sharingMode = vk::SharingMode::eExclusive;
+
+  verticesBuffer_ = allocator_.createBuffer(verticesInfo, verticesAllocationInfo);
+
+  size_t mappedSubMeshCount = 0u;
+  for (const auto& [subMesh, transformMatrix] : subMeshes) {
+    const GLTFPrimitive* primitive = mappedBuffers.find(subMesh);
+    mappedSubMeshCount += primitive ? 1u : 0u;
+    loadMesh(subMesh, primitive, transformMatrix);
+  }
+
+  if (mappedBuffers) {
+    std::cout << "Copied " << mappedSubMeshCount << " of " << subMeshes.size() << " submeshes from "
+              << mappedBuffers.mappedBytes() / 1024u << " KB of mapped glTF buffers." << std::endl;
+  }
+
   // Create top level acceleration structure.
   std::vector<RTXGeometryInstance> instances(rtMeshes_.size());
   for (uint64_t i = 0; i < rtMeshes_.size(); i++) {
@@ -81,32 +113,57 @@ void RTXSceneConverter::loadScene(const lsg::Ref<lsg::Scene>& scene) {
 
   instancesBuffer.destroy();
 
-  // Copy materials and vertices to buffer
-  verticesBuffer_ =
-    copyToGPU(vertices_.data(), vertices_.size() * sizeof(RTXVertex), vk::BufferUsageFlagBits::eStorageBuffer);
+  // Copy materials and instances to buffer
   materialsBuffer_ =
-    copyToGPU(materials_.data(), materials_.size() * sizeof(RTXMaterial), vk::BufferUsageFlagBits::eStorageBuffer);
+    copyToGPU(materials_.data(), materials_.size() * sizeof(GPUMaterial), vk::BufferUsageFlagBits::eStorageBuffer);
+  instancesBuffer_ =
+    copyToGPU(instances_.data(), instances_.size() * sizeof(RTXInstance), vk::BufferUsageFlagBits::eStorageBuffer);
+
+  // Vertices used to take 32 B and materials 80 B (including the vertices offset, now in the instances).
+  const size_t packedBytes = vertexCount_ * sizeof(RTXVertex) + materials_.size() * sizeof(GPUMaterial) +
+                             instances_.size() * sizeof(RTXInstance);
+  const size_t unpackedBytes = vertexCount_ * 32u + materials_.size() * 80u;
+  std::cout << "Scene buffers: " << packedBytes / 1024u << " KB (packed layouts save "
+            << (unpackedBytes - std::min(packedBytes, unpackedBytes)) / 1024u << " KB)." << std::endl;
+
+  releaseStaging();
+  applyHostCopyRetention();
 }
 
 const logi::VMAAccelerationStructureNV& RTXSceneConverter::getTopLevelAccelerationStructure() {
   return tlas_;
 }
 
-void RTXSceneConverter::loadMesh(const lsg::Ref<lsg::SubMesh>& subMesh, const glm::mat4x3& worldMatrix) {
+bool RTXSceneConverter::isLoadable(const lsg::Ref<lsg::SubMesh>& subMesh) {
   lsg::Ref<lsg::Geometry> geometry = subMesh->geometry();
-  lsg::Ref<lsg::MetallicRoughnessMaterial> material =
-    lsg::dynamicRefCast<lsg::MetallicRoughnessMaterial>(subMesh->material());
+  return geometry && lsg::dynamicRefCast<lsg::MetallicRoughnessMaterial>(subMesh->material()) &&
+         geometry->hasVertices() && geometry->hasNormals();
+}
 
+void RTXSceneConverter::loadMesh(const lsg::Ref<lsg::SubMesh>& subMesh, const GLTFPrimitive* primitive,
+                                 const glm::mat4x3& worldMatrix) {
   // Nothing to do if mesh has no geometry
-  if (!geometry || !material || !geometry->hasVertices() || !geometry->hasNormals()) {
+  if (!isLoadable(subMesh)) {
     std::wcerr << "Skipping mesh." << std::endl;
     return;
   }
 
-  // Store material info.
-  auto& gpuMaterial = materials_.emplace_back(material->baseColorFactor(), material->emissiveFactor(),
-                                              material->metallicFactor(), material->roughnessFactor(),
-                                              material->transmissionFactor(), material->ior(), vertices_.size());
+  lsg::Ref<lsg::Geometry> geometry = subMesh->geometry();
+  lsg::Ref<lsg::MetallicRoughnessMaterial> material =
+    lsg::dynamicRefCast<lsg::MetallicRoughnessMaterial>(subMesh->material());
+
+  // Store material and instance info.
+  RTXInstance& instance = instances_.resident().emplace_back();
+  instance.materialIndex = static_cast<uint32_t>(materials_.size());
+  instance.verticesOffset = vertexCount_;
+
+  GPUMaterial& gpuMaterial = materials_.resident().emplace_back();
+  gpuMaterial.baseColorFactor = material->baseColorFactor();
+  gpuMaterial.emissionFactor = material->emissiveFactor();
+  gpuMaterial.metallicFactor = material->metallicFactor();
+  gpuMaterial.roughnessFactor = material->roughnessFactor();
+  gpuMaterial.transmissionFactor = material->transmissionFactor();
+  gpuMaterial.ior = material->ior();
 
   gpuMaterial.colorTexture =
     (material->baseColorTex()) ? copyTextureToGPU(material->baseColorTex()) : std::numeric_limits<uint32_t>::max();
@@ -129,8 +186,20 @@ void RTXSceneConverter::loadMesh(const lsg::Ref<lsg::SubMesh>& subMesh, const gl
   RTMesh& rtMesh = rtMeshes_.emplace_back();
   rtMesh.transform = worldMatrix;
   lsg::TBufferAccessor<glm::vec3> vertices = geometry->getVertices();
-  rtMesh.vertices = copyToGPU(&vertices[0], vertices.count() * vertices.elementSize(),
-                              vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eRayTracingNV);
+  if (primitive) {
+    // Mapped positions may be interleaved with other attributes, so they are gathered into the staging memory.
+    const vk::DeviceSize positionsByteSize = primitive->positions.count * sizeof(glm::vec3);
+    rtMesh.vertices = createGPUBuffer(positionsByteSize, vk::BufferUsageFlagBits::eVertexBuffer |
+                                                           vk::BufferUsageFlagBits::eRayTracingNV);
+    auto* position = reinterpret_cast<glm::vec3*>(mapStaging(positionsByteSize));
+    for (size_t i = 0; i < primitive->positions.count; i++) {
+      position[i] = primitive->positions.get<glm::vec3>(i);
+    }
+    flushStaging(rtMesh.vertices, 0u, positionsByteSize);
+  } else {
+    rtMesh.vertices = copyToGPU(&vertices[0], vertices.count() * vertices.elementSize(),
+                                vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eRayTracingNV);
+  }
 
   geometryAS.geometry.triangles.vertexData = rtMesh.vertices;
   geometryAS.geometry.triangles.vertexStride = sizeof(glm::vec3);
@@ -138,26 +207,62 @@ void RTXSceneConverter::loadMesh(const lsg::Ref<lsg::SubMesh>& subMesh, const gl
   geometryAS.geometry.triangles.vertexOffset = 0;
   geometryAS.geometry.triangles.vertexFormat = vk::Format::eR32G32B32Sfloat;
 
-  // Store normals to vertex array.
+  // Interleave normals and uvs directly into the staging memory.
   auto normalAccessor = geometry->getTriangleNormalAccessor();
   auto uvAccessor = geometry->hasUv(0u) ? geometry->getTriangleUVAccessor(0u) : nullptr;
 
-  if (uvAccessor) {
+  const vk::DeviceSize verticesByteSize = normalAccessor->count() * 3u * sizeof(RTXVertex);
+  auto* vertex = reinterpret_cast<RTXVertex*>(mapStaging(verticesByteSize));
+
+  if (primitive) {
+    for (size_t i = 0; i < primitive->triangleCount(); i++) {
+      for (uint32_t corner = 0u; corner < 3u; corner++) {
+        const uint32_t v = primitive->vertex(i, corner);
+        *vertex++ = packRTXVertex(primitive->normals.get<glm::vec3>(v),
+                                  primitive->uvs ? primitive->uvs.get<glm::vec2>(v) : glm::vec2(0.0f));
+      }
+    }
+  } else if (uvAccessor) {
     for (size_t i = 0; i < normalAccessor->count(); i++) {
-      vertices_.emplace_back((*normalAccessor)[i].a(), (*uvAccessor)[i].a());
-      vertices_.emplace_back((*normalAccessor)[i].b(), (*uvAccessor)[i].b());
-      vertices_.emplace_back((*normalAccessor)[i].c(), (*uvAccessor)[i].c());
+      *vertex++ = packRTXVertex((*normalAccessor)[i].a(), (*uvAccessor)[i].a());
+      *vertex++ = packRTXVertex((*normalAccessor)[i].b(), (*uvAccessor)[i].b());
+      *vertex++ = packRTXVertex((*normalAccessor)[i].c(), (*uvAccessor)[i].c());
     }
   } else {
     for (size_t i = 0; i < normalAccessor->count(); i++) {
-      vertices_.emplace_back((*normalAccessor)[i].a());
-      vertices_.emplace_back((*normalAccessor)[i].b());
-      vertices_.emplace_back((*normalAccessor)[i].c());
+      *vertex++ = packRTXVertex((*normalAccessor)[i].a());
+      *vertex++ = packRTXVertex((*normalAccessor)[i].b());
+      *vertex++ = packRTXVertex((*normalAccessor)[i].c());
     }
   }
 
+  flushStaging(verticesBuffer_, vertexCount_ * sizeof(RTXVertex), verticesByteSize);
+  vertexCount_ += normalAccessor->count() * 3u;
+
   // Indices
-  if (geometry->hasIndices()) {
+  if (primitive && primitive->indices) {
+    // Byte indices are widened, as acceleration structures only take 16 and 32 bit indices.
+    const bool wideIndices = primitive->indices.stride == sizeof(uint32_t);
+    const size_t indexCount = primitive->indices.count;
+    const vk::DeviceSize indicesByteSize = indexCount * (wideIndices ? sizeof(uint32_t) : sizeof(uint16_t));
+    rtMesh.indices = createGPUBuffer(indicesByteSize, vk::BufferUsageFlagBits::eIndexBuffer |
+                                                        vk::BufferUsageFlagBits::eRayTracingNV);
+
+    std::byte* staging = mapStaging(indicesByteSize);
+    for (size_t i = 0; i < indexCount; i++) {
+      if (wideIndices) {
+        reinterpret_cast<uint32_t*>(staging)[i] = primitive->indices.index(i);
+      } else {
+        reinterpret_cast<uint16_t*>(staging)[i] = static_cast<uint16_t>(primitive->indices.index(i));
+      }
+    }
+    flushStaging(rtMesh.indices, 0u, indicesByteSize);
+
+    geometryAS.geometry.triangles.indexData = rtMesh.indices;
+    geometryAS.geometry.triangles.indexOffset = 0;
+    geometryAS.geometry.triangles.indexCount = indexCount;
+    geometryAS.geometry.triangles.indexType = wideIndices ? vk::IndexType::eUint32 : vk::IndexType::eUint16;
+  } else if (geometry->hasIndices()) {
     lsg::BufferAccessor indices = geometry->getIndices();
     rtMesh.indices =
       copyToGPU(indices.bufferView().data() + indices.byteOffset(), indices.count() * indices.elementSize(),
@@ -178,22 +283,7 @@ void RTXSceneConverter::loadMesh(const lsg::Ref<lsg::SubMesh>& subMesh, const gl
   rtMesh.blas = createAccelerationStructure(vk::AccelerationStructureTypeNV::eBottomLevel, {geometryAS});
 }
 
-logi::VMABuffer RTXSceneConverter::copyToGPU(void* data, size_t size, const vk::BufferUsageFlags& usageFlags) {
-  logi::CommandBuffer cmdBuffer = commandPool_.allocateCommandBuffer(vk::CommandBufferLevel::ePrimary);
-  cmdBuffer.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
-
-  // Allocate staging buffer.
-  VmaAllocationCreateInfo stagingBufferAllocationInfo = {};
-  stagingBufferAllocationInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_CPU_TO_GPU;
-
-  vk::BufferCreateInfo stagingBufferInfo;
-  stagingBufferInfo.size = size;
-  stagingBufferInfo.usage = usageFlags | vk::BufferUsageFlagBits::eTransferSrc;
-  stagingBufferInfo.sharingMode = vk::SharingMode::eExclusive;
-
-  logi::VMABuffer stagingBuffer = allocator_.createBuffer(stagingBufferInfo, stagingBufferAllocationInfo);
-  stagingBuffer.writeToBuffer(data, size);
-
+logi::VMABuffer RTXSceneConverter::createGPUBuffer(size_t size, const vk::BufferUsageFlags& usageFlags) {
   // Allocate dedicated GPU buffer.
   VmaAllocationCreateInfo gpuBufferAllocationInfo = {};
   gpuBufferAllocationInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_GPU_ONLY;
@@ -203,27 +293,76 @@ logi::VMABuffer RTXSceneConverter::copyToGPU(void* data, size_t size, const vk::
   gpuBufferInfo.usage = usageFlags | vk::BufferUsageFlagBits::eTransferDst;
   gpuBufferInfo.sharingMode = vk::SharingMode::eExclusive;
 
-  logi::VMABuffer gpuBuffer = allocator_.createBuffer(gpuBufferInfo, gpuBufferAllocationInfo);
+  return allocator_.createBuffer(gpuBufferInfo, gpuBufferAllocationInfo);
+}
+
+logi::VMABuffer RTXSceneConverter::copyToGPU(const void* data, size_t size,
+                                             const vk::BufferUsageFlags& usageFlags) {
+  logi::VMABuffer gpuBuffer = createGPUBuffer(size, usageFlags);
+
+  // Data is copied straight from the scene buffers into the mapped staging memory.
+  std::memcpy(mapStaging(size), data, size);
+  flushStaging(gpuBuffer, 0u, size);
+
+  return gpuBuffer;
+}
+
+std::byte* RTXSceneConverter::mapStaging(vk::DeviceSize size) {
+  if (stagingBuffer_ && stagingBuffer_.size() >= size) {
+    return stagingMemory_;
+  }
+
+  releaseStaging();
+
+  // Host coherent memory, so writes through the persistent mapping need no flushes.
+  VmaAllocationCreateInfo stagingBufferAllocationInfo = {};
+  stagingBufferAllocationInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_CPU_ONLY;
+
+  vk::BufferCreateInfo stagingBufferInfo;
+  stagingBufferInfo.size = std::max(size, kMinStagingSize);
+  stagingBufferInfo.usage = vk::BufferUsageFlagBits::eTransferSrc;
+  stagingBufferInfo.sharingMode = vk::SharingMode::eExclusive;
+
+  stagingBuffer_ = allocator_.createBuffer(stagingBufferInfo, stagingBufferAllocationInfo);
+  stagingMemory_ = static_cast<std::byte*>(stagingBuffer_.mapMemory());
+
+  return stagingMemory_;
+}
+
+void RTXSceneConverter::flushStaging(const logi::Buffer& dstBuffer, vk::DeviceSize dstOffset, vk::DeviceSize size) {
+  if (size == 0u) {
+    return;
+  }
+
+  logi::CommandBuffer cmdBuffer = commandPool_.allocateCommandBuffer(vk::CommandBufferLevel::ePrimary);
+  cmdBuffer.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
 
   // Add copy command to cmd buffer.
   vk::BufferCopy copyRegion;
   copyRegion.size = size;
   copyRegion.srcOffset = 0u;
-  copyRegion.dstOffset = 0u;
+  copyRegion.dstOffset = dstOffset;
 
-  cmdBuffer.copyBuffer(stagingBuffer, gpuBuffer, copyRegion);
+  cmdBuffer.copyBuffer(stagingBuffer_, dstBuffer, copyRegion);
   cmdBuffer.end();
 
   vk::SubmitInfo submit_info;
   submit_info.commandBufferCount = 1;
   submit_info.pCommandBuffers = &static_cast<const vk::CommandBuffer&>(cmdBuffer);
   transferQueue_.submit({submit_info});
+  // Staging memory is reused by the next copy.
   transferQueue_.waitIdle();
 
-  stagingBuffer.destroy();
   cmdBuffer.destroy();
+}
 
-  return gpuBuffer;
+void RTXSceneConverter::releaseStaging() {
+  if (stagingBuffer_) {
+    stagingBuffer_.unmapMemory();
+    stagingBuffer_.destroy();
+    stagingBuffer_ = {};
+    stagingMemory_ = nullptr;
+  }
 }
 
 uint32_t RTXSceneConverter::copyTextureToGPU(const lsg::Ref<lsg::Texture>& texture) {
@@ -376,8 +515,12 @@ uint32_t RTXSceneConverter::copyTextureToGPU(const lsg::Ref<lsg::Texture>& textu
 
 void RTXSceneConverter::reset() {
   materials_.clear();
+  instances_.clear();
+  // Spill file is rewritten by the next load.
+  hostCopyFile_.close();
   materialsBuffer_.destroy();
-  vertices_.clear();
+  instancesBuffer_.destroy();
+  vertexCount_ = 0u;
   verticesBuffer_.destroy();
   tlas_.destroy();
 
@@ -465,6 +608,30 @@ const logi::VMABuffer& RTXSceneConverter::getVertexBuffer() const {
   return verticesBuffer_;
 }
 
+const logi::VMABuffer& RTXSceneConverter::getInstancesBuffer() const {
+  return instancesBuffer_;
+}
+
 const std::vector<GPUTexture>& RTXSceneConverter::getTextures() const {
   return textures_;
 }
+
+const HostCopy<GPUMaterial>& RTXSceneConverter::getHostMaterials() const {
+  return materials_;
+}
+
+const HostCopy<RTXInstance>& RTXSceneConverter::getHostInstances() const {
+  return instances_;
+}
+
+void RTXSceneConverter::setHostCopyRetention(const HostCopyConfiguration& configuration) {
+  hostCopyConfig_ = configuration;
+}
+
+void RTXSceneConverter::setMappedBuffersPath(const std::string& path) {
+  mappedBuffersPath_ = path;
+}
+
+void RTXSceneConverter::applyHostCopyRetention() {
+  retainHostCopies(hostCopyConfig_, hostCopyFile_, materials_, instances_);
+}
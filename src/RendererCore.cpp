@@ -1,6 +1,123 @@
 #include "RendererCore.hpp"
+#include <algorithm>
 #include <cppglfw/GLFWManager.h>
+#include <cstring>
 #include <utility>
+#include "SobolSampler.hpp"
+
+const char* toString(PreviewShading shading) {
+  switch (shading) {
+    case PreviewShading::ePathTracing:
+      return "path tracing";
+    case PreviewShading::eAlbedoNormal:
+      return "albedo and normal";
+    case PreviewShading::eAmbientOcclusion:
+      return "ambient occlusion";
+    case PreviewShading::eDirectLighting:
+      return "direct lighting";
+  }
+  return "unknown";
+}
+
+const char* toString(RayTracingBackend backend) {
+  switch (backend) {
+    case RayTracingBackend::eAuto:
+      return "automatic";
+    case RayTracingBackend::eSoftwareBVH:
+      return "software BVH";
+    case RayTracingBackend::eRayQuery:
+      return "KHR ray query";
+    case RayTracingBackend::eNVRayTracing:
+      return "NV ray tracing";
+  }
+  return "unknown";
+}
+
+namespace {
+
+// Device extensions a backend needs on top of the ones every renderer enables.
+std::vector<const char*> backendExtensions(RayTracingBackend backend) {
+  switch (backend) {
+    case RayTracingBackend::eRayQuery:
+      return {VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME, VK_KHR_RAY_QUERY_EXTENSION_NAME,
+              VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME};
+    case RayTracingBackend::eNVRayTracing:
+      return {VK_NV_RAY_TRACING_EXTENSION_NAME, VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME};
+    default:
+      return {};
+  }
+}
+
+bool supportsExtensions(const logi::PhysicalDevice& device, const std::vector<const char*>& extensions) {
+  const std::vector<vk::ExtensionProperties> available = device.enumerateDeviceExtensionProperties();
+
+  for (const char* extension : extensions) {
+    auto matches = [extension](const vk::ExtensionProperties& properties) {
+      return std::strcmp(&properties.extensionName[0], extension) == 0;
+    };
+
+    if (std::none_of(available.begin(), available.end(), matches)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Texture tables are variable sized, non-uniformly indexed arrays that are updated while bound (see
+// createLogicalDevice). Every renderer needs them.
+bool supportsDescriptorIndexing(const logi::PhysicalDevice& device) {
+  if (!supportsExtensions(device, {VK_KHR_MAINTENANCE3_EXTENSION_NAME, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME})) {
+    return false;
+  }
+
+  const vk::PhysicalDeviceDescriptorIndexingFeaturesEXT features =
+    device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceDescriptorIndexingFeaturesEXT>()
+      .get<vk::PhysicalDeviceDescriptorIndexingFeaturesEXT>();
+  return features.shaderSampledImageArrayNonUniformIndexing &&
+         features.descriptorBindingSampledImageUpdateAfterBind &&
+         features.descriptorBindingUpdateUnusedWhilePending && features.descriptorBindingPartiallyBound &&
+         features.descriptorBindingVariableDescriptorCount && features.runtimeDescriptorArray;
+}
+
+bool supportsBackend(const logi::PhysicalDevice& device, RayTracingBackend backend) {
+  if (!supportsExtensions(device, backendExtensions(backend))) {
+    return false;
+  }
+
+  if (backend == RayTracingBackend::eRayQuery) {
+    // Ray query shaders are SPIR-V 1.5 and acceleration structures are built from buffer device addresses.
+    if (device.getProperties().apiVersion < VK_API_VERSION_1_2) {
+      return false;
+    }
+
+    auto features = device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceBufferDeviceAddressFeatures,
+                                        vk::PhysicalDeviceAccelerationStructureFeaturesKHR,
+                                        vk::PhysicalDeviceRayQueryFeaturesKHR>();
+    return features.get<vk::PhysicalDeviceBufferDeviceAddressFeatures>().bufferDeviceAddress &&
+           features.get<vk::PhysicalDeviceAccelerationStructureFeaturesKHR>().accelerationStructure &&
+           features.get<vk::PhysicalDeviceRayQueryFeaturesKHR>().rayQuery;
+  }
+
+  return true;
+}
+
+// Higher is faster. Negative for devices that are never selected.
+int deviceTypeRank(vk::PhysicalDeviceType type) {
+  switch (type) {
+    case vk::PhysicalDeviceType::eDiscreteGpu:
+      return 2;
+    case vk::PhysicalDeviceType::eIntegratedGpu:
+    case vk::PhysicalDeviceType::eVirtualGpu:
+      return 1;
+    case vk::PhysicalDeviceType::eCpu:
+      return 0;
+    default:
+      return -1;
+  }
+}
+
+} // namespace
 
 RendererConfiguration::RendererConfiguration(std::string windowTitle, int32_t windowWidth, int32_t windowHeight,
                                              float renderScale, std::vector<const char*> instanceExtensions,
@@ -25,18 +142,26 @@ VkBool32 debugCallback(VkDebugReportFlagsEXT flags, VkDebugReportObjectTypeEXT o
 }
 
 RendererCore::RendererCore(cppglfw::Window window, const RendererConfiguration& configuration)
-  : window_(std::move(window)), renderScale(configuration.renderScale) {
+  : window_(std::move(window)), rayTracingBackend_(configuration.rayTracingBackend),
+    renderScale(configuration.renderScale),
+    pipelineCachePath_(configuration.pipelineCachePath),
+    constructionStart_(std::chrono::high_resolution_clock::now()) {
   // Create instance.
   createInstance(configuration.instanceExtensions, configuration.validationLayers);
   // Create surface and register it on to the instance.
   surface_ = instance_.registerSurfaceKHR(window_.createWindowSurface(instance_).value);
   selectPhysicalDevice();
   createLogicalDevice(configuration.deviceExtensions);
+  loadPipelineCache();
   initializeSwapChain();
   buildSyncObjects();
   initializeCommandBuffers();
 }
 
+RendererCore::~RendererCore() {
+  savePipelineCache();
+}
+
 void RendererCore::createInstance(const std::vector<const char*>& extensions,
                                   const std::vector<const char*>& validationLayers) {
   // Add required extensions.
@@ -44,6 +169,8 @@ void RendererCore::createInstance(const std::vector<const char*>& extensions,
   allExtensions = cppglfw::GLFWManager::instance().getRequiredInstanceExtensions();
   allExtensions.insert(allExtensions.end(), extensions.begin(), extensions.end());
   allExtensions.emplace_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+  // Required by VK_EXT_descriptor_indexing.
+  allExtensions.emplace_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 
   // Remove duplicate extension.
   std::sort(allExtensions.begin(), allExtensions.end());
@@ -56,6 +183,11 @@ void RendererCore::createInstance(const std::vector<const char*>& extensions,
   instanceCI.ppEnabledExtensionNames = allExtensions.data();
   instanceCI.enabledExtensionCount = allExtensions.size();
 
+  // Ray queries need Vulkan 1.2 devices (see selectPhysicalDevice). Older devices are still enumerated.
+  vk::ApplicationInfo applicationInfo;
+  applicationInfo.apiVersion = VK_API_VERSION_1_2;
+  instanceCI.pApplicationInfo = &applicationInfo;
+
   instance_ = logi::createInstance(
     instanceCI, reinterpret_cast<PFN_vkCreateInstance>(glfwGetInstanceProcAddress(nullptr, "vkCreateInstance")),
     reinterpret_cast<PFN_vkGetInstanceProcAddr>(glfwGetInstanceProcAddress(nullptr, "vkGetInstanceProcAddr")));
@@ -70,24 +202,78 @@ void RendererCore::createInstance(const std::vector<const char*>& extensions,
 }
 
 void RendererCore::selectPhysicalDevice() {
-  // Select GPU
   const std::vector<logi::PhysicalDevice>& devices = instance_.enumeratePhysicalDevices();
+  const RayTracingBackend requested = rayTracingBackend_;
 
   // TODO: Implement better GPU selection for systems with multiple dedicated GPU-s.
+  int bestRank = -1;
   for (const auto& device : devices) {
-    vk::PhysicalDeviceType type = device.getProperties().deviceType;
+    const vk::PhysicalDeviceProperties properties = device.getProperties();
+    const int typeRank = deviceTypeRank(properties.deviceType);
+    if (typeRank < 0) {
+      continue;
+    }
 
-    if (type == vk::PhysicalDeviceType::eDiscreteGpu) {
-      // If discrete gpu is found select it immediately.
-      physicalDevice_ = device;
-      break;
-    } else if (type == vk::PhysicalDeviceType::eIntegratedGpu || type == vk::PhysicalDeviceType::eVirtualGpu) {
+    if (!supportsDescriptorIndexing(device)) {
+      std::cout << "Skipping " << &properties.deviceName[0] << ": descriptor indexing is not supported." << std::endl;
+      continue;
+    }
+
+    RayTracingBackend backend = requested;
+    if (requested == RayTracingBackend::eAuto || requested == RayTracingBackend::eRayQuery) {
+      backend = supportsBackend(device, RayTracingBackend::eRayQuery) ? RayTracingBackend::eRayQuery
+                                                                      : RayTracingBackend::eSoftwareBVH;
+    } else if (requested == RayTracingBackend::eNVRayTracing && !supportsBackend(device, requested)) {
+      continue;
+    }
+
+    // A GPU tracing the software BVH is still faster than a CPU implementation with ray queries.
+    const int rank = 2 * typeRank + (backend == RayTracingBackend::eSoftwareBVH ? 0 : 1);
+    if (rank > bestRank) {
+      bestRank = rank;
       physicalDevice_ = device;
+      rayTracingBackend_ = backend;
     }
   }
 
-  // Assert if no device is found.
-  assert(physicalDevice_);
+  if (!physicalDevice_) {
+    throw std::runtime_error(requested == RayTracingBackend::eNVRayTracing
+                               ? "No device supports VK_NV_ray_tracing and descriptor indexing."
+                               : "Failed to find a Vulkan device that supports descriptor indexing.");
+  }
+
+  if (requested == RayTracingBackend::eRayQuery && rayTracingBackend_ != RayTracingBackend::eRayQuery) {
+    std::cout << "No device supports KHR ray queries. Falling back to the software BVH." << std::endl;
+  }
+
+  // Texture tables hold combined image samplers, which count against both the sampler and the sampled image limits.
+  const vk::PhysicalDeviceDescriptorIndexingPropertiesEXT limits =
+    physicalDevice_.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDescriptorIndexingPropertiesEXT>()
+      .get<vk::PhysicalDeviceDescriptorIndexingPropertiesEXT>();
+  maxVariableDescriptorCount_ = std::min({kMaxVariableDescriptorCount,
+                                          limits.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                                          limits.maxDescriptorSetUpdateAfterBindSampledImages,
+                                          limits.maxPerStageDescriptorUpdateAfterBindSamplers,
+                                          limits.maxDescriptorSetUpdateAfterBindSamplers});
+
+  const vk::PhysicalDeviceProperties properties = physicalDevice_.getProperties();
+  std::cout << "Selected " << &properties.deviceName[0] << " (" << toString(rayTracingBackend_) << " backend)."
+            << std::endl;
+}
+
+bool RendererCore::supportsComputeSubgroupOperations() const {
+  if (physicalDevice_.getProperties().apiVersion < VK_API_VERSION_1_1) {
+    return false;
+  }
+
+  const vk::PhysicalDeviceSubgroupProperties properties =
+    physicalDevice_.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceSubgroupProperties>()
+      .get<vk::PhysicalDeviceSubgroupProperties>();
+  const vk::SubgroupFeatureFlags required = vk::SubgroupFeatureFlagBits::eBasic |
+                                            vk::SubgroupFeatureFlagBits::eArithmetic |
+                                            vk::SubgroupFeatureFlagBits::eBallot;
+  return (properties.supportedStages & vk::ShaderStageFlagBits::eCompute) &&
+         (properties.supportedOperations & required) == required;
 }
 
 void RendererCore::createLogicalDevice(const std::vector<const char*>& deviceExtensions) {
@@ -121,8 +307,39 @@ void RendererCore::createLogicalDevice(const std::vector<const char*>& deviceExt
     throw std::runtime_error("Failed to find queue family that supports presentation.");
   }
 
-  std::vector<const char*> extensions{VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+  std::vector<const char*> extensions{VK_KHR_SWAPCHAIN_EXTENSION_NAME, VK_KHR_MAINTENANCE3_EXTENSION_NAME,
+                                      VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME};
   extensions.insert(extensions.end(), deviceExtensions.begin(), deviceExtensions.end());
+  const std::vector<const char*> rayTracingExtensions = backendExtensions(rayTracingBackend_);
+  extensions.insert(extensions.end(), rayTracingExtensions.begin(), rayTracingExtensions.end());
+  std::sort(extensions.begin(), extensions.end(),
+            [](const char* lhs, const char* rhs) { return std::strcmp(lhs, rhs) < 0; });
+  extensions.erase(std::unique(extensions.begin(), extensions.end(),
+                               [](const char* lhs, const char* rhs) { return std::strcmp(lhs, rhs) == 0; }),
+                   extensions.end());
+
+  // Texture tables are variable sized, non-uniformly indexed arrays that are updated while bound.
+  vk::PhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures;
+  descriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+  descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+  descriptorIndexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+  descriptorIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+  descriptorIndexingFeatures.descriptorBindingVariableDescriptorCount = VK_TRUE;
+  descriptorIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+
+  // Acceleration structures are built from device addresses and traversed with ray queries in path_tracing.comp.
+  vk::PhysicalDeviceBufferDeviceAddressFeatures bufferDeviceAddressFeatures;
+  bufferDeviceAddressFeatures.bufferDeviceAddress = VK_TRUE;
+  vk::PhysicalDeviceAccelerationStructureFeaturesKHR accelerationStructureFeatures;
+  accelerationStructureFeatures.accelerationStructure = VK_TRUE;
+  vk::PhysicalDeviceRayQueryFeaturesKHR rayQueryFeatures;
+  rayQueryFeatures.rayQuery = VK_TRUE;
+
+  if (rayTracingBackend_ == RayTracingBackend::eRayQuery) {
+    descriptorIndexingFeatures.pNext = &bufferDeviceAddressFeatures;
+    bufferDeviceAddressFeatures.pNext = &accelerationStructureFeatures;
+    accelerationStructureFeatures.pNext = &rayQueryFeatures;
+  }
 
   static const std::array<float, 1> kPriorities = {1.0f};
 
@@ -137,6 +354,7 @@ void RendererCore::createLogicalDevice(const std::vector<const char*>& deviceExt
   deviceCI.ppEnabledExtensionNames = extensions.data();
   deviceCI.queueCreateInfoCount = queueCIs.size();
   deviceCI.pQueueCreateInfos = queueCIs.data();
+  deviceCI.pNext = &descriptorIndexingFeatures;
 
   logicalDevice_ = physicalDevice_.createLogicalDevice(deviceCI);
   std::vector<logi::QueueFamily> queueFamilies = logicalDevice_.enumerateQueueFamilies();
@@ -271,6 +489,98 @@ void RendererCore::buildSyncObjects() {
   inFlightFence_ = logicalDevice_.createFence(vk::FenceCreateInfo(vk::FenceCreateFlagBits::eSignaled));
 }
 
+namespace {
+
+/**
+ * Header written in front of the pipeline cache data. Cache is only reused on the same device and driver version.
+ */
+struct PipelineCacheFileHeader {
+  uint32_t magic;
+  uint32_t vendorID;
+  uint32_t deviceID;
+  uint32_t driverVersion;
+  uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+  uint64_t dataSize;
+};
+
+constexpr uint32_t kPipelineCacheMagic = 0x4C505443u; // "LPTC"
+
+PipelineCacheFileHeader createPipelineCacheHeader(const vk::PhysicalDeviceProperties& properties, uint64_t dataSize) {
+  PipelineCacheFileHeader header{};
+  header.magic = kPipelineCacheMagic;
+  header.vendorID = properties.vendorID;
+  header.deviceID = properties.deviceID;
+  header.driverVersion = properties.driverVersion;
+  std::memcpy(header.pipelineCacheUUID, &properties.pipelineCacheUUID[0], VK_UUID_SIZE);
+  header.dataSize = dataSize;
+  return header;
+}
+
+} // namespace
+
+void RendererCore::loadPipelineCache() {
+  std::vector<char> cacheData;
+
+  if (!pipelineCachePath_.empty()) {
+    std::ifstream file(pipelineCachePath_, std::ios::binary);
+    PipelineCacheFileHeader fileHeader{};
+
+    if (file.is_open() && file.read(reinterpret_cast<char*>(&fileHeader), sizeof(fileHeader))) {
+      PipelineCacheFileHeader deviceHeader = createPipelineCacheHeader(physicalDevice_.getProperties(), 0u);
+
+      // Data of a different device or driver would be rejected (or worse, misused) by the driver.
+      if (fileHeader.magic != deviceHeader.magic || fileHeader.vendorID != deviceHeader.vendorID ||
+          fileHeader.deviceID != deviceHeader.deviceID || fileHeader.driverVersion != deviceHeader.driverVersion ||
+          std::memcmp(fileHeader.pipelineCacheUUID, deviceHeader.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        std::cout << "Pipeline cache does not match the device or driver. Starting with an empty cache." << std::endl;
+      } else {
+        cacheData.resize(fileHeader.dataSize);
+        if (!file.read(cacheData.data(), cacheData.size())) {
+          std::cout << "Pipeline cache file is truncated. Starting with an empty cache." << std::endl;
+          cacheData.clear();
+        }
+      }
+    }
+  }
+
+  vk::PipelineCacheCreateInfo createInfo;
+  createInfo.initialDataSize = cacheData.size();
+  createInfo.pInitialData = cacheData.data();
+
+  pipelineCache_ = logicalDevice_.createPipelineCache(createInfo);
+  pipelineCacheWarm_ = !cacheData.empty();
+
+  if (pipelineCacheWarm_) {
+    std::cout << "Loaded pipeline cache (" << cacheData.size() << " bytes)." << std::endl;
+  }
+}
+
+void RendererCore::savePipelineCache() const {
+  if (pipelineCachePath_.empty() || !pipelineCache_) {
+    return;
+  }
+
+  std::vector<uint8_t> cacheData = pipelineCache_.getPipelineCacheData();
+  PipelineCacheFileHeader header = createPipelineCacheHeader(physicalDevice_.getProperties(), cacheData.size());
+
+  std::ofstream file(pipelineCachePath_, std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    std::cout << "Failed to write pipeline cache to " << pipelineCachePath_ << "." << std::endl;
+    return;
+  }
+
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(cacheData.data()), cacheData.size());
+}
+
+void RendererCore::reportStartupTime() const {
+  auto startupTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() -
+                                                                           constructionStart_)
+                       .count();
+  std::cout << "Renderer initialized in " << startupTime << " ms (" << (pipelineCacheWarm_ ? "warm" : "cold")
+            << " pipeline cache)." << std::endl;
+}
+
 logi::ShaderModule RendererCore::createShaderModule(const std::string& shaderPath) {
   std::ifstream file(shaderPath, std::ios::ate | std::ios::binary);
 
@@ -293,10 +603,19 @@ logi::ShaderModule RendererCore::createShaderModule(const std::string& shaderPat
   return logicalDevice_.createShaderModule(createInfo);
 }
 
-PipelineLayoutData RendererCore::loadPipelineShaders(const std::vector<ShaderInfo>& shaderInfo) {
+PipelineLayoutData RendererCore::loadPipelineShaders(const std::vector<ShaderInfo>& shaderInfo,
+                                                     const std::vector<ShaderInfo>& layoutShaderInfo) {
   PipelineLayoutData layoutData;
   std::vector<logi::ShaderStage> stages;
 
+  // Loaded first, so that a missing layout shader does not leave the pipeline shaders behind.
+  std::vector<logi::ShaderModule> layoutShaders;
+  std::vector<logi::ShaderStage> layoutStages;
+  for (const auto& entry : layoutShaderInfo) {
+    layoutShaders.emplace_back(createShaderModule(entry.path));
+    layoutStages.emplace_back(layoutShaders.back(), entry.entryPoint);
+  }
+
   for (const auto& entry : shaderInfo) {
     logi::ShaderModule shader = createShaderModule(entry.path);
     vk::ShaderStageFlagBits stage = shader.getEntryPointReflectionInfo(entry.entryPoint).stage;
@@ -309,18 +628,44 @@ PipelineLayoutData RendererCore::loadPipelineShaders(const std::vector<ShaderInf
     stages.emplace_back(shader, entry.entryPoint);
   }
 
-  // Generate descriptor set layouts.
-  std::vector<logi::DescriptorSetReflectionInfo> descriptorSetInfo = logi::reflectDescriptorSets(stages);
+  // Generate descriptor set layouts. Bindings of the same set and binding index are merged across the stages.
+  std::vector<logi::ShaderStage> reflectedStages(stages);
+  reflectedStages.insert(reflectedStages.end(), layoutStages.begin(), layoutStages.end());
+  std::vector<logi::DescriptorSetReflectionInfo> descriptorSetInfo = logi::reflectDescriptorSets(reflectedStages);
   layoutData.descriptorSetLayouts.reserve(descriptorSetInfo.size());
 
   for (const auto& info : descriptorSetInfo) {
     // Generate binding infos.
     std::vector<vk::DescriptorSetLayoutBinding> bindings(info.bindings.begin(), info.bindings.end());
+    std::vector<vk::DescriptorBindingFlagsEXT> bindingFlags(bindings.size());
+    bool updateAfterBind = false;
+
+    // Runtime arrays are reflected with zero descriptors. They are allocated with a variable descriptor count (see
+    // allocateVariableDescriptorSet), so they must be the last binding of their set.
+    for (size_t i = 0; i < bindings.size(); i++) {
+      if (bindings[i].descriptorCount == 0u) {
+        bindings[i].descriptorCount = maxVariableDescriptorCount_;
+        bindingFlags[i] = vk::DescriptorBindingFlagBitsEXT::eVariableDescriptorCount |
+                          vk::DescriptorBindingFlagBitsEXT::ePartiallyBound |
+                          vk::DescriptorBindingFlagBitsEXT::eUpdateAfterBind |
+                          vk::DescriptorBindingFlagBitsEXT::eUpdateUnusedWhilePending;
+        updateAfterBind = true;
+      }
+    }
+
+    vk::DescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo;
+    bindingFlagsInfo.bindingCount = bindingFlags.size();
+    bindingFlagsInfo.pBindingFlags = bindingFlags.data();
 
     vk::DescriptorSetLayoutCreateInfo descriptorSetLayoutInfo;
     descriptorSetLayoutInfo.bindingCount = bindings.size();
     descriptorSetLayoutInfo.pBindings = bindings.data();
 
+    if (updateAfterBind) {
+      descriptorSetLayoutInfo.flags = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPoolEXT;
+      descriptorSetLayoutInfo.pNext = &bindingFlagsInfo;
+    }
+
     layoutData.descriptorSetLayouts.emplace_back(logicalDevice_.createDescriptorSetLayout(descriptorSetLayoutInfo));
   }
 
@@ -339,9 +684,80 @@ PipelineLayoutData RendererCore::loadPipelineShaders(const std::vector<ShaderInf
 
   layoutData.layout = logicalDevice_.createPipelineLayout(pipelineLayoutInfo);
 
+  for (auto& shader : layoutShaders) {
+    shader.destroy();
+  }
+
   return layoutData;
 }
 
+logi::DescriptorSet RendererCore::allocateVariableDescriptorSet(logi::DescriptorPool& pool,
+                                                               const logi::DescriptorSetLayout& layout,
+                                                               vk::DescriptorType type, uint32_t descriptorCount) {
+  if (descriptorCount > maxVariableDescriptorCount_) {
+    throw std::runtime_error("Variable descriptor count exceeds the layout limit.");
+  }
+
+  // Destroying the pool also frees the previously allocated set.
+  if (pool) {
+    pool.destroy();
+  }
+
+  // Pool sizes must not be zero, while a variable descriptor count of zero is valid.
+  vk::DescriptorPoolSize poolSize(type, std::max(descriptorCount, 1u));
+
+  vk::DescriptorPoolCreateInfo poolInfo;
+  poolInfo.flags = vk::DescriptorPoolCreateFlagBits::eUpdateAfterBindEXT;
+  poolInfo.pPoolSizes = &poolSize;
+  poolInfo.poolSizeCount = 1u;
+  poolInfo.maxSets = 1u;
+
+  pool = logicalDevice_.createDescriptorPool(poolInfo);
+
+  vk::DescriptorSetVariableDescriptorCountAllocateInfoEXT variableCountInfo;
+  variableCountInfo.descriptorSetCount = 1u;
+  variableCountInfo.pDescriptorCounts = &descriptorCount;
+
+  return pool.allocateDescriptorSets({static_cast<const vk::DescriptorSetLayout&>(layout)}, variableCountInfo)[0];
+}
+
+logi::VMABuffer RendererCore::createSamplerBuffer(const logi::MemoryAllocator& allocator,
+                                                  const logi::DescriptorSet& descriptorSet, uint32_t binding) {
+  SobolSampler sampler;
+  const std::vector<uint32_t>& directionNumbers = sampler.getDirectionNumbers();
+  const size_t byteSize = directionNumbers.size() * sizeof(uint32_t);
+
+  VmaAllocationCreateInfo allocationInfo = {};
+  allocationInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_CPU_TO_GPU;
+
+  // Create and init Sobol direction numbers buffer.
+  vk::BufferCreateInfo bufferCreateInfo;
+  bufferCreateInfo.size = byteSize;
+  bufferCreateInfo.usage = vk::BufferUsageFlagBits::eStorageBuffer;
+  bufferCreateInfo.sharingMode = vk::SharingMode::eExclusive;
+
+  logi::VMABuffer buffer = allocator.createBuffer(bufferCreateInfo, allocationInfo);
+  buffer.writeToBuffer(directionNumbers.data(), byteSize);
+
+  // Update direction numbers descriptor.
+  vk::DescriptorBufferInfo bufferInfo;
+  bufferInfo.buffer = buffer;
+  bufferInfo.offset = 0;
+  bufferInfo.range = byteSize;
+
+  vk::WriteDescriptorSet descriptorWrite;
+  descriptorWrite.dstSet = descriptorSet;
+  descriptorWrite.dstBinding = binding;
+  descriptorWrite.dstArrayElement = 0;
+  descriptorWrite.descriptorType = vk::DescriptorType::eStorageBuffer;
+  descriptorWrite.descriptorCount = 1;
+  descriptorWrite.pBufferInfo = &bufferInfo;
+
+  logicalDevice_.updateDescriptorSets(descriptorWrite);
+
+  return buffer;
+}
+
 void RendererCore::initializeCommandBuffers() {
   graphicsFamilyCmdPool_ = graphicsFamily_.createCommandPool(vk::CommandPoolCreateFlagBits::eResetCommandBuffer);
   mainCmdBuffers_ =
@@ -4,13 +4,71 @@
 
 #include "RendererPT.h"
 #include <RendererPT.h>
+#include <algorithm>
 #include <chrono>
 #include <cmath>
+#include <numeric>
+#include <sstream>
+#include "Helpers.hpp"
 
 RendererPT::RendererPT(const cppglfw::Window& window, const RendererConfiguration& configuration)
   : RendererCore(window, configuration), allocator_(logicalDevice_.createMemoryAllocator()),
+    denoiserConfig_(configuration.denoiser), reprojectionConfig_(configuration.reprojection),
+    dynamicResolutionConfig_(configuration.dynamicResolution), dynamicRenderScale_(configuration.renderScale),
+    tiledConfig_(configuration.tiledRendering), kernelConfig_(configuration.kernel),
+    previewConfig_(configuration.preview), textureStreamingConfig_(configuration.textureStreaming),
+    sceneLoadingConfig_(configuration.sceneLoading),
+    flatSceneBVH_(configuration.bvhBuild.flattenScene),
     sceneConverter_(allocator_, graphicsFamilyCmdPool_, graphicsQueue_) {
   srand(static_cast<unsigned>(time(0)));
+  ubo_.scrambleSeed = rand();
+  ubo_.shadingMode = static_cast<uint32_t>(PreviewShading::ePathTracing);
+  ubo_.aoDistance = previewConfig_.aoDistance;
+
+  if (denoiserConfig_.iterations == 0u) {
+    denoiserConfig_.enabled = false;
+  }
+
+  if (tiledConfig_.enabled) {
+    if (reprojectionConfig_.enabled || dynamicResolutionConfig_.enabled) {
+      std::cout << "Reprojection and dynamic resolution are not supported in tiled mode and were disabled."
+                << std::endl;
+      reprojectionConfig_.enabled = false;
+      dynamicResolutionConfig_.enabled = false;
+    }
+
+    if (kernelConfig_.persistentThreads) {
+      std::cout << "Persistent threads are not supported in tiled mode and were disabled." << std::endl;
+      kernelConfig_.persistentThreads = false;
+    }
+
+    if (kernelConfig_.rasterPrimaryVisibility) {
+      std::cout << "Rasterized camera rays are not supported in tiled mode and were disabled." << std::endl;
+      kernelConfig_.rasterPrimaryVisibility = false;
+    }
+
+    // Tile dispatches do not reset the counters, so the count would add up over tiles and frames.
+    if (kernelConfig_.countRays) {
+      std::cout << "Ray counting is not supported in tiled mode and was disabled." << std::endl;
+      kernelConfig_.countRays = false;
+    }
+  }
+
+  persistentThreadsSupported_ = supportsComputeSubgroupOperations();
+  if (kernelConfig_.persistentThreads && !persistentThreadsSupported_) {
+    std::cout << "Persistent threads require compute subgroup operations and were disabled." << std::endl;
+    kernelConfig_.persistentThreads = false;
+  }
+
+  if (!kernelConfig_.rasterPrimaryVisibility) {
+    kernelConfig_.compareRasterVisibility = false;
+  }
+
+  gpuTimer_ = GPUTimer(physicalDevice_, logicalDevice_, kTimerScopeCount);
+  sceneConverter_.setTextureStreaming(textureStreamingConfig_);
+  sceneConverter_.setHostCopyRetention(configuration.hostCopies);
+  sceneConverter_.setMappedBuffersPath(configuration.sceneLoading.mappedBuffersPath);
+  sceneConverter_.setBVHBuildConfiguration(configuration.bvhBuild, configuration.kernel.intersectionStackSize);
 
   createTexViewerRenderPass();
   createFrameBuffers();
@@ -18,34 +76,133 @@ RendererPT::RendererPT(const cppglfw::Window& window, const RendererConfiguratio
   texViewerPipelineLayoutData_ =
     loadPipelineShaders({{"shaders/tex_to_quad.vert.spv", "main"}, {"shaders/tex_to_quad.frag.spv", "main"}});
 
-  pathTracingPipelineLayoutData_ = loadPipelineShaders({{"shaders/path_tracing.comp.spv", "main"}});
+  // Ray query permutations additionally bind the top level acceleration structure. Their optimized modules drop the
+  // BVH buffers, so the layout is the union of their bindings and those of the (unoptimized) default shader, which
+  // runs until the acceleration structures are built (see commitSceneBatches).
+  if (rayTracingBackend_ == RayTracingBackend::eRayQuery) {
+    try {
+      pathTracingPipelineLayoutData_ =
+        loadPipelineShaders({{"shaders/path_tracing.comp.spv", "main"}}, {{kRayQueryLayoutShader, "main"}});
+      accelerationStructures_ = KHRAccelerationStructures(physicalDevice_, logicalDevice_);
+    } catch (const std::runtime_error&) {
+      std::cout << "Shader permutation " << kRayQueryLayoutShader << " not found. Falling back to the software BVH."
+                << std::endl;
+      rayTracingBackend_ = RayTracingBackend::eSoftwareBVH;
+    }
+  }
+  if (rayTracingBackend_ != RayTracingBackend::eRayQuery) {
+    pathTracingPipelineLayoutData_ = loadPipelineShaders({{"shaders/path_tracing.comp.spv", "main"}});
+  }
+
+  denoisePipelineLayoutData_ = loadPipelineShaders({{"shaders/denoise/atrous.comp.spv", "main"}});
+
+  reprojectionPipelineLayoutData_ = loadPipelineShaders({{"shaders/reproject.comp.spv", "main"}});
+
+  if (kernelConfig_.rasterPrimaryVisibility) {
+    visibilityPipelineLayoutData_ =
+      loadPipelineShaders({{"shaders/visibility.vert.spv", "main"}, {"shaders/visibility.frag.spv", "main"}});
+    visibilityTimer_ = GPUTimer(physicalDevice_, logicalDevice_, 1u);
+    createVisibilityRenderPass();
+    createVisibilityPipeline();
+  }
 
   createTexViewerPipeline();
   createPathTracingPipeline();
-  initializeAccumulationTexture();
+  createDenoisePipeline();
+  createReprojectionPipeline();
+  initializeRenderTargets();
   initializeDescriptorSets();
-  updateAccumulationTexDescriptorSet();
+  updateRenderTargetDescriptorSets();
   initializeUBOBuffer();
+  sobolDirectionsBuffer_ = createSamplerBuffer(allocator_, pathTracingDescSets_[0], 7);
+  initializeTraversalCountersBuffer();
+  reportStartupTime();
+}
+
+RendererPT::~RendererPT() {
+  // Acceleration structures are not owned by logi, so they are destroyed before the device.
+  logicalDevice_.waitIdle();
+  accelerationStructures_.destroy();
 }
 
 void RendererPT::loadScene(const lsg::Ref<lsg::Scene>& scene) {
   sceneLoaded_ = false;
+  // Textures of the new scene are written from the start of the texture table.
+  boundTextureCount_ = 0u;
+  selectedCameraTransform_ = {};
+  sceneLoadStart_ = std::chrono::high_resolution_clock::now();
+
+  // Batches are committed by the render thread (see drawFrame), which displays the scene while it is still loading.
+  const std::chrono::milliseconds batchInterval = sceneLoadingConfig_.progressive
+                                                    ? std::chrono::milliseconds(sceneLoadingConfig_.batchInterval)
+                                                    : std::chrono::milliseconds::max();
+  sceneConverter_.loadScene(scene, batchInterval);
+}
+
+void RendererPT::commitSceneBatches() {
+  if (!sceneConverter_.commitBatches()) {
+    return;
+  }
 
-  sceneConverter_.loadScene(scene);
   const std::vector<lsg::Ref<lsg::Object>>& cameras = sceneConverter_.getCameras();
   if (cameras.empty()) {
-    std::cout << "Loaded scene without cameras." << std::endl;
-    sceneConverter_.reset();
+    if (sceneConverter_.isLoadComplete()) {
+      std::cout << "Loaded scene without cameras." << std::endl;
+    }
+    return;
   }
 
-  selectedCameraTransform_ = sceneConverter_.getCameras()[0]->getComponent<lsg::Transform>();
+  bool firstCommit = !selectedCameraTransform_;
+  if (firstCommit) {
+    selectedCameraTransform_ = cameras[0]->getComponent<lsg::Transform>();
 
-  auto cameraData = cameras[0]->getComponent<lsg::PerspectiveCamera>();
-  ubo_.camera.fovY = cameraData->fov();
-  ubo_.camera.worldMatrix = selectedCameraTransform_->worldMatrix();
-  ubo_.reset = true;
+    auto cameraData = cameras[0]->getComponent<lsg::PerspectiveCamera>();
+    ubo_.camera.fovY = cameraData->fov();
+    ubo_.camera.worldMatrix = selectedCameraTransform_->worldMatrix();
+    ubo_.reset = true;
+    historyValid_ = false;
+  }
+
+  // Acceleration structures are built once, over the complete scene.
+  const bool buildAccelerationStructures =
+    rayTracingBackend_ == RayTracingBackend::eRayQuery && sceneConverter_.isLoadComplete();
+  if (buildAccelerationStructures) {
+    accelerationStructures_.build(sceneConverter_, flatSceneBVH_, graphicsFamilyCmdPool_, graphicsQueue_);
+    rayQueriesEnabled_ = accelerationStructures_.isBuilt();
+  }
+
+  // Features only accumulate while loading, so the permutation changes at most a few times. Persistent threads kernel
+  // and ray queries only exist as permutations.
+  if (kernelConfig_.selectShaderPermutation || kernelConfig_.persistentThreads || buildAccelerationStructures) {
+    selectPathTracingShader();
+  }
 
+  // Buffers may have been reallocated and the objects BVH was replaced.
   initializeAndBindSceneBuffer();
+  sceneChanged_ = true;
+
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() -
+                                                                       sceneLoadStart_);
+  if (firstCommit) {
+    std::cout << "First scene batch displayed after " << elapsed.count() << " ms." << std::endl;
+  }
+
+  if (sceneConverter_.isLoadComplete()) {
+    std::cout << "Scene loaded in " << elapsed.count() << " ms (peak RSS "
+              << getPeakResidentSetSize() / (1024u * 1024u) << " MB)." << std::endl;
+
+    // Benchmarks only make sense on the complete scene. Persistent threads kernel has a fixed workgroup shape.
+    if (kernelConfig_.autotuneWorkgroupSize && !kernelConfig_.persistentThreads) {
+      autotuneWorkgroupSize();
+    }
+    if (kernelConfig_.compareTraversalKernels && !tiledConfig_.enabled) {
+      compareTraversalKernels();
+    }
+    if (kernelConfig_.compareRasterVisibility) {
+      compareRasterVisibility();
+    }
+  }
+
   sceneLoaded_ = true;
 }
 
@@ -130,6 +287,13 @@ void RendererPT::createTexViewerPipeline() {
   ;
   fragShaderStageInfo.pName = "main";
 
+  // Reprojected history length differs per pixel, so the accumulation is normalized by its own sample count.
+  vk::Bool32 perPixelSampleCount = VK_TRUE;
+  vk::SpecializationMapEntry perPixelSampleCountEntry(0u, 0u, sizeof(vk::Bool32));
+  vk::SpecializationInfo fragSpecializationInfo(1u, &perPixelSampleCountEntry, sizeof(vk::Bool32),
+                                                &perPixelSampleCount);
+  fragShaderStageInfo.pSpecializationInfo = &fragSpecializationInfo;
+
   vk::PipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
 
   vk::PipelineVertexInputStateCreateInfo vertexInputInfo;
@@ -202,7 +366,7 @@ void RendererPT::createTexViewerPipeline() {
   pipelineInfo.renderPass = texViewerRenderPass_;
   pipelineInfo.subpass = 0;
 
-  texViewerPipeline_ = logicalDevice_.createGraphicsPipeline(pipelineInfo);
+  texViewerPipeline_ = logicalDevice_.createGraphicsPipeline(pipelineInfo, pipelineCache_);
 }
 
 void RendererPT::createPathTracingPipeline() {
@@ -210,31 +374,525 @@ void RendererPT::createPathTracingPipeline() {
     pathTracingPipeline_.destroy();
   }
 
+  PathTracingSpecialization specialization{};
+  // AOVs are only written when they are consumed by the denoiser or the reprojection.
+  specialization.writeAOVs = denoiserConfig_.enabled || reprojectionConfig_.enabled;
+  // Persistent threads kernel keeps a traversal stack per invocation in shared memory, so its workgroups are small.
+  specialization.workgroupWidth =
+    kernelConfig_.persistentThreads ? kPersistentWorkgroupSize : kernelConfig_.workgroupWidth;
+  specialization.workgroupHeight = kernelConfig_.persistentThreads ? 1u : kernelConfig_.workgroupHeight;
+  specialization.intersectionStackSize = kernelConfig_.intersectionStackSize;
+  specialization.maxTraceDepth = kernelConfig_.maxTraceDepth;
+  specialization.russianRouletteBounces = kernelConfig_.russianRouletteBounces;
+  specialization.textureFeedbackInterval =
+    textureStreamingConfig_.enabled ? std::max(textureStreamingConfig_.feedbackInterval, 1u) : 0u;
+  specialization.flatSceneBVH = flatSceneBVH_;
+  specialization.rasterPrimaryVisibility = kernelConfig_.rasterPrimaryVisibility;
+  specialization.countRays = kernelConfig_.countRays;
+
+  const std::array<vk::SpecializationMapEntry, 10> specializationEntries = {
+    vk::SpecializationMapEntry(0u, offsetof(PathTracingSpecialization, writeAOVs), sizeof(vk::Bool32)),
+    vk::SpecializationMapEntry(1u, offsetof(PathTracingSpecialization, workgroupWidth), sizeof(uint32_t)),
+    vk::SpecializationMapEntry(2u, offsetof(PathTracingSpecialization, workgroupHeight), sizeof(uint32_t)),
+    vk::SpecializationMapEntry(3u, offsetof(PathTracingSpecialization, intersectionStackSize), sizeof(uint32_t)),
+    vk::SpecializationMapEntry(4u, offsetof(PathTracingSpecialization, maxTraceDepth), sizeof(uint32_t)),
+    vk::SpecializationMapEntry(5u, offsetof(PathTracingSpecialization, russianRouletteBounces), sizeof(uint32_t)),
+    vk::SpecializationMapEntry(6u, offsetof(PathTracingSpecialization, textureFeedbackInterval), sizeof(uint32_t)),
+    vk::SpecializationMapEntry(7u, offsetof(PathTracingSpecialization, flatSceneBVH), sizeof(vk::Bool32)),
+    vk::SpecializationMapEntry(8u, offsetof(PathTracingSpecialization, rasterPrimaryVisibility), sizeof(vk::Bool32)),
+    vk::SpecializationMapEntry(9u, offsetof(PathTracingSpecialization, countRays), sizeof(vk::Bool32))};
+  vk::SpecializationInfo specializationInfo(specializationEntries.size(), specializationEntries.data(),
+                                            sizeof(PathTracingSpecialization), &specialization);
+
   vk::PipelineShaderStageCreateInfo compShaderStageInfo;
   compShaderStageInfo.stage = vk::ShaderStageFlagBits::eCompute;
-  compShaderStageInfo.module = pathTracingPipelineLayoutData_.shaders.at(vk::ShaderStageFlagBits::eCompute);
+  compShaderStageInfo.module = pathTracingShaderVariant_
+                                 ? pathTracingShaderVariant_
+                                 : pathTracingPipelineLayoutData_.shaders.at(vk::ShaderStageFlagBits::eCompute);
   compShaderStageInfo.pName = "main";
+  compShaderStageInfo.pSpecializationInfo = &specializationInfo;
 
   vk::ComputePipelineCreateInfo pipelineInfo;
   pipelineInfo.stage = compShaderStageInfo;
   pipelineInfo.layout = pathTracingPipelineLayoutData_.layout;
 
-  pathTracingPipeline_ = logicalDevice_.createComputePipeline(pipelineInfo);
+  pathTracingPipeline_ = logicalDevice_.createComputePipeline(pipelineInfo, pipelineCache_);
+}
+
+namespace {
+
+std::string workgroupCacheKey(const vk::PhysicalDeviceProperties& properties) {
+  return std::to_string(properties.vendorID) + ":" + std::to_string(properties.deviceID) + ":" +
+         std::to_string(properties.driverVersion);
+}
+
+} // namespace
+
+void RendererPT::autotuneWorkgroupSize() {
+  static const std::array<std::pair<uint32_t, uint32_t>, 5> kCandidates = {
+    {{8u, 8u}, {16u, 8u}, {8u, 16u}, {16u, 16u}, {32u, 8u}}};
+  static const uint32_t kIterations = 3u;
+
+  const std::string deviceKey = workgroupCacheKey(physicalDevice_.getProperties());
+
+  // Cache file holds one "<device key> <width> <height>" line per device.
+  std::vector<std::string> cacheLines;
+  {
+    std::ifstream cacheFile(kernelConfig_.autotuneCachePath);
+    std::string line;
+
+    while (std::getline(cacheFile, line)) {
+      std::istringstream lineStream(line);
+      std::string key;
+      uint32_t width = 0u;
+      uint32_t height = 0u;
+
+      if (!(lineStream >> key >> width >> height)) {
+        continue;
+      }
+
+      if (key == deviceKey && width > 0u && height > 0u) {
+        std::cout << "Using cached workgroup size " << width << "x" << height << "." << std::endl;
+        kernelConfig_.workgroupWidth = width;
+        kernelConfig_.workgroupHeight = height;
+        createPathTracingPipeline();
+        recordCommandBuffers();
+        return;
+      }
+
+      cacheLines.emplace_back(line);
+    }
+  }
+
+  const uint32_t maxInvocations = physicalDevice_.getProperties().limits.maxComputeWorkGroupInvocations;
+  std::pair<uint32_t, uint32_t> bestCandidate = {kernelConfig_.workgroupWidth, kernelConfig_.workgroupHeight};
+  double bestTime = -1.0;
+
+  for (const auto& candidate : kCandidates) {
+    if (candidate.first * candidate.second > maxInvocations) {
+      continue;
+    }
+
+    kernelConfig_.workgroupWidth = candidate.first;
+    kernelConfig_.workgroupHeight = candidate.second;
+    createPathTracingPipeline();
+
+    double time = benchmarkPathTracing(kIterations);
+    if (time < 0.0) {
+      std::cout << "Workgroup size autotuning requires timestamp queries." << std::endl;
+      break;
+    }
+
+    std::cout << "Workgroup size " << candidate.first << "x" << candidate.second << ": " << time << " ms" << std::endl;
+    if (bestTime < 0.0 || time < bestTime) {
+      bestTime = time;
+      bestCandidate = candidate;
+    }
+  }
+
+  kernelConfig_.workgroupWidth = bestCandidate.first;
+  kernelConfig_.workgroupHeight = bestCandidate.second;
+  createPathTracingPipeline();
+  recordCommandBuffers();
+
+  if (bestTime >= 0.0) {
+    std::cout << "Selected workgroup size " << bestCandidate.first << "x" << bestCandidate.second << "." << std::endl;
+
+    std::ofstream cacheFile(kernelConfig_.autotuneCachePath, std::ios::trunc);
+    for (const auto& line : cacheLines) {
+      cacheFile << line << std::endl;
+    }
+    cacheFile << deviceKey << " " << bestCandidate.first << " " << bestCandidate.second << std::endl;
+  }
+}
+
+double RendererPT::benchmarkPathTracing(uint32_t iterations) {
+  GPUTimer timer(physicalDevice_, logicalDevice_, 1u);
+  if (!timer.isSupported()) {
+    return -1.0;
+  }
+
+  updateUBOBuffer();
+
+  double bestTime = -1.0;
+
+  // First iteration warms up caches and is not measured.
+  for (uint32_t i = 0; i <= iterations; i++) {
+    logi::CommandBuffer cmdBuffer = graphicsFamilyCmdPool_.allocateCommandBuffer(vk::CommandBufferLevel::ePrimary);
+    cmdBuffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+    timer.recordReset(cmdBuffer);
+    timer.recordBegin(cmdBuffer, 0u);
+    recordPathTracingDispatch(cmdBuffer);
+    timer.recordEnd(cmdBuffer, 0u, vk::PipelineStageFlagBits::eComputeShader);
+    cmdBuffer.end();
+
+    vk::SubmitInfo submitInfo;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &static_cast<const vk::CommandBuffer&>(cmdBuffer);
+    graphicsQueue_.submit({submitInfo});
+    logicalDevice_.waitIdle();
+    cmdBuffer.destroy();
+
+    if (i > 0u && timer.fetchResults()) {
+      double time = timer.getMilliseconds(0u);
+      bestTime = bestTime < 0.0 ? time : std::min(bestTime, time);
+    }
+  }
+
+  timer.destroy();
+  return bestTime;
+}
+
+void RendererPT::compareTraversalKernels() {
+  static const uint32_t kIterations = 3u;
+  const bool persistentThreads = kernelConfig_.persistentThreads;
+  const bool countRays = kernelConfig_.countRays;
+  kernelConfig_.countRays = true;
+  createPathTracingPipeline();
+
+  for (bool persistent : {false, true}) {
+    if (persistent && !persistentThreadsSupported_) {
+      std::cout << "Persistent threads kernel requires compute subgroup operations." << std::endl;
+      break;
+    }
+
+    kernelConfig_.persistentThreads = persistent;
+    selectPathTracingShader();
+
+    // Permutation of the persistent threads kernel is missing.
+    if (kernelConfig_.persistentThreads != persistent) {
+      break;
+    }
+
+    double time = benchmarkPathTracing(kIterations);
+    if (time < 0.0) {
+      std::cout << "Traversal kernel comparison requires timestamp queries." << std::endl;
+      break;
+    }
+
+    // Every iteration traces the same rays, so the count of the last one holds for the fastest.
+    std::cout << (persistent ? "Persistent threads" : "Per pixel") << " kernel: " << time << " ms, "
+              << fetchRayCount() / (time * 1000.0) << " Mrays/s" << std::endl;
+  }
+
+  kernelConfig_.persistentThreads = persistentThreads;
+  kernelConfig_.countRays = countRays;
+  selectPathTracingShader();
+  createPathTracingPipeline();
+  recordCommandBuffers();
+}
+
+void RendererPT::compareRasterVisibility() {
+  static const uint32_t kIterations = 3u;
+
+  submitVisibilityPass();
+  logicalDevice_.waitIdle();
+  const double visibilityTime = visibilityTimer_.fetchResults() ? visibilityTimer_.getMilliseconds(0u) : -1.0;
+
+  // Both kernels read the same camera rays, so only the primary hits differ.
+  std::array<double, 2> times{};
+  for (bool raster : {false, true}) {
+    kernelConfig_.rasterPrimaryVisibility = raster;
+    createPathTracingPipeline();
+    times[raster ? 1u : 0u] = benchmarkPathTracing(kIterations);
+  }
+  recordCommandBuffers();
+
+  if (times[0] < 0.0 || times[1] < 0.0) {
+    std::cout << "Visibility buffer comparison requires timestamp queries." << std::endl;
+    return;
+  }
+
+  std::cout << "Path tracing dispatch with traced camera rays: " << times[0] << " ms, with the visibility buffer: "
+            << times[1] << " ms (" << times[0] - times[1] << " ms saved per sample). Visibility pass: "
+            << visibilityTime << " ms, drawn when the camera moves." << std::endl;
+}
+
+void RendererPT::recordPathTracingDispatch(const logi::CommandBuffer& cmdBuffer) {
+  // Pixel and ray counters restart with every dispatch. The per pixel kernel only uses them to count rays.
+  if (kernelConfig_.persistentThreads || kernelConfig_.countRays) {
+    cmdBuffer.fillBuffer(traversalCountersBuffer_, 0, sizeof(TraversalCounters), 0u);
+    vk::MemoryBarrier resetBarrier(vk::AccessFlagBits::eTransferWrite,
+                                   vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+    cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {},
+                              resetBarrier, {}, {});
+  }
+
+  PathTracingPushConstants pushConstants{};
+
+  cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pathTracingPipeline_);
+  cmdBuffer.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute, pathTracingPipelineLayoutData_.layout, 0,
+    std::vector<vk::DescriptorSet>(pathTracingDescSets_.begin(), pathTracingDescSets_.end()));
+  cmdBuffer.pushConstants(pathTracingPipelineLayoutData_.layout, vk::ShaderStageFlagBits::eCompute, 0,
+                          sizeof(PathTracingPushConstants), &pushConstants);
+
+  if (kernelConfig_.persistentThreads) {
+    cmdBuffer.dispatch(kernelConfig_.persistentWorkgroupCount, 1, 1);
+  } else {
+    vk::Extent2D renderExtent = getRenderExtent();
+    cmdBuffer.dispatch((renderExtent.width + kernelConfig_.workgroupWidth - 1u) / kernelConfig_.workgroupWidth,
+                       (renderExtent.height + kernelConfig_.workgroupHeight - 1u) / kernelConfig_.workgroupHeight, 1);
+  }
+
+  // Ray count is read by the host once the submission has finished.
+  if (kernelConfig_.countRays) {
+    vk::MemoryBarrier countersBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eHostRead);
+    cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eHost, {},
+                              countersBarrier, {}, {});
+  }
+}
+
+void RendererPT::selectPathTracingShader() {
+  const SceneFeatures& features = sceneConverter_.getSceneFeatures();
+
+  // Bit order matches the axes passed to compile_shader_permutations in CMakeLists.txt. Without the permutation
+  // selection every feature is enabled, as in the default shader.
+  uint32_t permutation = kernelConfig_.selectShaderPermutation
+                           ? (kernelConfig_.useMicrofacet ? 1u : 0u) | (features.textures ? 2u : 0u) |
+                               (features.transmission ? 4u : 0u) | (features.normalMaps ? 8u : 0u)
+                           : 15u;
+  if (kernelConfig_.persistentThreads) {
+    permutation |= 16u;
+  }
+  if (rayQueriesEnabled_) {
+    permutation |= 32u;
+  }
+  if (permutation == pathTracingPermutation_) {
+    return;
+  }
+  pathTracingPermutation_ = permutation;
+
+  std::string shaderPath = "shaders/path_tracing.comp." + std::to_string(permutation) + ".spv";
+
+  logi::ShaderModule previousVariant = pathTracingShaderVariant_;
+
+  try {
+    pathTracingShaderVariant_ = createShaderModule(shaderPath);
+    std::cout << "Using path tracing shader permutation " << shaderPath << "." << std::endl;
+  } catch (const std::runtime_error&) {
+    std::cout << "Shader permutation " << shaderPath << " not found. Using the default shader." << std::endl;
+    pathTracingShaderVariant_ = {};
+
+    // Default shader is the per pixel kernel.
+    if (kernelConfig_.persistentThreads) {
+      std::cout << "Persistent threads were disabled." << std::endl;
+      kernelConfig_.persistentThreads = false;
+    }
+    if (rayQueriesEnabled_) {
+      std::cout << "Ray queries were disabled." << std::endl;
+      rayQueriesEnabled_ = false;
+    }
+  }
+
+  createPathTracingPipeline();
+
+  if (previousVariant) {
+    previousVariant.destroy();
+  }
+}
+
+void RendererPT::createDenoisePipeline() {
+  if (denoisePipeline_) {
+    denoisePipeline_.destroy();
+  }
+
+  vk::PipelineShaderStageCreateInfo compShaderStageInfo;
+  compShaderStageInfo.stage = vk::ShaderStageFlagBits::eCompute;
+  compShaderStageInfo.module = denoisePipelineLayoutData_.shaders.at(vk::ShaderStageFlagBits::eCompute);
+  compShaderStageInfo.pName = "main";
+
+  vk::ComputePipelineCreateInfo pipelineInfo;
+  pipelineInfo.stage = compShaderStageInfo;
+  pipelineInfo.layout = denoisePipelineLayoutData_.layout;
+
+  denoisePipeline_ = logicalDevice_.createComputePipeline(pipelineInfo, pipelineCache_);
+}
+
+void RendererPT::createReprojectionPipeline() {
+  if (reprojectionPipeline_) {
+    reprojectionPipeline_.destroy();
+  }
+
+  vk::PipelineShaderStageCreateInfo compShaderStageInfo;
+  compShaderStageInfo.stage = vk::ShaderStageFlagBits::eCompute;
+  compShaderStageInfo.module = reprojectionPipelineLayoutData_.shaders.at(vk::ShaderStageFlagBits::eCompute);
+  compShaderStageInfo.pName = "main";
+
+  vk::ComputePipelineCreateInfo pipelineInfo;
+  pipelineInfo.stage = compShaderStageInfo;
+  pipelineInfo.layout = reprojectionPipelineLayoutData_.layout;
+
+  reprojectionPipeline_ = logicalDevice_.createComputePipeline(pipelineInfo, pipelineCache_);
+}
+
+void RendererPT::createVisibilityRenderPass() {
+  std::array<vk::AttachmentDescription, 2> attachments;
+
+  // Read by the path tracer as a storage image.
+  attachments[0].format = kVisibilityFormat;
+  attachments[0].samples = vk::SampleCountFlagBits::e1;
+  attachments[0].loadOp = vk::AttachmentLoadOp::eClear;
+  attachments[0].storeOp = vk::AttachmentStoreOp::eStore;
+  attachments[0].stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+  attachments[0].stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+  attachments[0].initialLayout = vk::ImageLayout::eUndefined;
+  attachments[0].finalLayout = vk::ImageLayout::eGeneral;
+
+  attachments[1].format = kVisibilityDepthFormat;
+  attachments[1].samples = vk::SampleCountFlagBits::e1;
+  attachments[1].loadOp = vk::AttachmentLoadOp::eClear;
+  attachments[1].storeOp = vk::AttachmentStoreOp::eDontCare;
+  attachments[1].stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+  attachments[1].stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+  attachments[1].initialLayout = vk::ImageLayout::eUndefined;
+  attachments[1].finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+
+  vk::AttachmentReference colorAttachmentRef(0u, vk::ImageLayout::eColorAttachmentOptimal);
+  vk::AttachmentReference depthAttachmentRef(1u, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+
+  vk::SubpassDescription subpass;
+  subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+  subpass.colorAttachmentCount = 1;
+  subpass.pColorAttachments = &colorAttachmentRef;
+  subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+  // Previous frame must finish reading the buffer before it is redrawn, and the next one waits for the new contents.
+  std::array<vk::SubpassDependency, 2> dependencies;
+  dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[0].dstSubpass = 0;
+  dependencies[0].srcStageMask = vk::PipelineStageFlagBits::eComputeShader;
+  dependencies[0].srcAccessMask = vk::AccessFlagBits::eShaderRead;
+  dependencies[0].dstStageMask =
+    vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests;
+  dependencies[0].dstAccessMask =
+    vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+
+  dependencies[1].srcSubpass = 0;
+  dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[1].srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+  dependencies[1].srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite;
+  dependencies[1].dstStageMask = vk::PipelineStageFlagBits::eComputeShader;
+  dependencies[1].dstAccessMask = vk::AccessFlagBits::eShaderRead;
+
+  vk::RenderPassCreateInfo renderPassCreateInfo;
+  renderPassCreateInfo.attachmentCount = attachments.size();
+  renderPassCreateInfo.pAttachments = attachments.data();
+  renderPassCreateInfo.subpassCount = 1;
+  renderPassCreateInfo.pSubpasses = &subpass;
+  renderPassCreateInfo.dependencyCount = dependencies.size();
+  renderPassCreateInfo.pDependencies = dependencies.data();
+
+  visibilityRenderPass_ = logicalDevice_.createRenderPass(renderPassCreateInfo);
+}
+
+void RendererPT::createVisibilityPipeline() {
+  vk::PipelineShaderStageCreateInfo vertShaderStageInfo;
+  vertShaderStageInfo.stage = vk::ShaderStageFlagBits::eVertex;
+  vertShaderStageInfo.module = visibilityPipelineLayoutData_.shaders.at(vk::ShaderStageFlagBits::eVertex);
+  vertShaderStageInfo.pName = "main";
+
+  vk::Bool32 flatSceneBVH = flatSceneBVH_;
+  vk::SpecializationMapEntry flatSceneBVHEntry(0u, 0u, sizeof(vk::Bool32));
+  vk::SpecializationInfo vertSpecializationInfo(1u, &flatSceneBVHEntry, sizeof(vk::Bool32), &flatSceneBVH);
+  vertShaderStageInfo.pSpecializationInfo = &vertSpecializationInfo;
+
+  vk::PipelineShaderStageCreateInfo fragShaderStageInfo;
+  fragShaderStageInfo.stage = vk::ShaderStageFlagBits::eFragment;
+  fragShaderStageInfo.module = visibilityPipelineLayoutData_.shaders.at(vk::ShaderStageFlagBits::eFragment);
+  fragShaderStageInfo.pName = "main";
+
+  vk::PipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
+
+  // Vertices are read from the path tracer vertices buffer.
+  vk::PipelineVertexInputStateCreateInfo vertexInputInfo;
+
+  vk::PipelineInputAssemblyStateCreateInfo inputAssembly;
+  inputAssembly.topology = vk::PrimitiveTopology::eTriangleList;
+  inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+  // Render extent changes with the dynamic resolution, so the viewport is set when recording.
+  vk::PipelineViewportStateCreateInfo viewportState;
+  viewportState.viewportCount = 1;
+  viewportState.scissorCount = 1;
+
+  const std::array<vk::DynamicState, 2> dynamicStates = {vk::DynamicState::eViewport, vk::DynamicState::eScissor};
+  vk::PipelineDynamicStateCreateInfo dynamicState;
+  dynamicState.dynamicStateCount = dynamicStates.size();
+  dynamicState.pDynamicStates = dynamicStates.data();
+
+  // Path tracer intersects both sides of the triangles.
+  vk::PipelineRasterizationStateCreateInfo rasterizer;
+  rasterizer.depthClampEnable = VK_FALSE;
+  rasterizer.rasterizerDiscardEnable = VK_FALSE;
+  rasterizer.polygonMode = vk::PolygonMode::eFill;
+  rasterizer.lineWidth = 1.0f;
+  rasterizer.cullMode = vk::CullModeFlagBits::eNone;
+  rasterizer.frontFace = vk::FrontFace::eCounterClockwise;
+  rasterizer.depthBiasEnable = VK_FALSE;
+
+  vk::PipelineMultisampleStateCreateInfo multisampling;
+  multisampling.sampleShadingEnable = VK_FALSE;
+  multisampling.rasterizationSamples = vk::SampleCountFlagBits::e1;
+
+  // Reversed depth, nearer surfaces have greater values.
+  vk::PipelineDepthStencilStateCreateInfo depthStencil;
+  depthStencil.depthTestEnable = VK_TRUE;
+  depthStencil.depthWriteEnable = VK_TRUE;
+  depthStencil.depthCompareOp = vk::CompareOp::eGreater;
+
+  vk::PipelineColorBlendAttachmentState colorBlendAttachment;
+  colorBlendAttachment.colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
+                                        vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
+  colorBlendAttachment.blendEnable = VK_FALSE;
+
+  vk::PipelineColorBlendStateCreateInfo colorBlending;
+  colorBlending.logicOpEnable = VK_FALSE;
+  colorBlending.attachmentCount = 1;
+  colorBlending.pAttachments = &colorBlendAttachment;
+
+  vk::GraphicsPipelineCreateInfo pipelineInfo;
+  pipelineInfo.stageCount = 2;
+  pipelineInfo.pStages = shaderStages;
+  pipelineInfo.pVertexInputState = &vertexInputInfo;
+  pipelineInfo.pInputAssemblyState = &inputAssembly;
+  pipelineInfo.pViewportState = &viewportState;
+  pipelineInfo.pRasterizationState = &rasterizer;
+  pipelineInfo.pMultisampleState = &multisampling;
+  pipelineInfo.pDepthStencilState = &depthStencil;
+  pipelineInfo.pColorBlendState = &colorBlending;
+  pipelineInfo.pDynamicState = &dynamicState;
+  pipelineInfo.layout = visibilityPipelineLayoutData_.layout;
+  pipelineInfo.renderPass = visibilityRenderPass_;
+  pipelineInfo.subpass = 0;
+
+  visibilityPipeline_ = logicalDevice_.createGraphicsPipeline(pipelineInfo, pipelineCache_);
 }
 
 void RendererPT::onSwapChainRecreate() {
   createFrameBuffers();
   createTexViewerPipeline();
-  initializeAccumulationTexture();
-  updateAccumulationTexDescriptorSet();
+  initializeRenderTargets();
+  updateRenderTargetDescriptorSets();
   recordCommandBuffers();
   ubo_.reset = true;
 }
 
-void RendererPT::initializeAccumulationTexture() {
+vk::Extent2D RendererPT::getRenderExtent() const {
+  return vk::Extent2D(std::max(static_cast<uint32_t>(swapchainImageExtent_.width * dynamicRenderScale_), 1u),
+                      std::max(static_cast<uint32_t>(swapchainImageExtent_.height * dynamicRenderScale_), 1u));
+}
+
+vk::Extent2D RendererPT::getMaxRenderExtent() const {
+  return vk::Extent2D(std::max(static_cast<uint32_t>(swapchainImageExtent_.width * renderScale), 1u),
+                      std::max(static_cast<uint32_t>(swapchainImageExtent_.height * renderScale), 1u));
+}
+
+void RendererPT::initializeStorageTexture(GPUTexture& texture, vk::Format format, const vk::Extent2D& extent,
+                                          vk::ImageUsageFlags additionalUsage) {
   // Destroy existing image. Useful for recreation.
-  if (accumulationTexture_.image) {
-    accumulationTexture_.image.destroy();
+  if (texture.image) {
+    texture.image.destroy();
   }
 
   VmaAllocationCreateInfo allocationInfo = {};
@@ -243,7 +901,7 @@ void RendererPT::initializeAccumulationTexture() {
 
   vk::ImageCreateInfo imageInfo;
   imageInfo.imageType = vk::ImageType::e2D;
-  imageInfo.format = vk::Format::eR32G32B32A32Sfloat;
+  imageInfo.format = format;
   imageInfo.mipLevels = 1;
   imageInfo.arrayLayers = 1;
   imageInfo.samples = vk::SampleCountFlagBits::e1;
@@ -251,11 +909,11 @@ void RendererPT::initializeAccumulationTexture() {
   imageInfo.sharingMode = vk::SharingMode::eExclusive;
   // Set initial layout of the image to undefined
   imageInfo.initialLayout = vk::ImageLayout::eUndefined;
-  imageInfo.extent =
-    vk::Extent3D(swapchainImageExtent_.width * renderScale, swapchainImageExtent_.height * renderScale, 1);
-  imageInfo.usage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled;
+  imageInfo.extent = vk::Extent3D(extent.width, extent.height, 1);
+  imageInfo.usage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled |
+                    vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | additionalUsage;
 
-  accumulationTexture_.image = allocator_.createImage(imageInfo, allocationInfo);
+  texture.image = allocator_.createImage(imageInfo, allocationInfo);
 
   // Update image layout
   logi::CommandBuffer cmdBuffer = graphicsFamilyCmdPool_.allocateCommandBuffer(vk::CommandBufferLevel::ePrimary);
@@ -264,7 +922,7 @@ void RendererPT::initializeAccumulationTexture() {
   vk::ImageMemoryBarrier changeLayoutBarrier;
   changeLayoutBarrier.oldLayout = vk::ImageLayout::eUndefined;
   changeLayoutBarrier.newLayout = vk::ImageLayout::eGeneral;
-  changeLayoutBarrier.image = accumulationTexture_.image;
+  changeLayoutBarrier.image = texture.image;
   changeLayoutBarrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
   changeLayoutBarrier.subresourceRange.baseArrayLayer = 0u;
   changeLayoutBarrier.subresourceRange.layerCount = 1u;
@@ -283,12 +941,53 @@ void RendererPT::initializeAccumulationTexture() {
   cmdBuffer.destroy();
 
   // Create image view.
-  accumulationTexture_.imageView =
-    accumulationTexture_.image.createImageView({}, vk::ImageViewType::e2D, vk::Format::eR32G32B32A32Sfloat, {},
-                                               vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
+  texture.imageView =
+    texture.image.createImageView({}, vk::ImageViewType::e2D, format, {},
+                                  vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
+}
+
+void RendererPT::initializeDepthTexture(GPUTexture& texture, const vk::Extent2D& extent) {
+  VmaAllocationCreateInfo allocationInfo = {};
+  allocationInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_GPU_ONLY;
+
+  // Only used within a render pass, which also transitions its layout.
+  vk::ImageCreateInfo imageInfo;
+  imageInfo.imageType = vk::ImageType::e2D;
+  imageInfo.format = kVisibilityDepthFormat;
+  imageInfo.mipLevels = 1;
+  imageInfo.arrayLayers = 1;
+  imageInfo.samples = vk::SampleCountFlagBits::e1;
+  imageInfo.tiling = vk::ImageTiling::eOptimal;
+  imageInfo.sharingMode = vk::SharingMode::eExclusive;
+  imageInfo.initialLayout = vk::ImageLayout::eUndefined;
+  imageInfo.extent = vk::Extent3D(extent.width, extent.height, 1);
+  imageInfo.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment;
+
+  texture.image = allocator_.createImage(imageInfo, allocationInfo);
+  texture.imageView =
+    texture.image.createImageView({}, vk::ImageViewType::e2D, kVisibilityDepthFormat, {},
+                                  vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1));
+}
+
+void RendererPT::initializeRenderTargets() {
+  // Swapchain extent changed, so none of the pooled render targets can be reused.
+  for (auto& renderTargets : renderTargetPool_) {
+    destroyRenderTargets(renderTargets);
+  }
+  renderTargetPool_.clear();
+
+  dynamicRenderScale_ = renderScale;
+  acquireRenderTargets(getRenderExtent());
+
+  // History is copied from render targets of any scale, so it is sized for the largest one.
+  vk::Extent2D historyExtent = reprojectionConfig_.enabled ? getMaxRenderExtent() : vk::Extent2D(1u, 1u);
+  initializeStorageTexture(historyTexture_, vk::Format::eR32G32B32A32Sfloat, historyExtent);
+  initializeStorageTexture(historyNormalDepthTexture_, vk::Format::eR32G32B32A32Sfloat, historyExtent);
+  historyValid_ = false;
+  visibilityValid_ = false;
 
   // Create sampler
-  if (!accumulationTexture_.sampler) {
+  if (!outputSampler_) {
     vk::SamplerCreateInfo samplerInfo;
     samplerInfo.magFilter = vk::Filter::eLinear;
     samplerInfo.minFilter = vk::Filter::eLinear;
@@ -304,27 +1003,259 @@ void RendererPT::initializeAccumulationTexture() {
     samplerInfo.anisotropyEnable = VK_FALSE;
     samplerInfo.borderColor = vk::BorderColor::eFloatOpaqueWhite;
 
-    accumulationTexture_.sampler = logicalDevice_.createSampler(samplerInfo);
+    outputSampler_ = logicalDevice_.createSampler(samplerInfo);
   }
+
+  recordHistoryCommands();
+}
+
+void RendererPT::acquireRenderTargets(const vk::Extent2D& extent) {
+  auto it = std::find_if(renderTargetPool_.begin(), renderTargetPool_.end(),
+                         [&](const RenderTargets& renderTargets) { return renderTargets.extent == extent; });
+
+  if (it == renderTargetPool_.end()) {
+    // Evict the least recently used set to bound memory usage.
+    if (renderTargetPool_.size() >= kMaxPooledRenderTargets) {
+      auto lru = std::min_element(renderTargetPool_.begin(), renderTargetPool_.end(),
+                                  [](const RenderTargets& lhs, const RenderTargets& rhs) {
+                                    return lhs.lastUsedFrame < rhs.lastUsedFrame;
+                                  });
+      destroyRenderTargets(*lru);
+      renderTargetPool_.erase(lru);
+    }
+
+    // Images of disabled passes are kept as 1x1 placeholders so descriptors stay valid.
+    const vk::Extent2D placeholderExtent(1u, 1u);
+    vk::Extent2D aovExtent = denoiserConfig_.enabled || reprojectionConfig_.enabled ? extent : placeholderExtent;
+    vk::Extent2D denoiseExtent = denoiserConfig_.enabled ? extent : placeholderExtent;
+
+    RenderTargets& renderTargets = renderTargetPool_.emplace_back();
+    renderTargets.extent = extent;
+    initializeStorageTexture(renderTargets.accumulation, vk::Format::eR32G32B32A32Sfloat, extent);
+    initializeStorageTexture(renderTargets.albedo, vk::Format::eR32G32B32A32Sfloat, aovExtent);
+    initializeStorageTexture(renderTargets.normalDepth, vk::Format::eR32G32B32A32Sfloat, aovExtent);
+
+    for (auto& denoiseTexture : renderTargets.denoise) {
+      initializeStorageTexture(denoiseTexture, vk::Format::eR32G32B32A32Sfloat, denoiseExtent);
+    }
+
+    vk::Extent2D visibilityExtent = kernelConfig_.rasterPrimaryVisibility ? extent : placeholderExtent;
+    initializeStorageTexture(renderTargets.visibility, kVisibilityFormat, visibilityExtent,
+                             vk::ImageUsageFlagBits::eColorAttachment);
+
+    if (kernelConfig_.rasterPrimaryVisibility) {
+      initializeDepthTexture(renderTargets.visibilityDepth, extent);
+
+      const std::array<vk::ImageView, 2> attachments = {renderTargets.visibility.imageView,
+                                                        renderTargets.visibilityDepth.imageView};
+      vk::FramebufferCreateInfo framebufferInfo;
+      framebufferInfo.renderPass = visibilityRenderPass_;
+      framebufferInfo.attachmentCount = attachments.size();
+      framebufferInfo.pAttachments = attachments.data();
+      framebufferInfo.width = extent.width;
+      framebufferInfo.height = extent.height;
+      framebufferInfo.layers = 1;
+
+      renderTargets.visibilityFramebuffer = logicalDevice_.createFramebuffer(framebufferInfo);
+    }
+
+    it = std::prev(renderTargetPool_.end());
+  }
+
+  it->lastUsedFrame = frameIndex_;
+  renderTargets_ = *it;
+}
+
+void RendererPT::destroyRenderTargets(RenderTargets& renderTargets) {
+  renderTargets.accumulation.image.destroy();
+  renderTargets.albedo.image.destroy();
+  renderTargets.normalDepth.image.destroy();
+
+  for (auto& denoiseTexture : renderTargets.denoise) {
+    denoiseTexture.image.destroy();
+  }
+
+  renderTargets.visibility.image.destroy();
+  if (renderTargets.visibilityFramebuffer) {
+    renderTargets.visibilityFramebuffer.destroy();
+    renderTargets.visibilityDepth.image.destroy();
+  }
+}
+
+float RendererPT::selectRenderScale(bool cameraMoved) const {
+  // Converging image is always rendered at the full configured scale.
+  if (!dynamicResolutionConfig_.enabled || !cameraMoved || !gpuTimer_.isSupported()) {
+    return renderScale;
+  }
+
+  double frameTime = 0.0;
+  for (uint32_t scope = 0; scope < kTimerScopeCount; scope++) {
+    frameTime += gpuTimer_.getMilliseconds(scope);
+  }
+
+  // Keep the current scale while the frame time is slightly below the target to avoid oscillation.
+  const double targetFrameTime = dynamicResolutionConfig_.targetFrameTime;
+  if (frameTime <= 0.0 || (frameTime <= targetFrameTime && frameTime > 0.85 * targetFrameTime)) {
+    return dynamicRenderScale_;
+  }
+
+  // Frame time is proportional to the pixel count, that is to the square of the scale.
+  float scale = dynamicRenderScale_ * static_cast<float>(std::sqrt(targetFrameTime / frameTime));
+
+  const float step = renderScale / static_cast<float>(std::max(dynamicResolutionConfig_.scaleSteps, 1u));
+  const float minScale = std::max(renderScale * dynamicResolutionConfig_.minScale, step);
+  scale = std::floor(scale / step) * step;
+
+  return std::clamp(scale, minScale, renderScale);
+}
+
+void RendererPT::applyRenderScale(float scale) {
+  // Descriptor sets and command buffers are still in use by the previous submission.
+  logicalDevice_.waitIdle();
+
+  dynamicRenderScale_ = scale;
+  acquireRenderTargets(getRenderExtent());
+  updateRenderTargetDescriptorSets();
+  recordCommandBuffers();
+  recordHistoryCommands();
+}
+
+void RendererPT::recordHistoryCommands() {
+  if (!historyCmdBuffer_) {
+    historyCmdBuffer_ = graphicsFamilyCmdPool_.allocateCommandBuffer(vk::CommandBufferLevel::ePrimary);
+  } else {
+    historyCmdBuffer_.reset();
+  }
+
+  vk::Extent2D renderExtent = renderTargets_.extent;
+
+  historyCmdBuffer_.begin(vk::CommandBufferBeginInfo());
+
+  if (reprojectionConfig_.enabled) {
+    // Previous frame must finish writing (and the reprojection reading) before the images are copied.
+    vk::MemoryBarrier copyBarrier(vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eShaderRead,
+                                  vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite);
+    historyCmdBuffer_.pipelineBarrier(
+      vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eFragmentShader,
+      vk::PipelineStageFlagBits::eTransfer, {}, copyBarrier, {}, {});
+
+    vk::ImageCopy region;
+    region.srcSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0u, 0u, 1u);
+    region.dstSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0u, 0u, 1u);
+    region.extent = vk::Extent3D(renderExtent.width, renderExtent.height, 1u);
+
+    historyCmdBuffer_.copyImage(renderTargets_.accumulation.image, vk::ImageLayout::eGeneral, historyTexture_.image,
+                                vk::ImageLayout::eGeneral, region);
+    historyCmdBuffer_.copyImage(renderTargets_.normalDepth.image, vk::ImageLayout::eGeneral,
+                                historyNormalDepthTexture_.image, vk::ImageLayout::eGeneral, region);
+
+    vk::MemoryBarrier readBarrier(vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eTransferRead,
+                                  vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+    historyCmdBuffer_.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader,
+                                      {}, readBarrier, {}, {});
+  }
+
+  historyCmdBuffer_.end();
+}
+
+glm::mat4 RendererPT::getVisibilityViewProjection() const {
+  // generateRay maps pixel p to uv = 2p / extent - 1 (before the jitter), while rasterization samples pixel centers, so
+  // the image is shifted by half a pixel. Clip w is the view depth and clip z the near plane, which gives reversed
+  // depth with an infinite far plane.
+  const vk::Extent2D extent = renderTargets_.extent;
+  const float tanHalfFovY = std::tan(ubo_.camera.fovY / 2.0f);
+  const float aspectRatio = static_cast<float>(extent.width) / extent.height;
+
+  glm::mat4 projection(0.0f);
+  projection[0][0] = 1.0f / (aspectRatio * tanHalfFovY);
+  projection[1][1] = 1.0f / tanHalfFovY;
+  projection[2][0] = -1.0f / extent.width;
+  projection[2][1] = -1.0f / extent.height;
+  projection[2][3] = -1.0f;
+  projection[3][2] = kVisibilityNearPlane;
+
+  return projection * glm::inverse(ubo_.camera.worldMatrix);
+}
+
+void RendererPT::submitVisibilityPass() {
+  // Previous submission finished with the last frame, which was submitted after it.
+  if (!visibilityCmdBuffer_) {
+    visibilityCmdBuffer_ = graphicsFamilyCmdPool_.allocateCommandBuffer(vk::CommandBufferLevel::ePrimary);
+  } else {
+    visibilityCmdBuffer_.reset();
+  }
+
+  const vk::Extent2D extent = renderTargets_.extent;
+
+  visibilityCmdBuffer_.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+  visibilityTimer_.recordReset(visibilityCmdBuffer_);
+  visibilityTimer_.recordBegin(visibilityCmdBuffer_, 0u);
+
+  std::array<vk::ClearValue, 2> clearValues;
+  clearValues[0].color.setUint32({0xFFFFFFFFu, 0xFFFFFFFFu, 0u, 0u});
+  clearValues[1].depthStencil = vk::ClearDepthStencilValue(0.0f, 0u);
+
+  vk::RenderPassBeginInfo renderPassInfo;
+  renderPassInfo.renderPass = visibilityRenderPass_;
+  renderPassInfo.framebuffer = renderTargets_.visibilityFramebuffer;
+  renderPassInfo.renderArea.extent = extent;
+  renderPassInfo.clearValueCount = clearValues.size();
+  renderPassInfo.pClearValues = clearValues.data();
+
+  VisibilityPushConstants pushConstants{};
+  pushConstants.viewProjection = getVisibilityViewProjection();
+
+  visibilityCmdBuffer_.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
+  visibilityCmdBuffer_.bindPipeline(vk::PipelineBindPoint::eGraphics, visibilityPipeline_);
+  visibilityCmdBuffer_.bindDescriptorSets(
+    vk::PipelineBindPoint::eGraphics, visibilityPipelineLayoutData_.layout, 0,
+    std::vector<vk::DescriptorSet>(visibilityDescSets_.begin(), visibilityDescSets_.end()));
+  visibilityCmdBuffer_.setViewport(
+    0, vk::Viewport(0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.0f, 1.0f));
+  visibilityCmdBuffer_.setScissor(0, vk::Rect2D({0, 0}, extent));
+  visibilityCmdBuffer_.pushConstants(visibilityPipelineLayoutData_.layout, vk::ShaderStageFlagBits::eVertex, 0,
+                                     sizeof(VisibilityPushConstants), &pushConstants);
+
+  // One draw per object, whose index is passed as the instance index.
+  for (const VertexRange& range : sceneConverter_.getVertexRanges()) {
+    if (range.vertexCount > 0u) {
+      visibilityCmdBuffer_.draw(range.vertexCount, 1u, range.firstVertex, range.objectIndex);
+    }
+  }
+
+  visibilityCmdBuffer_.endRenderPass();
+  visibilityTimer_.recordEnd(visibilityCmdBuffer_, 0u, vk::PipelineStageFlagBits::eColorAttachmentOutput);
+  visibilityCmdBuffer_.end();
+
+  vk::SubmitInfo submitInfo;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &static_cast<const vk::CommandBuffer&>(visibilityCmdBuffer_);
+  graphicsQueue_.submit({submitInfo});
+
+  visibilityValid_ = true;
 }
 
 void RendererPT::initializeDescriptorSets() {
   static const size_t numPoolSets = 10;
-  static const std::vector<vk::DescriptorPoolSize> poolSizes = {
+  std::vector<vk::DescriptorPoolSize> poolSizes = {
     //{vk::DescriptorType::eSampler, 0},
-    {vk::DescriptorType::eCombinedImageSampler, 257},
+    {vk::DescriptorType::eCombinedImageSampler, 1},
     //{vk::DescriptorType::eSampledImage, 0},
-    {vk::DescriptorType::eStorageImage, 1},
+    {vk::DescriptorType::eStorageImage, 22},
     //{vk::DescriptorType::eUniformTexelBuffer, 0},
     //{vk::DescriptorType::eStorageTexelBuffer, 0},
-    {vk::DescriptorType::eUniformBuffer, 1},
-    {vk::DescriptorType::eStorageBuffer, 4},
+    {vk::DescriptorType::eUniformBuffer, 2},
+    {vk::DescriptorType::eStorageBuffer, 12},
     //{vk::DescriptorType::eUniformBufferDynamic, 0},
     //{vk::DescriptorType::eStorageBufferDynamic, 0},
     //{vk::DescriptorType::eInputAttachment, 0},
     //{vk::DescriptorType::eInlineUniformBlockEXT, 0},
     //{vk::DescriptorType::eAccelerationStructureNV, 0}
   };
+  // Top level acceleration structure of the ray query backend.
+  if (rayTracingBackend_ == RayTracingBackend::eRayQuery) {
+    poolSizes.emplace_back(vk::DescriptorType::eAccelerationStructureKHR, 1u);
+  }
 
   vk::DescriptorPoolCreateInfo poolInfo;
   poolInfo.pPoolSizes = poolSizes.data();
@@ -337,41 +1268,104 @@ void RendererPT::initializeDescriptorSets() {
   texViewerDescSets_ = descriptorPool_.allocateDescriptorSets(
     std::vector<vk::DescriptorSetLayout>(texViewerPipelineLayoutData_.descriptorSetLayouts.begin(),
                                          texViewerPipelineLayoutData_.descriptorSetLayouts.end()));
+  // Texture table (set 1) is allocated separately, at capacity.
   pathTracingDescSets_ = descriptorPool_.allocateDescriptorSets(
-    std::vector<vk::DescriptorSetLayout>(pathTracingPipelineLayoutData_.descriptorSetLayouts.begin(),
-                                         pathTracingPipelineLayoutData_.descriptorSetLayouts.end()));
+    {static_cast<const vk::DescriptorSetLayout&>(pathTracingPipelineLayoutData_.descriptorSetLayouts[0])});
+  initializeTextureDescriptorSet();
+  denoiseDescSets_ = descriptorPool_.allocateDescriptorSets(std::vector<vk::DescriptorSetLayout>(
+    3u, static_cast<const vk::DescriptorSetLayout&>(denoisePipelineLayoutData_.descriptorSetLayouts[0])));
+  reprojectionDescSets_ = descriptorPool_.allocateDescriptorSets(
+    std::vector<vk::DescriptorSetLayout>(reprojectionPipelineLayoutData_.descriptorSetLayouts.begin(),
+                                         reprojectionPipelineLayoutData_.descriptorSetLayouts.end()));
+
+  if (kernelConfig_.rasterPrimaryVisibility) {
+    visibilityDescSets_ = descriptorPool_.allocateDescriptorSets(
+      std::vector<vk::DescriptorSetLayout>(visibilityPipelineLayoutData_.descriptorSetLayouts.begin(),
+                                           visibilityPipelineLayoutData_.descriptorSetLayouts.end()));
+  }
 }
 
-void RendererPT::updateAccumulationTexDescriptorSet() {
-  std::vector<vk::WriteDescriptorSet> descriptorWrites(2);
+void RendererPT::initializeTextureDescriptorSet() {
+  logi::DescriptorSet textureSet =
+    allocateVariableDescriptorSet(textureDescriptorPool_, pathTracingPipelineLayoutData_.descriptorSetLayouts[1],
+                                  vk::DescriptorType::eCombinedImageSampler, maxVariableDescriptorCount_);
 
-  vk::DescriptorImageInfo texViewerTextureDescriptor;
-  texViewerTextureDescriptor.imageView = accumulationTexture_.imageView;
-  texViewerTextureDescriptor.sampler = accumulationTexture_.sampler;
-  texViewerTextureDescriptor.imageLayout = vk::ImageLayout::eGeneral;
+  pathTracingDescSets_.resize(2u);
+  pathTracingDescSets_[1] = textureSet;
+  boundTextureCount_ = 0u;
+}
 
-  descriptorWrites[0].dstSet = texViewerDescSets_[0];
-  descriptorWrites[0].dstBinding = 0;
-  descriptorWrites[0].dstArrayElement = 0;
-  descriptorWrites[0].descriptorType = vk::DescriptorType::eCombinedImageSampler;
-  descriptorWrites[0].descriptorCount = 1;
-  descriptorWrites[0].pImageInfo = &texViewerTextureDescriptor;
+void RendererPT::updateRenderTargetDescriptorSets() {
+  std::vector<vk::WriteDescriptorSet> descriptorWrites;
+  std::vector<vk::DescriptorImageInfo> imageInfos;
+  // Reserve so that the pointers stored in the writes remain valid.
+  imageInfos.reserve(24u);
+
+  auto addStorageImageWrite = [&](const logi::DescriptorSet& descriptorSet, uint32_t binding,
+                                  const GPUTexture& texture) {
+    vk::DescriptorImageInfo& imageInfo = imageInfos.emplace_back();
+    imageInfo.imageView = texture.imageView;
+    imageInfo.imageLayout = vk::ImageLayout::eGeneral;
+
+    vk::WriteDescriptorSet& descriptorWrite = descriptorWrites.emplace_back();
+    descriptorWrite.dstSet = descriptorSet;
+    descriptorWrite.dstBinding = binding;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = vk::DescriptorType::eStorageImage;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pImageInfo = &imageInfo;
+  };
 
-  vk::DescriptorImageInfo pathTracerTextureDescriptor;
-  pathTracerTextureDescriptor.imageView = accumulationTexture_.imageView;
-  pathTracerTextureDescriptor.sampler = accumulationTexture_.sampler;
-  pathTracerTextureDescriptor.imageLayout = vk::ImageLayout::eGeneral;
+  // Texture viewer displays either the accumulated or the denoised image.
+  vk::DescriptorImageInfo& texViewerTextureDescriptor = imageInfos.emplace_back();
+  texViewerTextureDescriptor.imageView = getOutputTexture().imageView;
+  texViewerTextureDescriptor.sampler = outputSampler_;
+  texViewerTextureDescriptor.imageLayout = vk::ImageLayout::eGeneral;
 
-  descriptorWrites[1].dstSet = pathTracingDescSets_[0];
-  descriptorWrites[1].dstBinding = 0;
-  descriptorWrites[1].dstArrayElement = 0;
-  descriptorWrites[1].descriptorType = vk::DescriptorType::eStorageImage;
-  descriptorWrites[1].descriptorCount = 1;
-  descriptorWrites[1].pImageInfo = &pathTracerTextureDescriptor;
+  vk::WriteDescriptorSet& texViewerWrite = descriptorWrites.emplace_back();
+  texViewerWrite.dstSet = texViewerDescSets_[0];
+  texViewerWrite.dstBinding = 0;
+  texViewerWrite.dstArrayElement = 0;
+  texViewerWrite.descriptorType = vk::DescriptorType::eCombinedImageSampler;
+  texViewerWrite.descriptorCount = 1;
+  texViewerWrite.pImageInfo = &texViewerTextureDescriptor;
+
+  addStorageImageWrite(pathTracingDescSets_[0], 0, renderTargets_.accumulation);
+  addStorageImageWrite(pathTracingDescSets_[0], 8, renderTargets_.albedo);
+  addStorageImageWrite(pathTracingDescSets_[0], 9, renderTargets_.normalDepth);
+  addStorageImageWrite(pathTracingDescSets_[0], 13, renderTargets_.visibility);
+
+  // Denoiser ping-pongs between the two denoise textures after reading the accumulation in the first pass.
+  const std::array<const GPUTexture*, 3> denoiseInputs = {&renderTargets_.accumulation, &renderTargets_.denoise[0],
+                                                          &renderTargets_.denoise[1]};
+  const std::array<const GPUTexture*, 3> denoiseOutputs = {&renderTargets_.denoise[0], &renderTargets_.denoise[1],
+                                                           &renderTargets_.denoise[0]};
+
+  for (size_t i = 0; i < denoiseDescSets_.size(); i++) {
+    addStorageImageWrite(denoiseDescSets_[i], 0, *denoiseInputs[i]);
+    addStorageImageWrite(denoiseDescSets_[i], 1, *denoiseOutputs[i]);
+    addStorageImageWrite(denoiseDescSets_[i], 2, renderTargets_.albedo);
+    addStorageImageWrite(denoiseDescSets_[i], 3, renderTargets_.normalDepth);
+  }
+
+  addStorageImageWrite(reprojectionDescSets_[0], 0, renderTargets_.accumulation);
+  addStorageImageWrite(reprojectionDescSets_[0], 1, renderTargets_.albedo);
+  addStorageImageWrite(reprojectionDescSets_[0], 2, renderTargets_.normalDepth);
+  addStorageImageWrite(reprojectionDescSets_[0], 3, historyTexture_);
+  addStorageImageWrite(reprojectionDescSets_[0], 4, historyNormalDepthTexture_);
 
   logicalDevice_.updateDescriptorSets(descriptorWrites);
 }
 
+const GPUTexture& RendererPT::getOutputTexture() const {
+  if (denoiserConfig_.enabled) {
+    // Pass i writes to denoise texture i % 2.
+    return renderTargets_.denoise[(denoiserConfig_.iterations - 1u) % 2u];
+  }
+
+  return renderTargets_.accumulation;
+}
+
 void RendererPT::initializeUBOBuffer() {
   VmaAllocationCreateInfo allocationInfo = {};
   allocationInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_CPU_TO_GPU;
@@ -390,7 +1384,7 @@ void RendererPT::initializeUBOBuffer() {
   bufferInfo.offset = 0;
   bufferInfo.range = sizeof(ubo_);
 
-  std::array<vk::WriteDescriptorSet, 2> descriptorWrites;
+  std::array<vk::WriteDescriptorSet, 3> descriptorWrites;
   descriptorWrites[0].dstSet = pathTracingDescSets_[0];
   descriptorWrites[0].dstBinding = 1;
   descriptorWrites[0].dstArrayElement = 0;
@@ -422,17 +1416,81 @@ void RendererPT::initializeUBOBuffer() {
   descriptorWrites[1].descriptorCount = 1;
   descriptorWrites[1].pBufferInfo = &sampleCountBufferInfo;
 
+  reprojectionUBO_.maxHistoryLength = reprojectionConfig_.maxHistoryLength;
+  reprojectionUBO_.depthTolerance = reprojectionConfig_.depthTolerance;
+  reprojectionUBO_.normalTolerance = reprojectionConfig_.normalTolerance;
+  reprojectionUBO_.active = VK_FALSE;
+
+  // Create and init reprojection UBO buffer.
+  vk::BufferCreateInfo reprojectionUBOBufferInfo;
+  reprojectionUBOBufferInfo.size = sizeof(reprojectionUBO_);
+  reprojectionUBOBufferInfo.usage = vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst;
+  reprojectionUBOBufferInfo.sharingMode = vk::SharingMode::eExclusive;
+
+  reprojectionUBOBuffer_ = allocator_.createBuffer(reprojectionUBOBufferInfo, allocationInfo);
+
+  vk::DescriptorBufferInfo reprojectionBufferInfo;
+  reprojectionBufferInfo.buffer = reprojectionUBOBuffer_;
+  reprojectionBufferInfo.offset = 0;
+  reprojectionBufferInfo.range = sizeof(reprojectionUBO_);
+
+  descriptorWrites[2].dstSet = reprojectionDescSets_[0];
+  descriptorWrites[2].dstBinding = 5;
+  descriptorWrites[2].dstArrayElement = 0;
+  descriptorWrites[2].descriptorType = vk::DescriptorType::eUniformBuffer;
+  descriptorWrites[2].descriptorCount = 1;
+  descriptorWrites[2].pBufferInfo = &reprojectionBufferInfo;
+
   logicalDevice_.updateDescriptorSets(descriptorWrites);
 }
 
 void RendererPT::updateUBOBuffer() {
   uboBuffer_.writeToBuffer(&ubo_, sizeof(ubo_));
   sampleCountBuffer_.writeToBuffer(&invSampleCount, sizeof(invSampleCount));
+  reprojectionUBOBuffer_.writeToBuffer(&reprojectionUBO_, sizeof(reprojectionUBO_));
+}
+
+
+void RendererPT::initializeTraversalCountersBuffer() {
+  // Reset by the GPU before every dispatch and read back by the host. CPU only memory is host coherent.
+  VmaAllocationCreateInfo allocationInfo = {};
+  allocationInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_CPU_ONLY;
+
+  vk::BufferCreateInfo bufferCreateInfo;
+  bufferCreateInfo.size = sizeof(TraversalCounters);
+  bufferCreateInfo.usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst;
+  bufferCreateInfo.sharingMode = vk::SharingMode::eExclusive;
+
+  traversalCountersBuffer_ = allocator_.createBuffer(bufferCreateInfo, allocationInfo);
+  TraversalCounters counters{};
+  traversalCountersBuffer_.writeToBuffer(&counters, sizeof(TraversalCounters));
+
+  vk::DescriptorBufferInfo bufferInfo;
+  bufferInfo.buffer = traversalCountersBuffer_;
+  bufferInfo.offset = 0;
+  bufferInfo.range = sizeof(TraversalCounters);
+
+  vk::WriteDescriptorSet descriptorWrite;
+  descriptorWrite.dstSet = pathTracingDescSets_[0];
+  descriptorWrite.dstBinding = 12;
+  descriptorWrite.dstArrayElement = 0;
+  descriptorWrite.descriptorType = vk::DescriptorType::eStorageBuffer;
+  descriptorWrite.descriptorCount = 1;
+  descriptorWrite.pBufferInfo = &bufferInfo;
+
+  logicalDevice_.updateDescriptorSets(descriptorWrite);
+}
+
+uint32_t RendererPT::fetchRayCount() {
+  auto* counters = static_cast<const TraversalCounters*>(traversalCountersBuffer_.mapMemory());
+  const uint32_t rayCount = counters->rayCount;
+  traversalCountersBuffer_.unmapMemory();
+  return rayCount;
 }
 
 void RendererPT::initializeAndBindSceneBuffer() {
   // Update descriptor sets.
-  std::vector<vk::WriteDescriptorSet> descriptorWrites(4);
+  std::vector<vk::WriteDescriptorSet> descriptorWrites(6);
 
   // Object data binding
   vk::DescriptorBufferInfo objectDataBufferInfo;
@@ -486,24 +1544,122 @@ void RendererPT::initializeAndBindSceneBuffer() {
   descriptorWrites[3].descriptorCount = 1;
   descriptorWrites[3].pBufferInfo = &meshBVHNodesInfo;
 
+  // Materials binding
+  vk::DescriptorBufferInfo materialsInfo;
+  materialsInfo.buffer = sceneConverter_.getMaterialsBuffer();
+  materialsInfo.offset = 0;
+  materialsInfo.range = sceneConverter_.getMaterialsBuffer().size();
+
+  descriptorWrites[4].dstSet = pathTracingDescSets_[0];
+  descriptorWrites[4].dstBinding = 6;
+  descriptorWrites[4].dstArrayElement = 0;
+  descriptorWrites[4].descriptorType = vk::DescriptorType::eStorageBuffer;
+  descriptorWrites[4].descriptorCount = 1;
+  descriptorWrites[4].pBufferInfo = &materialsInfo;
+
+  // Primitive objects binding. Only read by the flattened scene traversal.
+  vk::DescriptorBufferInfo primitiveObjectsInfo;
+  primitiveObjectsInfo.buffer = sceneConverter_.getPrimitiveObjectsBuffer();
+  primitiveObjectsInfo.offset = 0;
+  primitiveObjectsInfo.range = sceneConverter_.getPrimitiveObjectsBuffer().size();
+
+  descriptorWrites[5].dstSet = pathTracingDescSets_[0];
+  descriptorWrites[5].dstBinding = 11;
+  descriptorWrites[5].dstArrayElement = 0;
+  descriptorWrites[5].descriptorType = vk::DescriptorType::eStorageBuffer;
+  descriptorWrites[5].descriptorCount = 1;
+  descriptorWrites[5].pBufferInfo = &primitiveObjectsInfo;
+
+  // Visibility pass reads the objects, the vertices and the primitive objects through its own set.
+  if (!visibilityDescSets_.empty()) {
+    const std::array<std::pair<uint32_t, const vk::DescriptorBufferInfo*>, 3> visibilityBindings = {
+      std::make_pair(0u, &objectDataBufferInfo), std::make_pair(1u, &verticesInfo),
+      std::make_pair(2u, &primitiveObjectsInfo)};
+
+    for (const auto& [binding, bufferInfo] : visibilityBindings) {
+      vk::WriteDescriptorSet& visibilityWrite = descriptorWrites.emplace_back();
+      visibilityWrite.dstSet = visibilityDescSets_[0];
+      visibilityWrite.dstBinding = binding;
+      visibilityWrite.dstArrayElement = 0;
+      visibilityWrite.descriptorType = vk::DescriptorType::eStorageBuffer;
+      visibilityWrite.descriptorCount = 1;
+      visibilityWrite.pBufferInfo = bufferInfo;
+    }
+  }
+
+  // Top level acceleration structure of the ray query permutations, once it is built (see commitSceneBatches).
+  vk::WriteDescriptorSetAccelerationStructureKHR accelerationStructureInfo;
+  if (accelerationStructures_.isBuilt()) {
+    accelerationStructureInfo.accelerationStructureCount = 1u;
+    accelerationStructureInfo.pAccelerationStructures = &accelerationStructures_.getTopLevel();
+
+    vk::WriteDescriptorSet& accelerationStructureWrite = descriptorWrites.emplace_back();
+    accelerationStructureWrite.pNext = &accelerationStructureInfo;
+    accelerationStructureWrite.dstSet = pathTracingDescSets_[0];
+    accelerationStructureWrite.dstBinding = 14;
+    accelerationStructureWrite.dstArrayElement = 0;
+    accelerationStructureWrite.descriptorType = vk::DescriptorType::eAccelerationStructureKHR;
+    accelerationStructureWrite.descriptorCount = 1;
+  }
+
   const std::vector<GPUTexture>& textures = sceneConverter_.getTextures();
+
+  // Texture feedback binding. Bound even if streaming is disabled, since the shader always declares it.
+  if (textureFeedbackBuffer_) {
+    textureFeedbackBuffer_.destroy();
+  }
+
+  const size_t feedbackByteSize = std::max<size_t>(textures.size(), 1u) * sizeof(uint32_t);
+
+  // Read back by the host every frame. CPU only memory is host coherent, so no flushes or invalidations are needed.
+  VmaAllocationCreateInfo feedbackAllocationInfo = {};
+  feedbackAllocationInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_CPU_ONLY;
+
+  vk::BufferCreateInfo feedbackBufferInfo;
+  feedbackBufferInfo.size = feedbackByteSize;
+  feedbackBufferInfo.usage = vk::BufferUsageFlagBits::eStorageBuffer;
+  feedbackBufferInfo.sharingMode = vk::SharingMode::eExclusive;
+
+  textureFeedbackBuffer_ = allocator_.createBuffer(feedbackBufferInfo, feedbackAllocationInfo);
+  std::vector<uint32_t> emptyFeedback(feedbackByteSize / sizeof(uint32_t), 0u);
+  textureFeedbackBuffer_.writeToBuffer(emptyFeedback.data(), feedbackByteSize);
+
+  vk::DescriptorBufferInfo feedbackInfo;
+  feedbackInfo.buffer = textureFeedbackBuffer_;
+  feedbackInfo.offset = 0;
+  feedbackInfo.range = feedbackByteSize;
+
+  vk::WriteDescriptorSet& feedbackWrite = descriptorWrites.emplace_back();
+  feedbackWrite.dstSet = pathTracingDescSets_[0];
+  feedbackWrite.dstBinding = 10;
+  feedbackWrite.dstArrayElement = 0;
+  feedbackWrite.descriptorType = vk::DescriptorType::eStorageBuffer;
+  feedbackWrite.descriptorCount = 1;
+  feedbackWrite.pBufferInfo = &feedbackInfo;
+
+  if (textures.size() > maxVariableDescriptorCount_) {
+    throw std::runtime_error("Scene has more textures than the texture table holds.");
+  }
+  // Texture table is allocated at capacity, partially bound and update-after-bind, so only the textures published
+  // since the last commit are written.
   std::vector<vk::DescriptorImageInfo> descriptorImageInfos;
 
-  if (!textures.empty()) {
-    for (const auto& texture : textures) {
+  if (textures.size() > boundTextureCount_) {
+    for (size_t i = boundTextureCount_; i < textures.size(); i++) {
       vk::DescriptorImageInfo& descriptorImageInfo = descriptorImageInfos.emplace_back();
-      descriptorImageInfo.imageView = texture.imageView;
-      descriptorImageInfo.sampler = texture.sampler;
+      descriptorImageInfo.imageView = textures[i].imageView;
+      descriptorImageInfo.sampler = textures[i].sampler;
       descriptorImageInfo.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
     }
 
     vk::WriteDescriptorSet& descriptorWriteTex = descriptorWrites.emplace_back();
-    descriptorWriteTex.dstSet = pathTracingDescSets_[0];
-    descriptorWriteTex.dstBinding = 6;
-    descriptorWriteTex.dstArrayElement = 0;
+    descriptorWriteTex.dstSet = pathTracingDescSets_[1];
+    descriptorWriteTex.dstBinding = 0;
+    descriptorWriteTex.dstArrayElement = boundTextureCount_;
     descriptorWriteTex.descriptorType = vk::DescriptorType::eCombinedImageSampler;
     descriptorWriteTex.descriptorCount = descriptorImageInfos.size();
     descriptorWriteTex.pImageInfo = descriptorImageInfos.data();
+    boundTextureCount_ = textures.size();
   }
 
   logicalDevice_.updateDescriptorSets(descriptorWrites);
@@ -512,6 +1668,10 @@ void RendererPT::initializeAndBindSceneBuffer() {
 }
 
 void RendererPT::recordCommandBuffers() {
+  if (tiledConfig_.enabled) {
+    recordTileCommands();
+  }
+
   // Destroy old command buffers.
   for (const auto& cmdBuffer : mainCmdBuffers_) {
     cmdBuffer.reset();
@@ -522,22 +1682,44 @@ void RendererPT::recordCommandBuffers() {
     beginInfo.flags = vk::CommandBufferUsageFlagBits::eSimultaneousUse;
 
     mainCmdBuffers_[i].begin(beginInfo);
+    gpuTimer_.recordReset(mainCmdBuffers_[i]);
+
+    // Compute shader. In tiled mode path tracing is submitted separately (see submitTiles).
+    vk::Extent2D renderExtent = getRenderExtent();
+    if (!tiledConfig_.enabled) {
+      gpuTimer_.recordBegin(mainCmdBuffers_[i], kTimerPathTracing);
+      recordPathTracingDispatch(mainCmdBuffers_[i]);
+      gpuTimer_.recordEnd(mainCmdBuffers_[i], kTimerPathTracing, vk::PipelineStageFlagBits::eComputeShader);
+    }
 
-    // Compute shader.
-    mainCmdBuffers_[i].bindPipeline(vk::PipelineBindPoint::eCompute, pathTracingPipeline_);
-    mainCmdBuffers_[i].bindDescriptorSets(
-      vk::PipelineBindPoint::eCompute, pathTracingPipelineLayoutData_.layout, 0,
-      std::vector<vk::DescriptorSet>(pathTracingDescSets_.begin(), pathTracingDescSets_.end()));
-    mainCmdBuffers_[i].dispatch(
-      static_cast<uint32_t>(std::ceil(swapchainImageExtent_.width * renderScale / float(32))),
-      static_cast<uint32_t>(std::ceil(swapchainImageExtent_.height * renderScale / float(32))), 1);
+    if (reprojectionConfig_.enabled) {
+      // Dispatched every frame. The shader returns immediately unless the camera moved.
+      vk::MemoryBarrier memoryBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+      mainCmdBuffers_[i].pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                                         vk::PipelineStageFlagBits::eComputeShader, {}, memoryBarrier, {}, {});
+
+      gpuTimer_.recordBegin(mainCmdBuffers_[i], kTimerReprojection, vk::PipelineStageFlagBits::eComputeShader);
+      mainCmdBuffers_[i].bindPipeline(vk::PipelineBindPoint::eCompute, reprojectionPipeline_);
+      mainCmdBuffers_[i].bindDescriptorSets(
+        vk::PipelineBindPoint::eCompute, reprojectionPipelineLayoutData_.layout, 0,
+        std::vector<vk::DescriptorSet>(reprojectionDescSets_.begin(), reprojectionDescSets_.end()));
+      mainCmdBuffers_[i].dispatch(static_cast<uint32_t>(std::ceil(renderExtent.width / float(16))),
+                                  static_cast<uint32_t>(std::ceil(renderExtent.height / float(16))), 1);
+      gpuTimer_.recordEnd(mainCmdBuffers_[i], kTimerReprojection, vk::PipelineStageFlagBits::eComputeShader);
+    }
+
+    if (denoiserConfig_.enabled) {
+      gpuTimer_.recordBegin(mainCmdBuffers_[i], kTimerDenoise, vk::PipelineStageFlagBits::eComputeShader);
+      recordDenoiseCommands(mainCmdBuffers_[i]);
+      gpuTimer_.recordEnd(mainCmdBuffers_[i], kTimerDenoise, vk::PipelineStageFlagBits::eComputeShader);
+    }
 
     vk::ImageMemoryBarrier imageMemoryBarrier;
     imageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
     imageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eShaderRead;
     imageMemoryBarrier.oldLayout = vk::ImageLayout::eGeneral;
     imageMemoryBarrier.newLayout = vk::ImageLayout::eGeneral;
-    imageMemoryBarrier.image = accumulationTexture_.image;
+    imageMemoryBarrier.image = getOutputTexture().image;
     imageMemoryBarrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
     imageMemoryBarrier.subresourceRange.baseArrayLayer = 0u;
     imageMemoryBarrier.subresourceRange.layerCount = 1u;
@@ -565,33 +1747,382 @@ void RendererPT::recordCommandBuffers() {
 
     mainCmdBuffers_[i].draw(3);
     mainCmdBuffers_[i].endRenderPass();
+
+    // Texture feedback is read by the host once the frame fence is signaled.
+    if (textureStreamingConfig_.enabled) {
+      vk::MemoryBarrier feedbackBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eHostRead);
+      mainCmdBuffers_[i].pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eHost,
+                                         {}, feedbackBarrier, {}, {});
+    }
+
     mainCmdBuffers_[i].end();
   }
 }
 
+void RendererPT::recordDenoiseCommands(const logi::CommandBuffer& cmdBuffer) {
+  vk::Extent2D renderExtent = getRenderExtent();
+  cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, denoisePipeline_);
+
+  for (uint32_t i = 0; i < denoiserConfig_.iterations; i++) {
+    // Each pass reads the result of the previous dispatch.
+    vk::MemoryBarrier memoryBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+    cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {},
+                              memoryBarrier, {}, {});
+
+    DenoisePushConstants pushConstants{};
+    pushConstants.stepWidth = 1 << i;
+    // Color sensitivity is tightened with every pass as the noise is reduced.
+    pushConstants.colorPhi = denoiserConfig_.colorPhi * std::pow(2.0f, -static_cast<float>(i));
+    pushConstants.normalPhi = denoiserConfig_.normalPhi;
+    pushConstants.depthPhi = denoiserConfig_.depthPhi;
+    pushConstants.flags = (i == 0u ? 1u : 0u) | (i == denoiserConfig_.iterations - 1u ? 2u : 0u);
+
+    const logi::DescriptorSet& descriptorSet = denoiseDescSets_[i == 0u ? 0u : 1u + (i - 1u) % 2u];
+    cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, denoisePipelineLayoutData_.layout, 0,
+                                 std::vector<vk::DescriptorSet>{descriptorSet});
+    cmdBuffer.pushConstants(denoisePipelineLayoutData_.layout, vk::ShaderStageFlagBits::eCompute, 0,
+                            sizeof(DenoisePushConstants), &pushConstants);
+    cmdBuffer.dispatch(static_cast<uint32_t>(std::ceil(renderExtent.width / float(16))),
+                       static_cast<uint32_t>(std::ceil(renderExtent.height / float(16))), 1);
+  }
+}
+
+uint32_t RendererPT::getTileSize() const {
+  // Tiles must consist of whole workgroups.
+  const uint32_t step = std::lcm(kernelConfig_.workgroupWidth, kernelConfig_.workgroupHeight);
+  return std::max((tiledConfig_.tileSize + step - 1u) / step, 1u) * step;
+}
+
+void RendererPT::recordTileCommands() {
+  vk::Extent2D renderExtent = getRenderExtent();
+  const uint32_t tileSize = getTileSize();
+
+  tileOffsets_.clear();
+  for (uint32_t y = 0; y < renderExtent.height; y += tileSize) {
+    for (uint32_t x = 0; x < renderExtent.width; x += tileSize) {
+      tileOffsets_.emplace_back(x, y);
+    }
+  }
+
+  // Order tiles around the center.
+  const glm::vec2 center = tiledConfig_.center * glm::vec2(renderExtent.width, renderExtent.height);
+  auto centerOffset = [&](const glm::uvec2& tileOffset) {
+    return glm::vec2(tileOffset) + glm::vec2(0.5f * tileSize) - center;
+  };
+
+  if (tiledConfig_.order == TileOrder::eSpiral) {
+    auto spiralKey = [&](const glm::uvec2& tileOffset) {
+      glm::vec2 offset = centerOffset(tileOffset);
+      auto ring = static_cast<int32_t>(std::round(std::max(std::abs(offset.x), std::abs(offset.y)) / tileSize));
+      return std::make_pair(ring, std::atan2(offset.y, offset.x));
+    };
+
+    std::stable_sort(tileOffsets_.begin(), tileOffsets_.end(),
+                     [&](const glm::uvec2& lhs, const glm::uvec2& rhs) { return spiralKey(lhs) < spiralKey(rhs); });
+  } else {
+    std::stable_sort(tileOffsets_.begin(), tileOffsets_.end(), [&](const glm::uvec2& lhs, const glm::uvec2& rhs) {
+      return glm::length(centerOffset(lhs)) < glm::length(centerOffset(rhs));
+    });
+  }
+
+  // Reallocate command buffers and queries if the number of tiles changed.
+  if (tileCmdBuffers_.size() != tileOffsets_.size()) {
+    for (auto& cmdBuffer : tileCmdBuffers_) {
+      cmdBuffer.destroy();
+    }
+
+    tileCmdBuffers_ =
+      graphicsFamilyCmdPool_.allocateCommandBuffers(vk::CommandBufferLevel::ePrimary, tileOffsets_.size());
+
+    tileTimer_.destroy();
+    tileTimer_ = GPUTimer(physicalDevice_, logicalDevice_, static_cast<uint32_t>(tileOffsets_.size()));
+  }
+
+  for (uint32_t i = 0; i < tileOffsets_.size(); i++) {
+    const logi::CommandBuffer& cmdBuffer = tileCmdBuffers_[i];
+    PathTracingPushConstants pushConstants{tileOffsets_[i]};
+    uint32_t tileWidth = std::min(tileSize, renderExtent.width - tileOffsets_[i].x);
+    uint32_t tileHeight = std::min(tileSize, renderExtent.height - tileOffsets_[i].y);
+
+    cmdBuffer.reset();
+    cmdBuffer.begin(vk::CommandBufferBeginInfo());
+    tileTimer_.recordReset(cmdBuffer, i);
+    tileTimer_.recordBegin(cmdBuffer, i);
+
+    cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pathTracingPipeline_);
+    cmdBuffer.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute, pathTracingPipelineLayoutData_.layout, 0,
+      std::vector<vk::DescriptorSet>(pathTracingDescSets_.begin(), pathTracingDescSets_.end()));
+    cmdBuffer.pushConstants(pathTracingPipelineLayoutData_.layout, vk::ShaderStageFlagBits::eCompute, 0,
+                            sizeof(PathTracingPushConstants), &pushConstants);
+    cmdBuffer.dispatch((tileWidth + kernelConfig_.workgroupWidth - 1u) / kernelConfig_.workgroupWidth,
+                       (tileHeight + kernelConfig_.workgroupHeight - 1u) / kernelConfig_.workgroupHeight, 1);
+
+    tileTimer_.recordEnd(cmdBuffer, i, vk::PipelineStageFlagBits::eComputeShader);
+    cmdBuffer.end();
+  }
+
+  tileCursor_ = 0u;
+}
+
+void RendererPT::submitTiles() {
+  // Estimate the cost of a tile from the tiles that were measured so far.
+  if (tileTimer_.fetchResults()) {
+    double totalTime = 0.0;
+    uint32_t measuredTiles = 0u;
+
+    for (uint32_t i = 0; i < tileOffsets_.size(); i++) {
+      double tileTime = tileTimer_.getMilliseconds(i);
+      if (tileTime > 0.0) {
+        totalTime += tileTime;
+        measuredTiles++;
+      }
+    }
+
+    averageTileTime_ = measuredTiles > 0u ? totalTime / measuredTiles : 0.0;
+  }
+
+  auto tileCount = static_cast<uint32_t>(tileOffsets_.size()) - tileCursor_;
+  if (averageTileTime_ > 0.0) {
+    tileCount = std::min(tileCount, std::max(static_cast<uint32_t>(tiledConfig_.frameBudget / averageTileTime_), 1u));
+  } else {
+    // Nothing measured yet (or timestamps are not supported), render a single tile.
+    tileCount = std::min(tileCount, 1u);
+  }
+
+  // One submission per tile bounds the GPU time of a single submission.
+  std::vector<vk::SubmitInfo> submitInfos(tileCount);
+  for (uint32_t i = 0; i < tileCount; i++) {
+    submitInfos[i].commandBufferCount = 1;
+    submitInfos[i].pCommandBuffers = &static_cast<const vk::CommandBuffer&>(tileCmdBuffers_[tileCursor_ + i]);
+  }
+
+  graphicsQueue_.submit(submitInfos);
+  tileCursor_ += tileCount;
+}
+
+void RendererPT::setTileCenter(const glm::vec2& center) {
+  tiledConfig_.center = center;
+
+  if (tiledConfig_.enabled) {
+    logicalDevice_.waitIdle();
+    recordTileCommands();
+  }
+}
+
+void RendererPT::setPersistentThreads(bool enabled) {
+  if (tiledConfig_.enabled || (enabled && !persistentThreadsSupported_) || kernelConfig_.persistentThreads == enabled) {
+    return;
+  }
+
+  logicalDevice_.waitIdle();
+  kernelConfig_.persistentThreads = enabled;
+
+  // Before the first scene batch the shader is selected by commitSceneBatches.
+  if (sceneLoaded_) {
+    selectPathTracingShader();
+    recordCommandBuffers();
+  } else {
+    createPathTracingPipeline();
+  }
+}
+
+void RendererPT::setPreviewShading(PreviewShading shading) {
+  // Takes effect with the next frame, which restarts the accumulation if the shading changes.
+  previewConfig_.shading = shading;
+}
+
+bool RendererPT::pick(const glm::vec2& position, SceneHit& hit) const {
+  if (!selectedCameraTransform_) {
+    return false;
+  }
+
+  // Same as generateRay in path_tracing.comp, without the jitter.
+  const vk::Extent2D extent = getRenderExtent();
+  const glm::mat4& worldMatrix = ubo_.camera.worldMatrix;
+  const float tanHalfFovY = std::tan(ubo_.camera.fovY / 2.0f);
+
+  glm::vec2 uv = 2.0f * position - 1.0f;
+  uv.x *= static_cast<float>(extent.width) / extent.height * tanHalfFovY;
+  uv.y *= tanHalfFovY;
+
+  SceneRay ray;
+  ray.origin = glm::vec3(worldMatrix[3]);
+  ray.direction = glm::normalize(uv.x * glm::vec3(worldMatrix[0]) + uv.y * glm::vec3(worldMatrix[1]) -
+                                 glm::vec3(worldMatrix[2]));
+
+  return intersect(sceneConverter_.getHostScene(), ray, std::numeric_limits<float>::infinity(), hit);
+}
+
+float RendererPT::focusDistance() const {
+  SceneHit hit;
+  return pick(glm::vec2(0.5f), hit) ? hit.distance : -1.0f;
+}
+
 static std::chrono::time_point<std::chrono::high_resolution_clock> startTime;
 
+bool RendererPT::updateTextureStreaming() {
+  if (!sceneConverter_.isTextureStreamingActive()) {
+    return false;
+  }
+
+  const std::vector<GPUTexture>& textures = sceneConverter_.getTextures();
+  std::vector<uint32_t> feedback(textures.size());
+
+  // Previous frame has finished, so the feedback is complete and can be cleared for the next one.
+  auto* mappedFeedback = static_cast<uint32_t*>(textureFeedbackBuffer_.mapMemory());
+  std::copy(mappedFeedback, mappedFeedback + feedback.size(), feedback.begin());
+  std::fill(mappedFeedback, mappedFeedback + feedback.size(), 0u);
+  textureFeedbackBuffer_.unmapMemory();
+
+  std::vector<uint32_t> changed = sceneConverter_.updateTextureStreaming(feedback.data(), frameIndex_);
+  if (changed.empty()) {
+    return false;
+  }
+
+  // Texture table is update-after-bind, so the recorded command buffers remain valid.
+  std::vector<vk::DescriptorImageInfo> imageInfos;
+  imageInfos.reserve(changed.size());
+  std::vector<vk::WriteDescriptorSet> descriptorWrites;
+
+  for (uint32_t textureIndex : changed) {
+    vk::DescriptorImageInfo& imageInfo = imageInfos.emplace_back();
+    imageInfo.imageView = textures[textureIndex].imageView;
+    imageInfo.sampler = textures[textureIndex].sampler;
+    imageInfo.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+
+    vk::WriteDescriptorSet& descriptorWrite = descriptorWrites.emplace_back();
+    descriptorWrite.dstSet = pathTracingDescSets_[1];
+    descriptorWrite.dstBinding = 0;
+    descriptorWrite.dstArrayElement = textureIndex;
+    descriptorWrite.descriptorType = vk::DescriptorType::eCombinedImageSampler;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pImageInfo = &imageInfo;
+  }
+
+  logicalDevice_.updateDescriptorSets(descriptorWrites);
+  return true;
+}
+
+PreviewShading RendererPT::selectShading(bool cameraMoved) {
+  staticFrameCount_ = cameraMoved ? 0u : std::min(staticFrameCount_ + 1u, previewConfig_.staticFrames);
+  return staticFrameCount_ < previewConfig_.staticFrames ? previewConfig_.shading : PreviewShading::ePathTracing;
+}
+
+void RendererPT::logShadingCosts() const {
+  std::cout << "Path tracing dispatch per frame:";
+  for (size_t mode = 0u; mode < kShadingModeCount; mode++) {
+    if (shadingCosts_[mode].frames > 0u) {
+      std::cout << " " << toString(static_cast<PreviewShading>(mode)) << " "
+                << shadingCosts_[mode].milliseconds / shadingCosts_[mode].frames << " ms ("
+                << shadingCosts_[mode].frames << " frames)";
+    }
+  }
+  std::cout << std::endl;
+}
+
 void RendererPT::preDraw() {
-  if (selectedCameraTransform_->isWorldMatrixDirty()) {
+  // Timer results belong to the last frame, which used the shading selected before this one. Tiles are timed apart.
+  if (gpuTimer_.fetchResults() && !tiledConfig_.enabled) {
+    ShadingCost& cost = shadingCosts_[static_cast<size_t>(activeShading_)];
+    cost.milliseconds += gpuTimer_.getMilliseconds(kTimerPathTracing);
+    cost.frames++;
+  }
+  if (kernelConfig_.countRays) {
+    lastFrameRayCount_ = fetchRayCount();
+  }
+
+  // Finer texture levels replace the blurry ones and committed scene batches add geometry, so the accumulation
+  // restarts.
+  bool texturesChanged = updateTextureStreaming() || sceneChanged_;
+  sceneChanged_ = false;
+
+  bool cameraMoved = selectedCameraTransform_->isWorldMatrixDirty();
+  float scale = selectRenderScale(cameraMoved);
+  bool scaleChanged = scale != dynamicRenderScale_;
+
+  PreviewShading shading = selectShading(cameraMoved);
+  bool shadingChanged = shading != activeShading_;
+  if (shadingChanged && activeShading_ != PreviewShading::ePathTracing) {
+    logShadingCosts();
+  }
+  activeShading_ = shading;
+  ubo_.shadingMode = static_cast<uint32_t>(shading);
+
+  reprojectionUBO_.previousCamera = ubo_.camera;
+  if (cameraMoved) {
     ubo_.camera.worldMatrix = selectedCameraTransform_->worldMatrix();
+  }
+  reprojectionUBO_.camera = ubo_.camera;
+
+  // Stale samples of streamed in textures and committed geometry must not be reprojected, so the history is dropped.
+  if (texturesChanged) {
+    historyValid_ = false;
+  }
+
+  // Render scale change restarts the accumulation in new render targets, the same way as a camera movement.
+  // Samples of different shading modes are never mixed, so a shading change does not reproject either.
+  if (cameraMoved || scaleChanged || texturesChanged || shadingChanged) {
     ubo_.reset = true;
     sampleCount = 1;
+    reprojectionUBO_.active = reprojectionConfig_.enabled && historyValid_ && (cameraMoved || scaleChanged) &&
+                              !shadingChanged && shading == PreviewShading::ePathTracing;
   } else {
-    ubo_.reset = false;
+    // In tiled mode the whole first pass over the tiles after a reset overwrites the accumulation.
+    ubo_.reset = tiledConfig_.enabled && sampleCount == 1u;
+    reprojectionUBO_.active = VK_FALSE;
+  }
+
+  if ((cameraMoved || texturesChanged || shadingChanged) && tiledConfig_.enabled) {
+    tileCursor_ = 0u;
+  }
+
+  // Save the accumulation before the path tracer overwrites it. Runs before the frame in submission order.
+  if (reprojectionUBO_.active) {
+    reprojectionUBO_.historyExtent = glm::uvec2(renderTargets_.extent.width, renderTargets_.extent.height);
+
+    vk::SubmitInfo submitInfo;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &static_cast<const vk::CommandBuffer&>(historyCmdBuffer_);
+    graphicsQueue_.submit({submitInfo});
+  }
+
+  if (scaleChanged) {
+    applyRenderScale(scale);
+  }
+
+  // Drawn before the frame in submission order, so that the path tracer reads the current camera.
+  if (kernelConfig_.rasterPrimaryVisibility && (cameraMoved || scaleChanged || texturesChanged || !visibilityValid_)) {
+    submitVisibilityPass();
   }
 
   invSampleCount = 1.0f / sampleCount;
-  ubo_.random.x = rand();
-  ubo_.random.y = rand();
+  // Reprojected pixels keep their history, so the sample sequence must not restart when the camera moves.
+  ubo_.sampleIndex = reprojectionConfig_.enabled ? frameIndex_ : sampleCount - 1u;
 
   if (sampleCount == 1) {
     startTime = std::chrono::high_resolution_clock::now();
   }
 
   updateUBOBuffer();
+
+  if (tiledConfig_.enabled) {
+    submitTiles();
+  }
 }
 
 void RendererPT::postDraw() {
+  frameIndex_++;
+  historyValid_ = true;
+
+  // In tiled mode a sample is complete once all tiles were rendered.
+  if (tiledConfig_.enabled) {
+    if (tileCursor_ < tileOffsets_.size()) {
+      return;
+    }
+    tileCursor_ = 0u;
+  }
+
   sampleCount++;
   if (sampleCount % 10 == 0) {
     std::cout << "Sample: " << sampleCount << std::endl;
@@ -602,10 +2133,39 @@ void RendererPT::postDraw() {
           .count() /
         1000.0f;
       std::cout << "Samples per second: " << sampleCount / dt << std::endl;
+
+      if (gpuTimer_.isSupported()) {
+        if (tiledConfig_.enabled) {
+          std::cout << "Path tracing tile: " << averageTileTime_ << " ms";
+        } else {
+          const double pathTracingTime = gpuTimer_.getMilliseconds(kTimerPathTracing);
+          std::cout << "Path tracing" << (kernelConfig_.persistentThreads ? " (persistent threads): " : ": ")
+                    << pathTracingTime << " ms";
+          if (kernelConfig_.countRays) {
+            std::cout << ", " << lastFrameRayCount_ / (pathTracingTime * 1000.0) << " Mrays/s";
+          }
+        }
+        if (kernelConfig_.rasterPrimaryVisibility && visibilityTimer_.fetchResults()) {
+          std::cout << ", last visibility pass: " << visibilityTimer_.getMilliseconds(0u) << " ms";
+        }
+        if (reprojectionConfig_.enabled) {
+          std::cout << ", reprojection: " << gpuTimer_.getMilliseconds(kTimerReprojection) << " ms";
+        }
+        if (denoiserConfig_.enabled) {
+          std::cout << ", denoise: " << gpuTimer_.getMilliseconds(kTimerDenoise) << " ms";
+        }
+        std::cout << std::endl;
+      }
     }
   }
 }
 void RendererPT::drawFrame() {
+  if (sceneConverter_.hasPendingBatches()) {
+    // Scene buffers may be reallocated, so the previous frame must have finished.
+    inFlightFence_.wait(std::numeric_limits<uint64_t>::max());
+    commitSceneBatches();
+  }
+
   if (sceneLoaded_) {
     RendererCore::drawFrame();
   }
@@ -5,16 +5,27 @@
 #include "RendererRTX.h"
 #include <chrono>
 #include <cmath>
+#include "Helpers.hpp"
 
 RendererRTX::RendererRTX(const cppglfw::Window& window, const RendererConfiguration& configuration)
   : RendererCore(window, configuration), allocator_(logicalDevice_.createMemoryAllocator()),
-    sceneConverter_(allocator_, graphicsFamilyCmdPool_, graphicsQueue_) {
+    countRays_(configuration.kernel.countRays), sceneConverter_(allocator_, graphicsFamilyCmdPool_, graphicsQueue_) {
+  // The NV extensions are only enabled for this backend (see RendererCore::createLogicalDevice).
+  if (rayTracingBackend_ != RayTracingBackend::eNVRayTracing) {
+    throw std::runtime_error("RendererRTX requires the NV ray tracing backend.");
+  }
+
   srand(static_cast<unsigned>(time(0)));
+  ubo_.scrambleSeed = rand();
+
+  sceneConverter_.setHostCopyRetention(configuration.hostCopies);
+  sceneConverter_.setMappedBuffersPath(configuration.sceneLoading.mappedBuffersPath);
 
   // Fetch ray tracing properties.
   rayTracingProperties_ =
     physicalDevice_.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceRayTracingPropertiesNV>()
       .get<vk::PhysicalDeviceRayTracingPropertiesNV>();
+  gpuTimer_ = GPUTimer(physicalDevice_, logicalDevice_, kTimerScopeCount);
 
   createTexViewerRenderPass();
   createFrameBuffers();
@@ -32,10 +43,16 @@ RendererRTX::RendererRTX(const cppglfw::Window& window, const RendererConfigurat
   initializeDescriptorSets();
   updateAccumulationTexDescriptorSet();
   initializeUBOs();
+  sobolDirectionsBuffer_ = createSamplerBuffer(allocator_, pathTracingDescSets_[0], 6);
+  initializeRayCounterBuffer();
+  reportStartupTime();
 }
 
 void RendererRTX::loadScene(const lsg::Ref<lsg::Scene>& scene) {
   sceneLoaded_ = false;
+  // Textures of the new scene are written from the start of the texture table.
+  boundTextureCount_ = 0u;
+  auto loadStart = std::chrono::high_resolution_clock::now();
   sceneConverter_.loadScene(scene);
 
   lsg::Ref<lsg::PerspectiveCamera> camPerspective;
@@ -59,6 +76,12 @@ void RendererRTX::loadScene(const lsg::Ref<lsg::Scene>& scene) {
   ubo_.reset = true;
 
   initializeAndBindSceneBuffer();
+
+  auto elapsed =
+    std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - loadStart);
+  std::cout << "Scene loaded in " << elapsed.count() << " ms (peak RSS "
+            << getPeakResidentSetSize() / (1024u * 1024u) << " MB)." << std::endl;
+
   sceneLoaded_ = true;
 }
 
@@ -215,7 +238,7 @@ void RendererRTX::createTexViewerPipeline() {
   pipelineInfo.renderPass = texViewerRenderPass_;
   pipelineInfo.subpass = 0;
 
-  texViewerPipeline_ = logicalDevice_.createGraphicsPipeline(pipelineInfo);
+  texViewerPipeline_ = logicalDevice_.createGraphicsPipeline(pipelineInfo, pipelineCache_);
 }
 
 void RendererRTX::createShaderBindingTable() {
@@ -281,6 +304,11 @@ void RendererRTX::createPathTracingPipeline() {
   shaderStages[kIndexRaygen].pName = "main";
   shaderStages[kIndexRaygen].module = pathTracingPipelineLayoutData_.shaders.at(vk::ShaderStageFlagBits::eRaygenNV);
 
+  vk::Bool32 countRays = countRays_ ? VK_TRUE : VK_FALSE;
+  vk::SpecializationMapEntry countRaysEntry(0u, 0u, sizeof(vk::Bool32));
+  vk::SpecializationInfo raygenSpecializationInfo(1u, &countRaysEntry, sizeof(vk::Bool32), &countRays);
+  shaderStages[kIndexRaygen].pSpecializationInfo = &raygenSpecializationInfo;
+
   shaderStages[kIndexMiss].stage = vk::ShaderStageFlagBits::eMissNV;
   shaderStages[kIndexMiss].pName = "main";
   shaderStages[kIndexMiss].module = pathTracingPipelineLayoutData_.shaders.at(vk::ShaderStageFlagBits::eMissNV);
@@ -295,10 +323,11 @@ void RendererRTX::createPathTracingPipeline() {
   pipelineInfo.pStages = shaderStages.data();
   pipelineInfo.groupCount = static_cast<uint32_t>(groups.size());
   pipelineInfo.pGroups = groups.data();
-  pipelineInfo.maxRecursionDepth = 20;
+  // Bounces are traced by the raygen shader (see raygen.rgen), so no shader traces from a hit.
+  pipelineInfo.maxRecursionDepth = 1;
   pipelineInfo.layout = pathTracingPipelineLayoutData_.layout;
 
-  pathTracingPipeline_ = logicalDevice_.createRayTracingPipelineNV(pipelineInfo);
+  pathTracingPipeline_ = logicalDevice_.createRayTracingPipelineNV(pipelineInfo, pipelineCache_);
   createShaderBindingTable();
 }
 
@@ -391,13 +420,13 @@ void RendererRTX::initializeAccumulationTexture() {
 void RendererRTX::initializeDescriptorSets() {
   static const size_t numPoolSets = 10;
   static const std::vector<vk::DescriptorPoolSize> poolSizes = {//{vk::DescriptorType::eSampler, 0},
-                                                                {vk::DescriptorType::eCombinedImageSampler, 600},
+                                                                {vk::DescriptorType::eCombinedImageSampler, 1},
                                                                 //{vk::DescriptorType::eSampledImage, 0},
                                                                 {vk::DescriptorType::eStorageImage, 1},
                                                                 //{vk::DescriptorType::eUniformTexelBuffer, 0},
                                                                 //{vk::DescriptorType::eStorageTexelBuffer, 0},
                                                                 {vk::DescriptorType::eUniformBuffer, 2},
-                                                                {vk::DescriptorType::eStorageBuffer, 4},
+                                                                {vk::DescriptorType::eStorageBuffer, 6},
                                                                 //{vk::DescriptorType::eUniformBufferDynamic, 0},
                                                                 //{vk::DescriptorType::eStorageBufferDynamic, 0},
                                                                 //{vk::DescriptorType::eInputAttachment, 0},
@@ -415,9 +444,20 @@ void RendererRTX::initializeDescriptorSets() {
   texViewerDescSets_ = descriptorPool_.allocateDescriptorSets(
     std::vector<vk::DescriptorSetLayout>(texViewerPipelineLayoutData_.descriptorSetLayouts.begin(),
                                          texViewerPipelineLayoutData_.descriptorSetLayouts.end()));
+  // Texture table (set 1) is allocated separately, at capacity.
   pathTracingDescSets_ = descriptorPool_.allocateDescriptorSets(
-    std::vector<vk::DescriptorSetLayout>(pathTracingPipelineLayoutData_.descriptorSetLayouts.begin(),
-                                         pathTracingPipelineLayoutData_.descriptorSetLayouts.end()));
+    {static_cast<const vk::DescriptorSetLayout&>(pathTracingPipelineLayoutData_.descriptorSetLayouts[0])});
+  initializeTextureDescriptorSet();
+}
+
+void RendererRTX::initializeTextureDescriptorSet() {
+  logi::DescriptorSet textureSet =
+    allocateVariableDescriptorSet(textureDescriptorPool_, pathTracingPipelineLayoutData_.descriptorSetLayouts[1],
+                                  vk::DescriptorType::eCombinedImageSampler, maxVariableDescriptorCount_);
+
+  pathTracingDescSets_.resize(2u);
+  pathTracingDescSets_[1] = textureSet;
+  boundTextureCount_ = 0u;
 }
 
 void RendererRTX::updateAccumulationTexDescriptorSet() {
@@ -508,9 +548,47 @@ void RendererRTX::updateUBOBuffer() {
   sampleCountBuffer_.writeToBuffer(&invSampleCount, sizeof(invSampleCount));
 }
 
+
+void RendererRTX::initializeRayCounterBuffer() {
+  // Reset by the GPU before every launch and read back by the host. CPU only memory is host coherent.
+  VmaAllocationCreateInfo allocationInfo = {};
+  allocationInfo.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_CPU_ONLY;
+
+  vk::BufferCreateInfo bufferCreateInfo;
+  bufferCreateInfo.size = sizeof(uint32_t);
+  bufferCreateInfo.usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst;
+  bufferCreateInfo.sharingMode = vk::SharingMode::eExclusive;
+
+  rayCounterBuffer_ = allocator_.createBuffer(bufferCreateInfo, allocationInfo);
+  const uint32_t rayCount = 0u;
+  rayCounterBuffer_.writeToBuffer(&rayCount, sizeof(uint32_t));
+
+  vk::DescriptorBufferInfo bufferInfo;
+  bufferInfo.buffer = rayCounterBuffer_;
+  bufferInfo.offset = 0;
+  bufferInfo.range = sizeof(uint32_t);
+
+  vk::WriteDescriptorSet descriptorWrite;
+  descriptorWrite.dstSet = pathTracingDescSets_[0];
+  descriptorWrite.dstBinding = 7;
+  descriptorWrite.dstArrayElement = 0;
+  descriptorWrite.descriptorType = vk::DescriptorType::eStorageBuffer;
+  descriptorWrite.descriptorCount = 1;
+  descriptorWrite.pBufferInfo = &bufferInfo;
+
+  logicalDevice_.updateDescriptorSets(descriptorWrite);
+}
+
+uint32_t RendererRTX::fetchRayCount() {
+  auto* rayCount = static_cast<const uint32_t*>(rayCounterBuffer_.mapMemory());
+  const uint32_t count = *rayCount;
+  rayCounterBuffer_.unmapMemory();
+  return count;
+}
+
 void RendererRTX::initializeAndBindSceneBuffer() {
   // Update descriptor sets.
-  std::vector<vk::WriteDescriptorSet> descriptorWrites(3);
+  std::vector<vk::WriteDescriptorSet> descriptorWrites(4);
 
   vk::WriteDescriptorSetAccelerationStructureNV descriptorAccelerationStructureInfo;
   descriptorAccelerationStructureInfo.accelerationStructureCount = 1;
@@ -547,25 +625,43 @@ void RendererRTX::initializeAndBindSceneBuffer() {
   descriptorWrites[2].descriptorType = vk::DescriptorType::eStorageBuffer;
   descriptorWrites[2].pBufferInfo = &vertexBufferInfo;
 
+  logi::VMABuffer instancesBuffer = sceneConverter_.getInstancesBuffer();
+  vk::DescriptorBufferInfo instancesBufferInfo;
+  instancesBufferInfo.buffer = instancesBuffer;
+  instancesBufferInfo.offset = 0;
+  instancesBufferInfo.range = instancesBuffer.size();
+
+  descriptorWrites[3].dstSet = pathTracingDescSets_[0];
+  descriptorWrites[3].dstBinding = 5;
+  descriptorWrites[3].descriptorCount = 1;
+  descriptorWrites[3].descriptorType = vk::DescriptorType::eStorageBuffer;
+  descriptorWrites[3].pBufferInfo = &instancesBufferInfo;
+
   const std::vector<GPUTexture>& textures = sceneConverter_.getTextures();
   std::cout << "Number of textures: " << textures.size() << std::endl;
+  if (textures.size() > maxVariableDescriptorCount_) {
+    throw std::runtime_error("Scene has more textures than the texture table holds.");
+  }
+  // Texture table is allocated at capacity, partially bound and update-after-bind, so only the textures published
+  // since the last commit are written.
   std::vector<vk::DescriptorImageInfo> descriptorImageInfos;
 
-  if (!textures.empty()) {
-    for (const auto& texture : textures) {
+  if (textures.size() > boundTextureCount_) {
+    for (size_t i = boundTextureCount_; i < textures.size(); i++) {
       vk::DescriptorImageInfo& descriptorImageInfo = descriptorImageInfos.emplace_back();
-      descriptorImageInfo.imageView = texture.imageView;
-      descriptorImageInfo.sampler = texture.sampler;
+      descriptorImageInfo.imageView = textures[i].imageView;
+      descriptorImageInfo.sampler = textures[i].sampler;
       descriptorImageInfo.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
     }
 
     vk::WriteDescriptorSet& descriptorWriteTex = descriptorWrites.emplace_back();
-    descriptorWriteTex.dstSet = pathTracingDescSets_[0];
-    descriptorWriteTex.dstBinding = 5;
-    descriptorWriteTex.dstArrayElement = 0;
+    descriptorWriteTex.dstSet = pathTracingDescSets_[1];
+    descriptorWriteTex.dstBinding = 0;
+    descriptorWriteTex.dstArrayElement = boundTextureCount_;
     descriptorWriteTex.descriptorType = vk::DescriptorType::eCombinedImageSampler;
     descriptorWriteTex.descriptorCount = descriptorImageInfos.size();
     descriptorWriteTex.pImageInfo = descriptorImageInfos.data();
+    boundTextureCount_ = textures.size();
   }
 
   logicalDevice_.updateDescriptorSets(descriptorWrites);
@@ -584,6 +680,16 @@ void RendererRTX::recordCommandBuffers() {
     beginInfo.flags = vk::CommandBufferUsageFlagBits::eSimultaneousUse;
 
     mainCmdBuffers_[i].begin(beginInfo);
+    gpuTimer_.recordReset(mainCmdBuffers_[i]);
+
+    // Ray counter restarts with every launch.
+    if (countRays_) {
+      mainCmdBuffers_[i].fillBuffer(rayCounterBuffer_, 0, sizeof(uint32_t), 0u);
+      vk::MemoryBarrier resetBarrier(vk::AccessFlagBits::eTransferWrite,
+                                     vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+      mainCmdBuffers_[i].pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                         vk::PipelineStageFlagBits::eRayTracingShaderNV, {}, resetBarrier, {}, {});
+    }
 
     // Compute shader.
     mainCmdBuffers_[i].bindPipeline(vk::PipelineBindPoint::eRayTracingNV, pathTracingPipeline_);
@@ -597,10 +703,19 @@ void RendererRTX::recordCommandBuffers() {
     VkDeviceSize bindingOffsetHitShader = rayTracingProperties_.shaderGroupHandleSize * kIndexClosestHit;
     VkDeviceSize bindingStride = rayTracingProperties_.shaderGroupHandleSize;
 
+    gpuTimer_.recordBegin(mainCmdBuffers_[i], kTimerPathTracing);
     mainCmdBuffers_[i].traceRaysNV(shaderBindingTable_, bindingOffsetRayGenShader, shaderBindingTable_,
                                    bindingOffsetMissShader, bindingStride, shaderBindingTable_, bindingOffsetHitShader,
                                    bindingStride, nullptr, 0, 0, swapchainImageExtent_.width * renderScale,
                                    swapchainImageExtent_.height * renderScale, 1);
+    gpuTimer_.recordEnd(mainCmdBuffers_[i], kTimerPathTracing, vk::PipelineStageFlagBits::eRayTracingShaderNV);
+
+    // Ray count is read by the host once the submission has finished.
+    if (countRays_) {
+      vk::MemoryBarrier counterBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eHostRead);
+      mainCmdBuffers_[i].pipelineBarrier(vk::PipelineStageFlagBits::eRayTracingShaderNV,
+                                         vk::PipelineStageFlagBits::eHost, {}, counterBarrier, {}, {});
+    }
 
     vk::ImageMemoryBarrier imageMemoryBarrier;
     imageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
@@ -641,6 +756,13 @@ void RendererRTX::recordCommandBuffers() {
 
 static std::chrono::time_point<std::chrono::high_resolution_clock> startTime;
 void RendererRTX::preDraw() {
+  gpuTimer_.fetchResults();
+  // Called once drawFrame has waited on the fence of the previous submission. Submissions share the counter, but only
+  // one of them is in flight at a time.
+  if (countRays_) {
+    lastFrameRayCount_ = fetchRayCount();
+  }
+
   if (selectedCameraTransform_->isWorldMatrixDirty()) {
     ubo_.camera.worldMatrix = selectedCameraTransform_->worldMatrix();
     ubo_.reset = true;
@@ -648,8 +770,7 @@ void RendererRTX::preDraw() {
   }
 
   invSampleCount = 1.0f / sampleCount;
-  ubo_.random.x = rand();
-  ubo_.random.y = rand();
+  ubo_.sampleIndex = sampleCount - 1u;
 
   if (sampleCount == 1) {
     startTime = std::chrono::high_resolution_clock::now();
@@ -670,6 +791,15 @@ void RendererRTX::postDraw() {
           .count() /
         1000.0f;
       std::cout << "Samples per second: " << sampleCount / dt << std::endl;
+
+      if (gpuTimer_.isSupported()) {
+        const double pathTracingTime = gpuTimer_.getMilliseconds(kTimerPathTracing);
+        std::cout << "Path tracing: " << pathTracingTime << " ms";
+        if (countRays_) {
+          std::cout << ", " << lastFrameRayCount_ / (pathTracingTime * 1000.0) << " Mrays/s";
+        }
+        std::cout << std::endl;
+      }
     }
   }
 }
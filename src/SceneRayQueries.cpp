@@ -0,0 +1,309 @@
+#include "SceneRayQueries.hpp"
+#include <algorithm>
+#include <array>
+#include <future>
+#include <thread>
+#include <tuple>
+#include <utility>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define LOGIPATHTRACER_SSE_BOX_TEST
+#endif
+
+namespace {
+
+// EPS in shaders/common/constants.glsl.
+constexpr float kEpsilon = 0.0001f;
+constexpr float kMiss = std::numeric_limits<float>::infinity();
+// Deeper than any tree the GPU traversal stack can handle. Children that do not fit are skipped.
+constexpr uint32_t kStackSize = 64u;
+// Smaller batches are not worth starting a thread for.
+constexpr size_t kMinBatchRaysPerThread = 64u;
+
+glm::vec3 vertexPosition(const GPUVertex& vertex) {
+  return glm::vec3(vertex.position[0], vertex.position[1], vertex.position[2]);
+}
+
+/**
+ * Same as rayAABBEntry in ray.glsl. With SSE all three slabs are tested at once: the corners are loaded together with
+ * the child index packed behind them (see GPUBVHNode), whose lane is ignored by the reductions.
+ */
+class RayBoxTest {
+ public:
+  explicit RayBoxTest(const SceneRay& ray) {
+    const glm::vec3 inverseDirection = glm::vec3(1.0f) / ray.direction;
+#ifdef LOGIPATHTRACER_SSE_BOX_TEST
+    origin_ = _mm_setr_ps(ray.origin.x, ray.origin.y, ray.origin.z, 0.0f);
+    inverseDirection_ = _mm_setr_ps(inverseDirection.x, inverseDirection.y, inverseDirection.z, 0.0f);
+#else
+    origin_ = ray.origin;
+    inverseDirection_ = inverseDirection;
+#endif
+  }
+
+  float entry(const GPUBVHNode& node, float maxDistance) const {
+#ifdef LOGIPATHTRACER_SSE_BOX_TEST
+    __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.minCorner[0]), origin_), inverseDirection_);
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.maxCorner[0]), origin_), inverseDirection_);
+    __m128 tMin = _mm_min_ps(t0, t1);
+    __m128 tMax = _mm_max_ps(t0, t1);
+
+    // Lane 0 of the reductions combines x, y and z.
+    __m128 enterX = _mm_max_ss(tMin, _mm_shuffle_ps(tMin, tMin, _MM_SHUFFLE(3, 0, 2, 1)));
+    __m128 exitX = _mm_min_ss(tMax, _mm_shuffle_ps(tMax, tMax, _MM_SHUFFLE(3, 0, 2, 1)));
+    float enter = _mm_cvtss_f32(_mm_max_ss(enterX, _mm_shuffle_ps(tMin, tMin, _MM_SHUFFLE(3, 1, 0, 2))));
+    float exit = _mm_cvtss_f32(_mm_min_ss(exitX, _mm_shuffle_ps(tMax, tMax, _MM_SHUFFLE(3, 1, 0, 2))));
+#else
+    glm::vec3 t0 = (node.minCorner - origin_) * inverseDirection_;
+    glm::vec3 t1 = (node.maxCorner - origin_) * inverseDirection_;
+    glm::vec3 tMin = glm::min(t0, t1);
+    glm::vec3 tMax = glm::max(t0, t1);
+
+    float enter = std::max(std::max(tMin.x, tMin.y), tMin.z);
+    float exit = std::min(std::min(tMax.x, tMax.y), tMax.z);
+#endif
+
+    if (enter > exit || exit <= 0.0f) {
+      return kMiss;
+    }
+
+    enter = std::max(enter, 0.0f);
+    return enter < maxDistance ? enter : kMiss;
+  }
+
+ private:
+#ifdef LOGIPATHTRACER_SSE_BOX_TEST
+  __m128 origin_;
+  __m128 inverseDirection_;
+#else
+  glm::vec3 origin_;
+  glm::vec3 inverseDirection_;
+#endif
+};
+
+// Same as rayTriangleIntersect in ray.glsl. Triangle is given by its first vertex.
+float intersectTriangle(const SceneRay& ray, const GPUVertex* vertices) {
+  glm::vec3 v0 = vertexPosition(vertices[0]);
+  glm::vec3 edge1 = vertexPosition(vertices[1]) - v0;
+  glm::vec3 edge2 = vertexPosition(vertices[2]) - v0;
+  glm::vec3 p = glm::cross(ray.direction, edge2);
+  float determinant = glm::dot(edge1, p);
+
+  if (determinant == 0.0f) {
+    return kMiss;
+  }
+
+  float inverseDeterminant = 1.0f / determinant;
+  glm::vec3 t = ray.origin - v0;
+  float u = glm::dot(t, p) * inverseDeterminant;
+  if (u < 0.0f || u > 1.0f) {
+    return kMiss;
+  }
+
+  glm::vec3 q = glm::cross(t, edge1);
+  float v = glm::dot(ray.direction, q) * inverseDeterminant;
+  if (v < 0.0f || u + v > 1.0f) {
+    return kMiss;
+  }
+
+  return glm::dot(edge2, q) * inverseDeterminant;
+}
+
+SceneRay toObjectSpace(const SceneRay& ray, const GPUObjectData& object) {
+  return {glm::vec4(ray.origin, 1.0f) * object.worldToObject, glm::vec4(ray.direction, 0.0f) * object.worldToObject};
+}
+
+/**
+ * BVH traversal from the first node, which is not tested. With nearFirst the nearer child is visited first and pushed
+ * children are skipped once closest drops below their entry (sceneIntersect), otherwise children are visited in stored
+ * order (occluded). Leaf calls leafIntersect(first, last, closest), which may lower closest and returns true to end
+ * the traversal. Returns true if a leaf ended it.
+ */
+template <typename LeafIntersect>
+bool traverse(const SceneRay& ray, const GPUBVHNode* nodes, float& closest, bool nearFirst,
+              LeafIntersect leafIntersect) {
+  const RayBoxTest boxTest(ray);
+
+  std::array<std::pair<uint32_t, float>, kStackSize> stack;
+  uint32_t stackSize = 0u;
+  uint32_t nodeIndex = 0u;
+
+  while (true) {
+    const GPUBVHNode& node = nodes[nodeIndex];
+    glm::uvec2 indices = nodeIndices(node);
+
+    if (isLeaf(node)) {
+      if (leafIntersect(indices.x, indices.y, closest)) {
+        return true;
+      }
+    } else {
+      std::pair<uint32_t, float> near(indices.x, boxTest.entry(nodes[indices.x], closest));
+      std::pair<uint32_t, float> far(indices.y, boxTest.entry(nodes[indices.y], closest));
+
+      if (nearFirst && far.second < near.second) {
+        std::swap(near, far);
+      }
+
+      if (near.second != kMiss && far.second != kMiss && stackSize < kStackSize) {
+        stack[stackSize++] = far;
+      }
+
+      if (near.second != kMiss || far.second != kMiss) {
+        nodeIndex = near.second != kMiss ? near.first : far.first;
+        continue;
+      }
+    }
+
+    float entry = kMiss;
+    do {
+      if (stackSize == 0u) {
+        return false;
+      }
+      std::tie(nodeIndex, entry) = stack[--stackSize];
+    } while (entry >= closest);
+  }
+}
+
+// Ray has to be in the space of the mesh vertices. Lowers closest and fills hit on a closer hit.
+void meshIntersect(const HostScene& scene, const SceneRay& ray, uint32_t bvhOffset, uint32_t verticesOffset,
+                   uint32_t objectIndex, float& closest, SceneHit& hit) {
+  traverse(ray, scene.meshBVHNodes + bvhOffset, closest, true, [&](uint32_t first, uint32_t last, float& distance) {
+    for (uint32_t i = first; i < last; i++) {
+      const uint32_t firstVertex = verticesOffset + 3u * i;
+      float triangleDistance = intersectTriangle(ray, scene.vertices + firstVertex);
+
+      if (triangleDistance > kEpsilon && triangleDistance < distance) {
+        distance = triangleDistance;
+        hit.objectIndex = objectIndex;
+        hit.primitiveIndex = firstVertex;
+      }
+    }
+    return false;
+  });
+}
+
+bool meshOccluded(const HostScene& scene, const SceneRay& ray, uint32_t bvhOffset, uint32_t verticesOffset,
+                  float tMax) {
+  return traverse(ray, scene.meshBVHNodes + bvhOffset, tMax, false, [&](uint32_t first, uint32_t last, float&) {
+    for (uint32_t i = first; i < last; i++) {
+      float triangleDistance = intersectTriangle(ray, scene.vertices + verticesOffset + 3u * i);
+
+      if (triangleDistance > kEpsilon && triangleDistance < tMax) {
+        return true;
+      }
+    }
+    return false;
+  });
+}
+
+/**
+ * Calls query(i) for every ray index, splitting the rays into contiguous ranges over threadCount threads. The calling
+ * thread takes the first range.
+ */
+template <typename Query>
+void forEachRay(size_t rayCount, uint32_t threadCount, Query query) {
+  if (threadCount == 0u) {
+    threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  const size_t rangeCount = std::clamp<size_t>(rayCount / kMinBatchRaysPerThread, 1u, threadCount);
+  const size_t rangeSize = (rayCount + rangeCount - 1u) / rangeCount;
+
+  auto runRange = [&](size_t first) {
+    for (size_t i = first; i < std::min(first + rangeSize, rayCount); i++) {
+      query(i);
+    }
+  };
+
+  std::vector<std::future<void>> ranges;
+  ranges.reserve(rangeCount - 1u);
+  for (size_t range = 1u; range < rangeCount; range++) {
+    ranges.emplace_back(std::async(std::launch::async, runRange, range * rangeSize));
+  }
+
+  runRange(0u);
+  for (auto& range : ranges) {
+    range.get();
+  }
+}
+
+} // namespace
+
+bool HostScene::valid() const {
+  return vertices && meshBVHNodeCount > 0u && (flattened || (objects && objectBVHNodeCount > 0u));
+}
+
+bool intersect(const HostScene& scene, const SceneRay& ray, float tMax, SceneHit& hit) {
+  if (!scene.valid()) {
+    return false;
+  }
+
+  float closest = tMax;
+  SceneHit closestHit;
+
+  if (scene.flattened) {
+    meshIntersect(scene, ray, 0u, 0u, 0u, closest, closestHit);
+
+    // Object is only looked up for the closest hit.
+    if (closest < tMax && scene.primitiveObjects) {
+      closestHit.objectIndex = scene.primitiveObjects[closestHit.primitiveIndex / 3u];
+    }
+  } else {
+    traverse(ray, scene.objectBVHNodes, closest, true, [&](uint32_t first, uint32_t last, float& distance) {
+      for (uint32_t i = first; i < last; i++) {
+        const GPUObjectData& object = scene.objects[i];
+        meshIntersect(scene, toObjectSpace(ray, object), object.bvhOffset, object.verticesOffset, i, distance,
+                      closestHit);
+      }
+      return false;
+    });
+  }
+
+  if (closest >= tMax) {
+    return false;
+  }
+
+  closestHit.distance = closest;
+  hit = closestHit;
+  return true;
+}
+
+bool occluded(const HostScene& scene, const SceneRay& ray, float tMax) {
+  if (!scene.valid()) {
+    return false;
+  }
+
+  if (scene.flattened) {
+    return meshOccluded(scene, ray, 0u, 0u, tMax);
+  }
+
+  float distance = tMax;
+  return traverse(ray, scene.objectBVHNodes, distance, false, [&](uint32_t first, uint32_t last, float&) {
+    for (uint32_t i = first; i < last; i++) {
+      const GPUObjectData& object = scene.objects[i];
+
+      if (meshOccluded(scene, toObjectSpace(ray, object), object.bvhOffset, object.verticesOffset, tMax)) {
+        return true;
+      }
+    }
+    return false;
+  });
+}
+
+std::vector<SceneHit> intersect(const HostScene& scene, const std::vector<SceneRay>& rays, float tMax,
+                                uint32_t threadCount) {
+  std::vector<SceneHit> hits(rays.size());
+  if (scene.valid()) {
+    forEachRay(rays.size(), threadCount, [&](size_t i) { intersect(scene, rays[i], tMax, hits[i]); });
+  }
+  return hits;
+}
+
+std::vector<uint8_t> occluded(const HostScene& scene, const std::vector<SceneRay>& rays, float tMax,
+                              uint32_t threadCount) {
+  std::vector<uint8_t> occlusion(rays.size(), 0u);
+  if (scene.valid()) {
+    forEachRay(rays.size(), threadCount, [&](size_t i) { occlusion[i] = occluded(scene, rays[i], tMax) ? 1u : 0u; });
+  }
+  return occlusion;
+}
@@ -0,0 +1,77 @@
+#include "SobolSampler.hpp"
+#include <array>
+
+namespace {
+
+struct SobolPolynomial {
+  uint32_t degree;
+  uint32_t coefficients;
+  std::array<uint32_t, 7> initialNumbers;
+};
+
+// Primitive polynomials and initial direction numbers for dimensions 2 - 32 (first dimension is van der Corput).
+constexpr std::array<SobolPolynomial, SobolSampler::kDimensions - 1u> kPolynomials = {{
+  {1, 0, {1}},
+  {2, 1, {1, 3}},
+  {3, 1, {1, 3, 1}},
+  {3, 2, {1, 1, 1}},
+  {4, 1, {1, 1, 3, 3}},
+  {4, 4, {1, 3, 5, 13}},
+  {5, 2, {1, 1, 5, 5, 17}},
+  {5, 4, {1, 1, 5, 5, 5}},
+  {5, 7, {1, 1, 7, 11, 19}},
+  {5, 11, {1, 1, 5, 1, 1}},
+  {5, 13, {1, 1, 1, 3, 11}},
+  {5, 14, {1, 3, 5, 5, 31}},
+  {6, 1, {1, 3, 3, 9, 7, 49}},
+  {6, 13, {1, 1, 1, 15, 21, 21}},
+  {6, 16, {1, 3, 1, 13, 27, 49}},
+  {6, 19, {1, 1, 1, 15, 7, 5}},
+  {6, 22, {1, 3, 1, 15, 13, 25}},
+  {6, 25, {1, 1, 5, 5, 19, 61}},
+  {7, 1, {1, 3, 7, 11, 23, 15, 103}},
+  {7, 4, {1, 3, 7, 13, 13, 15, 69}},
+  {7, 7, {1, 1, 3, 13, 7, 35, 63}},
+  {7, 8, {1, 3, 5, 9, 1, 25, 53}},
+  {7, 14, {1, 3, 1, 13, 9, 35, 107}},
+  {7, 19, {1, 3, 1, 5, 27, 61, 31}},
+  {7, 21, {1, 1, 5, 11, 19, 41, 61}},
+  {7, 28, {1, 3, 5, 3, 3, 13, 69}},
+  {7, 31, {1, 1, 7, 13, 1, 19, 1}},
+  {7, 32, {1, 3, 7, 5, 13, 19, 59}},
+  {7, 37, {1, 1, 3, 9, 25, 29, 41}},
+  {7, 41, {1, 3, 5, 13, 23, 1, 55}},
+  {7, 42, {1, 3, 7, 3, 13, 59, 17}},
+}};
+
+} // namespace
+
+SobolSampler::SobolSampler() : directionNumbers_(kDimensions * kBits) {
+  // First dimension is the van der Corput sequence.
+  for (uint32_t i = 0; i < kBits; i++) {
+    directionNumbers_[i] = 1u << (kBits - 1u - i);
+  }
+
+  for (uint32_t dim = 1; dim < kDimensions; dim++) {
+    const SobolPolynomial& polynomial = kPolynomials[dim - 1u];
+    const uint32_t s = polynomial.degree;
+    uint32_t* v = &directionNumbers_[dim * kBits];
+
+    for (uint32_t i = 0; i < s; i++) {
+      v[i] = polynomial.initialNumbers[i] << (kBits - 1u - i);
+    }
+
+    // Recurrence over the primitive polynomial coefficients.
+    for (uint32_t i = s; i < kBits; i++) {
+      v[i] = v[i - s] ^ (v[i - s] >> s);
+
+      for (uint32_t k = 1; k < s; k++) {
+        v[i] ^= ((polynomial.coefficients >> (s - 1u - k)) & 1u) * v[i - k];
+      }
+    }
+  }
+}
+
+const std::vector<uint32_t>& SobolSampler::getDirectionNumbers() const {
+  return directionNumbers_;
+}
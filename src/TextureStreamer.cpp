@@ -0,0 +1,257 @@
+#include "TextureStreamer.hpp"
+#include <algorithm>
+#include <iostream>
+#include <utility>
+#include "Helpers.hpp"
+
+TextureStreamer::TextureStreamer(logi::MemoryAllocator allocator, logi::CommandPool commandPool, logi::Queue queue,
+                                 const TextureStreamingConfiguration& configuration)
+  : allocator_(std::move(allocator)), commandPool_(std::move(commandPool)), queue_(std::move(queue)),
+    configuration_(configuration), worker_(&TextureStreamer::workerLoop, this) {}
+
+TextureStreamer::~TextureStreamer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopWorker_ = true;
+  }
+  requestAvailable_.notify_one();
+  worker_.join();
+
+  for (auto& texture : textures_) {
+    if (texture.streamed.image) {
+      texture.streamed.image.destroy();
+    }
+    if (texture.base.image) {
+      texture.base.image.destroy();
+    }
+  }
+}
+
+bool TextureStreamer::isStreamable(vk::Format format) {
+  switch (format) {
+    case vk::Format::eR8Unorm:
+    case vk::Format::eR8G8Unorm:
+    case vk::Format::eR8G8B8A8Unorm:
+    case vk::Format::eR8G8B8A8Srgb:
+    case vk::Format::eB8G8R8A8Unorm:
+    case vk::Format::eB8G8R8A8Srgb:
+      return true;
+    default:
+      return false;
+  }
+}
+
+GPUTexture TextureStreamer::registerTexture(uint32_t textureIndex, const lsg::Ref<lsg::Image>& image) {
+  if (textures_.size() <= textureIndex) {
+    textures_.resize(textureIndex + 1u);
+  }
+
+  StreamedTexture& texture = textures_[textureIndex];
+  texture.image = image;
+
+  uint32_t maxDimension = std::max(image->width(), image->height());
+  while ((maxDimension >> texture.mipCount) > 0u) {
+    texture.mipCount++;
+  }
+  while (texture.baseMip + 1u < texture.mipCount && (maxDimension >> texture.baseMip) > configuration_.baseResolution) {
+    texture.baseMip++;
+  }
+  texture.residentMip = texture.baseMip;
+
+  LevelData level = downsample({textureIndex, texture.baseMip, image});
+  texture.base = uploadTexture(allocator_, commandPool_, queue_, level.pixels.data(), level.pixels.size(), level.width,
+                               level.height, image->getFormat());
+  residentBytes_ += level.pixels.size();
+
+  if (residentBytes_ > (static_cast<uint64_t>(configuration_.vramBudget) << 20u)) {
+    std::cout << "Base levels of streamed textures exceed the VRAM budget." << std::endl;
+  }
+
+  return texture.base;
+}
+
+std::vector<uint32_t> TextureStreamer::update(const uint32_t* feedback, size_t feedbackSize, uint32_t frameIndex) {
+  std::vector<uint32_t> changed;
+
+  // Feedback value v requests 2^(v - 1) texels across the texture (zero if the texture was not hit).
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (uint32_t i = 0; i < std::min(feedbackSize, textures_.size()); i++) {
+      StreamedTexture& texture = textures_[i];
+
+      if (!texture.image || feedback[i] == 0u) {
+        continue;
+      }
+
+      texture.lastRequestedFrame = frameIndex;
+      uint32_t desiredMip = static_cast<uint32_t>(
+        std::clamp(static_cast<int32_t>(texture.mipCount) - static_cast<int32_t>(feedback[i]), 0,
+                   static_cast<int32_t>(texture.baseMip)));
+
+      if (desiredMip < texture.residentMip && !texture.pending) {
+        texture.pending = true;
+        requests_.push_back({i, desiredMip, texture.image});
+      }
+    }
+  }
+  requestAvailable_.notify_one();
+
+  const uint64_t budget = static_cast<uint64_t>(configuration_.vramBudget) << 20u;
+
+  for (uint32_t uploads = 0; uploads < configuration_.maxUploadsPerFrame; uploads++) {
+    LevelData level;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (results_.empty()) {
+        break;
+      }
+      level = std::move(results_.front());
+      results_.pop_front();
+    }
+
+    StreamedTexture& texture = textures_[level.textureIndex];
+    texture.pending = false;
+
+    // Replaced level of the same texture does not count against the budget.
+    uint64_t required = residentBytes_ - texture.streamedBytes + level.pixels.size();
+    if (required > budget && !makeRoom(required - budget, texture.lastRequestedFrame, changed)) {
+      continue;
+    }
+
+    GPUTexture streamed = uploadTexture(allocator_, commandPool_, queue_, level.pixels.data(), level.pixels.size(),
+                                        level.width, level.height, texture.image->getFormat());
+    evict(texture);
+
+    texture.streamed = streamed;
+    texture.streamedBytes = level.pixels.size();
+    texture.residentMip = level.mip;
+    residentBytes_ += texture.streamedBytes;
+    changed.emplace_back(level.textureIndex);
+  }
+
+  // Texture may be both evicted and upgraded in the same update.
+  std::sort(changed.begin(), changed.end());
+  changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+
+  return changed;
+}
+
+const GPUTexture& TextureStreamer::getTexture(uint32_t textureIndex) const {
+  const StreamedTexture& texture = textures_[textureIndex];
+  return texture.streamed.image ? texture.streamed : texture.base;
+}
+
+uint64_t TextureStreamer::getResidentBytes() const {
+  return residentBytes_;
+}
+
+TextureStreamer::LevelData TextureStreamer::downsample(const LevelRequest& request) {
+  const lsg::Ref<lsg::Image>& image = request.image;
+  const uint32_t pixelSize = image->pixelSize();
+
+  LevelData level;
+  level.textureIndex = request.textureIndex;
+  level.mip = request.mip;
+  level.width = image->width();
+  level.height = image->height();
+
+  const auto* rawPixels = reinterpret_cast<const uint8_t*>(image->rawPixelData());
+  level.pixels.assign(rawPixels, rawPixels + static_cast<size_t>(level.width) * level.height * pixelSize);
+
+  // Every 8 bit channel is averaged separately. Clamping to the edge handles odd dimensions.
+  for (uint32_t mip = 0; mip < request.mip; mip++) {
+    uint32_t width = std::max(level.width / 2u, 1u);
+    uint32_t height = std::max(level.height / 2u, 1u);
+    std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * pixelSize);
+
+    for (uint32_t y = 0; y < height; y++) {
+      uint32_t y0 = std::min(2u * y, level.height - 1u);
+      uint32_t y1 = std::min(2u * y + 1u, level.height - 1u);
+
+      for (uint32_t x = 0; x < width; x++) {
+        uint32_t x0 = std::min(2u * x, level.width - 1u);
+        uint32_t x1 = std::min(2u * x + 1u, level.width - 1u);
+
+        for (uint32_t c = 0; c < pixelSize; c++) {
+          uint32_t sum = level.pixels[(y0 * level.width + x0) * pixelSize + c] +
+                         level.pixels[(y0 * level.width + x1) * pixelSize + c] +
+                         level.pixels[(y1 * level.width + x0) * pixelSize + c] +
+                         level.pixels[(y1 * level.width + x1) * pixelSize + c];
+          pixels[(y * width + x) * pixelSize + c] = static_cast<uint8_t>((sum + 2u) / 4u);
+        }
+      }
+    }
+
+    level.width = width;
+    level.height = height;
+    level.pixels = std::move(pixels);
+  }
+
+  return level;
+}
+
+void TextureStreamer::workerLoop() {
+  while (true) {
+    LevelRequest request;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      requestAvailable_.wait(lock, [this]() { return stopWorker_ || !requests_.empty(); });
+
+      if (stopWorker_) {
+        return;
+      }
+
+      request = std::move(requests_.front());
+      requests_.pop_front();
+    }
+
+    LevelData level = downsample(request);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    results_.emplace_back(std::move(level));
+  }
+}
+
+bool TextureStreamer::makeRoom(uint64_t byteSize, uint32_t lastRequestedFrame, std::vector<uint32_t>& evicted) {
+  std::vector<uint32_t> candidates;
+  for (uint32_t i = 0; i < textures_.size(); i++) {
+    if (textures_[i].streamed.image && textures_[i].lastRequestedFrame < lastRequestedFrame) {
+      candidates.emplace_back(i);
+    }
+  }
+
+  std::sort(candidates.begin(), candidates.end(), [this](uint32_t lhs, uint32_t rhs) {
+    return textures_[lhs].lastRequestedFrame < textures_[rhs].lastRequestedFrame;
+  });
+
+  // Find the shortest prefix of the LRU order that frees enough memory.
+  uint64_t freed = 0u;
+  size_t count = 0u;
+  while (count < candidates.size() && freed < byteSize) {
+    freed += textures_[candidates[count++]].streamedBytes;
+  }
+
+  if (freed < byteSize) {
+    return false;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    evict(textures_[candidates[i]]);
+    evicted.emplace_back(candidates[i]);
+  }
+
+  return true;
+}
+
+void TextureStreamer::evict(StreamedTexture& texture) {
+  if (!texture.streamed.image) {
+    return;
+  }
+
+  texture.streamed.image.destroy();
+  texture.streamed = GPUTexture();
+  residentBytes_ -= texture.streamedBytes;
+  texture.streamedBytes = 0u;
+  texture.residentMip = texture.baseMip;
+}